@@ -18,10 +18,18 @@ JPEG_DEP_PATH=../libjpeg-turbo
 #   patch -p1 < ../freerdp_mac_catalyst.patch
 #   patch -p1 < ../disable_freerdp_context_free.patch
 #   patch -p1 < ../clipboard-redirection.patch
+#   patch -p1 < ../clipboard-delayed-rendering.patch
 #   patch -p1 < ../freerdp_fix_for_set_format.patch
+#   patch -p1 < ../rdpsnd-jitter-buffer.patch
+#   patch -p1 < ../rdpsnd-adpcm.patch
+#   cp ../../sCloudRDP/common/AudioJitterBuffer.h ../../sCloudRDP/common/AdpcmDecoder.h channels/rdpsnd/client/ios/
 #   patch -p1 < ../freerdp_sse_guards.patch
 #   patch -p1 < ../freerdp_ios_disconnect_fix.patch
 #   patch -p1 < ../freerdp_fix_arm64_alignment_issues.patch
+#   patch -p1 < ../freerdp_rfx_decode_threads.patch
+#   patch -p1 < ../freerdp_ios_auto_reconnect.patch
+#   patch -p1 < ../freerdp_tcp_warm_socket.patch
+#   patch -p1 < ../freerdp_transport_bio.patch
 # }
 
 # if git clone https://github.com/FreeRDP/FreeRDP.git FreeRDP_iphoneos
@@ -122,8 +130,8 @@ do
   then
     issh_platform="macosx"
   fi
-  deps="libs_$platform/* $ISSH_DEP_PATH/openssl_$issh_platform/lib/*"
-  # $ISSH_DEP_PATH/libssh2_$issh_platform/lib/* $DEP_PATH/lib/libav*.a $DEP_PATH/lib/libswresample.a $DEP_PATH/lib/libopenh264.a"
+  deps="libs_$platform/* $ISSH_DEP_PATH/openssl_$issh_platform/lib/* $ISSH_DEP_PATH/libssh2_$issh_platform/lib/*"
+  # $DEP_PATH/lib/libav*.a $DEP_PATH/lib/libswresample.a $DEP_PATH/lib/libopenh264.a"
   echo libtool -static -o duperlib.a $deps
   #rm "libs_$platform/libiFreeRDPLib.a"
   /Library/Developer/CommandLineTools/usr/bin//libtool -static -o duperlib.a $deps
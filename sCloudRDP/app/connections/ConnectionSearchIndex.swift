@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+import Foundation
+
+/**
+ Trigram index over the searchable text of each connection, keyed by connection id.
+ A query of three or more characters only verifies the connections that contain every
+ trigram of the query instead of rebuilding and scanning the titles of all of them.
+ */
+class ConnectionSearchIndex {
+    private var documents: [String: String] = [:]
+    private var trigramsById: [String: Set<UInt64>] = [:]
+    private var postings: [UInt64: Set<String>] = [:]
+
+    func rebuild(documents: [(id: String, text: String)]) {
+        self.documents.removeAll(keepingCapacity: true)
+        self.trigramsById.removeAll(keepingCapacity: true)
+        self.postings.removeAll(keepingCapacity: true)
+        documents.forEach { document in
+            update(id: document.id, text: document.text)
+        }
+    }
+
+    func update(id: String, text: String) {
+        let lowerCasedText = ConnectionSearchIndex.normalize(text)
+        if documents[id] == lowerCasedText {
+            return
+        }
+        remove(id: id)
+        let trigrams = ConnectionSearchIndex.trigrams(lowerCasedText)
+        documents[id] = lowerCasedText
+        trigramsById[id] = trigrams
+        trigrams.forEach { trigram in
+            postings[trigram, default: []].insert(id)
+        }
+    }
+
+    func remove(id: String) {
+        guard documents.removeValue(forKey: id) != nil else {
+            return
+        }
+        trigramsById.removeValue(forKey: id)?.forEach { trigram in
+            postings[trigram]?.remove(id)
+            if postings[trigram]?.isEmpty ?? false {
+                postings.removeValue(forKey: trigram)
+            }
+        }
+    }
+
+    /**
+     Returns the ids of the connections whose text contains searchText, or nil when
+     searchText is empty and everything matches.
+     */
+    func search(searchText: String) -> Set<String>? {
+        let lowerCasedSearchText = ConnectionSearchIndex.normalize(searchText)
+        if lowerCasedSearchText == "" {
+            return nil
+        }
+        let trigrams = ConnectionSearchIndex.trigrams(lowerCasedSearchText)
+        if trigrams.isEmpty {
+            // Too short to use the index, the pre-lowercased text is still cheap to scan.
+            return Set(documents.filter { $0.value.contains(lowerCasedSearchText) }.keys)
+        }
+        var candidatePostings: [Set<String>] = []
+        for trigram in trigrams {
+            guard let ids = postings[trigram] else {
+                return []
+            }
+            candidatePostings.append(ids)
+        }
+        candidatePostings.sort { $0.count < $1.count }
+        var candidates = candidatePostings[0]
+        for ids in candidatePostings.dropFirst() {
+            candidates.formIntersection(ids)
+            if candidates.isEmpty {
+                return candidates
+            }
+        }
+        // Trigrams do not encode their order, so confirm the actual substring.
+        return candidates.filter { documents[$0]?.contains(lowerCasedSearchText) ?? false }
+    }
+
+    fileprivate static func normalize(_ text: String) -> String {
+        // Composed and decomposed accents should produce the same trigrams.
+        return text.lowercased().precomposedStringWithCanonicalMapping
+    }
+
+    fileprivate static func trigrams(_ text: String) -> Set<UInt64> {
+        var trigrams = Set<UInt64>()
+        var window: UInt64 = 0
+        var count = 0
+        for scalar in text.unicodeScalars {
+            // Scalars fit in 21 bits, so three of them pack into one key.
+            window = ((window << 21) | UInt64(scalar.value)) & ((1 << 63) - 1)
+            count += 1
+            if count >= 3 {
+                trigrams.insert(window)
+            }
+        }
+        return trigrams
+    }
+}
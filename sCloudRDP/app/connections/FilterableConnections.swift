@@ -30,6 +30,7 @@ class FilterableConnections : ObservableObject {
     var defaultSettings: Dictionary<String, String> = [:]
     var selectedConnection: Dictionary<String, String> = [:]
     var editedConnection: Dictionary<String, String> = [:]
+    private let searchIndex = ConnectionSearchIndex()
     
     
     init(stateKeeper: StateKeeper?) {
@@ -91,28 +92,14 @@ class FilterableConnections : ObservableObject {
         return newConnections
     }
     
-    fileprivate func loadCredentialsForAllConnections(_ connections: [[String : String]]) -> [[String : String]] {
-        log_callback_str(message: #function)
-        var newConnections: [[String : String]] = []
-        for connection in connections {
-            let connectionWithCredentials = SecureStorageDelegate.loadCredentialsForConnection(
-                connection: connection
-            )
-            newConnections.append(connectionWithCredentials)
-        }
-        return newConnections
-    }
-    
-    fileprivate func saveCredentials(_ connections: [[String : String]]) -> [[String : String]] {
-        var newConnections: [[String : String]] = []
-        connections.forEach { connection in
-            let newConnection = connection
-            let connectionWithoutCredentials = SecureStorageDelegate.saveCredentialsForConnection(
-                connection: newConnection
-            )
-            newConnections.append(connectionWithoutCredentials)
+    /**
+     Credentials stay in secure storage until a connection is opened or edited, the list only
+     ever holds connections without them.
+     */
+    fileprivate func removeCredentials(_ connections: [[String : String]]) -> [[String : String]] {
+        return connections.map { connection in
+            SecureStorageDelegate.removeCredentialsFromConnection(connection: connection)
         }
-        return newConnections
     }
     
     fileprivate func loadDefaultSettings() {
@@ -129,7 +116,10 @@ class FilterableConnections : ObservableObject {
             forKey: Constants.SAVED_CONNECTIONS_KEY) as? [Dictionary<String, String>] ?? []
         log_callback_str(message: "Connections version \(connectionsVersion), number: \(allConnections.count)")
         self.allConnections = migrateConnections(self.allConnections)
-        self.allConnections = loadCredentialsForAllConnections(self.allConnections)
+        self.allConnections = removeCredentials(self.allConnections)
+        self.searchIndex.rebuild(documents: self.allConnections.map { connection in
+            (id: getConnectionId(connection), text: buildSearchableText(connection: connection))
+        })
         self.filteredConnections = self.allConnections
         self.filterConnections()
     }
@@ -180,24 +170,88 @@ class FilterableConnections : ObservableObject {
         return title
     }
     
-    fileprivate func connectionMatchesSearchText(_ connection: [String : String]) -> Bool {
-        let searchConnectionTextLowerCased = searchConnectionText.lowercased()
-        return searchConnectionTextLowerCased == "" ||
-        buildGenericTitle(connection: connection).lowercased().contains(searchConnectionTextLowerCased) ||
-        buildTitle(connection: connection).lowercased().contains(searchConnectionTextLowerCased)
+    fileprivate func buildSearchableText(connection: Dictionary<String, String>) -> String {
+        return buildTitle(connection: connection) + "\n" +
+        buildGenericTitle(connection: connection) + "\n" +
+        (connection["username"] ?? "")
+    }
+    
+    fileprivate func indexConnection(_ connection: [String : String]) {
+        self.searchIndex.update(id: getConnectionId(connection), text: buildSearchableText(connection: connection))
     }
     
     func filterConnections() {
-        self.filteredConnections = allConnections.filter(
+        guard let matchingIds = self.searchIndex.search(searchText: searchConnectionText) else {
+            self.filteredConnections = sortConnections(allConnections)
+            return
+        }
+        self.filteredConnections = sortConnections(allConnections.filter(
             { (connection) -> Bool in
-                connectionMatchesSearchText(connection)
-            })
+                matchingIds.contains(getConnectionId(connection))
+            }))
+    }
+    
+    var sortByResponsiveness: Bool {
+        get {
+            return self.settings.bool(forKey: Constants.SORT_CONNECTIONS_BY_RESPONSIVENESS_KEY)
+        }
+        set {
+            self.settings.set(newValue, forKey: Constants.SORT_CONNECTIONS_BY_RESPONSIVENESS_KEY)
+            self.filterConnections()
+        }
+    }
+    
+    /**
+     The host and port a connection dials first, its SSH server or RDP gateway when it uses one
+     */
+    func getFirstHop(connection: [String: String]) -> (host: String, port: String) {
+        let sshAddress = connection["sshAddress"] ?? ""
+        if sshAddress != "" {
+            return (sshAddress, connection["sshPort"] ?? "22")
+        } else if Utils.isRdp() && Bool(connection["rdpGatewayEnabled"] ?? "false") ?? false {
+            return (connection["rdpGatewayAddress"] ?? "", connection["rdpGatewayPort"] ?? "443")
+        }
+        return (connection["address"] ?? "", connection["port"] ?? Utils.getDefaultPort())
+    }
+    
+    func getReachability(connection: [String: String]) -> ReachabilityResult? {
+        let hop = getFirstHop(connection: connection)
+        var result = ReachabilityResult()
+        return reachability_prober_lookup(hop.host, hop.port, &result) ? result : nil
+    }
+    
+    /**
+     Reachable connections come first, fastest first, then the ones not probed yet and the dead
+     ones last. Round trips are compared in 10 ms steps so that jitter does not reshuffle the list,
+     connections that rank the same keep their saved order.
+     */
+    fileprivate func sortConnections(_ connections: [[String: String]]) -> [[String: String]] {
+        guard sortByResponsiveness else {
+            return connections
+        }
+        return connections.enumerated().map { (index, connection) -> (rank: UInt64, index: Int, connection: [String: String]) in
+            let result = getReachability(connection: connection)
+            var rank = UInt64(UInt32.max)
+            switch result?.state ?? REACHABILITY_UNKNOWN {
+            case REACHABILITY_REACHABLE:
+                rank = UInt64(result!.rttUs / 10000)
+            case REACHABILITY_REFUSED:
+                rank += 1
+            case REACHABILITY_UNREACHABLE:
+                rank += 2
+            default:
+                break
+            }
+            return (rank, index, connection)
+        }.sorted {
+            $0.rank != $1.rank ? $0.rank < $1.rank : $0.index < $1.index
+        }.map { $0.connection }
     }
     
     func edit(connection: Dictionary<String, String>) -> Void {
         log_callback_str(message: #function)
-        self.editedConnection = connection
         self.select(connection: connection)
+        self.editedConnection = self.selectedConnection
     }
     
     func editDefaultSettings() -> Void {
@@ -213,7 +267,7 @@ class FilterableConnections : ObservableObject {
     
     func select(connection: Dictionary<String, String>) -> Void {
         log_callback_str(message: #function)
-        self.selectedConnection = connection
+        self.selectedConnection = SecureStorageDelegate.loadMissingCredentialsForConnection(connection: connection)
         self.selectedConnectionId = getConnectionId(connection)
     }
     
@@ -226,6 +280,7 @@ class FilterableConnections : ObservableObject {
         self.allConnections.removeAll { connection in
             selectedConnection == connection
         }
+        self.searchIndex.remove(id: id)
         self.filterConnections()
     }
     
@@ -248,7 +303,8 @@ class FilterableConnections : ObservableObject {
     
     func saveConnections() {
         log_callback_str(message: "\(#function)")
-        let connections = saveCredentials(self.allConnections)
+        // Only the connection being saved writes to secure storage, the others were never loaded.
+        let connections = removeCredentials(self.allConnections)
         self.settings.set(connections, forKey: Constants.SAVED_CONNECTIONS_KEY)
     }
     
@@ -272,7 +328,8 @@ class FilterableConnections : ObservableObject {
     fileprivate func replaceConnectionById(id: String, connection: Dictionary<String, String>) {
         let indexFound = self.allConnections.firstIndex(where: { $0["id"] == id }) ?? -1
         if indexFound >= 0 {
-            self.allConnections[indexFound] = connection
+            self.allConnections[indexFound] = SecureStorageDelegate.removeCredentialsFromConnection(connection: connection)
+            self.indexConnection(connection)
         }
     }
     
@@ -327,7 +384,8 @@ class FilterableConnections : ObservableObject {
             return
         } else if (selectedConnectionId == Constants.UNSELECTED_SETTINGS_ID) {
             log_callback_str(message: "\(#function) Saving a new connection")
-            self.allConnections.append(connection)
+            self.allConnections.append(SecureStorageDelegate.removeCredentialsFromConnection(connection: connection))
+            self.indexConnection(connection)
         } else {
             log_callback_str(message: "\(#function) Saving connection with ID \(selectedConnectionId)")
             copyConnectionIntoSelectedConnection(connection: connection)
@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2024- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+import Foundation
+import Security
+
+/**
+ Keeps each secret as a generic password item in the data protection keychain.
+ */
+class KeychainStorage: CredentialStorage {
+    
+    func save(account: String, password: String, user: String, server: String?, port: String?) -> Bool {
+        var query = getBaseQuery(account)
+        query[kSecValueData as String] = password.data(using: String.Encoding.utf8)!
+        query[kSecAttrLabel as String] = getLabel(
+            Utils.bundleID, user, server ?? Utils.getDefaultAddress(), port ?? Utils.getDefaultSshPort()
+        )
+        let status = SecItemAdd(query as CFDictionary, nil)
+        guard status == errSecSuccess else {
+            log_callback_str(message: "\(#function) Error \(SecCopyErrorMessageString(status, nil)!) saving \(account) credentials in secure storage")
+            return false
+        }
+        return true
+    }
+    
+    func load(account: String) -> String? {
+        var query = getBaseQuery(account)
+        query[kSecMatchLimit as String] = kSecMatchLimitOne
+        query[kSecReturnAttributes as String] = true
+        query[kSecReturnData as String] = true
+        var item: CFTypeRef?
+        let status = SecItemCopyMatching(query as CFDictionary, &item)
+        guard status == errSecSuccess,
+              let passwordData = (item as? [String: Any])?[kSecValueData as String] as? Data else {
+            return nil
+        }
+        return String(data: passwordData, encoding: String.Encoding.utf8)
+    }
+    
+    func delete(account: String) -> Bool {
+        let status = SecItemDelete(getBaseQuery(account) as CFDictionary)
+        guard status == errSecSuccess else {
+            log_callback_str(message: "\(#function) Error '\(SecCopyErrorMessageString(status, nil)!)', status \(status) deleting \(account) credentials from secure storage")
+            return false
+        }
+        return true
+    }
+    
+    fileprivate func getBaseQuery(_ account: String) -> [String : Any] {
+        return [
+            kSecClass as String: kSecClassGenericPassword,
+            kSecAttrAccount as String: account,
+            kSecUseDataProtectionKeychain as String: true
+        ] as [String : Any]
+    }
+    
+    fileprivate func getLabel(_ appId: String, _ user: String, _ address: String, _ port: String) -> String {
+        let userAtOrEmpty = user != "" ? user + "@" : ""
+        return appId + ": " + userAtOrEmpty + address + ":" + port
+    }
+}
@@ -19,8 +19,20 @@
 
 import Foundation
 
+/**
+ Where SecureStorageDelegate keeps secrets, one per account. The keychain in the app.
+ */
+protocol CredentialStorage {
+    func save(account: String, password: String, user: String, server: String?, port: String?) -> Bool
+    func load(account: String) -> String?
+    func delete(account: String) -> Bool
+}
+
 class SecureStorageDelegate {
     
+    static let credentialFields = ["password", "sshPass", "sshPassphrase", "sshPrivateKey", "rdpGatewayPass"]
+    static var storage: CredentialStorage = KeychainStorage()
+    
     static func loadCredentialsForConnection(connection: [String : String]) -> [String : String] {
         var newConnection = loadCredentialsFromSecureStorage(connection: connection, passwordField: "password")
         newConnection = loadCredentialsFromSecureStorage(connection: newConnection, passwordField: "sshPass")
@@ -30,10 +42,34 @@ class SecureStorageDelegate {
         return newConnection
     }
     
-    static func saveCredentialsForConnection(connection: [String: String]) -> [String: String] {
+    /**
+     Loads credentials from secure storage only for fields the connection does not already carry,
+     so that credentials typed in but not saved are not replaced by stale ones.
+     */
+    static func loadMissingCredentialsForConnection(connection: [String : String]) -> [String : String] {
+        var newConnection = loadCredentialsForConnection(connection: connection)
+        for field in credentialFields where (connection[field] ?? "") != "" {
+            newConnection[field] = connection[field]
+        }
+        return newConnection
+    }
+    
+    /**
+     Drops credentials without touching secure storage, unlike saveCredentialsForConnection. A connection
+     without a credential field leaves secure storage alone when saved, only a blank one deletes the secret.
+     */
+    static func removeCredentialsFromConnection(connection: [String : String]) -> [String : String] {
         var copyOfConnection = connection
-        if copyOfConnection["saveCredentials"] == "true" // User wants to save credentials
-            || copyOfConnection["password"] == "" { // User may be deleting a password
+        for field in credentialFields {
+            copyOfConnection.removeValue(forKey: field)
+        }
+        return copyOfConnection
+    }
+    
+    static func saveCredentialsForConnection(connection: [String: String]) -> [String: String] {
+        if connection["password"] != nil
+            && (connection["saveCredentials"] == "true" // User wants to save credentials
+                || connection["password"] == "") { // User may be deleting a password
             saveCredentials(
                 connection: connection,
                 usernameField: "username",
@@ -42,12 +78,11 @@ class SecureStorageDelegate {
                 portField: "port"
             )
         }
-        copyOfConnection["password"] = ""
         
-        let sshServerNotEmpty = copyOfConnection["sshAddress"] != ""
-        if (sshServerNotEmpty &&
-            (copyOfConnection["saveSshCredentials"] == "true"
-             || copyOfConnection["sshPass"] == "")) { // User may be deleting the password
+        let sshServerNotEmpty = (connection["sshAddress"] ?? "") != ""
+        if (sshServerNotEmpty && connection["sshPass"] != nil &&
+            (connection["saveSshCredentials"] == "true"
+             || connection["sshPass"] == "")) { // User may be deleting the password
             saveCredentials(
                 connection: connection,
                 usernameField: "sshUser",
@@ -56,9 +91,8 @@ class SecureStorageDelegate {
                 portField: "sshPort"
             )
         }
-        copyOfConnection["sshPass"] = ""
         
-        if sshServerNotEmpty {
+        if sshServerNotEmpty && connection["sshPassphrase"] != nil {
             saveCredentials(
                 connection: connection,
                 usernameField: "sshUser",
@@ -66,6 +100,8 @@ class SecureStorageDelegate {
                 addressField: "sshAddress",
                 portField: "sshPort"
             )
+        }
+        if sshServerNotEmpty && connection["sshPrivateKey"] != nil {
             saveCredentials(
                 connection: connection,
                 usernameField: "sshUser",
@@ -74,11 +110,10 @@ class SecureStorageDelegate {
                 portField: "sshPort"
             )
         }
-        copyOfConnection["sshPassphrase"] = ""
-        copyOfConnection["sshPrivateKey"] = ""
 
-        if copyOfConnection["saveCredentials"] == "true"
-            || copyOfConnection["rdpGatewayPass"] == "" { // User may be deleting the password
+        if connection["rdpGatewayPass"] != nil
+            && (connection["saveCredentials"] == "true"
+                || connection["rdpGatewayPass"] == "") { // User may be deleting the password
             saveCredentials(
                 connection: connection,
                 usernameField: "rdpGatewayUser",
@@ -87,8 +122,7 @@ class SecureStorageDelegate {
                 portField: "rdpGatewayPort"
             )
         }
-        copyOfConnection["rdpGatewayPass"] = ""
-        return copyOfConnection
+        return removeCredentialsFromConnection(connection: connection)
     }
     
     static func deleteCredentialsForConnection(connection: [String: String]) {
@@ -105,13 +139,9 @@ class SecureStorageDelegate {
             return
         }
         let account = getAccount(passwordField, uniqueField)
-        let query: [String: Any] = getBaseQuery(account)
-        let status = SecItemDelete(query as CFDictionary)
-        guard status == errSecSuccess else {
-            log_callback_str(message: "\(#function) Error '\(SecCopyErrorMessageString(status, nil)!)', status \(status) deleting \(account) credentials from secure storage")
-            return
+        if storage.delete(account: account) {
+            log_callback_str(message: "\(#function) Success deleting \(account) credentials from secure storage")
         }
-        log_callback_str(message: "\(#function) Success deleting \(account) credentials from secure storage")
     }
     
     static private func saveCredentials(
@@ -121,85 +151,38 @@ class SecureStorageDelegate {
         addressField: String,
         portField: String
     ) {
-        let username = (connection[usernameField] ?? "")
-        let server = getServer(connection[addressField], Utils.getDefaultAddress())
-        let port = getPort(connection[portField], Utils.getDefaultSshPort())
-        let password = (connection[passwordField] ?? "").data(using: String.Encoding.utf8)!
         guard let uniqueField = connection["id"] else {
             log_callback_str(message: "\(#function) Not saving credentials for connection with no unique ID")
             return
         }
         let account = getAccount(passwordField, uniqueField)
-        let query: [String: Any] = getSaveQuery(account, username, server, port, password)
-        deleteCredentials(connection: connection, passwordField: passwordField)
-        let status = SecItemAdd(query as CFDictionary, nil)
-        guard status == errSecSuccess else {
-            log_callback_str(message: "\(#function) Error \(SecCopyErrorMessageString(status, nil)!) saving \(account) credentials in secure storage")
-            return
+        _ = storage.delete(account: account)
+        if storage.save(
+            account: account,
+            password: connection[passwordField] ?? "",
+            user: connection[usernameField] ?? "",
+            server: connection[addressField],
+            port: connection[portField]
+        ) {
+            log_callback_str(message: "\(#function) Success saving \(account) credentials in secure storage")
         }
-        log_callback_str(message: "\(#function) Success saving \(account) credentials in secure storage")
     }
         
+    /**
+     A field with nothing in secure storage is left out of the connection rather than blanked.
+     */
     static private func loadCredentialsFromSecureStorage(connection: Dictionary<String, String>, passwordField: String) -> Dictionary<String, String> {
         var copyOfConnection = connection
         let uniqueField = connection["id"] ?? ""
         let account = getAccount(passwordField, uniqueField)
-        let query: [String: Any] = getLoadQuery(account)
-        var item: CFTypeRef?
-        let status = SecItemCopyMatching(query as CFDictionary, &item)
-        guard status == errSecSuccess && status != errSecItemNotFound else {
-            //log_callback_str(message: "\(#function) Could not load \(account) credentials due to: \(SecCopyErrorMessageString(status, nil)!)")
-            copyOfConnection[passwordField] = ""
+        guard let password = storage.load(account: account) else {
             return connection
         }
-        let passwordData = item![kSecValueData as String] as? Data
-        let password = String(data: passwordData!, encoding: String.Encoding.utf8)
         copyOfConnection[passwordField] = password
-        //log_callback_str(message: "\(#function) Success loading \(account) credentials from secure storage")
         return copyOfConnection
     }
     
-    static private func getBaseQuery(_ account: (String)) -> [String : Any] {
-        let query = [
-            kSecClass as String: kSecClassGenericPassword,
-            kSecAttrAccount as String: account,
-            kSecUseDataProtectionKeychain as String: true
-        ] as [String : Any]
-        return query
-    }
-    
-    static private func getSaveQuery(
-        _ account: (String), _ user: String, _ server: String, _ port: String, _ password: Data
-    ) -> [String : Any] {
-        var query = getBaseQuery(account)
-        query[kSecValueData as String] = password
-        query[kSecAttrLabel as String] = getLabel(Utils.bundleID, user, server, port)
-        return query
-    }
-    
-    static private func getLoadQuery(_ account: (String)) -> [String : Any] {
-        var query = getBaseQuery(account)
-        query[kSecMatchLimit as String] = kSecMatchLimitOne
-        query[kSecReturnAttributes as String] = true
-        query[kSecReturnData as String] = true
-        return query
-    }
-    
-    static private func getServer(_ address: String?, _ defaultAddress: String) -> String {
-        return address ?? defaultAddress
-    }
-    
-    static private func getPort(_ port: String?, _ defaultPort: String) -> String {
-        return port ?? defaultPort
-    }
-    
     fileprivate static func getAccount(_ passwordField: String, _ uniqueField: String) -> String {
         return passwordField + "/" + uniqueField
     }
-
-    fileprivate static func getLabel(_ appId: String, _ user: String, _ address: String, _ port: String) -> String {
-        let userAtOrEmpty = user != "" ? user + "@" : ""
-        return appId + ": " + userAtOrEmpty + address + ":" + port
-    }
-
 }
@@ -30,6 +30,7 @@ class AppDelegate: UIResponder, UIApplicationDelegate {
         // Override point for customization after application launch.
         StoreReviewHelper.incrementAppOpenedCount()
         globalStateKeeper = stateKeeper
+        cpu_sampler_tag_current_thread(THREAD_ROLE_RENDER)
         return true
     }
 
@@ -154,8 +154,29 @@ func utf8_clipboard_callback(clipboard: UnsafeMutablePointer<UInt8>?, size: Int)
         if clipboardContents == nil {
             clipboardContents = try_converting_utf_codepoints(clipboard: clipboard, size: size)
         }
-        UIPasteboard.general.string = clipboardContents
+        if !(globalStateKeeper?.clipboardMonitor?.deliverRemoteText(clipboardContents) ?? false) {
+            UIPasteboard.general.string = clipboardContents
+            globalStateKeeper?.remoteSession?.clipboardPublishedInSession(changeCount: UIPasteboard.general.changeCount)
+        }
+    }
+}
+
+func clipboard_formats_callback(textAvailable: Bool) -> Void {
+    log_callback_str(message: "clipboard_formats_callback: Server clipboard changed, text available: \(textAvailable)")
+    if textAvailable {
+        globalStateKeeper?.clipboardMonitor?.offerRemoteText()
+    }
+}
+
+func clipboard_data_callback(size: UnsafeMutablePointer<Int>?) -> UnsafeMutablePointer<CChar>? {
+    log_callback_str(message: "clipboard_data_callback: Server requested client clipboard contents")
+    // Runs on the session thread, which the main thread may be waiting on, so the
+    // pasteboard is not read here but when its change was noticed.
+    guard let contents = globalStateKeeper?.remoteSession?.cachedClipboardText() else {
+        return nil
     }
+    size?.pointee = contents.lengthOfBytes(using: .utf8)
+    return strdup(contents)
 }
 
 
@@ -258,11 +279,12 @@ func update_callback(instance: Int32, data: UnsafeMutablePointer<UInt8>?, fbW: I
         log_callback_str(message: "Current inst \(globalStateKeeper!.currInst) discarding update_callback, inst \(instance)")
         return false
     }
+    globalStateKeeper?.remoteSession?.framebufferChanged(x: Int(x), y: Int(y), width: Int(w), height: Int(h))
     if (!(globalStateKeeper?.isDrawing ?? false)) {
-        log_callback_str(message: "Not drawing, discard update.")
-        return false
+        // Asking for credentials or disconnecting, the session stays up and its damage is kept for the next frame drawn
+        client_log_string(CLIENT_LOG_LEVEL_DEBUG, "Not drawing, suppressing update.\n")
+        return true
     }
-    
     if (globalStateKeeper?.remoteSession?.hasDrawnFirstFrame ?? false) {
         globalStateKeeper?.remoteSession?.updateCallback()
     }
@@ -277,6 +299,47 @@ func cursor_shape_updated_callback(
     globalStateKeeper?.imageView?.setPointerData(pointerData: newPointer)
 }
 
+// Pointer shapes by the id the bridge gives identical shapes, dropped again under memory pressure
+var cursorShapeImages: [UInt32: UIImage] = [:]
+let cursorShapeImagesLock = NSLock()
+
+func shed_cursor_shape_images(context: UnsafeMutableRawPointer?, bytesWanted: Int) -> Int {
+    cursorShapeImagesLock.lock()
+    defer { cursorShapeImagesLock.unlock() }
+    let freed = cursorShapeImages.values.reduce(0) { $0 + ($1.cgImage.map { $0.bytesPerRow * $0.height } ?? 0) }
+    cursorShapeImages.removeAll()
+    memory_budget_set(MEMORY_PREVIEW, 0)
+    return freed
+}
+
+func cursor_shape_changed_callback(
+    instance: Int32, shapeId: UInt32, w: Int32, h: Int32, hotX: Int32, hotY: Int32, pixels: UnsafeMutablePointer<UInt8>?
+) {
+    cursorShapeImagesLock.lock()
+    var shape = cursorShapeImages[shapeId]
+    if shape == nil && pixels != nil {
+        shape = UIImage.imageFromARGB32Bitmap(
+            pixels: pixels,
+            withWidth: Int(w),
+            withHeight: Int(h),
+            alphaValue: CGImageAlphaInfo.premultipliedLast
+        )
+        if cursorShapeImages.count >= Int(CURSOR_CACHE_CAPACITY) {
+            cursorShapeImages.removeAll(keepingCapacity: true)
+            memory_budget_set(MEMORY_PREVIEW, 0)
+        }
+        cursorShapeImages[shapeId] = shape
+        memory_budget_add(MEMORY_PREVIEW, Int64(w) * Int64(h) * 4)
+    }
+    cursorShapeImagesLock.unlock()
+    let pointer = globalStateKeeper?.imageView?.getPointerData()
+    let newPointer = PointerData(shape: shape, width: Int(w), height: Int(h), hotX: Int(hotX), hotY: Int(hotY), x: pointer?.getRemoteX() ?? 0, y: pointer?.getRemoteY() ?? 0)
+    globalStateKeeper?.imageView?.setPointerData(pointerData: newPointer)
+    if (globalStateKeeper?.remoteSession?.hasDrawnFirstFrame ?? false) {
+        globalStateKeeper?.remoteSession?.updateCallback()
+    }
+}
+
 class RemoteSession {
     let stateKeeper: StateKeeper
     var instance: Int
@@ -292,6 +355,8 @@ class RemoteSession {
     var address: String = ""
     var sshPassphrase: String = ""
     var sshPrivateKey: String = ""
+    var sshCiphers: String = ""
+    var sshMacs: String = ""
     var keyboardLayout: String = ""
     var audioEnabled: Bool = false
     var sshForwardPort: String = ""
@@ -302,9 +367,18 @@ class RemoteSession {
     
     var data: UnsafeMutablePointer<UInt8>?
     var connected: Bool = false
+    var recordingTrace: Bool = false
+    let clipboardCacheLock = NSLock()
+    var clipboardCacheText: String?
+    var clipboardCacheChangeCount: Int = -1
+    var clipboardPublishedChangeCount: Int = -1
     var hasDrawnFirstFrame: Bool = false
     var customResolution: Bool = false
     var reDrawTimer: Timer = Timer()
+    // Pixels the image view was last given, only what changed since is copied in again.
+    let presentedLock = NSLock()
+    var presentedContext: CGContext?
+    var presentedDirty: CGRect = .null
 
     class var LCONTROL: Int { return 29 }
     class var RCONTROL: Int { return 285 }
@@ -457,10 +531,26 @@ class RemoteSession {
     
     func connect(currentConnection: [String:String]) {
         connected = true
+        cpu_sampler_start(Constants.CPU_SAMPLER_INTERVAL_MS)
+        recordingTrace = Bool(currentConnection["recordTrace"] ?? "false") ?? false
+        if recordingTrace {
+            log_callback_str(message: "Recording a performance trace of the start of the session")
+            metrics_trace_start(Constants.PERFORMANCE_TRACE_WINDOW_MS)
+        }
     }
     
     func disconnect() {
         connected = false
+        cpu_sampler_stop()
+        if recordingTrace {
+            recordingTrace = false
+            let paths = FileManager.default.urls(for: .documentDirectory, in: .userDomainMask)
+            let name = "trace-\(Int(Date().timeIntervalSince1970)).json"
+            let path = paths[0].appendingPathComponent(name).path
+            // The trace ends up next to the connection files, where it can be shared from the Files app.
+            let events = metrics_trace_dump(path)
+            log_callback_str(message: "Saved \(events) performance trace events to \(name)")
+        }
         self.reDrawTimer.invalidate()
     }
 
@@ -500,6 +590,56 @@ class RemoteSession {
         return scanCodes
     }
     
+    func clientClipboardChangedInSession(changeCount: Int) {
+        clientCutTextInSession(clientClipboardContents: UIPasteboard.general.string)
+    }
+    
+    func clipboardPublishedInSession(changeCount: Int) {
+        clipboardCacheLock.lock()
+        clipboardPublishedChangeCount = changeCount
+        clipboardCacheLock.unlock()
+    }
+    
+    /**
+     Must be called on the main thread, only reads the pasteboard when it has changed since the last call
+     and not because remote contents were published to it.
+     */
+    func cacheClipboardText(changeCount: Int) {
+        clipboardCacheLock.lock()
+        let cachedChangeCount = clipboardCacheChangeCount
+        // Reading back the remote contents' lazy provider would fetch them from the server
+        let published = changeCount == clipboardPublishedChangeCount
+        clipboardCacheLock.unlock()
+        if changeCount == cachedChangeCount || published {
+            return
+        }
+        let text = UIPasteboard.general.string
+        clipboardCacheLock.lock()
+        clipboardCacheText = text
+        clipboardCacheChangeCount = changeCount
+        clipboardCacheLock.unlock()
+    }
+    
+    func cachedClipboardText() -> String? {
+        clipboardCacheLock.lock()
+        defer { clipboardCacheLock.unlock() }
+        return clipboardCacheText
+    }
+    
+    func requestRemoteClipboardInSession() -> Bool {
+        return false
+    }
+    
+    func visibleViewportChanged(x: Int, y: Int, width: Int, height: Int) {
+    }
+    
+    /**
+     Returns false when the session cannot stop display updates and has to be disconnected instead.
+     */
+    func setOutputSuppressed(_ suppressed: Bool) -> Bool {
+        return false
+    }
+    
     func clientCutTextInSession(clientClipboardContents: String?) {
         guard (self.stateKeeper.getCurrentInstance()) != nil else {
             log_callback_str(message: "No currently connected instance, ignoring \(#function)")
@@ -539,30 +679,33 @@ class RemoteSession {
         }
     }
     
-    func startSshForwardingOnBackgroundThread(_ forwardToAddress: String, _ forwardToPort: String) {
+    func startSshForwardingOnBackgroundThread(_ forwardToAddress: String, _ forwardToPort: String, _ inProcess: Bool) {
         Background {
             self.stateKeeper.sshForwardingLock.unlock()
             self.stateKeeper.sshForwardingLock.lock()
             self.stateKeeper.sshTunnelingStarted = true
             log_callback_str(message: "Setting up SSH forwarding from \(self.address):\(self.port)")
             log_callback_str(message: "Setting up SSH forwarding to \(forwardToAddress):\(forwardToPort)")
-//            setupSshPortForward(
-//                Int32(self.stateKeeper.currInst),
-//                failure_callback_swift,
-//                ssh_forward_success,
-//                ssh_forward_failure,
-//                log_callback,
-//                yes_no_dialog_callback,
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshAddress as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshPort as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshUser as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshPass as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshPassphrase as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshPrivateKey as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: ("127.0.0.1" as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (self.sshForwardPort as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (forwardToAddress as NSString).utf8String),
-//                UnsafeMutablePointer<Int8>(mutating: (forwardToPort as NSString).utf8String))
+            setupSshPortForward(
+                Int32(self.stateKeeper.currInst),
+                failure_callback_swift,
+                ssh_forward_success,
+                ssh_forward_failure,
+                log_callback,
+                yes_no_dialog_callback,
+                UnsafeMutablePointer<Int8>(mutating: (self.sshAddress as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshPort as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshUser as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshPass as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshPassphrase as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshPrivateKey as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshCiphers as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshMacs as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: ("127.0.0.1" as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (self.sshForwardPort as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (forwardToAddress as NSString).utf8String),
+                UnsafeMutablePointer<Int8>(mutating: (forwardToPort as NSString).utf8String),
+                inProcess)
         }
     }
     
@@ -572,9 +715,15 @@ class RemoteSession {
             let fbW = Int(getCurrentFrameBufferWidth())
             let fbH = Int(getCurrentFrameBufferHeight())
             if self.stateKeeper.isCurrentSessionConnectedAndDrawing() {
-                let newImage = self.stateKeeper.imageView?.getPointerData().drawIn(
-                    image: UIImage.imageFromARGB32Bitmap(pixels: data, withWidth: fbW, withHeight: fbH)
-                )
+                let startNs = metrics_now_ns()
+                guard let image = self.presentedImage(pixels: data, fbW: fbW, fbH: fbH) else {
+                    return
+                }
+                let newImage = self.stateKeeper.imageView?.getPointerData().drawIn(image: image)
+                let endNs = metrics_now_ns()
+                metrics_histogram_record(METRIC_HISTOGRAM_CONVERT_US, (endNs - startNs) / 1000)
+                metrics_trace_complete("convert_frame", startNs, endNs)
+                metrics_counter_add(METRIC_FRAMES_PRESENTED, 1)
                 UserInterface {
                     self.stateKeeper.imageView?.image = newImage
                 }
@@ -582,6 +731,50 @@ class RemoteSession {
         }
     }
     
+    /**
+     Remembers a changed region of the framebuffer for the next frame drawn.
+     */
+    func framebufferChanged(x: Int, y: Int, width: Int, height: Int) {
+        presentedLock.lock()
+        presentedDirty = presentedDirty.union(CGRect(x: x, y: y, width: width, height: height))
+        presentedLock.unlock()
+    }
+    
+    /**
+     Copies the regions that changed since the last frame into the presented pixels and returns them
+     as an image. Everything is copied the first time and whenever the framebuffer size changes.
+     */
+    func presentedImage(pixels: UnsafeMutablePointer<UInt8>?, fbW: Int, fbH: Int) -> UIImage? {
+        guard let pixels = pixels, fbW > 0, fbH > 0 else {
+            return nil
+        }
+        presentedLock.lock()
+        defer { presentedLock.unlock() }
+        var dirty = presentedDirty
+        presentedDirty = .null
+        if presentedContext?.width != fbW || presentedContext?.height != fbH {
+            let bitmapInfo = CGBitmapInfo(rawValue: CGImageAlphaInfo.noneSkipLast.rawValue).union(.byteOrder32Big)
+            presentedContext = CGContext(data: nil, width: fbW, height: fbH, bitsPerComponent: 8, bytesPerRow: 4 * fbW,
+                                         space: CGColorSpaceCreateDeviceRGB(), bitmapInfo: bitmapInfo.rawValue)
+            dirty = CGRect(x: 0, y: 0, width: fbW, height: fbH)
+        }
+        guard let context = presentedContext, let target = context.data else {
+            return nil
+        }
+        dirty = dirty.intersection(CGRect(x: 0, y: 0, width: fbW, height: fbH))
+        if !dirty.isEmpty {
+            let left = Int(dirty.minX)
+            let rowBytes = Int(dirty.width) * 4
+            for row in Int(dirty.minY)..<Int(dirty.maxY) {
+                memcpy(target + row * context.bytesPerRow + left * 4, pixels + (row * fbW + left) * 4, rowBytes)
+            }
+        }
+        guard let cgImage = context.makeImage() else {
+            return nil
+        }
+        return UIImage(cgImage: cgImage)
+    }
+    
     @objc func reDraw() {
         UserInterface {
             self.reDrawTimer.invalidate()
@@ -597,7 +790,9 @@ class RemoteSession {
             // Allow 60 fps only on newer devices
             timeBetweenFrames = 0.0167
         }
-        return timeBetweenFrames
+        // Slow links and devices ask for fewer frames than the display can show
+        let recommended = Double(getRecommendedFrameIntervalMs()) / 1000.0
+        return max(timeBetweenFrames, recommended)
     }
     
     func updateCallback() {
@@ -605,6 +800,7 @@ class RemoteSession {
             let timeNow = CACurrentMediaTime()
             if (timeNow - lastUpdate < getTimeBetweenFrames()) {
                 // Last frame drawn less than the threshold amount of time ago, discarding frame, scheduling redraw
+                metrics_counter_add(METRIC_FRAMES_DROPPED, 1)
                 self.rescheduleReDrawTimer()
             } else {
                 // Drawing a frame normally
@@ -52,6 +52,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     var yesNoDialogResponse: Int32 = 0
     var imageView: TouchEnabledUIImageView?
     var captureImageView: UIImageView?
+    var memoryPressureSource: DispatchSourceMemoryPressure?
     var remoteSession: RemoteSession?
     var modifierButtons: [String: UIControl]
     var keyboardButtons: [String: UIControl]
@@ -70,6 +71,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     var partialScreenUpdateTimer: Timer = Timer()
     var recurringPartialScreenUpdateTimer: Timer = Timer()
     var disconnectTimer: Timer = Timer()
+    var reachabilityTimer: Timer = Timer()
     var minScale: CGFloat = 0
     var macOs: Bool = false
     var iPadOnMacOs: Bool = false
@@ -82,6 +84,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     var orientation: Int = -1 /* -1 == Uninitialized, 0 == Portrait, 1 == Landscape */
     
     var disconnectedDueToBackgrounding: Bool = false
+    var outputSuppressedDueToBackgrounding: Bool = false
     var connectedWithConsoleFileOrUri: Bool = false
     var currInst: Int = -1
     
@@ -275,6 +278,24 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
         }
         self.clipboardMonitor = ClipboardMonitor(stateKeeper: self, repeated: self.isOnMacOs())
         self.onScreenKeysHidden = true
+        self.startMonitoringMemoryPressure()
+    }
+    
+    func startMonitoringMemoryPressure() {
+        memory_budget_register_shedder(MEMORY_SHED_PREVIEWS, shed_cursor_shape_images, nil)
+        let source = DispatchSource.makeMemoryPressureSource(eventMask: [.warning, .critical], queue: .main)
+        source.setEventHandler { [weak source] in
+            guard let event = source?.data else {
+                return
+            }
+            let level = event.contains(.critical) ? MEMORY_PRESSURE_CRITICAL : MEMORY_PRESSURE_WARNING
+            // Shedding can wait on the session for the display control channel, keep that off the main thread.
+            DispatchQueue.global(qos: .utility).async {
+                _ = bridgeMemoryPressure(Int32(level.rawValue))
+            }
+        }
+        source.resume()
+        self.memoryPressureSource = source
     }
     
     func connectIfConfigFileFound(_ destPath: String) -> Bool {
@@ -320,11 +341,18 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
             self.objectWillChange.send(self)
         }
     }
+    
+    var reachabilityVersion: UInt32 = 0 {
+        didSet {
+            self.objectWillChange.send(self)
+        }
+    }
 
     func selectAndConnect(connection: [String: String]) {
         log_callback_str(message: #function)
         self.connections.select(connection: connection)
-        self.connect(connection: connection)
+        // The list holds connections without credentials, select loads them from secure storage.
+        self.connect(connection: self.connections.selectedConnection)
     }
     
     /**
@@ -341,8 +369,71 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
         log_callback_str(message: #function)
         // Try to select the connection in order to not create duplicates
         self.connections.select(connection: connection)
-        self.connections.overwriteOneConnectionAndNavigate(connection: connection)
-        self.selectAndConnect(connection: connection)
+        // Save what select merged in from secure storage, the connection passed in may carry none.
+        let connectionWithCredentials = self.connections.selectedConnection
+        self.connections.overwriteOneConnectionAndNavigate(connection: connectionWithCredentials)
+        self.selectAndConnect(connection: connectionWithCredentials)
+    }
+    
+    fileprivate func getWarmUpTarget(connection: [String: String]) -> (host: String, port: String, openSocket: Bool) {
+        let hop = self.connections.getFirstHop(connection: connection)
+        // FreeRDP takes over a socket to the server or gateway, and the SSH tunnel one to the SSH server.
+        // Without the forwarder in the build a warmed SSH socket would only be opened to be closed again.
+        let openSocket = Constants.SSH_PORT_FORWARDER_BUILT || (connection["sshAddress"] ?? "") == ""
+        return (hop.host, hop.port, openSocket)
+    }
+    
+    /**
+     Probes the first hop of every saved connection in the background while the list is shown
+     */
+    func startProbingConnections() {
+        self.connections.allConnections.forEach { connection in
+            let hop = self.connections.getFirstHop(connection: connection)
+            if hop.host != "" {
+                _ = reachability_prober_watch(hop.host, hop.port)
+            }
+        }
+        reachability_prober_start(UInt32(REACHABILITY_PROBER_DEFAULT_TTL_MS))
+        self.reachabilityTimer.invalidate()
+        self.reachabilityTimer = Timer.scheduledTimer(timeInterval: Constants.REACHABILITY_REFRESH_INTERVAL, target: self, selector: #selector(refreshReachability), userInfo: nil, repeats: true)
+    }
+    
+    func stopProbingConnections() {
+        self.reachabilityTimer.invalidate()
+        reachability_prober_stop()
+    }
+    
+    @objc func refreshReachability(sender: Timer) {
+        let version = reachability_prober_version()
+        guard version != self.reachabilityVersion, self.currentPage == "connectionsList" else {
+            return
+        }
+        self.reachabilityVersion = version
+        if self.connections.sortByResponsiveness {
+            let order = self.connections.filteredConnections.map { $0["id"] ?? "" }
+            self.connections.filterConnections()
+            if order != self.connections.filteredConnections.map({ $0["id"] ?? "" }) {
+                self.recreateMainPage()
+            }
+        }
+    }
+    
+    func toggleSortByResponsiveness() {
+        self.connections.sortByResponsiveness = !self.connections.sortByResponsiveness
+        self.showConnections()
+    }
+    
+    /**
+     Used when a saved connection is highlighted in the list, to get DNS and TCP out of the way before connecting
+     */
+    func warmUpConnection(connection: [String: String]) {
+        guard Bool(connection["preconnectEnabled"] ?? "false") ?? false else {
+            return
+        }
+        let target = getWarmUpTarget(connection: connection)
+        if target.host != "" {
+            _ = connection_warmup_start(target.host, target.port, target.openSocket, UInt32(CONNECTION_WARMUP_DEFAULT_GRACE_MS))
+        }
     }
     
     fileprivate func constructRemoteSession(_ customResolution: Bool, _ customWidth: Int, _ customHeight: Int) -> RemoteSession {
@@ -358,6 +449,8 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
         self.requestingCredentials = false
         self.requestingSshCredentials = false
         self.clipboardMonitor?.startMonitoring()
+        // The session should not share the network with probes of the other connections.
+        self.stopProbingConnections()
         self.receivedUpdate = false
         log_callback_str(message: "Connecting and navigating to the connection screen")
         self.yesNoDialogResponse = 0
@@ -374,6 +467,11 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
         let customResolution = Bool(connection["customResolution"] ?? "false")!
         let customWidth = Utils.getResolutionWidth(connection["customWidth"])
         let customHeight = Utils.getResolutionHeight(connection["customHeight"])
+        let warmUpTarget = getWarmUpTarget(connection: connection)
+        if !warmUpTarget.openSocket {
+            // Only the DNS cache was being warmed up, which has served its purpose by now.
+            connection_warmup_cancel(warmUpTarget.host, warmUpTarget.port)
+        }
         self.remoteSession = constructRemoteSession(customResolution, customWidth, customHeight)
         self.remoteSession!.connect(currentConnection: connection)
         createAndRepositionButtons()
@@ -406,6 +504,11 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     }
     
     func reconnectIfDisconnectedDueToBackgrounding() {
+        if outputSuppressedDueToBackgrounding {
+            log_callback_str(message: "Resuming display updates after backgrounding")
+            outputSuppressedDueToBackgrounding = false
+            _ = self.remoteSession?.setOutputSuppressed(false)
+        }
         if disconnectedDueToBackgrounding && !self.connectedWithConsoleFileOrUri {
             log_callback_str(message: "Reconnecting after previous disconnect due to backgrounding")
             disconnectedDueToBackgrounding = false
@@ -414,6 +517,12 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     }
     
     func disconnectDueToBackgrounding() {
+        // Sessions that can stop display updates stay connected and skip the reconnect
+        if self.isDrawing && (self.remoteSession?.setOutputSuppressed(true) ?? false) {
+            log_callback_str(message: "Suppressing display updates due to backgrounding")
+            outputSuppressedDueToBackgrounding = true
+            return
+        }
         if self.isDrawing && !self.connectedWithConsoleFileOrUri {
             log_callback_str(message: "Disconnecting due to backgrounding")
             disconnectedDueToBackgrounding = true
@@ -445,6 +554,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     func disconnect(wasDrawing: Bool) {
         log_callback_str(message: "\(#function) called")
         self.currInst = (currInst + 1) % maxClCapacity
+        self.outputSuppressedDueToBackgrounding = false
         
         if !self.disconnectedDueToBackgrounding && self.receivedUpdate {
             _ = self.connections.saveImage(image: self.captureScreen(imageView: self.captureImageView))
@@ -590,6 +700,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
             self.connections.loadConnections()
             self.currentPage = "connectionsList"
             self.recreateMainPage()
+            self.startProbingConnections()
         }
     }
     
@@ -746,6 +857,30 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
         self.originalImageRect = imageView?.frame ?? CGRect()
     }
     
+    /**
+     Tells the session which part of the remote desktop is on screen, in remote coordinates,
+     so that updates to the rest are not converted while zoomed in.
+     */
+    func updateVisibleViewport() {
+        guard let imageView = self.imageView, let window = globalWindow, self.fbW > 0, self.fbH > 0,
+              imageView.frame.width > 0, imageView.frame.height > 0 else {
+            return
+        }
+        let frame = imageView.frame
+        let visible = frame.intersection(window.bounds)
+        if visible.isNull {
+            self.remoteSession?.visibleViewportChanged(x: 0, y: 0, width: 0, height: 0)
+            return
+        }
+        let scaleX = self.fbW / frame.width
+        let scaleY = self.fbH / frame.height
+        let x = Int(((visible.minX - frame.minX) * scaleX).rounded(.down))
+        let y = Int(((visible.minY - frame.minY) * scaleY).rounded(.down))
+        let maxX = Int(((visible.maxX - frame.minX) * scaleX).rounded(.up))
+        let maxY = Int(((visible.maxY - frame.minY) * scaleY).rounded(.up))
+        self.remoteSession?.visibleViewportChanged(x: x, y: y, width: maxX - x, height: maxY - y)
+    }
+    
     func localizedString(
         for key: String, tableName: String = "OverrideLocalizable",
         bundle: Bundle = .main, comment: String = ""
@@ -760,6 +895,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
     func setImageRect(newRect: CGRect) {
         imageView?.frame = newRect
         log_callback_str(message: "Set image rect to: \(newRect)")
+        updateVisibleViewport()
     }
     
     fileprivate func initializeKeyboardButtonIfNotInitialized() {
@@ -1115,6 +1251,7 @@ class StateKeeper: NSObject, ObservableObject, KeyboardObserving, NSCoding {
                 self.imageView?.enableGestures()
                 self.imageView?.enableTouch()
                 globalWindow!.addSubview(self.imageView!)
+                self.updateVisibleViewport()
                 self.createAndRepositionButtons()
                 self.addButtons(buttons: self.interfaceButtons)
                 self.showConnectedSession()
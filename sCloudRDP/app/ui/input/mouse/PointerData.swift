@@ -34,6 +34,16 @@ class PointerData {
         self.yLocation = y
     }
     
+    init(shape: UIImage?, width: Int, height: Int, hotX: Int, hotY: Int, x: Float, y: Float) {
+        self.pointerShape = shape
+        self.pointerWidth = width
+        self.pointerHeight = height
+        self.hotX = hotX
+        self.hotY = hotY
+        self.xLocation = x
+        self.yLocation = y
+    }
+    
     func getPointerWidth() -> Int {
         return pointerWidth
     }
@@ -21,6 +21,8 @@ struct AddOrEditConnectionPage : View {
     @State var sshPassphraseText: String
     @State var sshPrivateKeyText: String
     @State var sshFingerprintSha256: String
+    @State var sshCiphersText: String
+    @State var sshMacsText: String
     @State var x509FingerprintSha256: String
     @State var x509FingerprintSha512: String
     @State var addressText: String
@@ -36,6 +38,8 @@ struct AddOrEditConnectionPage : View {
     @State var id: String
     @State var textHeight: CGFloat = 20
     @State var audioEnabled: Bool
+    @State var preconnectEnabled: Bool
+    @State var recordTrace: Bool
     @State var allowZooming: Bool
     @State var allowPanning: Bool
     @State var touchInputMethod: TouchInputMethod
@@ -69,6 +73,8 @@ struct AddOrEditConnectionPage : View {
             "sshPassphrase": self.sshPassphraseText.trimmingCharacters(in: .whitespacesAndNewlines),
             "sshPrivateKey": self.sshPrivateKeyText.trimmingCharacters(in: .whitespacesAndNewlines),
             "sshFingerprintSha256": self.sshFingerprintSha256.trimmingCharacters(in: .whitespacesAndNewlines),
+            "sshCiphers": self.sshCiphersText.trimmingCharacters(in: .whitespacesAndNewlines),
+            "sshMacs": self.sshMacsText.trimmingCharacters(in: .whitespacesAndNewlines),
             "x509FingerprintSha256": self.x509FingerprintSha256.trimmingCharacters(in: .whitespacesAndNewlines),
             "x509FingerprintSha512": self.x509FingerprintSha512.trimmingCharacters(in: .whitespacesAndNewlines),
             "address": self.addressText.trimmingCharacters(in: .whitespacesAndNewlines),
@@ -79,6 +85,8 @@ struct AddOrEditConnectionPage : View {
             "saveCredentials": String(self.saveCredentials),
             "id": self.id.trimmingCharacters(in: .whitespacesAndNewlines),
             "audioEnabled": String(self.audioEnabled),
+            "preconnectEnabled": String(self.preconnectEnabled),
+            "recordTrace": String(self.recordTrace),
             "allowZooming": String(self.allowZooming),
             "allowPanning": String(self.allowPanning),
             "touchInputMethod": self.touchInputMethod.rawValue.trimmingCharacters(in: .whitespacesAndNewlines),
@@ -229,7 +237,7 @@ struct AddOrEditConnectionPage : View {
 //    
     fileprivate func getHelpButtonActions() {
         var help_messages_list: [LocalizedStringKey] = ["VNC_CONNECTION_SETUP_HELP_TEXT", "UI_SETUP_HELP_TEXT"]
-        if self.stateKeeper.sshAppIds.contains("UIApplication.appId") {
+        if Constants.SSH_PORT_FORWARDER_BUILT && self.stateKeeper.sshAppIds.contains(UIApplication.appId ?? "") {
             help_messages_list.insert("SSH_CONNECTION_SETUP_HELP_TEXT", at: 0)
         }
         self.stateKeeper.connections.edit(connection: self.retrieveConnectionDetails())
@@ -317,6 +325,8 @@ struct AddOrEditConnectionPage : View {
                     getTextField(text: "SSH_PORT_LABEL", binding: $sshPortText)
                     getSshCredentialsFields()
                     getSecureField(text: "SSH_PASSPHRASE_LABEL", binding: $sshPassphraseText)
+                    getTextField(text: "SSH_CIPHERS_LABEL", binding: $sshCiphersText)
+                    getTextField(text: "SSH_MACS_LABEL", binding: $sshMacsText)
                     //getGenerateSshKeyButton()
                     if (generateSshKeyButtonClicked) {
                         MultilineTextView(placeholder: "", text: $instructions, minHeight: self.textHeight, calculatedHeight: $textHeight).frame(minHeight: self.textHeight, maxHeight: self.textHeight)
@@ -350,7 +360,7 @@ struct AddOrEditConnectionPage : View {
     }
     
     fileprivate func shouldShowSshSettingsFields() -> Bool {
-        return self.stateKeeper.sshAppIds.contains("UIApplication.appId")
+        return Constants.SSH_PORT_FORWARDER_BUILT && self.stateKeeper.sshAppIds.contains(UIApplication.appId ?? "")
     }
     
     fileprivate func getTextField(text: String, binding: Binding<String>) -> some View {
@@ -375,6 +385,12 @@ struct AddOrEditConnectionPage : View {
             if Utils.isSpice() {
                 getTextField(text: "TLS_PORT_LABEL", binding: $tlsPortText)
             }
+            Toggle(isOn: $preconnectEnabled) {
+                Text("PRECONNECT_ENABLED_LABEL").font(.title)
+            }
+            Toggle(isOn: $recordTrace) {
+                Text("RECORD_TRACE_LABEL").font(.title)
+            }
         }.padding()
     }
     
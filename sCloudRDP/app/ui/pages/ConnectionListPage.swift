@@ -93,6 +93,32 @@ struct ConnectionsListPage : View {
         return messages
     }
     
+    fileprivate func getReachabilityStatus(connection: [String: String]) -> some View {
+        let result = self.stateKeeper.connections.getReachability(connection: connection)
+        var color = Color.gray
+        var text = ""
+        switch result?.state ?? REACHABILITY_UNKNOWN {
+        case REACHABILITY_REACHABLE:
+            color = .green
+            text = "\(max(1, (result!.rttUs + 500) / 1000)) ms"
+        case REACHABILITY_REFUSED:
+            color = .orange
+            text = self.stateKeeper.localizedString(for: "REACHABILITY_REFUSED_LABEL")
+        case REACHABILITY_UNREACHABLE:
+            color = .red
+            text = self.stateKeeper.localizedString(for: "REACHABILITY_UNREACHABLE_LABEL")
+        default:
+            break
+        }
+        return HStack(spacing: 5) {
+            Image(systemName: "circle.fill")
+                .font(.caption)
+                .foregroundColor(color)
+            Text(text)
+                .font(.caption)
+        }
+    }
+    
     fileprivate func getThumbnailButtonForConnection(_ i: Int) -> some View {
         let screenshotFile = self.connections[i]["id"] ?? ""
         //log_callback_str(message: "\(#function) \(i) connection out of \(self.connections.count): screenshotFile: \(screenshotFile)")
@@ -112,6 +138,7 @@ struct ConnectionsListPage : View {
                     .foregroundColor(.white)
                     .padding(5)
                     .frame(height:100)
+                self.getReachabilityStatus(connection: self.connections[i])
             }
             .padding()
             .foregroundColor(.white)
@@ -122,8 +149,16 @@ struct ConnectionsListPage : View {
                     .stroke(Color.white, lineWidth: 2))
             .onTapGesture {
                 self.connect(index: i)
-            }.onLongPressGesture {
+            }.onLongPressGesture(pressing: { pressing in
+                if pressing {
+                    self.stateKeeper.warmUpConnection(connection: self.connections[i])
+                }
+            }) {
                 self.edit(index: i)
+            }.onHover { hovering in
+                if hovering {
+                    self.stateKeeper.warmUpConnection(connection: self.connections[i])
+                }
             }
         }.buttonStyle(PlainButtonStyle()).contextMenu {
             Button("EDIT_LABEL", action: { edit(index: i) })
@@ -172,6 +207,18 @@ struct ConnectionsListPage : View {
                         }.padding()
                     }
                     
+                    Button(action: {
+                        self.stateKeeper.toggleSortByResponsiveness()
+                    }) {
+                        VStack(spacing: 10) {
+                            Image(systemName: self.stateKeeper.connections.sortByResponsiveness ? "speedometer" : "list.bullet")
+                                .resizable()
+                                .scaledToFit()
+                                .frame(width: 32, height: 32)
+                            Text("SORT_BY_RESPONSIVENESS_LABEL")
+                        }.padding()
+                    }
+                    
                     Button(action: {
                         self.stateKeeper.editDefaultSetting()
                     }) {
@@ -59,6 +59,8 @@ struct MainPage : View {
                     sshPassphraseText: selectedConnection["sshPassphrase"] ?? "",
                     sshPrivateKeyText: selectedConnection["sshPrivateKey"] ?? "",
                     sshFingerprintSha256: selectedConnection["sshFingerprintSha256"] ?? "",
+                    sshCiphersText: selectedConnection["sshCiphers"] ?? "",
+                    sshMacsText: selectedConnection["sshMacs"] ?? "",
                     x509FingerprintSha256: selectedConnection["x509FingerprintSha256"] ?? "",
                     x509FingerprintSha512: selectedConnection["x509FingerprintSha512"] ?? "",
                     addressText: selectedConnection["address"] ?? "",
@@ -74,6 +76,8 @@ struct MainPage : View {
                     saveCredentials: Bool(selectedConnection["saveCredentials"] ?? "true") ?? true,
                     id: id,
                     audioEnabled: Bool(selectedConnection["audioEnabled"] ?? "true") ?? true,
+                    preconnectEnabled: Bool(selectedConnection["preconnectEnabled"] ?? "false") ?? false,
+                    recordTrace: Bool(selectedConnection["recordTrace"] ?? "false") ?? false,
                     allowZooming: Bool(selectedConnection["allowZooming"] ?? "true") ?? true,
                     allowPanning: Bool(selectedConnection["allowPanning"] ?? "true") ?? true,
                     touchInputMethod: TouchInputMethod.init(rawValue: selectedConnection["touchInputMethod"] ?? TouchInputMethod.directSwipePan.rawValue) ?? TouchInputMethod.directSwipePan,
@@ -131,6 +135,8 @@ struct MainPageA_Previews : PreviewProvider {
             sshPassphraseText: "",
             sshPrivateKeyText: "",
             sshFingerprintSha256: "",
+            sshCiphersText: "",
+            sshMacsText: "",
             x509FingerprintSha256: "",
             x509FingerprintSha512: "",
             addressText: "",
@@ -145,6 +151,8 @@ struct MainPageA_Previews : PreviewProvider {
             saveCredentials: true,
             id: "",
             audioEnabled: true,
+            preconnectEnabled: false,
+            recordTrace: false,
             allowZooming: true,
             allowPanning: true,
             touchInputMethod: TouchInputMethod.directSwipePan,
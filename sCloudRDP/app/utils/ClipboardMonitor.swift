@@ -22,9 +22,10 @@ import Foundation
 
 class ClipboardMonitor {
     let stateKeeper: StateKeeper
-    var clipboardTextContents: String?
     var timer: Timer?
     var repeated: Bool = false
+    let pendingLock = NSLock()
+    var pendingRemoteText: [(Data?, Error?) -> Void] = []
     
     init(stateKeeper: StateKeeper, repeated: Bool) {
         self.stateKeeper = stateKeeper
@@ -40,17 +41,46 @@ class ClipboardMonitor {
     
     func stopMonitoring() {
         self.timer?.invalidate()
+        _ = self.deliverRemoteText(nil)
     }
     
     @objc func checkAndSendContents() {
+        // The change count is cheap to read, the contents are only fetched when the server pastes
         if UIPasteboard.general.hasStrings {
-            let currentTextContents = UIPasteboard.general.string
-            if clipboardTextContents != currentTextContents {
-                clipboardTextContents = currentTextContents
-                if self.stateKeeper.remoteSession?.connected ?? false {
-                    self.stateKeeper.remoteSession?.clientCutTextInSession(clientClipboardContents: clipboardTextContents)
-                }
+            if self.stateKeeper.remoteSession?.connected ?? false {
+                self.stateKeeper.remoteSession?.clientClipboardChangedInSession(changeCount: UIPasteboard.general.changeCount)
             }
         }
     }
+    
+    func offerRemoteText() {
+        UserInterface {
+            let provider = NSItemProvider()
+            provider.registerDataRepresentation(forTypeIdentifier: "public.utf8-plain-text", visibility: .all) { completion in
+                self.requestRemoteText(completion: completion)
+                return nil
+            }
+            UIPasteboard.general.setItemProviders([provider], localOnly: false, expirationDate: nil)
+            self.stateKeeper.remoteSession?.clipboardPublishedInSession(changeCount: UIPasteboard.general.changeCount)
+        }
+    }
+    
+    func requestRemoteText(completion: @escaping (Data?, Error?) -> Void) {
+        self.pendingLock.lock()
+        self.pendingRemoteText.append(completion)
+        self.pendingLock.unlock()
+        if !(self.stateKeeper.remoteSession?.requestRemoteClipboardInSession() ?? false) {
+            _ = self.deliverRemoteText(nil)
+        }
+    }
+    
+    func deliverRemoteText(_ text: String?) -> Bool {
+        self.pendingLock.lock()
+        let completions = self.pendingRemoteText
+        self.pendingRemoteText.removeAll()
+        self.pendingLock.unlock()
+        let data = text?.data(using: .utf8)
+        completions.forEach { $0(data, nil) }
+        return !completions.isEmpty
+    }
 }
@@ -27,6 +27,7 @@ class Constants {
     class var SAVED_CONNECTIONS_VERSION_KEY: String { return "connections_version" }
     class var SAVED_CONNECTIONS_KEY: String { return "connections" }
     class var SAVED_DEFAULT_SETTINGS_KEY: String { return "defaults" }
+    class var SORT_CONNECTIONS_BY_RESPONSIVENESS_KEY: String { return "sort_connections_by_responsiveness" }
     class var DEFAULT_LAYOUT: String { return "English (US)" }
     class var LAYOUT_PATH: String { return "aSPICE-resources/Resources/layouts/" }
     class var MAX_RESOLUTION_FOR_AUTO_SCALE_UP_IOS: Double { return 2000.0 }
@@ -38,5 +39,10 @@ class Constants {
     class var CUSTOM_RESOLUTION_ENTRIES: Array<Int> { return Array(stride(from: 128, to: 4097, by: 128)) }
     class var DEFAULT_WIDTH: Int { return 1280 }
     class var DEFAULT_HEIGHT: Int { return 768 }
+    class var CPU_SAMPLER_INTERVAL_MS: Int32 { return 1000 }
+    // The SSH port forwarder in ssh/ is compiled in and linked against libssh2 through duperlib.a.
+    class var SSH_PORT_FORWARDER_BUILT: Bool { return true }
+    class var PERFORMANCE_TRACE_WINDOW_MS: UInt64 { return 60000 }
+    class var REACHABILITY_REFRESH_INTERVAL: Double { return 1.0 }
 }
 
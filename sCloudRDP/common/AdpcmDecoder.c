@@ -0,0 +1,287 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "AdpcmDecoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IMA_HEADER_BYTES 4
+#define MS_HEADER_BYTES 7
+#define MS_DEFAULT_COEFFICIENTS 7
+#define MS_MIN_DELTA 16
+// Keeps the step adaptation from overflowing on corrupt input.
+#define MS_MAX_DELTA (INT32_MAX / 768)
+
+static const int16_t ima_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428,
+    4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t ima_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static const int16_t ms_adaptation_table[16] = {
+    230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230
+};
+
+static const int16_t ms_default_coefficients[MS_DEFAULT_COEFFICIENTS][2] = {
+    { 256, 0 }, { 512, -256 }, { 0, 0 }, { 192, 64 }, { 240, 0 }, { 460, -208 }, { 392, -232 }
+};
+
+static int16_t read_int16(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static int16_t clamp_sample(int32_t value) {
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)value;
+}
+
+static uint32_t samples_per_block(uint16_t formatTag, uint32_t channels, uint32_t blockAlign) {
+    if (formatTag == ADPCM_FORMAT_IMA) {
+        return (blockAlign - IMA_HEADER_BYTES * channels) * 2 / channels + 1;
+    }
+    return (blockAlign - MS_HEADER_BYTES * channels) * 2 / channels + 2;
+}
+
+bool adpcm_format_supported(uint16_t formatTag, uint32_t channels, uint32_t blockAlign, uint32_t bitsPerSample) {
+    if (channels == 0 || channels > ADPCM_MAX_CHANNELS || bitsPerSample != 4) {
+        return false;
+    }
+    if (formatTag == ADPCM_FORMAT_IMA) {
+        // Stereo data is interleaved in four byte words per channel.
+        return blockAlign > IMA_HEADER_BYTES * channels && (blockAlign - IMA_HEADER_BYTES * channels) % (4 * channels) == 0;
+    }
+    if (formatTag == ADPCM_FORMAT_MS) {
+        return blockAlign > MS_HEADER_BYTES * channels;
+    }
+    return false;
+}
+
+bool adpcm_decoder_init(AdpcmDecoder *decoder, uint16_t formatTag, uint32_t channels, uint32_t blockAlign,
+                        const uint8_t *extra, size_t extraSize) {
+    memset(decoder, 0, sizeof(AdpcmDecoder));
+    if (!adpcm_format_supported(formatTag, channels, blockAlign, 4)) {
+        return false;
+    }
+    decoder->formatTag = formatTag;
+    decoder->channels = channels;
+    decoder->blockAlign = blockAlign;
+    decoder->samplesPerBlock = samples_per_block(formatTag, channels, blockAlign);
+
+    if (formatTag == ADPCM_FORMAT_MS) {
+        // wSamplesPerBlock, wNumCoef and the coefficient pairs, the first
+        // seven of which are fixed by the format.
+        uint32_t count = extraSize >= 4 ? (uint32_t)(extra[2] | (extra[3] << 8)) : 0;
+        if (count >= MS_DEFAULT_COEFFICIENTS && count <= ADPCM_MAX_COEFFICIENTS && extraSize >= 4 + count * 4) {
+            for (uint32_t i = 0; i < count; i++) {
+                decoder->coefficients[i][0] = read_int16(extra + 4 + i * 4);
+                decoder->coefficients[i][1] = read_int16(extra + 6 + i * 4);
+            }
+            decoder->coefficientCount = count;
+        } else {
+            memcpy(decoder->coefficients, ms_default_coefficients, sizeof(ms_default_coefficients));
+            decoder->coefficientCount = MS_DEFAULT_COEFFICIENTS;
+        }
+    }
+
+    decoder->scratch = malloc((size_t)decoder->samplesPerBlock * channels * sizeof(int16_t));
+    return decoder->scratch != NULL;
+}
+
+void adpcm_decoder_free(AdpcmDecoder *decoder) {
+    free(decoder->scratch);
+    decoder->scratch = NULL;
+}
+
+/* IMA ADPCM */
+
+static int16_t ima_expand(int32_t *predictor, int32_t *index, uint8_t nibble) {
+    int32_t step = ima_step_table[*index];
+    int32_t diff = step >> 3;
+    if (nibble & 4) {
+        diff += step;
+    }
+    if (nibble & 2) {
+        diff += step >> 1;
+    }
+    if (nibble & 1) {
+        diff += step >> 2;
+    }
+    *predictor = clamp_sample((nibble & 8) ? *predictor - diff : *predictor + diff);
+    *index += ima_index_table[nibble];
+    if (*index < 0) {
+        *index = 0;
+    } else if (*index > 88) {
+        *index = 88;
+    }
+    return (int16_t)*predictor;
+}
+
+static size_t ima_decode_block(const AdpcmDecoder *decoder, const uint8_t *block, size_t size, int16_t *frames) {
+    uint32_t channels = decoder->channels;
+    int32_t predictor[ADPCM_MAX_CHANNELS];
+    int32_t index[ADPCM_MAX_CHANNELS];
+    for (uint32_t c = 0; c < channels; c++) {
+        predictor[c] = read_int16(block + c * IMA_HEADER_BYTES);
+        index[c] = block[c * IMA_HEADER_BYTES + 2];
+        if (index[c] > 88) {
+            index[c] = 88;
+        }
+        frames[c] = (int16_t)predictor[c];
+    }
+
+    // Each channel contributes four bytes, eight samples, per group.
+    const uint8_t *data = block + IMA_HEADER_BYTES * channels;
+    size_t groups = (size - IMA_HEADER_BYTES * channels) / (4 * channels);
+    int16_t *out = frames + channels;
+    for (size_t g = 0; g < groups; g++) {
+        for (uint32_t c = 0; c < channels; c++) {
+            for (int i = 0; i < 4; i++) {
+                uint8_t byte = data[i];
+                out[(2 * i) * channels + c] = ima_expand(&predictor[c], &index[c], byte & 0x0F);
+                out[(2 * i + 1) * channels + c] = ima_expand(&predictor[c], &index[c], byte >> 4);
+            }
+            data += 4;
+        }
+        out += 8 * channels;
+    }
+    return 1 + groups * 8;
+}
+
+/* Microsoft ADPCM */
+
+static size_t ms_decode_block(const AdpcmDecoder *decoder, const uint8_t *block, size_t size, int16_t *frames) {
+    uint32_t channels = decoder->channels;
+    int32_t coefficient1[ADPCM_MAX_CHANNELS];
+    int32_t coefficient2[ADPCM_MAX_CHANNELS];
+    int32_t delta[ADPCM_MAX_CHANNELS];
+    int32_t sample1[ADPCM_MAX_CHANNELS];
+    int32_t sample2[ADPCM_MAX_CHANNELS];
+
+    const uint8_t *p = block;
+    for (uint32_t c = 0; c < channels; c++) {
+        uint8_t predictor = p[c];
+        if (predictor >= decoder->coefficientCount) {
+            predictor = 0;
+        }
+        coefficient1[c] = decoder->coefficients[predictor][0];
+        coefficient2[c] = decoder->coefficients[predictor][1];
+    }
+    p += channels;
+    for (uint32_t c = 0; c < channels; c++, p += 2) {
+        delta[c] = read_int16(p);
+    }
+    for (uint32_t c = 0; c < channels; c++, p += 2) {
+        sample1[c] = read_int16(p);
+    }
+    for (uint32_t c = 0; c < channels; c++, p += 2) {
+        sample2[c] = read_int16(p);
+    }
+
+    // The header samples come out oldest first.
+    for (uint32_t c = 0; c < channels; c++) {
+        frames[c] = (int16_t)sample2[c];
+        frames[channels + c] = (int16_t)sample1[c];
+    }
+
+    // Nibbles are high first and alternate between channels.
+    size_t nibbles = (size - MS_HEADER_BYTES * channels) * 2;
+    nibbles -= nibbles % channels;
+    int16_t *out = frames + 2 * channels;
+    for (size_t n = 0; n < nibbles; n++) {
+        uint32_t c = (uint32_t)(n % channels);
+        uint8_t byte = p[n / 2];
+        uint8_t nibble = (n & 1) ? (byte & 0x0F) : (byte >> 4);
+        int32_t signedNibble = nibble >= 8 ? nibble - 16 : nibble;
+        int32_t predicted = (sample1[c] * coefficient1[c] + sample2[c] * coefficient2[c]) >> 8;
+        int16_t sample = clamp_sample(predicted + signedNibble * delta[c]);
+        sample2[c] = sample1[c];
+        sample1[c] = sample;
+        delta[c] = (ms_adaptation_table[nibble] * delta[c]) >> 8;
+        if (delta[c] < MS_MIN_DELTA) {
+            delta[c] = MS_MIN_DELTA;
+        }
+        if (delta[c] > MS_MAX_DELTA) {
+            delta[c] = MS_MAX_DELTA;
+        }
+        out[n] = sample;
+    }
+    return 2 + nibbles / channels;
+}
+
+size_t adpcm_decode_block(const AdpcmDecoder *decoder, const uint8_t *block, size_t size, int16_t *frames) {
+    if (size > decoder->blockAlign) {
+        size = decoder->blockAlign;
+    }
+    if (decoder->formatTag == ADPCM_FORMAT_IMA) {
+        if (size < IMA_HEADER_BYTES * decoder->channels) {
+            return 0;
+        }
+        return ima_decode_block(decoder, block, size, frames);
+    }
+    if (size < MS_HEADER_BYTES * decoder->channels) {
+        return 0;
+    }
+    return ms_decode_block(decoder, block, size, frames);
+}
+
+size_t adpcm_decode_to_jitter_buffer(AdpcmDecoder *decoder, AudioJitterBuffer *buffer, const uint8_t *data,
+                                     size_t size, uint64_t arrivalUs) {
+    size_t queued = 0;
+    audio_jitter_buffer_begin_packet(buffer, arrivalUs);
+    for (size_t offset = 0; offset < size; offset += decoder->blockAlign) {
+        size_t blockSize = size - offset < decoder->blockAlign ? size - offset : decoder->blockAlign;
+        size_t space = decoder->samplesPerBlock;
+        int16_t *region = audio_jitter_buffer_write_region(buffer, &space);
+        if (space == decoder->samplesPerBlock) {
+            size_t frames = adpcm_decode_block(decoder, data + offset, blockSize, region);
+            audio_jitter_buffer_commit(buffer, frames);
+            queued += frames;
+            continue;
+        }
+
+        // The block straddles the wrap point or the buffer is nearly full.
+        size_t frames = adpcm_decode_block(decoder, data + offset, blockSize, decoder->scratch);
+        size_t copied = 0;
+        while (copied < frames) {
+            size_t chunk = frames - copied;
+            region = audio_jitter_buffer_write_region(buffer, &chunk);
+            if (chunk == 0) {
+                break;
+            }
+            memcpy(region, decoder->scratch + copied * decoder->channels, chunk * decoder->channels * sizeof(int16_t));
+            audio_jitter_buffer_commit(buffer, chunk);
+            copied += chunk;
+        }
+        audio_jitter_buffer_drop(buffer, frames - copied);
+        queued += copied;
+    }
+    return queued;
+}
@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef AdpcmDecoder_h
+#define AdpcmDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "AudioJitterBuffer.h"
+
+#define ADPCM_FORMAT_MS 0x0002
+#define ADPCM_FORMAT_IMA 0x0011
+#define ADPCM_MAX_CHANNELS 2
+#define ADPCM_MAX_COEFFICIENTS 32
+
+// Stateless block decoder for the two ADPCM flavours RDP servers offer,
+// each block carries its own predictor state.
+typedef struct {
+    uint16_t formatTag;
+    uint32_t channels;
+    uint32_t blockAlign;
+    uint32_t samplesPerBlock;
+    uint32_t coefficientCount;
+    int16_t coefficients[ADPCM_MAX_COEFFICIENTS][2];
+    // One block of output, only used where a block straddles the ring wrap point.
+    int16_t *scratch;
+} AdpcmDecoder;
+
+bool adpcm_format_supported(uint16_t formatTag, uint32_t channels, uint32_t blockAlign, uint32_t bitsPerSample);
+// extra is the WAVEFORMATEX trailer, which may be absent.
+bool adpcm_decoder_init(AdpcmDecoder *decoder, uint16_t formatTag, uint32_t channels, uint32_t blockAlign,
+                        const uint8_t *extra, size_t extraSize);
+void adpcm_decoder_free(AdpcmDecoder *decoder);
+
+// Decodes one block of at most blockAlign bytes into interleaved frames,
+// returns the number of frames produced.
+size_t adpcm_decode_block(const AdpcmDecoder *decoder, const uint8_t *block, size_t size, int16_t *frames);
+// Decodes a wave straight into free space in the jitter buffer, returns the
+// number of frames queued.
+size_t adpcm_decode_to_jitter_buffer(AdpcmDecoder *decoder, AudioJitterBuffer *buffer, const uint8_t *data,
+                                     size_t size, uint64_t arrivalUs);
+
+#endif /* AdpcmDecoder_h */
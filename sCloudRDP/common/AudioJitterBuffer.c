@@ -0,0 +1,407 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+// The network thread estimates arrival jitter RFC 3550 style and derives the
+// playout delay from it. The render thread waits for that much audio before
+// starting, fades out over gaps and nudges its consumption rate by a fraction
+// of a percent to keep the fill level near the target, which absorbs the
+// drift between the server clock and the device clock.
+
+#include "AudioJitterBuffer.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FADE_FRAMES 64
+#define MIN_CAPACITY_FRAMES 1024
+// Arrival gaps longer than this are silence on the server, not jitter.
+#define STREAM_GAP_US 500000.0
+#define JITTER_MULTIPLIER 4.0
+#define TARGET_DECAY 256.0
+// Packets for the fastest transit time to follow clock drift, and for a
+// delay spike to stop counting.
+#define BASELINE_TRACKING 2048.0
+#define PEAK_DECAY 512.0
+#define UNDERRUN_BOOST 1.25
+#define FILL_SMOOTHING 16.0
+
+#define CACHE_LINE 64
+
+struct AudioJitterBuffer {
+    uint32_t channels;
+    uint32_t sampleRate;
+    uint32_t capacity;
+    uint32_t mask;
+    uint32_t minTarget;
+    uint32_t maxTarget;
+    int16_t *samples;
+
+    // Shared between the two threads.
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t writePos;
+    _Alignas(CACHE_LINE) atomic_uint_fast64_t readPos;
+    _Alignas(CACHE_LINE) atomic_uint targetFrames;
+    atomic_uint jitterUs;
+    atomic_uint_fast64_t underruns;
+    atomic_uint_fast64_t concealedFrames;
+    atomic_uint_fast64_t droppedFrames;
+    atomic_uint_fast64_t insertedFrames;
+    atomic_uint_fast64_t overflowFrames;
+
+    // Producer only.
+    _Alignas(CACHE_LINE) uint64_t producedFrames;
+    uint64_t packetStart;
+    uint32_t packetFrames;
+    bool streamStarted;
+    double lastTransitUs;
+    double minTransitUs;
+    double peakDelayUs;
+    double jitter;
+    double target;
+    uint64_t seenUnderruns;
+
+    // Consumer only.
+    _Alignas(CACHE_LINE) bool playing;
+    uint32_t fadeIn;
+    double smoothedFill;
+    int16_t last[AUDIO_JITTER_MAX_CHANNELS];
+};
+
+static uint32_t ms_to_frames(uint32_t ms, uint32_t sampleRate) {
+    return (uint32_t)((uint64_t)ms * sampleRate / 1000);
+}
+
+void audio_jitter_config_default(AudioJitterConfig *config, uint32_t sampleRate, uint32_t channels) {
+    config->sampleRate = sampleRate;
+    config->channels = channels;
+    config->minLatencyMs = 40;
+    config->maxLatencyMs = 400;
+    config->capacityMs = 1000;
+}
+
+AudioJitterBuffer *audio_jitter_buffer_new(const AudioJitterConfig *config) {
+    if (config->sampleRate == 0 || config->channels == 0 || config->channels > AUDIO_JITTER_MAX_CHANNELS ||
+        config->minLatencyMs > config->maxLatencyMs || config->maxLatencyMs >= config->capacityMs) {
+        return NULL;
+    }
+
+    AudioJitterBuffer *buffer = NULL;
+    if (posix_memalign((void **)&buffer, CACHE_LINE, sizeof(AudioJitterBuffer)) != 0) {
+        return NULL;
+    }
+    memset(buffer, 0, sizeof(AudioJitterBuffer));
+
+    uint32_t capacity = MIN_CAPACITY_FRAMES;
+    while (capacity < ms_to_frames(config->capacityMs, config->sampleRate)) {
+        capacity <<= 1;
+    }
+    buffer->samples = calloc((size_t)capacity * config->channels, sizeof(int16_t));
+    if (buffer->samples == NULL) {
+        free(buffer);
+        return NULL;
+    }
+    buffer->channels = config->channels;
+    buffer->sampleRate = config->sampleRate;
+    buffer->capacity = capacity;
+    buffer->mask = capacity - 1;
+    buffer->minTarget = ms_to_frames(config->minLatencyMs, config->sampleRate);
+    buffer->maxTarget = ms_to_frames(config->maxLatencyMs, config->sampleRate);
+    buffer->target = buffer->minTarget;
+    atomic_init(&buffer->writePos, 0);
+    atomic_init(&buffer->readPos, 0);
+    atomic_init(&buffer->targetFrames, buffer->minTarget);
+    atomic_init(&buffer->jitterUs, 0);
+    atomic_init(&buffer->underruns, 0);
+    atomic_init(&buffer->concealedFrames, 0);
+    atomic_init(&buffer->droppedFrames, 0);
+    atomic_init(&buffer->insertedFrames, 0);
+    atomic_init(&buffer->overflowFrames, 0);
+    return buffer;
+}
+
+void audio_jitter_buffer_free(AudioJitterBuffer *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    free(buffer->samples);
+    free(buffer);
+}
+
+void audio_jitter_buffer_reset(AudioJitterBuffer *buffer) {
+    if (buffer == NULL) {
+        return;
+    }
+    uint64_t w = atomic_load_explicit(&buffer->writePos, memory_order_acquire);
+    atomic_store_explicit(&buffer->readPos, w, memory_order_release);
+    buffer->packetStart = buffer->producedFrames;
+    buffer->streamStarted = false;
+    buffer->playing = false;
+    buffer->fadeIn = 0;
+    buffer->smoothedFill = 0;
+    memset(buffer->last, 0, sizeof(buffer->last));
+}
+
+/* Producer side */
+
+static void update_target(AudioJitterBuffer *buffer) {
+    double desired = buffer->packetFrames + JITTER_MULTIPLIER * buffer->jitter * buffer->sampleRate / 1e6;
+    // Cellular links stall for a while and then deliver a burst, which the
+    // mean deviation underestimates.
+    double spike = buffer->packetFrames + buffer->peakDelayUs * buffer->sampleRate / 1e6;
+    if (spike > desired) {
+        desired = spike;
+    }
+
+    // An underrun means the estimate was too optimistic, back off quickly.
+    uint64_t underruns = atomic_load_explicit(&buffer->underruns, memory_order_relaxed);
+    if (underruns != buffer->seenUnderruns) {
+        buffer->seenUnderruns = underruns;
+        double boosted = buffer->target * UNDERRUN_BOOST;
+        if (boosted > desired) {
+            desired = boosted;
+        }
+    }
+
+    // Grow at once, shrink over a few seconds of packets.
+    if (desired > buffer->target) {
+        buffer->target = desired;
+    } else {
+        buffer->target -= (buffer->target - desired) / TARGET_DECAY;
+    }
+    if (buffer->target < buffer->minTarget) {
+        buffer->target = buffer->minTarget;
+    } else if (buffer->target > buffer->maxTarget) {
+        buffer->target = buffer->maxTarget;
+    }
+    atomic_store_explicit(&buffer->targetFrames, (unsigned)buffer->target, memory_order_relaxed);
+}
+
+void audio_jitter_buffer_begin_packet(AudioJitterBuffer *buffer, uint64_t arrivalUs) {
+    if (buffer->producedFrames > buffer->packetStart) {
+        buffer->packetFrames = (uint32_t)(buffer->producedFrames - buffer->packetStart);
+    }
+    buffer->packetStart = buffer->producedFrames;
+
+    // Transit time relative to the media clock, only its variation matters.
+    double mediaUs = (double)buffer->producedFrames * 1e6 / buffer->sampleRate;
+    double transitUs = (double)arrivalUs - mediaUs;
+    if (!buffer->streamStarted || transitUs - buffer->lastTransitUs >= STREAM_GAP_US) {
+        buffer->minTransitUs = transitUs;
+    } else {
+        buffer->jitter += (fabs(transitUs - buffer->lastTransitUs) - buffer->jitter) / 16.0;
+        atomic_store_explicit(&buffer->jitterUs, (unsigned)buffer->jitter, memory_order_relaxed);
+        if (transitUs < buffer->minTransitUs) {
+            buffer->minTransitUs = transitUs;
+        } else {
+            buffer->minTransitUs += (transitUs - buffer->minTransitUs) / BASELINE_TRACKING;
+        }
+    }
+    double delayUs = transitUs - buffer->minTransitUs;
+    buffer->peakDelayUs -= buffer->peakDelayUs / PEAK_DECAY;
+    if (delayUs > buffer->peakDelayUs) {
+        buffer->peakDelayUs = delayUs;
+    }
+    buffer->streamStarted = true;
+    buffer->lastTransitUs = transitUs;
+    update_target(buffer);
+}
+
+int16_t *audio_jitter_buffer_write_region(AudioJitterBuffer *buffer, size_t *frames) {
+    uint64_t w = atomic_load_explicit(&buffer->writePos, memory_order_relaxed);
+    uint64_t r = atomic_load_explicit(&buffer->readPos, memory_order_acquire);
+    size_t space = buffer->capacity - (size_t)(w - r);
+    size_t offset = (size_t)(w & buffer->mask);
+    size_t contiguous = buffer->capacity - offset;
+    if (space > contiguous) {
+        space = contiguous;
+    }
+    if (*frames > space) {
+        *frames = space;
+    }
+    return buffer->samples + offset * buffer->channels;
+}
+
+void audio_jitter_buffer_commit(AudioJitterBuffer *buffer, size_t frames) {
+    uint64_t w = atomic_load_explicit(&buffer->writePos, memory_order_relaxed);
+    buffer->producedFrames += frames;
+    atomic_store_explicit(&buffer->writePos, w + frames, memory_order_release);
+}
+
+void audio_jitter_buffer_drop(AudioJitterBuffer *buffer, size_t frames) {
+    if (frames == 0) {
+        return;
+    }
+    // Dropped frames still advance the media clock.
+    buffer->producedFrames += frames;
+    atomic_fetch_add_explicit(&buffer->overflowFrames, frames, memory_order_relaxed);
+}
+
+size_t audio_jitter_buffer_write(AudioJitterBuffer *buffer, const int16_t *samples, size_t frames, uint64_t arrivalUs) {
+    audio_jitter_buffer_begin_packet(buffer, arrivalUs);
+    size_t written = 0;
+    while (written < frames) {
+        size_t chunk = frames - written;
+        int16_t *region = audio_jitter_buffer_write_region(buffer, &chunk);
+        if (chunk == 0) {
+            break;
+        }
+        memcpy(region, samples + written * buffer->channels, chunk * buffer->channels * sizeof(int16_t));
+        audio_jitter_buffer_commit(buffer, chunk);
+        written += chunk;
+    }
+    audio_jitter_buffer_drop(buffer, frames - written);
+    return written;
+}
+
+/* Consumer side */
+
+static const int16_t *frame_at(const AudioJitterBuffer *buffer, uint64_t position) {
+    return buffer->samples + (size_t)(position & buffer->mask) * buffer->channels;
+}
+
+static void copy_frames(AudioJitterBuffer *buffer, uint64_t r, int16_t *out, size_t frames) {
+    size_t offset = (size_t)(r & buffer->mask);
+    size_t first = buffer->capacity - offset;
+    if (first > frames) {
+        first = frames;
+    }
+    memcpy(out, buffer->samples + offset * buffer->channels, first * buffer->channels * sizeof(int16_t));
+    if (first < frames) {
+        memcpy(out + first * buffer->channels, buffer->samples, (frames - first) * buffer->channels * sizeof(int16_t));
+    }
+}
+
+// Plays consumed frames in the time of frames output frames by linear interpolation.
+static void resample_frames(AudioJitterBuffer *buffer, uint64_t r, size_t consumed, int16_t *out, size_t frames) {
+    uint64_t step = ((uint64_t)(consumed - 1) << 16) / (frames - 1);
+    uint64_t position = 0;
+    for (size_t i = 0; i < frames; i++, position += step) {
+        size_t index = (size_t)(position >> 16);
+        int64_t fraction = (int64_t)(position & 0xFFFF);
+        const int16_t *a = frame_at(buffer, r + index);
+        const int16_t *b = index + 1 < consumed ? frame_at(buffer, r + index + 1) : a;
+        for (uint32_t c = 0; c < buffer->channels; c++) {
+            // A full-scale step times a 16-bit fraction needs more than 32 bits.
+            out[i * buffer->channels + c] = (int16_t)(a[c] + (((int64_t)(b[c] - a[c]) * fraction) >> 16));
+        }
+    }
+}
+
+static void conceal(AudioJitterBuffer *buffer, int16_t *out, size_t frames) {
+    size_t fade = frames < FADE_FRAMES ? frames : FADE_FRAMES;
+    for (size_t i = 0; i < fade; i++) {
+        int32_t gain = (int32_t)(FADE_FRAMES - 1 - i);
+        for (uint32_t c = 0; c < buffer->channels; c++) {
+            out[i * buffer->channels + c] = (int16_t)(buffer->last[c] * gain / FADE_FRAMES);
+        }
+    }
+    memset(out + fade * buffer->channels, 0, (frames - fade) * buffer->channels * sizeof(int16_t));
+    memset(buffer->last, 0, sizeof(buffer->last));
+}
+
+static void apply_fade_in(AudioJitterBuffer *buffer, int16_t *out, size_t frames) {
+    size_t i = 0;
+    for (; i < frames && buffer->fadeIn > 0; i++, buffer->fadeIn--) {
+        int32_t gain = (int32_t)(FADE_FRAMES - buffer->fadeIn);
+        for (uint32_t c = 0; c < buffer->channels; c++) {
+            out[i * buffer->channels + c] = (int16_t)(out[i * buffer->channels + c] * gain / FADE_FRAMES);
+        }
+    }
+}
+
+void audio_jitter_buffer_read(AudioJitterBuffer *buffer, int16_t *samples, size_t frames) {
+    if (frames == 0) {
+        return;
+    }
+    uint64_t r = atomic_load_explicit(&buffer->readPos, memory_order_relaxed);
+    uint64_t w = atomic_load_explicit(&buffer->writePos, memory_order_acquire);
+    size_t available = (size_t)(w - r);
+    size_t target = atomic_load_explicit(&buffer->targetFrames, memory_order_relaxed);
+
+    // Never let latency grow past the cap, skip straight back to the target.
+    if (available > buffer->maxTarget + frames) {
+        size_t skip = available - target;
+        r += skip;
+        available -= skip;
+        buffer->smoothedFill = (double)available;
+        atomic_fetch_add_explicit(&buffer->droppedFrames, skip, memory_order_relaxed);
+    }
+
+    if (!buffer->playing) {
+        if (available < target || available < frames) {
+            memset(samples, 0, frames * buffer->channels * sizeof(int16_t));
+            atomic_store_explicit(&buffer->readPos, r, memory_order_release);
+            return;
+        }
+        buffer->playing = true;
+        buffer->fadeIn = FADE_FRAMES;
+        buffer->smoothedFill = (double)available;
+    }
+
+    if (available < frames) {
+        copy_frames(buffer, r, samples, available);
+        if (available > 0) {
+            memcpy(buffer->last, samples + (available - 1) * buffer->channels, buffer->channels * sizeof(int16_t));
+        }
+        conceal(buffer, samples + available * buffer->channels, frames - available);
+        atomic_store_explicit(&buffer->readPos, r + available, memory_order_release);
+        atomic_fetch_add_explicit(&buffer->underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&buffer->concealedFrames, frames - available, memory_order_relaxed);
+        buffer->playing = false;
+        return;
+    }
+
+    // The fill level swings by a packet between callbacks, so steer on its
+    // average and only when it leaves a band around the target.
+    buffer->smoothedFill += ((double)available - buffer->smoothedFill) / FILL_SMOOTHING;
+    double band = target / 4.0 + frames / 2.0;
+    size_t step = frames > 1 ? 1 + frames / 256 : 0;
+    size_t consumed = frames;
+    if (step > 0 && buffer->smoothedFill > target + band && available >= frames + step) {
+        consumed = frames + step;
+        atomic_fetch_add_explicit(&buffer->droppedFrames, step, memory_order_relaxed);
+    } else if (step > 0 && buffer->smoothedFill < target - band) {
+        consumed = frames - step;
+        atomic_fetch_add_explicit(&buffer->insertedFrames, step, memory_order_relaxed);
+    }
+
+    if (consumed == frames) {
+        copy_frames(buffer, r, samples, frames);
+    } else {
+        resample_frames(buffer, r, consumed, samples, frames);
+    }
+    apply_fade_in(buffer, samples, frames);
+    memcpy(buffer->last, samples + (frames - 1) * buffer->channels, buffer->channels * sizeof(int16_t));
+    atomic_store_explicit(&buffer->readPos, r + consumed, memory_order_release);
+}
+
+void audio_jitter_buffer_stats(AudioJitterBuffer *buffer, AudioJitterStats *stats) {
+    uint64_t r = atomic_load_explicit(&buffer->readPos, memory_order_acquire);
+    uint64_t w = atomic_load_explicit(&buffer->writePos, memory_order_acquire);
+    stats->underruns = atomic_load_explicit(&buffer->underruns, memory_order_relaxed);
+    stats->concealedFrames = atomic_load_explicit(&buffer->concealedFrames, memory_order_relaxed);
+    stats->droppedFrames = atomic_load_explicit(&buffer->droppedFrames, memory_order_relaxed);
+    stats->insertedFrames = atomic_load_explicit(&buffer->insertedFrames, memory_order_relaxed);
+    stats->overflowFrames = atomic_load_explicit(&buffer->overflowFrames, memory_order_relaxed);
+    stats->targetFrames = atomic_load_explicit(&buffer->targetFrames, memory_order_relaxed);
+    stats->bufferedFrames = w >= r ? (uint32_t)(w - r) : 0;
+    stats->jitterMs = atomic_load_explicit(&buffer->jitterUs, memory_order_relaxed) / 1000.0;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef AudioJitterBuffer_h
+#define AudioJitterBuffer_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AUDIO_JITTER_MAX_CHANNELS 8
+
+// Interleaved signed 16-bit audio passed from one network thread to one
+// real-time render thread. The render side never blocks, allocates or logs.
+typedef struct AudioJitterBuffer AudioJitterBuffer;
+
+typedef struct {
+    uint32_t sampleRate;
+    uint32_t channels;
+    // Bounds for the adaptive playout delay.
+    uint32_t minLatencyMs;
+    uint32_t maxLatencyMs;
+    uint32_t capacityMs;
+} AudioJitterConfig;
+
+typedef struct {
+    uint64_t underruns;
+    uint64_t concealedFrames;
+    // Frames skipped to catch up with the server clock or the latency cap.
+    uint64_t droppedFrames;
+    // Frames stretched in to slow down towards the server clock.
+    uint64_t insertedFrames;
+    uint64_t overflowFrames;
+    uint32_t targetFrames;
+    uint32_t bufferedFrames;
+    double jitterMs;
+} AudioJitterStats;
+
+void audio_jitter_config_default(AudioJitterConfig *config, uint32_t sampleRate, uint32_t channels);
+AudioJitterBuffer *audio_jitter_buffer_new(const AudioJitterConfig *config);
+void audio_jitter_buffer_free(AudioJitterBuffer *buffer);
+// Drops buffered audio but keeps the learned latency target. Only safe
+// while the render side is stopped.
+void audio_jitter_buffer_reset(AudioJitterBuffer *buffer);
+
+/* Producer side */
+
+// Records the arrival time of the packet whose frames are written next.
+void audio_jitter_buffer_begin_packet(AudioJitterBuffer *buffer, uint64_t arrivalUs);
+// Contiguous free space for decoding in place, shorter than requested at the wrap point.
+int16_t *audio_jitter_buffer_write_region(AudioJitterBuffer *buffer, size_t *frames);
+void audio_jitter_buffer_commit(AudioJitterBuffer *buffer, size_t frames);
+// Accounts for frames that did not fit so the media clock stays in step.
+void audio_jitter_buffer_drop(AudioJitterBuffer *buffer, size_t frames);
+// Copies a whole packet, returns the number of frames that fit.
+size_t audio_jitter_buffer_write(AudioJitterBuffer *buffer, const int16_t *samples, size_t frames, uint64_t arrivalUs);
+
+/* Consumer side */
+
+// Always produces exactly frames frames, concealing whatever is missing.
+void audio_jitter_buffer_read(AudioJitterBuffer *buffer, int16_t *samples, size_t frames);
+
+void audio_jitter_buffer_stats(AudioJitterBuffer *buffer, AudioJitterStats *stats);
+
+#endif /* AudioJitterBuffer_h */
@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ClipboardSync.h"
+
+void clipboard_sync_init(ClipboardSync *sync) {
+    pthread_mutex_init(&sync->lock, NULL);
+    clipboard_sync_reset(sync);
+}
+
+void clipboard_sync_reset(ClipboardSync *sync) {
+    pthread_mutex_lock(&sync->lock);
+    sync->announcedChangeCount = -1;
+    sync->publishedChangeCount = -1;
+    sync->remoteTextAvailable = false;
+    sync->requestInFlight = false;
+    sync->requestDeadlineNs = 0;
+    pthread_mutex_unlock(&sync->lock);
+}
+
+bool clipboard_sync_local_changed(ClipboardSync *sync, long changeCount) {
+    pthread_mutex_lock(&sync->lock);
+    bool announce = false;
+    if (changeCount != sync->announcedChangeCount) {
+        sync->announcedChangeCount = changeCount;
+        // Publishing remote contents locally changes the pasteboard too,
+        // announcing that back would bounce the clipboard between peers.
+        if (changeCount != sync->publishedChangeCount) {
+            sync->remoteTextAvailable = false;
+            announce = true;
+        }
+    }
+    pthread_mutex_unlock(&sync->lock);
+    return announce;
+}
+
+void clipboard_sync_local_published(ClipboardSync *sync, long changeCount) {
+    pthread_mutex_lock(&sync->lock);
+    sync->publishedChangeCount = changeCount;
+    pthread_mutex_unlock(&sync->lock);
+}
+
+void clipboard_sync_remote_formats(ClipboardSync *sync, bool textAvailable) {
+    pthread_mutex_lock(&sync->lock);
+    sync->remoteTextAvailable = textAvailable;
+    sync->requestInFlight = false;
+    pthread_mutex_unlock(&sync->lock);
+}
+
+ClipboardRequestAction clipboard_sync_begin_request(ClipboardSync *sync, uint64_t nowNs) {
+    pthread_mutex_lock(&sync->lock);
+    ClipboardRequestAction action;
+    if (!sync->remoteTextAvailable) {
+        action = CLIPBOARD_REQUEST_UNAVAILABLE;
+    } else if (sync->requestInFlight && nowNs < sync->requestDeadlineNs) {
+        // Several readers of the same contents share one transfer.
+        action = CLIPBOARD_REQUEST_PENDING;
+    } else {
+        sync->requestInFlight = true;
+        sync->requestDeadlineNs = nowNs + CLIPBOARD_REQUEST_TIMEOUT_NS;
+        action = CLIPBOARD_REQUEST_SEND;
+    }
+    pthread_mutex_unlock(&sync->lock);
+    return action;
+}
+
+bool clipboard_sync_complete_request(ClipboardSync *sync) {
+    pthread_mutex_lock(&sync->lock);
+    bool requested = sync->requestInFlight;
+    sync->requestInFlight = false;
+    pthread_mutex_unlock(&sync->lock);
+    return requested;
+}
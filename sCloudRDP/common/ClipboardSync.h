@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef ClipboardSync_h
+#define ClipboardSync_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Largest clipboard payload rendered for the remote side.
+#define CLIPBOARD_MAX_BYTES (16 * 1024 * 1024)
+// A request the server never answers no longer holds back later pastes after this long.
+#define CLIPBOARD_REQUEST_TIMEOUT_NS (5ULL * 1000 * 1000 * 1000)
+
+typedef enum {
+    CLIPBOARD_REQUEST_SEND = 0,
+    CLIPBOARD_REQUEST_PENDING,
+    CLIPBOARD_REQUEST_UNAVAILABLE
+} ClipboardRequestAction;
+
+// Tracks clipboard ownership between the local pasteboard and the remote
+// side so that only format lists cross the wire until somebody pastes.
+typedef struct {
+    pthread_mutex_t lock;
+    long announcedChangeCount;
+    long publishedChangeCount;
+    bool remoteTextAvailable;
+    bool requestInFlight;
+    uint64_t requestDeadlineNs;
+} ClipboardSync;
+
+void clipboard_sync_init(ClipboardSync *sync);
+// Forgets ownership and pending requests when a new session starts.
+void clipboard_sync_reset(ClipboardSync *sync);
+// Returns true when the local pasteboard changed and the change must be announced.
+bool clipboard_sync_local_changed(ClipboardSync *sync, long changeCount);
+// Records the change count produced by publishing remote contents locally.
+void clipboard_sync_local_published(ClipboardSync *sync, long changeCount);
+// A new format list replaces the remote contents, a request for the old ones is abandoned.
+void clipboard_sync_remote_formats(ClipboardSync *sync, bool textAvailable);
+ClipboardRequestAction clipboard_sync_begin_request(ClipboardSync *sync, uint64_t nowNs);
+// Returns true if the data answers a request that was in flight, also used
+// to abandon a request that could not be sent.
+bool clipboard_sync_complete_request(ClipboardSync *sync);
+
+#endif /* ClipboardSync_h */
@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ConnectTimeline.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+static pthread_mutex_t timelineLock = PTHREAD_MUTEX_INITIALIZER;
+static ConnectReport timeline;
+static atomic_bool timelineComplete;
+
+static const char *milestoneNames[CONNECT_MILESTONE_COUNT] = {
+    "started",
+    "dns",
+    "tcp",
+    "ssh_handshake",
+    "ssh_host_key",
+    "ssh_auth",
+    "ssh_channel",
+    "ssh_tunnel",
+    "rdp_started",
+    "rdp_tls",
+    "rdp_security",
+    "rdp_licensing",
+    "rdp_capabilities",
+    "post_connect",
+    "first_frame",
+};
+
+void connect_timeline_start(uint64_t nowNs) {
+    pthread_mutex_lock(&timelineLock);
+    uint32_t attempt = timeline.attempt + 1;
+    memset(&timeline, 0, sizeof(timeline));
+    timeline.attempt = attempt;
+    timeline.atNs[CONNECT_MILESTONE_STARTED] = nowNs;
+    atomic_store_explicit(&timelineComplete, false, memory_order_relaxed);
+    pthread_mutex_unlock(&timelineLock);
+}
+
+bool connect_timeline_mark(ConnectMilestone milestone, uint64_t nowNs) {
+    if (milestone <= CONNECT_MILESTONE_STARTED || milestone >= CONNECT_MILESTONE_COUNT ||
+        atomic_load_explicit(&timelineComplete, memory_order_relaxed)) {
+        return false;
+    }
+    bool recorded = false;
+    pthread_mutex_lock(&timelineLock);
+    // Marks from before the connect started, or after it completed, belong to another one.
+    if (timeline.atNs[CONNECT_MILESTONE_STARTED] != 0 && !timeline.complete && timeline.atNs[milestone] == 0) {
+        timeline.atNs[milestone] = nowNs;
+        recorded = true;
+        if (milestone == CONNECT_MILESTONE_FIRST_FRAME) {
+            timeline.complete = true;
+            atomic_store_explicit(&timelineComplete, true, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&timelineLock);
+    return recorded;
+}
+
+bool connect_timeline_complete(void) {
+    return atomic_load_explicit(&timelineComplete, memory_order_relaxed);
+}
+
+void connect_timeline_report(ConnectReport *report) {
+    pthread_mutex_lock(&timelineLock);
+    *report = timeline;
+    pthread_mutex_unlock(&timelineLock);
+}
+
+const char *connect_milestone_name(ConnectMilestone milestone) {
+    if (milestone < 0 || milestone >= CONNECT_MILESTONE_COUNT) {
+        return "unknown";
+    }
+    return milestoneNames[milestone];
+}
+
+static unsigned long long elapsed_ms(uint64_t fromNs, uint64_t toNs) {
+    return toNs > fromNs ? (unsigned long long)((toNs - fromNs) / 1000000) : 0;
+}
+
+size_t connect_report_format(const ConnectReport *report, char *buffer, size_t size) {
+    uint64_t startNs = report->atNs[CONNECT_MILESTONE_STARTED];
+    uint64_t lastNs = startNs;
+    for (int m = CONNECT_MILESTONE_STARTED + 1; m < CONNECT_MILESTONE_COUNT; m++) {
+        if (report->atNs[m] > lastNs) {
+            lastNs = report->atNs[m];
+        }
+    }
+    size_t length = 0;
+    int written = snprintf(buffer, size, "Connect #%u %s in %llu ms:", report->attempt,
+                           report->complete ? "drew its first frame" : "stopped",
+                           elapsed_ms(startNs, lastNs));
+    if (written < 0) {
+        return 0;
+    }
+    length += (size_t)written;
+    uint64_t previousNs = startNs;
+    for (int m = CONNECT_MILESTONE_STARTED + 1; m < CONNECT_MILESTONE_COUNT; m++) {
+        if (report->atNs[m] == 0) {
+            continue;
+        }
+        written = snprintf(length < size ? buffer + length : NULL, length < size ? size - length : 0,
+                           " %s=%llu", milestoneNames[m], elapsed_ms(previousNs, report->atNs[m]));
+        if (written < 0) {
+            return length;
+        }
+        length += (size_t)written;
+        if (report->atNs[m] > previousNs) {
+            previousNs = report->atNs[m];
+        }
+    }
+    return length;
+}
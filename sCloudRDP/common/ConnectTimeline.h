@@ -0,0 +1,72 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#ifndef ConnectTimeline_h
+#define ConnectTimeline_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// In the order a connection passes them, not every connection passes all.
+typedef enum {
+    CONNECT_MILESTONE_STARTED = 0,
+    CONNECT_MILESTONE_DNS_RESOLVED,
+    CONNECT_MILESTONE_TCP_CONNECTED,
+    CONNECT_MILESTONE_SSH_HANDSHAKE,
+    CONNECT_MILESTONE_SSH_HOST_KEY_ACCEPTED,
+    CONNECT_MILESTONE_SSH_AUTHENTICATED,
+    CONNECT_MILESTONE_SSH_CHANNEL_OPEN,
+    // The session thread saw the tunnel come up.
+    CONNECT_MILESTONE_SSH_TUNNEL_READY,
+    // libfreerdp starts its own DNS lookup, TCP connect and TLS handshake.
+    CONNECT_MILESTONE_RDP_STARTED,
+    CONNECT_MILESTONE_RDP_TLS,
+    // Security is set up, including NLA when the server asked for it.
+    CONNECT_MILESTONE_RDP_SECURITY,
+    CONNECT_MILESTONE_RDP_LICENSING,
+    CONNECT_MILESTONE_RDP_CAPABILITIES,
+    CONNECT_MILESTONE_POST_CONNECT,
+    CONNECT_MILESTONE_FIRST_FRAME,
+    CONNECT_MILESTONE_COUNT
+} ConnectMilestone;
+
+typedef struct {
+    // Monotonic time of each milestone, zero for those not reached.
+    uint64_t atNs[CONNECT_MILESTONE_COUNT];
+    uint32_t attempt;
+    bool complete;
+} ConnectReport;
+
+// Forgets the previous connect and records CONNECT_MILESTONE_STARTED.
+void connect_timeline_start(uint64_t nowNs);
+// Only the first time a milestone is passed counts, later and out of order ones
+// are ignored. Returns true when this call recorded it.
+bool connect_timeline_mark(ConnectMilestone milestone, uint64_t nowNs);
+// True once the first frame was drawn, cheap enough to call on every frame.
+bool connect_timeline_complete(void);
+void connect_timeline_report(ConnectReport *report);
+
+const char *connect_milestone_name(ConnectMilestone milestone);
+// One line with the total and the time spent reaching each milestone from the
+// one before, returns what snprintf would have written.
+size_t connect_report_format(const ConnectReport *report, char *buffer, size_t size);
+
+#endif /* ConnectTimeline_h */
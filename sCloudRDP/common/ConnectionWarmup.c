@@ -0,0 +1,363 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ConnectionWarmup.h"
+#include "Utility.h"
+#include "ReachabilityProber.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WARMUP_HOST_SIZE 256
+#define WARMUP_PORT_SIZE 16
+
+typedef enum {
+    WARMUP_FREE = 0,
+    // The worker is resolving or connecting.
+    WARMUP_PENDING,
+    WARMUP_READY,
+    WARMUP_FAILED
+} WarmupState;
+
+// Each busy entry is owned by one detached worker thread, which is the only
+// one that frees it again, so a slot is never reused while a worker can touch it.
+typedef struct {
+    WarmupState state;
+    bool openSocket;
+    // Set when taken, evicted or cancelled, the worker then closes what is left and exits.
+    bool cancelled;
+    int fd;
+    uint64_t startedMs;
+    uint64_t deadlineMs;
+    char host[WARMUP_HOST_SIZE];
+    char port[WARMUP_PORT_SIZE];
+    char ip[INET6_ADDRSTRLEN];
+} WarmupEntry;
+
+static WarmupEntry entries[CONNECTION_WARMUP_MAX_ENTRIES];
+static pthread_mutex_t warmupLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t warmupChanged = PTHREAD_COND_INITIALIZER;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+// Condition variables wait on the wall clock, so convert the monotonic deadline.
+static void wait_until(uint64_t deadlineMs) {
+    uint64_t now = now_ms();
+    if (deadlineMs <= now) {
+        return;
+    }
+    uint64_t remainingMs = deadlineMs - now;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct timespec abstime;
+    uint64_t nsec = (uint64_t)tv.tv_usec * 1000ULL + (remainingMs % 1000ULL) * 1000000ULL;
+    abstime.tv_sec = tv.tv_sec + (time_t)(remainingMs / 1000ULL) + (time_t)(nsec / 1000000000ULL);
+    abstime.tv_nsec = (long)(nsec % 1000000000ULL);
+    pthread_cond_timedwait(&warmupChanged, &warmupLock, &abstime);
+}
+
+static int find_entry(const char *host, const char *port) {
+    for (int i = 0; i < CONNECTION_WARMUP_MAX_ENTRIES; i++) {
+        WarmupEntry *entry = &entries[i];
+        if (entry->state != WARMUP_FREE && !entry->cancelled &&
+            strcmp(entry->host, host) == 0 && strcmp(entry->port, port) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int connect_with_timeout(const struct addrinfo *ai, int timeoutMs) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+        return -1;
+    }
+    int on = 1;
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if (rc != 0 && errno == EINPROGRESS) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        rc = -1;
+        if (poll(&pfd, 1, timeoutMs) == 1) {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0) {
+                rc = 0;
+            }
+        }
+    }
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    // Whoever takes the socket over expects the default blocking mode.
+    fcntl(fd, F_SETFL, flags);
+    return fd;
+}
+
+static void numeric_address(const struct sockaddr *address, socklen_t length, char *ip, size_t ipSize) {
+    if (getnameinfo(address, length, ip, (socklen_t)ipSize, NULL, 0, NI_NUMERICHOST) != 0) {
+        ip[0] = '\0';
+    }
+}
+
+static void *warmup_thread(void *arg) {
+    WarmupEntry *entry = (WarmupEntry *)arg;
+    char host[WARMUP_HOST_SIZE];
+    char port[WARMUP_PORT_SIZE];
+    char ip[INET6_ADDRSTRLEN] = "";
+    pthread_mutex_lock(&warmupLock);
+    memcpy(host, entry->host, sizeof(host));
+    memcpy(port, entry->port, sizeof(port));
+    bool openSocket = entry->openSocket;
+    pthread_mutex_unlock(&warmupLock);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    struct addrinfo *result = NULL;
+    int fd = -1;
+    int rc = getaddrinfo(host, port, &hints, &result);
+    if (rc != 0) {
+        CLIENT_LOG_DEBUG("Warm-up could not resolve %s: %s\n", host, gai_strerror(rc));
+    } else {
+        numeric_address(result->ai_addr, result->ai_addrlen, ip, sizeof(ip));
+        // Addresses the reachability prober found dead are only tried after the others.
+        for (int pass = 0; openSocket && fd < 0 && pass < 2; pass++) {
+            for (struct addrinfo *ai = result; ai != NULL; ai = ai->ai_next) {
+                if (reachability_prober_address_dead(ai->ai_addr, ai->ai_addrlen) != (pass == 1)) {
+                    continue;
+                }
+                fd = connect_with_timeout(ai, CONNECTION_WARMUP_CONNECT_TIMEOUT_MS);
+                if (fd >= 0) {
+                    numeric_address(ai->ai_addr, ai->ai_addrlen, ip, sizeof(ip));
+                    break;
+                }
+            }
+        }
+        freeaddrinfo(result);
+    }
+
+    pthread_mutex_lock(&warmupLock);
+    memcpy(entry->ip, ip, sizeof(entry->ip));
+    entry->fd = fd;
+    bool ready = ip[0] != '\0' && (!openSocket || fd >= 0);
+    entry->state = ready ? WARMUP_READY : WARMUP_FAILED;
+    CLIENT_LOG_DEBUG("Warm-up of %s:%s %s after %llu ms\n", host, port,
+                     ready ? "ready" : "failed", (unsigned long long)(now_ms() - entry->startedMs));
+    pthread_cond_broadcast(&warmupChanged);
+
+    // Hold on to the connection until it is taken or the grace period runs out.
+    while (!entry->cancelled && now_ms() < entry->deadlineMs) {
+        wait_until(entry->deadlineMs);
+    }
+    if (entry->fd >= 0) {
+        CLIENT_LOG_DEBUG("Warm-up closing unused connection to %s:%s\n", host, port);
+        close(entry->fd);
+    }
+    memset(entry, 0, sizeof(*entry));
+    entry->fd = -1;
+    pthread_cond_broadcast(&warmupChanged);
+    pthread_mutex_unlock(&warmupLock);
+    return NULL;
+}
+
+bool connection_warmup_start(const char *host, const char *port, bool openSocket, uint32_t gracePeriodMs) {
+    if (host == NULL || port == NULL || host[0] == '\0' ||
+        strlen(host) >= WARMUP_HOST_SIZE || strlen(port) >= WARMUP_PORT_SIZE) {
+        return false;
+    }
+    uint64_t now = now_ms();
+    pthread_mutex_lock(&warmupLock);
+    int index = find_entry(host, port);
+    if (index >= 0 && (entries[index].openSocket || !openSocket)) {
+        WarmupEntry *entry = &entries[index];
+        if (now + gracePeriodMs > entry->deadlineMs) {
+            entry->deadlineMs = now + gracePeriodMs;
+        }
+        pthread_mutex_unlock(&warmupLock);
+        return true;
+    }
+    if (index >= 0) {
+        // Only resolving so far, start over with a connection.
+        entries[index].cancelled = true;
+        pthread_cond_broadcast(&warmupChanged);
+    }
+
+    WarmupEntry *entry = NULL;
+    WarmupEntry *oldest = NULL;
+    for (int i = 0; i < CONNECTION_WARMUP_MAX_ENTRIES; i++) {
+        if (entries[i].state == WARMUP_FREE) {
+            entry = &entries[i];
+            break;
+        }
+        if (!entries[i].cancelled && entries[i].state != WARMUP_PENDING &&
+            (oldest == NULL || entries[i].startedMs < oldest->startedMs)) {
+            oldest = &entries[i];
+        }
+    }
+    if (entry == NULL) {
+        // The slot frees up once its worker notices, so a later request can use it.
+        if (oldest != NULL) {
+            oldest->cancelled = true;
+            pthread_cond_broadcast(&warmupChanged);
+        }
+        pthread_mutex_unlock(&warmupLock);
+        return false;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->state = WARMUP_PENDING;
+    entry->openSocket = openSocket;
+    entry->fd = -1;
+    entry->startedMs = now;
+    entry->deadlineMs = now + gracePeriodMs;
+    strcpy(entry->host, host);
+    strcpy(entry->port, port);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    bool started = pthread_create(&thread, &attr, warmup_thread, entry) == 0;
+    pthread_attr_destroy(&attr);
+    if (!started) {
+        entry->state = WARMUP_FREE;
+    }
+    pthread_mutex_unlock(&warmupLock);
+    return started;
+}
+
+int connection_warmup_take(const char *host, const char *port, uint32_t waitMs, char *ip, size_t ipSize) {
+    if (ip != NULL && ipSize > 0) {
+        ip[0] = '\0';
+    }
+    if (host == NULL || port == NULL) {
+        return -1;
+    }
+    uint64_t waitDeadlineMs = now_ms() + waitMs;
+    int fd = -1;
+    pthread_mutex_lock(&warmupLock);
+    int index = find_entry(host, port);
+    while (index >= 0 && entries[index].state == WARMUP_PENDING && now_ms() < waitDeadlineMs) {
+        wait_until(waitDeadlineMs);
+        index = find_entry(host, port);
+    }
+    if (index >= 0) {
+        WarmupEntry *entry = &entries[index];
+        if (entry->state != WARMUP_PENDING) {
+            if (ip != NULL && ipSize > 0) {
+                snprintf(ip, ipSize, "%s", entry->ip);
+            }
+            fd = entry->fd;
+            entry->fd = -1;
+        }
+        // Not needed any more either way, a pending worker cleans up after itself.
+        entry->cancelled = true;
+        pthread_cond_broadcast(&warmupChanged);
+    }
+    pthread_mutex_unlock(&warmupLock);
+    client_log("Warm-up for %s:%s %s\n", host, port, fd >= 0 ? "handed over a connection" : "had no connection ready");
+    return fd;
+}
+
+bool connection_warmup_wait_ready(const char *host, const char *port, uint32_t waitMs) {
+    if (host == NULL || port == NULL) {
+        return false;
+    }
+    uint64_t waitDeadlineMs = now_ms() + waitMs;
+    pthread_mutex_lock(&warmupLock);
+    int index = find_entry(host, port);
+    while (index >= 0 && entries[index].state == WARMUP_PENDING && now_ms() < waitDeadlineMs) {
+        wait_until(waitDeadlineMs);
+        index = find_entry(host, port);
+    }
+    bool ready = index >= 0 && entries[index].state == WARMUP_READY;
+    pthread_mutex_unlock(&warmupLock);
+    return ready;
+}
+
+static int count_busy(void) {
+    int busy = 0;
+    for (int i = 0; i < CONNECTION_WARMUP_MAX_ENTRIES; i++) {
+        if (entries[i].state != WARMUP_FREE) {
+            busy++;
+        }
+    }
+    return busy;
+}
+
+int connection_warmup_wait_busy(int maxBusy, uint32_t waitMs) {
+    uint64_t waitDeadlineMs = now_ms() + waitMs;
+    pthread_mutex_lock(&warmupLock);
+    int busy = count_busy();
+    while (busy > maxBusy && now_ms() < waitDeadlineMs) {
+        wait_until(waitDeadlineMs);
+        busy = count_busy();
+    }
+    pthread_mutex_unlock(&warmupLock);
+    return busy;
+}
+
+void connection_warmup_cancel(const char *host, const char *port) {
+    if (host == NULL || port == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&warmupLock);
+    int index = find_entry(host, port);
+    if (index >= 0) {
+        entries[index].cancelled = true;
+        pthread_cond_broadcast(&warmupChanged);
+    }
+    pthread_mutex_unlock(&warmupLock);
+}
+
+void connection_warmup_cancel_all(void) {
+    pthread_mutex_lock(&warmupLock);
+    for (int i = 0; i < CONNECTION_WARMUP_MAX_ENTRIES; i++) {
+        if (entries[i].state != WARMUP_FREE) {
+            entries[i].cancelled = true;
+        }
+    }
+    pthread_cond_broadcast(&warmupChanged);
+    pthread_mutex_unlock(&warmupLock);
+}
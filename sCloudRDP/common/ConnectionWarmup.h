@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef ConnectionWarmup_h
+#define ConnectionWarmup_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CONNECTION_WARMUP_MAX_ENTRIES 4
+#define CONNECTION_WARMUP_DEFAULT_GRACE_MS 15000
+#define CONNECTION_WARMUP_CONNECT_TIMEOUT_MS 5000
+
+// Resolves host in the background and, with openSocket, also opens a TCP
+// connection to it that is kept for gracePeriodMs. Calling it again for the
+// same host and port only extends the grace period. Returns false when all
+// entries are busy connecting.
+bool connection_warmup_start(const char *host, const char *port, bool openSocket, uint32_t gracePeriodMs);
+
+// Hands over the warmed up connection to host and port, waiting up to waitMs
+// for one that is still being set up. Returns the connected socket, which the
+// caller now owns, or -1. Either way ip receives the resolved address if
+// resolution had succeeded, and an empty string otherwise.
+int connection_warmup_take(const char *host, const char *port, uint32_t waitMs, char *ip, size_t ipSize);
+
+// Waits up to waitMs for the warm-up of host and port to finish without
+// taking it. Returns true when there is one ready to be taken.
+bool connection_warmup_wait_ready(const char *host, const char *port, uint32_t waitMs);
+
+// Waits up to waitMs until at most maxBusy entries are in use, counting the
+// ones whose workers are still closing up. Returns the number in use.
+int connection_warmup_wait_busy(int maxBusy, uint32_t waitMs);
+
+void connection_warmup_cancel(const char *host, const char *port);
+void connection_warmup_cancel_all(void);
+
+#endif /* ConnectionWarmup_h */
@@ -0,0 +1,314 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "CpuSampler.h"
+#include "Utility.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#else
+#include <sys/syscall.h>
+#endif
+
+#define MAX_TAGGED_THREADS 64
+
+/* Platform backend */
+
+#ifdef __APPLE__
+typedef struct {
+    thread_act_t port;
+} ThreadHandle;
+
+static const bool backend_has_wakeups = false;
+
+static bool backend_current_thread(ThreadHandle *handle) {
+    handle->port = pthread_mach_thread_np(pthread_self());
+    return handle->port != MACH_PORT_NULL;
+}
+
+static bool backend_read(const ThreadHandle *handle, uint64_t *cpuNs, uint64_t *wakeups) {
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+    if (thread_info(handle->port, THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS) {
+        return false;
+    }
+    *cpuNs = ((uint64_t)info.user_time.seconds + (uint64_t)info.system_time.seconds) * 1000000000ULL +
+             ((uint64_t)info.user_time.microseconds + (uint64_t)info.system_time.microseconds) * 1000ULL;
+    *wakeups = 0;
+    return true;
+}
+#else
+typedef struct {
+    clockid_t clock;
+    pid_t tid;
+} ThreadHandle;
+
+static const bool backend_has_wakeups = true;
+
+static bool backend_current_thread(ThreadHandle *handle) {
+    handle->tid = (pid_t)syscall(SYS_gettid);
+    return pthread_getcpuclockid(pthread_self(), &handle->clock) == 0;
+}
+
+// Voluntary context switches are the number of times the thread blocked
+// and was subsequently woken up.
+static uint64_t read_proc_wakeups(pid_t tid) {
+    char path[64];
+    char line[128];
+    uint64_t wakeups = 0;
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)tid);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long value;
+        if (sscanf(line, "voluntary_ctxt_switches: %llu", &value) == 1) {
+            wakeups = value;
+            break;
+        }
+    }
+    fclose(file);
+    return wakeups;
+}
+
+static bool backend_read(const ThreadHandle *handle, uint64_t *cpuNs, uint64_t *wakeups) {
+    struct timespec ts;
+    if (clock_gettime(handle->clock, &ts) != 0) {
+        return false;
+    }
+    *cpuNs = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    *wakeups = read_proc_wakeups(handle->tid);
+    return true;
+}
+#endif
+
+/* Role registry */
+
+typedef struct {
+    bool used;
+    ThreadRole role;
+    ThreadHandle handle;
+    uint64_t baseCpuNs;
+    uint64_t baseWakeups;
+    uint64_t lastCpuNs;
+    uint64_t lastWakeups;
+} TaggedThread;
+
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampler_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_once_t sampler_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+static TaggedThread tagged[MAX_TAGGED_THREADS];
+static uint64_t retiredCpuNs[THREAD_ROLE_COUNT];
+static uint64_t retiredWakeups[THREAD_ROLE_COUNT];
+static CpuRoleSnapshot lastSnapshot;
+static pthread_t samplerThread;
+static bool samplerRunning = false;
+static int samplerIntervalMs = 1000;
+
+static const char *role_names[THREAD_ROLE_COUNT] = {
+    "other", "decoder", "ssh-reactor", "ssh-forwarder", "render"
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Stores the CPU time and wakeups accumulated since the thread was tagged.
+static void refresh_slot(TaggedThread *thread) {
+    uint64_t cpuNs, wakeups;
+    if (backend_read(&thread->handle, &cpuNs, &wakeups)) {
+        thread->lastCpuNs = cpuNs - thread->baseCpuNs;
+        thread->lastWakeups = wakeups - thread->baseWakeups;
+    }
+}
+
+static void retire_slot(TaggedThread *thread) {
+    refresh_slot(thread);
+    retiredCpuNs[thread->role] += thread->lastCpuNs;
+    retiredWakeups[thread->role] += thread->lastWakeups;
+    thread->used = false;
+}
+
+static void thread_exited(void *slot) {
+    pthread_mutex_lock(&sampler_lock);
+    TaggedThread *thread = (TaggedThread *)slot;
+    if (thread->used) {
+        retire_slot(thread);
+    }
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+static void sampler_init(void) {
+    pthread_key_create(&slot_key, thread_exited);
+}
+
+void cpu_sampler_tag_current_thread(ThreadRole role) {
+    pthread_once(&sampler_once, sampler_init);
+    TaggedThread *thread = pthread_getspecific(slot_key);
+    pthread_mutex_lock(&sampler_lock);
+    if (thread != NULL && thread->used) {
+        // Re-tagging moves the CPU time used so far to the previous role.
+        retire_slot(thread);
+    }
+    thread = NULL;
+    for (int i = 0; i < MAX_TAGGED_THREADS; i++) {
+        if (!tagged[i].used) {
+            thread = &tagged[i];
+            break;
+        }
+    }
+    if (thread != NULL && backend_current_thread(&thread->handle) &&
+        backend_read(&thread->handle, &thread->baseCpuNs, &thread->baseWakeups)) {
+        // Time spent before tagging belongs to whatever the thread did before.
+        thread->used = true;
+        thread->role = role;
+        thread->lastCpuNs = 0;
+        thread->lastWakeups = 0;
+        pthread_setspecific(slot_key, thread);
+    } else {
+        client_log("CpuSampler: Unable to tag thread with role %s\n", role_names[role]);
+        pthread_setspecific(slot_key, NULL);
+    }
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+void cpu_sampler_untag_current_thread(void) {
+    pthread_once(&sampler_once, sampler_init);
+    TaggedThread *thread = pthread_getspecific(slot_key);
+    if (thread == NULL) {
+        return;
+    }
+    thread_exited(thread);
+    pthread_setspecific(slot_key, NULL);
+}
+
+static void take_sample(void) {
+    CpuRoleSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+
+    pthread_mutex_lock(&sampler_lock);
+    snapshot.timestampNs = now_ns();
+    snapshot.wakeupsAvailable = backend_has_wakeups;
+    for (int r = 0; r < THREAD_ROLE_COUNT; r++) {
+        snapshot.cpuTimeNs[r] = retiredCpuNs[r];
+        snapshot.wakeups[r] = retiredWakeups[r];
+    }
+    for (int i = 0; i < MAX_TAGGED_THREADS; i++) {
+        TaggedThread *thread = &tagged[i];
+        if (!thread->used) {
+            continue;
+        }
+        refresh_slot(thread);
+        snapshot.cpuTimeNs[thread->role] += thread->lastCpuNs;
+        snapshot.wakeups[thread->role] += thread->lastWakeups;
+        snapshot.threads[thread->role]++;
+    }
+    if (lastSnapshot.timestampNs != 0 && snapshot.timestampNs > lastSnapshot.timestampNs) {
+        double wallNs = (double)(snapshot.timestampNs - lastSnapshot.timestampNs);
+        for (int r = 0; r < THREAD_ROLE_COUNT; r++) {
+            if (snapshot.cpuTimeNs[r] > lastSnapshot.cpuTimeNs[r]) {
+                snapshot.cpuPercent[r] = (double)(snapshot.cpuTimeNs[r] - lastSnapshot.cpuTimeNs[r]) * 100.0 / wallNs;
+            }
+        }
+    }
+    lastSnapshot = snapshot;
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+static void *sampler_loop(void *unused) {
+    (void)unused;
+    pthread_mutex_lock(&sampler_lock);
+    while (samplerRunning) {
+        pthread_mutex_unlock(&sampler_lock);
+        take_sample();
+        pthread_mutex_lock(&sampler_lock);
+        // Waiting on the condition lets cpu_sampler_stop, which runs on the
+        // main thread, return right away instead of after up to an interval.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + (uint64_t)samplerIntervalMs * 1000000ULL;
+        deadline.tv_sec += (time_t)(nsec / 1000000000ULL);
+        deadline.tv_nsec = (long)(nsec % 1000000000ULL);
+        while (samplerRunning) {
+            if (pthread_cond_timedwait(&sampler_wakeup, &sampler_lock, &deadline) != 0) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sampler_lock);
+    return NULL;
+}
+
+void cpu_sampler_start(int intervalMs) {
+    pthread_once(&sampler_once, sampler_init);
+    pthread_mutex_lock(&sampler_lock);
+    samplerIntervalMs = intervalMs > 0 ? intervalMs : 1000;
+    if (samplerRunning) {
+        pthread_mutex_unlock(&sampler_lock);
+        return;
+    }
+    samplerRunning = true;
+    pthread_mutex_unlock(&sampler_lock);
+    if (pthread_create(&samplerThread, NULL, sampler_loop, NULL) != 0) {
+        client_log("CpuSampler: Unable to start sampler thread\n");
+        pthread_mutex_lock(&sampler_lock);
+        samplerRunning = false;
+        pthread_mutex_unlock(&sampler_lock);
+    }
+}
+
+void cpu_sampler_stop(void) {
+    pthread_mutex_lock(&sampler_lock);
+    bool wasRunning = samplerRunning;
+    samplerRunning = false;
+    pthread_cond_signal(&sampler_wakeup);
+    pthread_mutex_unlock(&sampler_lock);
+    if (wasRunning) {
+        pthread_join(samplerThread, NULL);
+    }
+}
+
+void cpu_sampler_snapshot(CpuRoleSnapshot *snapshot) {
+    pthread_mutex_lock(&sampler_lock);
+    bool running = samplerRunning;
+    pthread_mutex_unlock(&sampler_lock);
+    if (!running) {
+        // Without a background sampler, sample on demand.
+        take_sample();
+    }
+    pthread_mutex_lock(&sampler_lock);
+    *snapshot = lastSnapshot;
+    pthread_mutex_unlock(&sampler_lock);
+}
+
+const char *cpu_sampler_role_name(ThreadRole role) {
+    if (role < 0 || role >= THREAD_ROLE_COUNT) {
+        return "unknown";
+    }
+    return role_names[role];
+}
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef CpuSampler_h
+#define CpuSampler_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    THREAD_ROLE_OTHER = 0,
+    THREAD_ROLE_DECODER,
+    THREAD_ROLE_SSH_REACTOR,
+    THREAD_ROLE_SSH_FORWARDER,
+    THREAD_ROLE_RENDER,
+    THREAD_ROLE_COUNT
+} ThreadRole;
+
+typedef struct {
+    uint64_t timestampNs;
+    // Cumulative values include threads of that role which have since exited.
+    uint64_t cpuTimeNs[THREAD_ROLE_COUNT];
+    uint64_t wakeups[THREAD_ROLE_COUNT];
+    // Percent of one core used during the last sampling interval.
+    double cpuPercent[THREAD_ROLE_COUNT];
+    int threads[THREAD_ROLE_COUNT];
+    bool wakeupsAvailable;
+} CpuRoleSnapshot;
+
+// Threads are tagged by the code that creates or takes them over and are
+// untagged automatically when they exit.
+void cpu_sampler_tag_current_thread(ThreadRole role);
+void cpu_sampler_untag_current_thread(void);
+
+void cpu_sampler_start(int intervalMs);
+void cpu_sampler_stop(void);
+void cpu_sampler_snapshot(CpuRoleSnapshot *snapshot);
+const char *cpu_sampler_role_name(ThreadRole role);
+
+#endif /* CpuSampler_h */
@@ -0,0 +1,160 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "CursorCache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void cursor_cache_init(CursorCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+void cursor_cache_clear(CursorCache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < cache->count; i++) {
+        free(cache->shapes[i].pixels);
+    }
+    memset(cache->shapes, 0, sizeof(cache->shapes));
+    cache->count = 0;
+    cache->bytes = 0;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// FNV-1a over 8 bytes at a time, hashing on every cache hit must stay cheaper than decoding.
+static uint64_t hash_bytes(uint64_t hash, const uint8_t *bytes, uint32_t length) {
+    if (bytes == NULL) {
+        return hash;
+    }
+    uint32_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 32;
+    }
+    for (; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+uint64_t cursor_cache_hash(const uint8_t *xorMask, uint32_t xorLength, const uint8_t *andMask, uint32_t andLength,
+                           uint32_t xorBpp, uint32_t width, uint32_t height, uint32_t hotX, uint32_t hotY) {
+    uint32_t header[5] = { xorBpp, width, height, hotX, hotY };
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ULL, (const uint8_t *)header, sizeof(header));
+    hash = hash_bytes(hash, xorMask, xorLength);
+    return hash_bytes(hash, andMask, andLength);
+}
+
+static CursorShape *find_shape(CursorCache *cache, uint64_t hash, uint32_t width, uint32_t height,
+                               uint32_t hotX, uint32_t hotY) {
+    for (uint32_t i = 0; i < cache->count; i++) {
+        CursorShape *shape = &cache->shapes[i];
+        if (shape->hash == hash && shape->width == width && shape->height == height &&
+            shape->hotX == hotX && shape->hotY == hotY) {
+            return shape;
+        }
+    }
+    return NULL;
+}
+
+uint32_t cursor_cache_find(CursorCache *cache, uint64_t hash, uint32_t width, uint32_t height,
+                           uint32_t hotX, uint32_t hotY) {
+    pthread_mutex_lock(&cache->lock);
+    CursorShape *shape = find_shape(cache, hash, width, height, hotX, hotY);
+    uint32_t id = CURSOR_SHAPE_NONE;
+    if (shape != NULL) {
+        shape->lastUsed = ++cache->clock;
+        id = shape->id;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return id;
+}
+
+uint32_t cursor_cache_insert(CursorCache *cache, uint64_t hash, uint32_t width, uint32_t height,
+                             uint32_t hotX, uint32_t hotY, uint8_t *pixels) {
+    pthread_mutex_lock(&cache->lock);
+    CursorShape *shape = find_shape(cache, hash, width, height, hotX, hotY);
+    if (shape != NULL) {
+        // Decoded twice, keep the pixels the id already refers to.
+        free(pixels);
+        shape->lastUsed = ++cache->clock;
+        uint32_t id = shape->id;
+        pthread_mutex_unlock(&cache->lock);
+        return id;
+    }
+    if (cache->count < CURSOR_CACHE_CAPACITY) {
+        shape = &cache->shapes[cache->count++];
+    } else {
+        shape = &cache->shapes[0];
+        for (uint32_t i = 1; i < cache->count; i++) {
+            if (cache->shapes[i].lastUsed < shape->lastUsed) {
+                shape = &cache->shapes[i];
+            }
+        }
+        free(shape->pixels);
+        cache->bytes -= (size_t)shape->width * shape->height * 4;
+    }
+    cache->bytes += (size_t)width * height * 4;
+    if (++cache->lastId == CURSOR_SHAPE_NONE) {
+        ++cache->lastId;
+    }
+    *shape = (CursorShape){ cache->lastId, hash, width, height, hotX, hotY, pixels, ++cache->clock };
+    uint32_t id = shape->id;
+    pthread_mutex_unlock(&cache->lock);
+    return id;
+}
+
+bool cursor_cache_get(CursorCache *cache, uint32_t id, CursorShape *shape) {
+    if (id == CURSOR_SHAPE_NONE) {
+        return false;
+    }
+    pthread_mutex_lock(&cache->lock);
+    bool found = false;
+    for (uint32_t i = 0; i < cache->count && !found; i++) {
+        if (cache->shapes[i].id == id) {
+            cache->shapes[i].lastUsed = ++cache->clock;
+            *shape = cache->shapes[i];
+            found = true;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+size_t cursor_cache_bytes(CursorCache *cache) {
+    pthread_mutex_lock(&cache->lock);
+    size_t bytes = cache->bytes;
+    pthread_mutex_unlock(&cache->lock);
+    return bytes;
+}
+
+void cursor_premultiply_alpha(uint8_t *rgba, size_t pixelCount) {
+    for (size_t i = 0; i < pixelCount; i++, rgba += 4) {
+        uint32_t alpha = rgba[3];
+        if (alpha == 255) {
+            continue;
+        }
+        rgba[0] = (uint8_t)((rgba[0] * alpha + 127) / 255);
+        rgba[1] = (uint8_t)((rgba[1] * alpha + 127) / 255);
+        rgba[2] = (uint8_t)((rgba[2] * alpha + 127) / 255);
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef CursorCache_h
+#define CursorCache_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Servers cycle through a handful of shapes, arrow, I-beam and resize handles.
+#define CURSOR_CACHE_CAPACITY 32
+// Id of no shape at all, for hidden pointers.
+#define CURSOR_SHAPE_NONE 0
+
+// A decoded pointer shape, RGBA with premultiplied alpha. Identical shapes
+// get the same id, and ids are never reused for a different shape.
+typedef struct {
+    uint32_t id;
+    uint64_t hash;
+    uint32_t width;
+    uint32_t height;
+    uint32_t hotX;
+    uint32_t hotY;
+    uint8_t *pixels;
+    uint64_t lastUsed;
+} CursorShape;
+
+typedef struct {
+    pthread_mutex_t lock;
+    CursorShape shapes[CURSOR_CACHE_CAPACITY];
+    uint32_t count;
+    // Pixels held by all shapes.
+    size_t bytes;
+    uint32_t lastId;
+    uint64_t clock;
+} CursorCache;
+
+void cursor_cache_init(CursorCache *cache);
+// Frees the pixels of all shapes.
+void cursor_cache_clear(CursorCache *cache);
+
+// Identifies a shape by the pointer data the server sent, before decoding it.
+uint64_t cursor_cache_hash(const uint8_t *xorMask, uint32_t xorLength, const uint8_t *andMask, uint32_t andLength,
+                           uint32_t xorBpp, uint32_t width, uint32_t height, uint32_t hotX, uint32_t hotY);
+// Returns the id of an already decoded shape or CURSOR_SHAPE_NONE.
+uint32_t cursor_cache_find(CursorCache *cache, uint64_t hash, uint32_t width, uint32_t height,
+                           uint32_t hotX, uint32_t hotY);
+// Takes ownership of malloc'd pixels, evicting the least recently used shape
+// when full, and returns the new id.
+uint32_t cursor_cache_insert(CursorCache *cache, uint64_t hash, uint32_t width, uint32_t height,
+                             uint32_t hotX, uint32_t hotY, uint8_t *pixels);
+// Copies out the shape, whose pixels stay valid until the next insert.
+bool cursor_cache_get(CursorCache *cache, uint32_t id, CursorShape *shape);
+size_t cursor_cache_bytes(CursorCache *cache);
+
+void cursor_premultiply_alpha(uint8_t *rgba, size_t pixelCount);
+
+#endif /* CursorCache_h */
@@ -0,0 +1,326 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "FrameBufferExport.h"
+#include "Utility.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <notify.h>
+#endif
+
+#define NOTIFY_PREFIX "com.morpheusly.framebuffer"
+
+typedef struct {
+    FrameBufferExportHeader *header;
+    size_t size;
+} ExportRegion;
+
+static char exportName[FRAMEBUFFER_EXPORT_NAME_SIZE];
+static bool exportEnabled = false;
+// The region gdi draws into, and the one it drew into before the last resize
+// until gdi hands that back.
+static ExportRegion currentRegion;
+static ExportRegion retiredRegion;
+static bool frameOpen = false;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)ts.tv_nsec / 1000000ULL;
+}
+
+static uint8_t *region_pixels(const ExportRegion *region) {
+    return (uint8_t *)region->header + region->header->dataOffset;
+}
+
+#if defined(__APPLE__)
+static void notify_name(const char *name, char *buffer, size_t size) {
+    snprintf(buffer, size, "%s%s", NOTIFY_PREFIX, name);
+}
+#endif
+
+static void wake_readers(FrameBufferExportHeader *header) {
+    __atomic_add_fetch(&header->notify, 1, __ATOMIC_RELEASE);
+#if defined(__linux__)
+    syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#elif defined(__APPLE__)
+    char name[sizeof(NOTIFY_PREFIX) + FRAMEBUFFER_EXPORT_NAME_SIZE];
+    notify_name(exportName, name, sizeof(name));
+    notify_post(name);
+#endif
+}
+
+static void unmap_region(ExportRegion *region) {
+    if (region->header != NULL) {
+        munmap(region->header, region->size);
+    }
+    region->header = NULL;
+    region->size = 0;
+}
+
+// Tells readers to reopen and takes the name away, the memory stays valid for gdi.
+static void retire_region(ExportRegion *region) {
+    if (region->header == NULL || region->header->retired) {
+        return;
+    }
+    // Unlinked first so that woken readers cannot reopen this same region.
+    shm_unlink(exportName);
+    __atomic_store_n(&region->header->retired, 1, __ATOMIC_RELEASE);
+    wake_readers(region->header);
+}
+
+static bool create_region(ExportRegion *region, uint32_t width, uint32_t height, uint32_t stride,
+                          uint32_t pixelFormat) {
+    size_t dataSize = (size_t)stride * height;
+    size_t size = FRAMEBUFFER_EXPORT_HEADER_SIZE + dataSize;
+    shm_unlink(exportName);
+    int fd = shm_open(exportName, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        client_log("Could not create framebuffer export %s: %s\n", exportName, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        client_log("Could not size framebuffer export %s: %s\n", exportName, strerror(errno));
+        close(fd);
+        shm_unlink(exportName);
+        return false;
+    }
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        client_log("Could not map framebuffer export %s: %s\n", exportName, strerror(errno));
+        shm_unlink(exportName);
+        return false;
+    }
+
+    FrameBufferExportHeader *header = (FrameBufferExportHeader *)base;
+    header->version = FRAMEBUFFER_EXPORT_VERSION;
+    header->headerSize = FRAMEBUFFER_EXPORT_HEADER_SIZE;
+    header->pixelFormat = pixelFormat;
+    header->width = width;
+    header->height = height;
+    header->stride = stride;
+    header->dataOffset = FRAMEBUFFER_EXPORT_HEADER_SIZE;
+    header->dataSize = dataSize;
+    // Readers check the magic first, so it goes in last.
+    __atomic_store_n(&header->magic, FRAMEBUFFER_EXPORT_MAGIC, __ATOMIC_RELEASE);
+
+    region->header = header;
+    region->size = size;
+    client_log("Exporting %ux%u framebuffer as %s\n", width, height, exportName);
+    return true;
+}
+
+bool framebuffer_export_enable(const char *name) {
+    if (name == NULL || name[0] != '/' || strlen(name) >= FRAMEBUFFER_EXPORT_NAME_SIZE ||
+        strchr(name + 1, '/') != NULL) {
+        client_log("Invalid framebuffer export name\n");
+        return false;
+    }
+    snprintf(exportName, sizeof(exportName), "%s", name);
+    exportEnabled = true;
+    return true;
+}
+
+bool framebuffer_export_enable_from_environment(void) {
+    const char *name = getenv(FRAMEBUFFER_EXPORT_ENVIRONMENT);
+    if (name == NULL || name[0] == '\0') {
+        return false;
+    }
+    return framebuffer_export_enable(name);
+}
+
+void framebuffer_export_disable(void) {
+    // Regions still in use by gdi go away when it releases them.
+    exportEnabled = false;
+}
+
+bool framebuffer_export_enabled(void) {
+    return exportEnabled;
+}
+
+uint8_t *framebuffer_export_allocate(uint32_t width, uint32_t height, uint32_t stride, uint32_t pixelFormat) {
+    if (!exportEnabled || width == 0 || height == 0 || stride < width) {
+        return NULL;
+    }
+    // Anything older than the previous region belongs to a gdi that no longer exists.
+    unmap_region(&retiredRegion);
+    retire_region(&currentRegion);
+    retiredRegion = currentRegion;
+    currentRegion.header = NULL;
+    currentRegion.size = 0;
+    frameOpen = false;
+    if (!create_region(&currentRegion, width, height, stride, pixelFormat)) {
+        return NULL;
+    }
+    return region_pixels(&currentRegion);
+}
+
+void framebuffer_export_release(void *pixels) {
+    if (pixels == NULL) {
+        return;
+    }
+    if (currentRegion.header != NULL && region_pixels(&currentRegion) == pixels) {
+        retire_region(&currentRegion);
+        unmap_region(&currentRegion);
+        frameOpen = false;
+    } else if (retiredRegion.header != NULL && region_pixels(&retiredRegion) == pixels) {
+        unmap_region(&retiredRegion);
+    }
+}
+
+void framebuffer_export_begin_frame(void) {
+    FrameBufferExportHeader *header = currentRegion.header;
+    if (header == NULL || frameOpen) {
+        return;
+    }
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    frameOpen = true;
+}
+
+void framebuffer_export_end_frame(const FrameBufferExportRect *damage, uint32_t count) {
+    FrameBufferExportHeader *header = currentRegion.header;
+    if (header == NULL) {
+        return;
+    }
+    framebuffer_export_begin_frame();
+    if (count > FRAMEBUFFER_EXPORT_MAX_DAMAGE || (count > 0 && damage == NULL)) {
+        header->damageCount = 0;
+        header->damageOverflow = 1;
+    } else {
+        memcpy(header->damage, damage, count * sizeof(FrameBufferExportRect));
+        header->damageCount = count;
+        header->damageOverflow = 0;
+    }
+    __atomic_store_n(&header->sequence, header->sequence + 1, __ATOMIC_RELEASE);
+    frameOpen = false;
+    wake_readers(header);
+}
+
+bool framebuffer_export_reader_open(FrameBufferExportReader *reader, const char *name) {
+    memset(reader, 0, sizeof(*reader));
+    reader->notifyFd = -1;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrameBufferExportHeader)) {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    FrameBufferExportHeader *header = (FrameBufferExportHeader *)base;
+    if (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FRAMEBUFFER_EXPORT_MAGIC ||
+        header->version != FRAMEBUFFER_EXPORT_VERSION || __atomic_load_n(&header->retired, __ATOMIC_ACQUIRE) ||
+        header->dataOffset + header->dataSize > (uint64_t)st.st_size) {
+        munmap(base, (size_t)st.st_size);
+        return false;
+    }
+    reader->header = header;
+    reader->pixels = (uint8_t *)base + header->dataOffset;
+    reader->mappedSize = (size_t)st.st_size;
+#if defined(__APPLE__)
+    char notifyName[sizeof(NOTIFY_PREFIX) + FRAMEBUFFER_EXPORT_NAME_SIZE];
+    notify_name(name, notifyName, sizeof(notifyName));
+    if (notify_register_file_descriptor(notifyName, &reader->notifyFd, 0, &reader->notifyToken) != NOTIFY_STATUS_OK) {
+        reader->notifyFd = -1;
+    }
+#endif
+    return true;
+}
+
+void framebuffer_export_reader_close(FrameBufferExportReader *reader) {
+#if defined(__APPLE__)
+    if (reader->notifyFd >= 0) {
+        notify_cancel(reader->notifyToken);
+    }
+#endif
+    if (reader->header != NULL) {
+        munmap(reader->header, reader->mappedSize);
+    }
+    memset(reader, 0, sizeof(*reader));
+    reader->notifyFd = -1;
+}
+
+static void wait_for_notify(FrameBufferExportReader *reader, uint32_t notify, int timeoutMs) {
+#if defined(__linux__)
+    struct timespec timeout = { timeoutMs / 1000, (long)(timeoutMs % 1000) * 1000000L };
+    syscall(SYS_futex, &reader->header->notify, FUTEX_WAIT, notify, &timeout, NULL, 0);
+#else
+    if (reader->notifyFd >= 0) {
+        struct pollfd pfd = { .fd = reader->notifyFd, .events = POLLIN };
+        if (poll(&pfd, 1, timeoutMs) == 1) {
+            int token;
+            while (read(reader->notifyFd, &token, sizeof(token)) == sizeof(token) &&
+                   __atomic_load_n(&reader->header->notify, __ATOMIC_ACQUIRE) == notify) {
+            }
+        }
+    } else {
+        struct timespec pause = { 0, 1000000L };
+        nanosleep(&pause, NULL);
+    }
+#endif
+}
+
+uint64_t framebuffer_export_reader_wait(FrameBufferExportReader *reader, uint64_t lastSequence, int timeoutMs) {
+    if (reader->header == NULL) {
+        return lastSequence;
+    }
+    uint64_t deadlineMs = now_ms() + (uint64_t)(timeoutMs > 0 ? timeoutMs : 0);
+    while (true) {
+        uint32_t notify = __atomic_load_n(&reader->header->notify, __ATOMIC_ACQUIRE);
+        uint64_t sequence = __atomic_load_n(&reader->header->sequence, __ATOMIC_ACQUIRE);
+        if ((sequence & 1) == 0 && sequence > lastSequence) {
+            return sequence;
+        }
+        if (__atomic_load_n(&reader->header->retired, __ATOMIC_ACQUIRE)) {
+            return lastSequence;
+        }
+        uint64_t now = now_ms();
+        if (now >= deadlineMs) {
+            return lastSequence;
+        }
+        wait_for_notify(reader, notify, (int)(deadlineMs - now));
+    }
+}
+
+bool framebuffer_export_reader_validate(const FrameBufferExportReader *reader, uint64_t sequence) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&reader->header->sequence, __ATOMIC_RELAXED) == sequence;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef FrameBufferExport_h
+#define FrameBufferExport_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FRAMEBUFFER_EXPORT_MAGIC 0x31584246 /* "FBX1" */
+#define FRAMEBUFFER_EXPORT_VERSION 1
+#define FRAMEBUFFER_EXPORT_HEADER_SIZE 4096
+#define FRAMEBUFFER_EXPORT_MAX_DAMAGE 32
+#define FRAMEBUFFER_EXPORT_NAME_SIZE 32
+#define FRAMEBUFFER_EXPORT_ENVIRONMENT "SCLOUDRDP_FRAMEBUFFER_EXPORT"
+// Byte order of the pixels in memory, matching PIXEL_FORMAT_RGBA32.
+#define FRAMEBUFFER_EXPORT_FORMAT_RGBA32 0x41424752 /* "RGBA" */
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} FrameBufferExportRect;
+
+// Laid out at the start of the shared region, the pixels follow at dataOffset.
+// The session draws straight into the region, so sequence works as a seqlock:
+// it is odd while a frame is being drawn and even once the frame is complete.
+// A reader that finds the same even value before and after using the pixels
+// has seen a whole frame. Once retired is set the session has moved on to a
+// new region under the same name, which readers reopen.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t pixelFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t retired;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint64_t sequence;
+    // Bumped after every frame, readers on Linux can futex wait on it.
+    uint32_t notify;
+    // Damage of the last completed frame, a count of zero with damageOverflow
+    // set means the whole frame changed.
+    uint32_t damageCount;
+    uint32_t damageOverflow;
+    uint32_t reserved;
+    FrameBufferExportRect damage[FRAMEBUFFER_EXPORT_MAX_DAMAGE];
+} FrameBufferExportHeader;
+
+/* Session side, only called from the thread that draws the framebuffer */
+
+// Names follow shm_open, a leading slash and at most 30 more characters.
+bool framebuffer_export_enable(const char *name);
+// Reads the region name from the SCLOUDRDP_FRAMEBUFFER_EXPORT environment variable.
+bool framebuffer_export_enable_from_environment(void);
+void framebuffer_export_disable(void);
+bool framebuffer_export_enabled(void);
+
+// Creates a region for a framebuffer of this size and retires the previous
+// one, returns where the pixels go or NULL when exporting is off or failed.
+uint8_t *framebuffer_export_allocate(uint32_t width, uint32_t height, uint32_t stride, uint32_t pixelFormat);
+// Matches the free callback that gdi expects for caller supplied buffers.
+void framebuffer_export_release(void *pixels);
+
+void framebuffer_export_begin_frame(void);
+void framebuffer_export_end_frame(const FrameBufferExportRect *damage, uint32_t count);
+
+/* Reader side, for tooling in other processes */
+
+typedef struct {
+    FrameBufferExportHeader *header;
+    uint8_t *pixels;
+    size_t mappedSize;
+    // Darwin notification used instead of a futex on Apple platforms.
+    int notifyFd;
+    int notifyToken;
+} FrameBufferExportReader;
+
+bool framebuffer_export_reader_open(FrameBufferExportReader *reader, const char *name);
+void framebuffer_export_reader_close(FrameBufferExportReader *reader);
+// Waits until a frame newer than lastSequence completes, returns its even
+// sequence number, or lastSequence on timeout or once the region is retired.
+uint64_t framebuffer_export_reader_wait(FrameBufferExportReader *reader, uint64_t lastSequence, int timeoutMs);
+// True if no frame was drawn since sequence was returned by the wait above.
+bool framebuffer_export_reader_validate(const FrameBufferExportReader *reader, uint64_t sequence);
+
+#endif /* FrameBufferExport_h */
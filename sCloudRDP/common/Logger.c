@@ -0,0 +1,281 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+// Producers (FreeRDP thread, SSH threads, UI) each write into their own
+// single-producer ring, so logging never takes a lock or calls into Swift.
+// A single drain thread delivers messages to client_log_callback and
+// rate limits what it forwards.
+
+#include "Logger.h"
+#include "Utility.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOG_RING_SLOTS 64
+#define LOG_SLOT_SIZE 1024
+// What the single client_log buffer used to carry, longer messages are cut.
+#define LOG_MESSAGE_MAX_SIZE 16384
+#define LOG_TRUNCATED_MARKER "... [truncated]\n"
+#define LOG_DRAIN_INTERVAL_NS 20000000L
+#define LOG_DRAIN_MAX_PER_SECOND 200
+
+typedef struct {
+    ClientLogLevel level;
+    // Messages that do not fit the slot are copied to the heap, the drain thread frees them.
+    char *longMessage;
+    char message[LOG_SLOT_SIZE];
+} LogSlot;
+
+typedef struct LogRing {
+    atomic_uint head;
+    atomic_uint tail;
+    atomic_uint dropped;
+    atomic_int owned;
+    struct LogRing *next;
+    LogSlot slots[LOG_RING_SLOTS];
+} LogRing;
+
+int client_log_level = CLIENT_LOG_LEVEL_INFO;
+
+static _Atomic(LogRing *) rings = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t logger_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static double drain_tokens = LOG_DRAIN_MAX_PER_SECOND;
+static struct timespec drain_last_refill;
+static unsigned int drain_suppressed = 0;
+
+static void release_ring(void *ring) {
+    atomic_store_explicit(&((LogRing *)ring)->owned, 0, memory_order_release);
+}
+
+static LogRing *claim_ring(void) {
+    LogRing *ring = pthread_getspecific(ring_key);
+    if (ring != NULL) {
+        return ring;
+    }
+
+    // Reuse a fully drained ring left behind by a thread that has exited.
+    for (ring = atomic_load_explicit(&rings, memory_order_acquire); ring != NULL; ring = ring->next) {
+        int expected = 0;
+        if (atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+            atomic_load_explicit(&ring->tail, memory_order_acquire) &&
+            atomic_compare_exchange_strong(&ring->owned, &expected, 1)) {
+            pthread_setspecific(ring_key, ring);
+            return ring;
+        }
+    }
+
+    ring = calloc(1, sizeof(LogRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    atomic_store_explicit(&ring->owned, 1, memory_order_relaxed);
+    ring->next = atomic_load_explicit(&rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&rings, &ring->next, ring,
+                                                  memory_order_release, memory_order_relaxed)) {
+    }
+    pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+static void deliver(const char *message) {
+    if (client_log_callback != NULL) {
+        client_log_callback((int8_t *)message);
+    }
+}
+
+static int take_token(ClientLogLevel level) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (double)(now.tv_sec - drain_last_refill.tv_sec) +
+                     (double)(now.tv_nsec - drain_last_refill.tv_nsec) / 1e9;
+    drain_last_refill = now;
+    drain_tokens += elapsed * LOG_DRAIN_MAX_PER_SECOND;
+    if (drain_tokens > LOG_DRAIN_MAX_PER_SECOND) {
+        drain_tokens = LOG_DRAIN_MAX_PER_SECOND;
+    }
+
+    // Errors are never rate limited.
+    if (level >= CLIENT_LOG_LEVEL_ERROR) {
+        return 1;
+    }
+    if (drain_tokens < 1.0) {
+        return 0;
+    }
+    drain_tokens -= 1.0;
+    return 1;
+}
+
+static void drain_rings(void) {
+    char summary[128];
+    pthread_mutex_lock(&drain_lock);
+    for (LogRing *ring = atomic_load_explicit(&rings, memory_order_acquire); ring != NULL; ring = ring->next) {
+        unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        while (tail != head) {
+            LogSlot *slot = &ring->slots[tail % LOG_RING_SLOTS];
+            if (take_token(slot->level)) {
+                deliver(slot->longMessage != NULL ? slot->longMessage : slot->message);
+            } else {
+                drain_suppressed++;
+            }
+            free(slot->longMessage);
+            slot->longMessage = NULL;
+            tail++;
+            atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        }
+        drain_suppressed += atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+    }
+    if (drain_suppressed > 0 && take_token(CLIENT_LOG_LEVEL_WARN)) {
+        snprintf(summary, sizeof(summary), "Logger: %u messages dropped or rate limited\n", drain_suppressed);
+        deliver(summary);
+        drain_suppressed = 0;
+    }
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void *drain_thread(void *unused) {
+    (void)unused;
+    struct timespec interval = { 0, LOG_DRAIN_INTERVAL_NS };
+    while (1) {
+        nanosleep(&interval, NULL);
+        drain_rings();
+    }
+    return NULL;
+}
+
+static void logger_init(void) {
+    pthread_t thread;
+    pthread_key_create(&ring_key, release_ring);
+    clock_gettime(CLOCK_MONOTONIC, &drain_last_refill);
+    if (pthread_create(&thread, NULL, drain_thread, NULL) == 0) {
+        pthread_detach(thread);
+    }
+}
+
+static LogSlot *reserve_slot(LogRing *ring, unsigned int *head) {
+    *head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (*head - tail >= LOG_RING_SLOTS) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return &ring->slots[*head % LOG_RING_SLOTS];
+}
+
+static void publish_slot(LogRing *ring, unsigned int head) {
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void client_log_set_level(ClientLogLevel level) {
+    __atomic_store_n(&client_log_level, (int)level, __ATOMIC_RELAXED);
+}
+
+// Ends a message that had to be cut short with a marker, so nobody mistakes it for the whole.
+static void mark_truncated(char *message, size_t size) {
+    size_t markerLength = strlen(LOG_TRUNCATED_MARKER);
+    memcpy(message + size - markerLength - 1, LOG_TRUNCATED_MARKER, markerLength + 1);
+}
+
+// Stores a message of length bytes, the slot keeps it when it fits and the heap otherwise.
+static void store_message(LogSlot *slot, size_t length) {
+    slot->longMessage = NULL;
+    if (length < LOG_SLOT_SIZE) {
+        return;
+    }
+    size_t size = length + 1 < LOG_MESSAGE_MAX_SIZE ? length + 1 : LOG_MESSAGE_MAX_SIZE;
+    slot->longMessage = malloc(size);
+    if (slot->longMessage == NULL) {
+        mark_truncated(slot->message, LOG_SLOT_SIZE);
+    }
+}
+
+void client_log_v(ClientLogLevel level, const char *format, va_list args) {
+    unsigned int head;
+    if (!client_log_enabled(level) || client_log_callback == NULL) {
+        return;
+    }
+    pthread_once(&logger_once, logger_init);
+    LogRing *ring = claim_ring();
+    if (ring == NULL) {
+        return;
+    }
+    LogSlot *slot = reserve_slot(ring, &head);
+    if (slot == NULL) {
+        return;
+    }
+    slot->level = level;
+    va_list retry;
+    va_copy(retry, args);
+    int length = vsnprintf(slot->message, LOG_SLOT_SIZE, format, args);
+    store_message(slot, length > 0 ? (size_t)length : 0);
+    if (slot->longMessage != NULL) {
+        vsnprintf(slot->longMessage, LOG_MESSAGE_MAX_SIZE, format, retry);
+        if ((size_t)length >= LOG_MESSAGE_MAX_SIZE) {
+            mark_truncated(slot->longMessage, LOG_MESSAGE_MAX_SIZE);
+        }
+    }
+    va_end(retry);
+    publish_slot(ring, head);
+}
+
+void client_log_at(ClientLogLevel level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    client_log_v(level, format, args);
+    va_end(args);
+}
+
+void client_log_string(ClientLogLevel level, const char *message) {
+    unsigned int head;
+    if (!client_log_enabled(level) || client_log_callback == NULL) {
+        return;
+    }
+    pthread_once(&logger_once, logger_init);
+    LogRing *ring = claim_ring();
+    if (ring == NULL) {
+        return;
+    }
+    LogSlot *slot = reserve_slot(ring, &head);
+    if (slot == NULL) {
+        return;
+    }
+    slot->level = level;
+    size_t length = strlen(message);
+    snprintf(slot->message, LOG_SLOT_SIZE, "%s", message);
+    store_message(slot, length);
+    if (slot->longMessage != NULL) {
+        snprintf(slot->longMessage, LOG_MESSAGE_MAX_SIZE, "%s", message);
+        if (length >= LOG_MESSAGE_MAX_SIZE) {
+            mark_truncated(slot->longMessage, LOG_MESSAGE_MAX_SIZE);
+        }
+    }
+    publish_slot(ring, head);
+}
+
+void client_log_flush(void) {
+    pthread_once(&logger_once, logger_init);
+    drain_rings();
+}
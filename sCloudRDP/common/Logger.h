@@ -0,0 +1,55 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef Logger_h
+#define Logger_h
+
+#include <stdarg.h>
+#include <stdint.h>
+
+typedef enum {
+    CLIENT_LOG_LEVEL_DEBUG = 0,
+    CLIENT_LOG_LEVEL_INFO,
+    CLIENT_LOG_LEVEL_WARN,
+    CLIENT_LOG_LEVEL_ERROR,
+    CLIENT_LOG_LEVEL_NONE
+} ClientLogLevel;
+
+// Messages below this level are discarded before any formatting takes place.
+extern int client_log_level;
+
+static inline int client_log_enabled(ClientLogLevel level) {
+    return (int)level >= __atomic_load_n(&client_log_level, __ATOMIC_RELAXED);
+}
+
+// Arguments are not evaluated at all when the level is disabled.
+#define CLIENT_LOG_AT(level, ...) do { \
+    if (client_log_enabled(level)) { client_log_at(level, __VA_ARGS__); } \
+} while (0)
+#define CLIENT_LOG_DEBUG(...) CLIENT_LOG_AT(CLIENT_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define CLIENT_LOG_WARN(...) CLIENT_LOG_AT(CLIENT_LOG_LEVEL_WARN, __VA_ARGS__)
+#define CLIENT_LOG_ERROR(...) CLIENT_LOG_AT(CLIENT_LOG_LEVEL_ERROR, __VA_ARGS__)
+
+void client_log_set_level(ClientLogLevel level);
+void client_log_at(ClientLogLevel level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void client_log_v(ClientLogLevel level, const char *format, va_list args);
+void client_log_string(ClientLogLevel level, const char *message);
+void client_log_flush(void);
+
+#endif /* Logger_h */
@@ -0,0 +1,179 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "MemoryBudget.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+typedef struct {
+    pMemoryShedder shedder;
+    void *context;
+} ShedderEntry;
+
+static atomic_uint_fast64_t limitBytes = MEMORY_BUDGET_MAX_LIMIT;
+static atomic_int_fast64_t subsystemBytes[MEMORY_SUBSYSTEM_COUNT];
+static atomic_int_fast64_t totalBytes;
+static atomic_uint_fast64_t peakBytes;
+// Shedders call back into memory_budget_add, so only the stages take this lock.
+static pthread_mutex_t shedLock = PTHREAD_MUTEX_INITIALIZER;
+static ShedderEntry shedders[MEMORY_SHED_STAGE_COUNT][MEMORY_BUDGET_MAX_SHEDDERS];
+static MemoryPressureLevel lastLevel = MEMORY_PRESSURE_NORMAL;
+static uint64_t shedBytes[MEMORY_SHED_STAGE_COUNT];
+static uint64_t shedCalls[MEMORY_SHED_STAGE_COUNT];
+
+uint64_t memory_budget_limit_for_device(uint64_t physicalMemory) {
+    uint64_t limit = physicalMemory / 4;
+    if (limit < MEMORY_BUDGET_MIN_LIMIT) {
+        return MEMORY_BUDGET_MIN_LIMIT;
+    }
+    return limit > MEMORY_BUDGET_MAX_LIMIT ? MEMORY_BUDGET_MAX_LIMIT : limit;
+}
+
+void memory_budget_set_limit(uint64_t limit) {
+    atomic_store_explicit(&limitBytes, limit, memory_order_relaxed);
+}
+
+uint64_t memory_budget_limit(void) {
+    return atomic_load_explicit(&limitBytes, memory_order_relaxed);
+}
+
+static void record_peak(int64_t total) {
+    uint64_t peak = atomic_load_explicit(&peakBytes, memory_order_relaxed);
+    while (total > 0 && (uint64_t)total > peak &&
+           !atomic_compare_exchange_weak_explicit(&peakBytes, &peak, (uint64_t)total,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+bool memory_budget_add(MemorySubsystem subsystem, int64_t delta) {
+    atomic_fetch_add_explicit(&subsystemBytes[subsystem], delta, memory_order_relaxed);
+    int64_t total = atomic_fetch_add_explicit(&totalBytes, delta, memory_order_relaxed) + delta;
+    record_peak(total);
+    return total <= 0 || (uint64_t)total <= memory_budget_limit();
+}
+
+bool memory_budget_set(MemorySubsystem subsystem, uint64_t bytes) {
+    int64_t previous = atomic_exchange_explicit(&subsystemBytes[subsystem], (int64_t)bytes, memory_order_relaxed);
+    int64_t delta = (int64_t)bytes - previous;
+    int64_t total = atomic_fetch_add_explicit(&totalBytes, delta, memory_order_relaxed) + delta;
+    record_peak(total);
+    return total <= 0 || (uint64_t)total <= memory_budget_limit();
+}
+
+uint64_t memory_budget_total(void) {
+    int64_t total = atomic_load_explicit(&totalBytes, memory_order_relaxed);
+    return total > 0 ? (uint64_t)total : 0;
+}
+
+bool memory_budget_register_shedder(MemoryShedStage stage, pMemoryShedder shedder, void *context) {
+    pthread_mutex_lock(&shedLock);
+    bool registered = false;
+    for (int i = 0; i < MEMORY_BUDGET_MAX_SHEDDERS && !registered; i++) {
+        ShedderEntry *entry = &shedders[stage][i];
+        if (entry->shedder == NULL || (entry->shedder == shedder && entry->context == context)) {
+            *entry = (ShedderEntry){ shedder, context };
+            registered = true;
+        }
+    }
+    pthread_mutex_unlock(&shedLock);
+    return registered;
+}
+
+void memory_budget_unregister_shedder(MemoryShedStage stage, pMemoryShedder shedder, void *context) {
+    pthread_mutex_lock(&shedLock);
+    for (int i = 0; i < MEMORY_BUDGET_MAX_SHEDDERS; i++) {
+        ShedderEntry *entry = &shedders[stage][i];
+        if (entry->shedder == shedder && entry->context == context) {
+            *entry = (ShedderEntry){ NULL, NULL };
+        }
+    }
+    pthread_mutex_unlock(&shedLock);
+}
+
+uint64_t memory_budget_target(MemoryPressureLevel level) {
+    uint64_t limit = memory_budget_limit();
+    switch (level) {
+        case MEMORY_PRESSURE_CRITICAL:
+            return limit / 2;
+        case MEMORY_PRESSURE_WARNING:
+            return limit / 4 * 3;
+        case MEMORY_PRESSURE_NORMAL:
+        default:
+            return limit;
+    }
+}
+
+uint64_t memory_budget_pressure(MemoryPressureLevel level) {
+    uint64_t target = memory_budget_target(level);
+    // A smaller desktop costs the user the most and is kept for when it is critical.
+    int lastStage = level == MEMORY_PRESSURE_CRITICAL ? MEMORY_SHED_QUALITY : MEMORY_SHED_CACHES;
+    uint64_t freed = 0;
+    pthread_mutex_lock(&shedLock);
+    lastLevel = level;
+    for (int stage = MEMORY_SHED_PREVIEWS; stage <= lastStage; stage++) {
+        for (int i = 0; i < MEMORY_BUDGET_MAX_SHEDDERS; i++) {
+            uint64_t total = memory_budget_total();
+            ShedderEntry *entry = &shedders[stage][i];
+            if (total <= target) {
+                pthread_mutex_unlock(&shedLock);
+                return freed;
+            }
+            if (entry->shedder == NULL) {
+                continue;
+            }
+            size_t stageFreed = entry->shedder(entry->context, (size_t)(total - target));
+            shedBytes[stage] += stageFreed;
+            shedCalls[stage]++;
+            freed += stageFreed;
+        }
+    }
+    pthread_mutex_unlock(&shedLock);
+    return freed;
+}
+
+void memory_budget_snapshot(MemoryBudgetSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(MemoryBudgetSnapshot));
+    snapshot->limitBytes = memory_budget_limit();
+    snapshot->totalBytes = memory_budget_total();
+    snapshot->peakBytes = atomic_load_explicit(&peakBytes, memory_order_relaxed);
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++) {
+        int64_t bytes = atomic_load_explicit(&subsystemBytes[i], memory_order_relaxed);
+        snapshot->bytes[i] = bytes > 0 ? (uint64_t)bytes : 0;
+    }
+    pthread_mutex_lock(&shedLock);
+    snapshot->lastLevel = lastLevel;
+    memcpy(snapshot->shedBytes, shedBytes, sizeof(shedBytes));
+    memcpy(snapshot->shedCalls, shedCalls, sizeof(shedCalls));
+    pthread_mutex_unlock(&shedLock);
+}
+
+void memory_budget_reset(void) {
+    for (int i = 0; i < MEMORY_SUBSYSTEM_COUNT; i++) {
+        atomic_store_explicit(&subsystemBytes[i], 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&totalBytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&peakBytes, 0, memory_order_relaxed);
+    pthread_mutex_lock(&shedLock);
+    lastLevel = MEMORY_PRESSURE_NORMAL;
+    memset(shedBytes, 0, sizeof(shedBytes));
+    memset(shedCalls, 0, sizeof(shedCalls));
+    pthread_mutex_unlock(&shedLock);
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef MemoryBudget_h
+#define MemoryBudget_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMORY_BUDGET_MAX_SHEDDERS 4
+#define MEMORY_BUDGET_MIN_LIMIT (256ULL * 1024 * 1024)
+#define MEMORY_BUDGET_MAX_LIMIT (1024ULL * 1024 * 1024)
+
+// Codec scratch buffers live inside FreeRDP and the audio jitter buffer inside
+// its rdpsnd channel, neither is tagged and neither counts toward the limit.
+typedef enum {
+    MEMORY_FRAMEBUFFER = 0,
+    // Images decoded for the app's own views, such as the cursor shape images.
+    MEMORY_PREVIEW,
+    MEMORY_CURSOR_CACHE,
+    MEMORY_CLIPBOARD,
+    MEMORY_SUBSYSTEM_COUNT
+} MemorySubsystem;
+
+typedef enum {
+    MEMORY_PRESSURE_NORMAL = 0,
+    MEMORY_PRESSURE_WARNING,
+    MEMORY_PRESSURE_CRITICAL
+} MemoryPressureLevel;
+
+// What to give up, in the order it is given up.
+typedef enum {
+    MEMORY_SHED_PREVIEWS = 0,
+    MEMORY_SHED_CACHES,
+    // Asks for a smaller desktop or fewer colors, only under critical pressure.
+    MEMORY_SHED_QUALITY,
+    MEMORY_SHED_STAGE_COUNT
+} MemoryShedStage;
+
+// Frees up to bytesWanted, releases it with memory_budget_add and returns how much it freed.
+typedef size_t (*pMemoryShedder)(void *context, size_t bytesWanted);
+
+typedef struct {
+    uint64_t limitBytes;
+    uint64_t totalBytes;
+    uint64_t peakBytes;
+    uint64_t bytes[MEMORY_SUBSYSTEM_COUNT];
+    MemoryPressureLevel lastLevel;
+    uint64_t shedBytes[MEMORY_SHED_STAGE_COUNT];
+    uint64_t shedCalls[MEMORY_SHED_STAGE_COUNT];
+} MemoryBudgetSnapshot;
+
+// A quarter of the device's memory, within MEMORY_BUDGET_MIN_LIMIT and MEMORY_BUDGET_MAX_LIMIT.
+uint64_t memory_budget_limit_for_device(uint64_t physicalMemory);
+void memory_budget_set_limit(uint64_t limitBytes);
+uint64_t memory_budget_limit(void);
+
+// Tags allocations, negative deltas for what was freed. Returns true while within the limit.
+bool memory_budget_add(MemorySubsystem subsystem, int64_t delta);
+bool memory_budget_set(MemorySubsystem subsystem, uint64_t bytes);
+uint64_t memory_budget_total(void);
+
+bool memory_budget_register_shedder(MemoryShedStage stage, pMemoryShedder shedder, void *context);
+void memory_budget_unregister_shedder(MemoryShedStage stage, pMemoryShedder shedder, void *context);
+
+// Sheds stage by stage until usage is within the target of the level: the
+// limit when normal, three quarters of it on warning and half when critical.
+// Returns how much was freed.
+uint64_t memory_budget_pressure(MemoryPressureLevel level);
+uint64_t memory_budget_target(MemoryPressureLevel level);
+
+void memory_budget_snapshot(MemoryBudgetSnapshot *snapshot);
+void memory_budget_reset(void);
+
+#endif /* MemoryBudget_h */
@@ -0,0 +1,268 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "Metrics.h"
+#include "Utility.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define METRICS_TRACE_CAPACITY 65536
+
+// Every hot value lives on its own cache line so that the FreeRDP thread,
+// the SSH threads and the UI thread do not contend on the same line.
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t value;
+} PaddedCounter;
+
+typedef struct {
+    _Alignas(64) atomic_int_fast64_t value;
+} PaddedGauge;
+
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t count;
+    atomic_uint_fast64_t sum;
+    atomic_uint_fast64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+} Histogram;
+
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t bytesIn;
+    atomic_uint_fast64_t bytesOut;
+    atomic_int_fast64_t queueDepth;
+} SshChannelStats;
+
+#define METRICS_TRACE_NAME_LENGTH 32
+
+typedef struct {
+    char name[METRICS_TRACE_NAME_LENGTH];
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t tid;
+} TraceEvent;
+
+static PaddedCounter counters[METRIC_COUNTER_COUNT];
+static PaddedGauge gauges[METRIC_GAUGE_COUNT];
+static Histogram histograms[METRIC_HISTOGRAM_COUNT];
+static SshChannelStats sshChannels[METRICS_MAX_SSH_CHANNELS];
+
+static TraceEvent *traceEvents = NULL;
+static atomic_uint traceNext = 0;
+static atomic_uint traceWriters = 0;
+static pthread_mutex_t traceControlLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint_fast64_t traceDeadlineNs = 0;
+static uint64_t traceOriginNs = 0;
+static atomic_uint traceThreadIds = 0;
+static _Thread_local uint32_t traceTid = 0;
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bucket_for(uint64_t value) {
+    if (value == 0) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll(value);
+    return bucket < METRICS_HISTOGRAM_BUCKETS ? bucket : METRICS_HISTOGRAM_BUCKETS - 1;
+}
+
+void metrics_counter_add(MetricCounter counter, uint64_t value) {
+    atomic_fetch_add_explicit(&counters[counter].value, value, memory_order_relaxed);
+}
+
+void metrics_gauge_set(MetricGauge gauge, int64_t value) {
+    atomic_store_explicit(&gauges[gauge].value, value, memory_order_relaxed);
+}
+
+void metrics_gauge_add(MetricGauge gauge, int64_t value) {
+    atomic_fetch_add_explicit(&gauges[gauge].value, value, memory_order_relaxed);
+}
+
+void metrics_histogram_record(MetricHistogram histogram, uint64_t value) {
+    Histogram *h = &histograms[histogram];
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->buckets[bucket_for(value)], 1, memory_order_relaxed);
+}
+
+void metrics_ssh_channel_bytes(int channel, uint64_t bytesIn, uint64_t bytesOut) {
+    if (channel < 0 || channel >= METRICS_MAX_SSH_CHANNELS) {
+        return;
+    }
+    if (bytesIn) {
+        atomic_fetch_add_explicit(&sshChannels[channel].bytesIn, bytesIn, memory_order_relaxed);
+    }
+    if (bytesOut) {
+        atomic_fetch_add_explicit(&sshChannels[channel].bytesOut, bytesOut, memory_order_relaxed);
+    }
+}
+
+void metrics_ssh_channel_queue_depth(int channel, int64_t depth) {
+    if (channel < 0 || channel >= METRICS_MAX_SSH_CHANNELS) {
+        return;
+    }
+    atomic_store_explicit(&sshChannels[channel].queueDepth, depth, memory_order_relaxed);
+}
+
+void metrics_snapshot(MetricsSnapshot *snapshot) {
+    memset(snapshot, 0, sizeof(MetricsSnapshot));
+    snapshot->timestampNs = metrics_now_ns();
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        snapshot->counters[i] = atomic_load_explicit(&counters[i].value, memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_GAUGE_COUNT; i++) {
+        snapshot->gauges[i] = atomic_load_explicit(&gauges[i].value, memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        snapshot->histogramCounts[i] = atomic_load_explicit(&histograms[i].count, memory_order_relaxed);
+        snapshot->histogramSums[i] = atomic_load_explicit(&histograms[i].sum, memory_order_relaxed);
+        for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            snapshot->histogramBuckets[i][b] = atomic_load_explicit(&histograms[i].buckets[b], memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < METRICS_MAX_SSH_CHANNELS; i++) {
+        snapshot->sshBytesIn[i] = atomic_load_explicit(&sshChannels[i].bytesIn, memory_order_relaxed);
+        snapshot->sshBytesOut[i] = atomic_load_explicit(&sshChannels[i].bytesOut, memory_order_relaxed);
+        snapshot->sshQueueDepth[i] = atomic_load_explicit(&sshChannels[i].queueDepth, memory_order_relaxed);
+    }
+}
+
+void metrics_reset(void) {
+    for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+        atomic_store_explicit(&counters[i].value, 0, memory_order_relaxed);
+    }
+    for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+        atomic_store_explicit(&histograms[i].count, 0, memory_order_relaxed);
+        atomic_store_explicit(&histograms[i].sum, 0, memory_order_relaxed);
+        for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; b++) {
+            atomic_store_explicit(&histograms[i].buckets[b], 0, memory_order_relaxed);
+        }
+    }
+    for (int i = 0; i < METRICS_MAX_SSH_CHANNELS; i++) {
+        atomic_store_explicit(&sshChannels[i].bytesIn, 0, memory_order_relaxed);
+        atomic_store_explicit(&sshChannels[i].bytesOut, 0, memory_order_relaxed);
+    }
+}
+
+// Closes the recording window and waits out every producer that got past the
+// window check, after which the buffer can be reset or read without a race.
+// Both sides use sequentially consistent accesses, so either the producer
+// sees the closed window or this sees the producer.
+static void trace_quiesce(void) {
+    atomic_store_explicit(&traceDeadlineNs, 0, memory_order_seq_cst);
+    while (atomic_load_explicit(&traceWriters, memory_order_seq_cst) != 0) {
+        sched_yield();
+    }
+}
+
+void metrics_trace_start(uint64_t windowMs) {
+    pthread_mutex_lock(&traceControlLock);
+    if (traceEvents == NULL) {
+        traceEvents = calloc(METRICS_TRACE_CAPACITY, sizeof(TraceEvent));
+        if (traceEvents == NULL) {
+            pthread_mutex_unlock(&traceControlLock);
+            client_log("Metrics: Unable to allocate trace buffer\n");
+            return;
+        }
+    }
+    trace_quiesce();
+    // Only the first traceNext events are ever read, so there is no need to clear them.
+    atomic_store_explicit(&traceNext, 0, memory_order_relaxed);
+    traceOriginNs = metrics_now_ns();
+    atomic_store_explicit(&traceDeadlineNs, traceOriginNs + windowMs * 1000000ULL, memory_order_seq_cst);
+    pthread_mutex_unlock(&traceControlLock);
+}
+
+bool metrics_trace_active(void) {
+    uint64_t deadline = atomic_load_explicit(&traceDeadlineNs, memory_order_acquire);
+    return deadline != 0 && metrics_now_ns() < deadline;
+}
+
+void metrics_trace_complete(const char *name, uint64_t startNs, uint64_t endNs) {
+    if (!metrics_trace_active()) {
+        return;
+    }
+    atomic_fetch_add_explicit(&traceWriters, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&traceDeadlineNs, memory_order_seq_cst) != 0) {
+        unsigned int index = atomic_fetch_add_explicit(&traceNext, 1, memory_order_relaxed);
+        if (index < METRICS_TRACE_CAPACITY) {
+            if (traceTid == 0) {
+                traceTid = atomic_fetch_add_explicit(&traceThreadIds, 1, memory_order_relaxed) + 1;
+            }
+            TraceEvent *event = &traceEvents[index];
+            strncpy(event->name, name, METRICS_TRACE_NAME_LENGTH - 1);
+            event->name[METRICS_TRACE_NAME_LENGTH - 1] = '\0';
+            event->startNs = startNs;
+            event->durationNs = endNs > startNs ? endNs - startNs : 0;
+            event->tid = traceTid;
+        }
+    }
+    atomic_fetch_sub_explicit(&traceWriters, 1, memory_order_release);
+}
+
+int metrics_trace_dump(const char *path) {
+    pthread_mutex_lock(&traceControlLock);
+    if (traceEvents == NULL) {
+        pthread_mutex_unlock(&traceControlLock);
+        return -1;
+    }
+    // Stop recording before reading the buffer.
+    trace_quiesce();
+
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        pthread_mutex_unlock(&traceControlLock);
+        client_log("Metrics: Unable to open %s for trace output\n", path);
+        return -1;
+    }
+    unsigned int count = atomic_load_explicit(&traceNext, memory_order_relaxed);
+    if (count > METRICS_TRACE_CAPACITY) {
+        count = METRICS_TRACE_CAPACITY;
+    }
+    unsigned int written = 0;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (unsigned int i = 0; i < count; i++) {
+        TraceEvent *event = &traceEvents[i];
+        uint64_t startNs = event->startNs;
+        uint64_t durationNs = event->durationNs;
+        // Spans that began before the window opened are cut at its start.
+        if (startNs < traceOriginNs) {
+            if (startNs + durationNs <= traceOriginNs) {
+                continue;
+            }
+            durationNs -= traceOriginNs - startNs;
+            startNs = traceOriginNs;
+        }
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}\n",
+                written == 0 ? "" : ",", event->name, event->tid,
+                (double)(startNs - traceOriginNs) / 1000.0, (double)durationNs / 1000.0);
+        written++;
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    pthread_mutex_unlock(&traceControlLock);
+    client_log("Metrics: Wrote %u trace events to %s\n", written, path);
+    return (int)written;
+}
@@ -0,0 +1,87 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define METRICS_MAX_SSH_CHANNELS 10
+#define METRICS_HISTOGRAM_BUCKETS 32
+
+typedef enum {
+    METRIC_FRAMES_RECEIVED = 0,
+    METRIC_FRAMES_PRESENTED,
+    METRIC_FRAMES_DROPPED,
+    // Updates not presented because the viewer had them scrolled out of view.
+    METRIC_FRAMES_CULLED,
+    METRIC_DAMAGE_PIXELS,
+    METRIC_INPUT_EVENTS,
+    // Pointer shapes found already decoded, and ones that had to be decoded.
+    METRIC_CURSOR_CACHE_HITS,
+    METRIC_CURSOR_CACHE_MISSES,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    METRIC_GAUGE_SSH_CHANNELS_OPEN = 0,
+    METRIC_GAUGE_COUNT
+} MetricGauge;
+
+// Bucket i holds values v with 2^(i-1) <= v < 2^i, bucket 0 holds zero.
+typedef enum {
+    METRIC_HISTOGRAM_CONVERT_US = 0,
+    METRIC_HISTOGRAM_DAMAGE_AREA,
+    METRIC_HISTOGRAM_DECODE_US,
+    METRIC_HISTOGRAM_COUNT
+} MetricHistogram;
+
+typedef struct {
+    uint64_t timestampNs;
+    uint64_t counters[METRIC_COUNTER_COUNT];
+    int64_t gauges[METRIC_GAUGE_COUNT];
+    uint64_t histogramBuckets[METRIC_HISTOGRAM_COUNT][METRICS_HISTOGRAM_BUCKETS];
+    uint64_t histogramCounts[METRIC_HISTOGRAM_COUNT];
+    uint64_t histogramSums[METRIC_HISTOGRAM_COUNT];
+    uint64_t sshBytesIn[METRICS_MAX_SSH_CHANNELS];
+    uint64_t sshBytesOut[METRICS_MAX_SSH_CHANNELS];
+    int64_t sshQueueDepth[METRICS_MAX_SSH_CHANNELS];
+} MetricsSnapshot;
+
+uint64_t metrics_now_ns(void);
+
+void metrics_counter_add(MetricCounter counter, uint64_t value);
+void metrics_gauge_set(MetricGauge gauge, int64_t value);
+void metrics_gauge_add(MetricGauge gauge, int64_t value);
+void metrics_histogram_record(MetricHistogram histogram, uint64_t value);
+void metrics_ssh_channel_bytes(int channel, uint64_t bytesIn, uint64_t bytesOut);
+void metrics_ssh_channel_queue_depth(int channel, int64_t depth);
+
+void metrics_snapshot(MetricsSnapshot *snapshot);
+void metrics_reset(void);
+
+// Trace events are only recorded between metrics_trace_start and the end of
+// its window, into a fixed buffer that is then written as Chrome trace JSON.
+void metrics_trace_start(uint64_t windowMs);
+bool metrics_trace_active(void);
+void metrics_trace_complete(const char *name, uint64_t startNs, uint64_t endNs);
+int metrics_trace_dump(const char *path);
+
+#endif /* Metrics_h */
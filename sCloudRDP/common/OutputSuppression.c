@@ -0,0 +1,142 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "OutputSuppression.h"
+#include "Utility.h"
+
+#include <string.h>
+
+void output_suppression_init(OutputSuppression *suppression, const OutputSuppressionChannel *channel) {
+    memset(suppression, 0, sizeof(*suppression));
+    pthread_mutex_init(&suppression->lock, NULL);
+    suppression->channel = *channel;
+}
+
+void output_suppression_destroy(OutputSuppression *suppression) {
+    pthread_mutex_destroy(&suppression->lock);
+}
+
+static bool suppress(OutputSuppression *suppression) {
+    if (!suppression->channel.suppressOutput(suppression->context, false, NULL)) {
+        client_log("Could not suppress display updates\n");
+        return false;
+    }
+    suppression->suppressed = true;
+    return true;
+}
+
+static bool resume(OutputSuppression *suppression) {
+    OutputRect desktop = { 0, 0, suppression->width, suppression->height };
+    if (!suppression->channel.suppressOutput(suppression->context, true, &desktop)) {
+        client_log("Could not resume display updates\n");
+        return false;
+    }
+    suppression->suppressed = false;
+    // Nothing was sent while suppressed, the visible part is asked for first.
+    OutputRect areas[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS];
+    uint8_t count = output_suppression_refresh_areas(suppression->width, suppression->height,
+                                                     &suppression->viewport, areas);
+    if (count > 0 && !suppression->channel.refreshRect(suppression->context, count, areas)) {
+        client_log("Could not request a refresh after resuming display updates\n");
+    }
+    return true;
+}
+
+void output_suppression_connected(OutputSuppression *suppression, void *context, int32_t width, int32_t height) {
+    pthread_mutex_lock(&suppression->lock);
+    bool resized = width != suppression->width || height != suppression->height;
+    suppression->context = context;
+    suppression->width = width;
+    suppression->height = height;
+    suppression->suppressed = false;
+    if (resized) {
+        suppression->viewport = (OutputRect){ 0, 0, width, height };
+    }
+    if (suppression->hidden) {
+        suppress(suppression);
+    }
+    pthread_mutex_unlock(&suppression->lock);
+}
+
+void output_suppression_disconnected(OutputSuppression *suppression) {
+    pthread_mutex_lock(&suppression->lock);
+    suppression->context = NULL;
+    suppression->suppressed = false;
+    pthread_mutex_unlock(&suppression->lock);
+}
+
+bool output_suppression_set_hidden(OutputSuppression *suppression, bool hidden) {
+    pthread_mutex_lock(&suppression->lock);
+    bool told = suppression->context != NULL;
+    if (told && hidden && !suppression->suppressed) {
+        told = suppress(suppression);
+    } else if (told && !hidden && suppression->suppressed) {
+        told = resume(suppression);
+    }
+    // A caller told that it did not work falls back to something else, like
+    // disconnecting, and must not find the change applied on the next connect.
+    if (told) {
+        suppression->hidden = hidden;
+    }
+    pthread_mutex_unlock(&suppression->lock);
+    return told;
+}
+
+bool output_suppression_hidden(OutputSuppression *suppression) {
+    pthread_mutex_lock(&suppression->lock);
+    bool hidden = suppression->hidden;
+    pthread_mutex_unlock(&suppression->lock);
+    return hidden;
+}
+
+void output_suppression_set_viewport(OutputSuppression *suppression, int32_t x, int32_t y, int32_t width, int32_t height) {
+    pthread_mutex_lock(&suppression->lock);
+    suppression->viewport = (OutputRect){ x, y, width, height };
+    pthread_mutex_unlock(&suppression->lock);
+}
+
+uint8_t output_suppression_refresh_areas(int32_t width, int32_t height, const OutputRect *viewport,
+                                         OutputRect areas[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS]) {
+    if (width <= 0 || height <= 0) {
+        return 0;
+    }
+    int32_t left = viewport->x > 0 ? viewport->x : 0;
+    int32_t top = viewport->y > 0 ? viewport->y : 0;
+    int32_t right = viewport->x + viewport->width < width ? viewport->x + viewport->width : width;
+    int32_t bottom = viewport->y + viewport->height < height ? viewport->y + viewport->height : height;
+    if (left >= right || top >= bottom) {
+        areas[0] = (OutputRect){ 0, 0, width, height };
+        return 1;
+    }
+    uint8_t count = 0;
+    areas[count++] = (OutputRect){ left, top, right - left, bottom - top };
+    if (top > 0) {
+        areas[count++] = (OutputRect){ 0, 0, width, top };
+    }
+    if (bottom < height) {
+        areas[count++] = (OutputRect){ 0, bottom, width, height - bottom };
+    }
+    if (left > 0) {
+        areas[count++] = (OutputRect){ 0, top, left, bottom - top };
+    }
+    if (right < width) {
+        areas[count++] = (OutputRect){ right, top, width - right, bottom - top };
+    }
+    return count;
+}
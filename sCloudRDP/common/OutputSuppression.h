@@ -0,0 +1,77 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef OutputSuppression_h
+#define OutputSuppression_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The viewport first, then the bands of the desktop around it.
+#define OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS 5
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} OutputRect;
+
+// Sends the Suppress Output and Refresh Rect PDUs of the session. area is NULL
+// when display updates are suppressed.
+typedef struct {
+    bool (*suppressOutput)(void *context, bool allowDisplayUpdates, const OutputRect *area);
+    bool (*refreshRect)(void *context, uint8_t count, const OutputRect *areas);
+} OutputSuppressionChannel;
+
+// Tells the server to stop sending display updates while the session is not
+// visible, and to send what changed once it is visible again. Being hidden is
+// remembered across connects, the server forgets about it on every new one.
+typedef struct {
+    pthread_mutex_t lock;
+    OutputSuppressionChannel channel;
+    void *context;
+    bool hidden;
+    // Whether the server was last told to stop sending updates.
+    bool suppressed;
+    int32_t width;
+    int32_t height;
+    OutputRect viewport;
+} OutputSuppression;
+
+void output_suppression_init(OutputSuppression *suppression, const OutputSuppressionChannel *channel);
+void output_suppression_destroy(OutputSuppression *suppression);
+
+// The server starts every connection sending updates for a desktop of this size.
+void output_suppression_connected(OutputSuppression *suppression, void *context, int32_t width, int32_t height);
+void output_suppression_disconnected(OutputSuppression *suppression);
+
+// Returns false when there is no connection to tell or the server could not
+// be told, the previous state is kept then.
+bool output_suppression_set_hidden(OutputSuppression *suppression, bool hidden);
+bool output_suppression_hidden(OutputSuppression *suppression);
+// The part of the desktop refreshed first when resuming.
+void output_suppression_set_viewport(OutputSuppression *suppression, int32_t x, int32_t y, int32_t width, int32_t height);
+
+// Splits the desktop into the viewport followed by the bands around it, returns how many there are.
+uint8_t output_suppression_refresh_areas(int32_t width, int32_t height, const OutputRect *viewport,
+                                         OutputRect areas[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS]);
+
+#endif /* OutputSuppression_h */
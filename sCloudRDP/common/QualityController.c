@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "QualityController.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define EWMA_WEIGHT 0.3
+#define DOWNGRADE_AFTER_NS 2000000000ULL
+#define UPGRADE_AFTER_NS 10000000000ULL
+
+#define WEAK_DEVICE_CORES 2
+#define WEAK_DEVICE_MEMORY (2560ULL * 1024 * 1024)
+#define CONSTRAINED_BANDWIDTH_KBPS 1500.0
+#define CONSTRAINED_RTT_MS 150.0
+#define EXPENSIVE_FRAME_MS 50.0
+#define FAST_BANDWIDTH_KBPS 20000.0
+#define FAST_RTT_MS 30.0
+#define CHEAP_FRAME_MS 15.0
+#define FAST_DEVICE_CORES 6
+#define RESPONSIVE_DECODE_THREADS 2
+#define BALANCED_DECODE_THREADS 4
+#define MAX_DECODE_THREADS 8
+
+#define HISTORY_ENTRIES 16
+#define HISTORY_HOST_LENGTH 256
+
+typedef struct {
+    char host[HISTORY_HOST_LENGTH];
+    double bandwidthKbps;
+    double rttMs;
+    double frameCostMs;
+    uint64_t lastUsed;
+} HistoryEntry;
+
+static HistoryEntry history[HISTORY_ENTRIES];
+static uint64_t historyClock = 0;
+static pthread_mutex_t historyLock = PTHREAD_MUTEX_INITIALIZER;
+
+static double ewma(double current, double sample) {
+    if (current < 0) {
+        return sample;
+    }
+    return current + EWMA_WEIGHT * (sample - current);
+}
+
+static bool is_weak_device(const DeviceCapabilities *device) {
+    return device->cpuCores <= WEAK_DEVICE_CORES || device->memoryBytes < WEAK_DEVICE_MEMORY;
+}
+
+static SessionProfile classify(const QualityController *qc) {
+    if (is_weak_device(&qc->device)) {
+        return SESSION_PROFILE_RESPONSIVE;
+    }
+    if ((qc->bandwidthKbps >= 0 && qc->bandwidthKbps < CONSTRAINED_BANDWIDTH_KBPS) ||
+        qc->rttMs > CONSTRAINED_RTT_MS || qc->frameCostMs > EXPENSIVE_FRAME_MS) {
+        return SESSION_PROFILE_RESPONSIVE;
+    }
+    if (qc->bandwidthKbps >= FAST_BANDWIDTH_KBPS && qc->rttMs >= 0 && qc->rttMs <= FAST_RTT_MS &&
+        qc->frameCostMs < CHEAP_FRAME_MS && qc->device.cpuCores >= FAST_DEVICE_CORES) {
+        return SESSION_PROFILE_QUALITY;
+    }
+    return SESSION_PROFILE_BALANCED;
+}
+
+static int decode_threads_up_to(int limit, const DeviceCapabilities *device) {
+    int cores = device->performanceCores > 0 ? device->performanceCores : device->cpuCores;
+    if (cores > limit) {
+        return limit;
+    }
+    return cores > 1 ? cores : 1;
+}
+
+static QualityDecision decision_for(SessionProfile profile, const DeviceCapabilities *device) {
+    QualityDecision decision;
+    decision.profile = profile;
+    switch (profile) {
+        case SESSION_PROFILE_RESPONSIVE:
+            // RemoteFX tiles are expensive to decode and large on the wire,
+            // planar and progressive through GFX do better here.
+            decision.remoteFx = false;
+            decision.gfxH264 = false;
+            decision.colorDepth = 16;
+            decision.jpegQuality = 50;
+            decision.audioQuality = AUDIO_QUALITY_MEDIUM;
+            // Updates are small here, handing off tiles costs more than it saves on weak devices.
+            decision.decodeThreads = is_weak_device(device) ? 1 : decode_threads_up_to(RESPONSIVE_DECODE_THREADS, device);
+            decision.frameIntervalMs = 66;
+            break;
+        case SESSION_PROFILE_QUALITY:
+            decision.remoteFx = true;
+            decision.gfxH264 = device->h264Available;
+            decision.colorDepth = 32;
+            decision.jpegQuality = 85;
+            decision.audioQuality = AUDIO_QUALITY_HIGH;
+            decision.decodeThreads = decode_threads_up_to(MAX_DECODE_THREADS, device);
+            decision.frameIntervalMs = 16;
+            break;
+        case SESSION_PROFILE_BALANCED:
+        default:
+            decision.remoteFx = true;
+            decision.gfxH264 = device->h264Available;
+            decision.colorDepth = 32;
+            decision.jpegQuality = 70;
+            decision.audioQuality = AUDIO_QUALITY_DYNAMIC;
+            decision.decodeThreads = decode_threads_up_to(BALANCED_DECODE_THREADS, device);
+            decision.frameIntervalMs = 33;
+            break;
+    }
+    return decision;
+}
+
+void quality_controller_init(QualityController *qc, const DeviceCapabilities *device) {
+    memset(qc, 0, sizeof(QualityController));
+    qc->device = *device;
+    qc->bandwidthKbps = -1;
+    qc->rttMs = -1;
+    qc->frameCostMs = -1;
+    qc->current = decision_for(SESSION_PROFILE_BALANCED, device);
+    qc->candidate = qc->current.profile;
+}
+
+void quality_controller_seed_from_history(QualityController *qc, const char *host) {
+    if (host == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&historyLock);
+    for (int i = 0; i < HISTORY_ENTRIES; i++) {
+        if (history[i].lastUsed != 0 && strncmp(history[i].host, host, HISTORY_HOST_LENGTH) == 0) {
+            qc->bandwidthKbps = history[i].bandwidthKbps;
+            qc->rttMs = history[i].rttMs;
+            qc->frameCostMs = history[i].frameCostMs;
+            history[i].lastUsed = ++historyClock;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&historyLock);
+}
+
+void quality_controller_save_history(const QualityController *qc, const char *host) {
+    if (host == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&historyLock);
+    HistoryEntry *entry = &history[0];
+    for (int i = 0; i < HISTORY_ENTRIES; i++) {
+        if (history[i].lastUsed != 0 && strncmp(history[i].host, host, HISTORY_HOST_LENGTH) == 0) {
+            entry = &history[i];
+            break;
+        }
+        if (history[i].lastUsed < entry->lastUsed) {
+            entry = &history[i];
+        }
+    }
+    strncpy(entry->host, host, HISTORY_HOST_LENGTH - 1);
+    entry->host[HISTORY_HOST_LENGTH - 1] = '\0';
+    entry->bandwidthKbps = qc->bandwidthKbps;
+    entry->rttMs = qc->rttMs;
+    entry->frameCostMs = qc->frameCostMs;
+    entry->lastUsed = ++historyClock;
+    pthread_mutex_unlock(&historyLock);
+}
+
+QualityDecision quality_controller_connect_decision(QualityController *qc) {
+    qc->current = decision_for(classify(qc), &qc->device);
+    qc->candidate = qc->current.profile;
+    qc->candidateSinceNs = 0;
+    return qc->current;
+}
+
+void quality_controller_report_network(QualityController *qc, double bandwidthKbps, double rttMs) {
+    if (bandwidthKbps > 0) {
+        qc->bandwidthKbps = ewma(qc->bandwidthKbps, bandwidthKbps);
+    }
+    if (rttMs > 0) {
+        qc->rttMs = ewma(qc->rttMs, rttMs);
+    }
+}
+
+void quality_controller_report_frame_cost(QualityController *qc, double frameCostMs) {
+    if (frameCostMs >= 0) {
+        qc->frameCostMs = ewma(qc->frameCostMs, frameCostMs);
+    }
+}
+
+bool quality_controller_update(QualityController *qc, uint64_t nowNs, QualityDecision *decision) {
+    SessionProfile target = classify(qc);
+    if (target == qc->current.profile) {
+        qc->candidate = target;
+        qc->candidateSinceNs = 0;
+        return false;
+    }
+    if (target != qc->candidate || qc->candidateSinceNs == 0) {
+        qc->candidate = target;
+        qc->candidateSinceNs = nowNs;
+        return false;
+    }
+
+    // Step down quickly when the link or the device struggles, step up slowly.
+    uint64_t hold = target < qc->current.profile ? DOWNGRADE_AFTER_NS : UPGRADE_AFTER_NS;
+    if (nowNs - qc->candidateSinceNs < hold) {
+        return false;
+    }
+
+    // Codecs and color depth are negotiated at connect time and stay fixed.
+    QualityDecision next = decision_for(target, &qc->device);
+    qc->current.profile = next.profile;
+    qc->current.frameIntervalMs = next.frameIntervalMs;
+    qc->candidateSinceNs = 0;
+    *decision = qc->current;
+    return true;
+}
+
+const char *quality_controller_profile_name(SessionProfile profile) {
+    switch (profile) {
+        case SESSION_PROFILE_RESPONSIVE:
+            return "responsive";
+        case SESSION_PROFILE_QUALITY:
+            return "quality";
+        case SESSION_PROFILE_BALANCED:
+        default:
+            return "balanced";
+    }
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef QualityController_h
+#define QualityController_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    SESSION_PROFILE_RESPONSIVE = 0,
+    SESSION_PROFILE_BALANCED,
+    SESSION_PROFILE_QUALITY
+} SessionProfile;
+
+// Values of the rdpsnd Quality Mode PDU. Below high, servers favour the
+// compressed formats the client advertises.
+typedef enum {
+    AUDIO_QUALITY_DYNAMIC = 0,
+    AUDIO_QUALITY_MEDIUM,
+    AUDIO_QUALITY_HIGH
+} AudioQualityMode;
+
+typedef struct {
+    int cpuCores;
+    // Cores of the fastest kind, efficiency cores only hold up a parallel decode.
+    int performanceCores;
+    uint64_t memoryBytes;
+    bool h264Available;
+} DeviceCapabilities;
+
+typedef struct {
+    SessionProfile profile;
+    bool remoteFx;
+    bool gfxH264;
+    int colorDepth;
+    int jpegQuality;
+    AudioQualityMode audioQuality;
+    // Workers decoding the tiles of one RemoteFX or progressive update, 1 decodes
+    // on the session thread. Fixed once the codecs are set up at connect time.
+    int decodeThreads;
+    // Client side presentation pacing, the only knob that can change mid-session.
+    int frameIntervalMs;
+} QualityDecision;
+
+typedef struct {
+    DeviceCapabilities device;
+    // Exponentially weighted estimates, negative until the first sample.
+    double bandwidthKbps;
+    double rttMs;
+    double frameCostMs;
+    QualityDecision current;
+    SessionProfile candidate;
+    uint64_t candidateSinceNs;
+} QualityController;
+
+void quality_controller_init(QualityController *qc, const DeviceCapabilities *device);
+void quality_controller_seed_from_history(QualityController *qc, const char *host);
+void quality_controller_save_history(const QualityController *qc, const char *host);
+QualityDecision quality_controller_connect_decision(QualityController *qc);
+
+void quality_controller_report_network(QualityController *qc, double bandwidthKbps, double rttMs);
+void quality_controller_report_frame_cost(QualityController *qc, double frameCostMs);
+// Returns true when the in-session decision changed and stores it in decision.
+bool quality_controller_update(QualityController *qc, uint64_t nowNs, QualityDecision *decision);
+
+const char *quality_controller_profile_name(SessionProfile profile);
+
+#endif /* QualityController_h */
@@ -0,0 +1,538 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ReachabilityProber.h"
+#include "Metrics.h"
+#include "Utility.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define PROBER_HOST_SIZE 256
+#define PROBER_PORT_SIZE 16
+
+typedef struct {
+    struct sockaddr_storage address;
+    socklen_t length;
+    ReachabilityState state;
+    uint32_t rttUs;
+} ProbeAddress;
+
+typedef struct {
+    bool used;
+    bool probing;
+    ReachabilityState state;
+    uint32_t rttUs;
+    // Zero until the first probe completes.
+    uint64_t checkedNs;
+    uint64_t watchedNs;
+    char host[PROBER_HOST_SIZE];
+    char port[PROBER_PORT_SIZE];
+    int addressCount;
+    ProbeAddress addresses[REACHABILITY_PROBER_MAX_ADDRESSES];
+} ProbeTarget;
+
+// A copy the loop works on without holding the lock.
+typedef struct {
+    int index;
+    char host[PROBER_HOST_SIZE];
+    char port[PROBER_PORT_SIZE];
+    int addressCount;
+    ProbeAddress addresses[REACHABILITY_PROBER_MAX_ADDRESSES];
+} ProbeWork;
+
+typedef struct {
+    int fd;
+    ProbeAddress *address;
+    uint64_t startedNs;
+} ProbeSlot;
+
+// The names of one round. Resolvers still stuck in getaddrinfo at the deadline
+// keep it alive, the last one to let go frees it.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    int references;
+    int count;
+    int next;
+    int finished;
+    bool abandoned;
+    bool resolved[REACHABILITY_PROBER_MAX_TARGETS];
+    ProbeWork work[REACHABILITY_PROBER_MAX_TARGETS];
+} ResolveRound;
+
+static ProbeTarget targets[REACHABILITY_PROBER_MAX_TARGETS];
+static pthread_mutex_t proberLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t proberChanged = PTHREAD_COND_INITIALIZER;
+static bool active = false;
+static bool running = false;
+static uint64_t ttlNs = (uint64_t)REACHABILITY_PROBER_DEFAULT_TTL_MS * 1000000ULL;
+static uint32_t version = 0;
+static int resolversRunning = 0;
+
+static int find_target(const char *host, const char *port) {
+    for (int i = 0; i < REACHABILITY_PROBER_MAX_TARGETS; i++) {
+        if (targets[i].used && strcmp(targets[i].host, host) == 0 && strcmp(targets[i].port, port) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool is_due(const ProbeTarget *target, uint64_t now) {
+    return target->used && !target->probing && (target->checkedNs == 0 || now - target->checkedNs >= ttlNs);
+}
+
+// Condition variables wait on the wall clock, so convert the monotonic deadline.
+static void wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t deadlineNs) {
+    uint64_t now = metrics_now_ns();
+    if (deadlineNs <= now) {
+        return;
+    }
+    uint64_t remainingNs = deadlineNs - now;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    uint64_t nsec = (uint64_t)tv.tv_usec * 1000ULL + remainingNs % 1000000000ULL;
+    struct timespec abstime;
+    abstime.tv_sec = tv.tv_sec + (time_t)(remainingNs / 1000000000ULL) + (time_t)(nsec / 1000000000ULL);
+    abstime.tv_nsec = (long)(nsec % 1000000000ULL);
+    pthread_cond_timedwait(cond, mutex, &abstime);
+}
+
+static void resolve(ProbeWork *work) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    struct addrinfo *result = NULL;
+    int rc = getaddrinfo(work->host, work->port, &hints, &result);
+    if (rc != 0) {
+        CLIENT_LOG_DEBUG("Reachability could not resolve %s: %s\n", work->host, gai_strerror(rc));
+        return;
+    }
+    for (struct addrinfo *ai = result; ai != NULL && work->addressCount < REACHABILITY_PROBER_MAX_ADDRESSES; ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(struct sockaddr_storage)) {
+            continue;
+        }
+        ProbeAddress *address = &work->addresses[work->addressCount++];
+        memcpy(&address->address, ai->ai_addr, ai->ai_addrlen);
+        address->length = ai->ai_addrlen;
+        address->state = REACHABILITY_UNREACHABLE;
+    }
+    freeaddrinfo(result);
+}
+
+static void release_round(ResolveRound *round) {
+    pthread_mutex_lock(&round->lock);
+    bool last = --round->references == 0;
+    pthread_mutex_unlock(&round->lock);
+    if (last) {
+        pthread_mutex_destroy(&round->lock);
+        pthread_cond_destroy(&round->changed);
+        free(round);
+    }
+}
+
+static void *resolver_thread(void *arg) {
+    ResolveRound *round = arg;
+    pthread_mutex_lock(&round->lock);
+    while (!round->abandoned && round->next < round->count) {
+        int i = round->next++;
+        pthread_mutex_unlock(&round->lock);
+        // Only this thread touches the entry until it is marked resolved.
+        resolve(&round->work[i]);
+        pthread_mutex_lock(&round->lock);
+        round->resolved[i] = true;
+        round->finished++;
+        pthread_cond_signal(&round->changed);
+    }
+    pthread_mutex_unlock(&round->lock);
+    __atomic_sub_fetch(&resolversRunning, 1, __ATOMIC_RELAXED);
+    release_round(round);
+    return NULL;
+}
+
+// Resolves the names of the round on a few threads until the deadline. Names
+// that did not resolve in time keep no addresses, so they are unreachable.
+static void resolve_all(ProbeWork *work, int workCount) {
+    ResolveRound *round = calloc(1, sizeof(ResolveRound));
+    if (round == NULL) {
+        return;
+    }
+    pthread_mutex_init(&round->lock, NULL);
+    pthread_cond_init(&round->changed, NULL);
+    round->references = 1;
+    round->count = workCount;
+    for (int i = 0; i < workCount; i++) {
+        memcpy(round->work[i].host, work[i].host, sizeof(work[i].host));
+        memcpy(round->work[i].port, work[i].port, sizeof(work[i].port));
+    }
+
+    // Resolvers stuck from earlier rounds count toward the limit.
+    int wanted = workCount < REACHABILITY_PROBER_MAX_RESOLVERS ? workCount : REACHABILITY_PROBER_MAX_RESOLVERS;
+    int started = 0;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < wanted; i++) {
+        if (__atomic_add_fetch(&resolversRunning, 1, __ATOMIC_RELAXED) > REACHABILITY_PROBER_MAX_RESOLVERS) {
+            __atomic_sub_fetch(&resolversRunning, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        pthread_mutex_lock(&round->lock);
+        round->references++;
+        pthread_mutex_unlock(&round->lock);
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, resolver_thread, round) != 0) {
+            __atomic_sub_fetch(&resolversRunning, 1, __ATOMIC_RELAXED);
+            release_round(round);
+            break;
+        }
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    uint64_t deadlineNs = metrics_now_ns() + (uint64_t)REACHABILITY_PROBER_RESOLVE_TIMEOUT_MS * 1000000ULL;
+    pthread_mutex_lock(&round->lock);
+    while (started > 0 && round->finished < round->count && metrics_now_ns() < deadlineNs) {
+        wait_until(&round->changed, &round->lock, deadlineNs);
+    }
+    round->abandoned = true;
+    for (int i = 0; i < workCount; i++) {
+        if (round->resolved[i]) {
+            work[i].addressCount = round->work[i].addressCount;
+            memcpy(work[i].addresses, round->work[i].addresses, sizeof(work[i].addresses));
+        } else {
+            CLIENT_LOG_DEBUG("Reachability did not resolve %s in time\n", work[i].host);
+        }
+    }
+    pthread_mutex_unlock(&round->lock);
+    release_round(round);
+}
+
+static void finish_probe(ProbeSlot *slot, int error) {
+    if (error == 0) {
+        slot->address->state = REACHABILITY_REACHABLE;
+        slot->address->rttUs = (uint32_t)((metrics_now_ns() - slot->startedNs) / 1000ULL);
+    } else {
+        slot->address->state = error == ECONNREFUSED ? REACHABILITY_REFUSED : REACHABILITY_UNREACHABLE;
+    }
+    close(slot->fd);
+    slot->fd = -1;
+}
+
+// Returns false when the connect already finished one way or the other.
+static bool start_probe(ProbeSlot *slot, ProbeAddress *address) {
+    slot->address = address;
+    slot->fd = socket(address->address.ss_family, SOCK_STREAM, 0);
+    if (slot->fd < 0) {
+        address->state = REACHABILITY_UNREACHABLE;
+        return false;
+    }
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(slot->fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    fcntl(slot->fd, F_SETFL, fcntl(slot->fd, F_GETFL, 0) | O_NONBLOCK);
+    slot->startedNs = metrics_now_ns();
+    if (connect(slot->fd, (struct sockaddr *)&address->address, address->length) == 0) {
+        finish_probe(slot, 0);
+        return false;
+    }
+    if (errno != EINPROGRESS) {
+        finish_probe(slot, errno);
+        return false;
+    }
+    return true;
+}
+
+// Runs the connects of all addresses of all targets in the round on one poll
+// loop, so a round takes about one connect timeout however many targets there are.
+static void probe_all(ProbeWork *work, int workCount) {
+    ProbeSlot slots[REACHABILITY_PROBER_MAX_IN_FLIGHT];
+    struct pollfd pfds[REACHABILITY_PROBER_MAX_IN_FLIGHT];
+    int inFlight = 0;
+    int nextWork = 0;
+    int nextAddress = 0;
+    uint64_t timeoutNs = (uint64_t)REACHABILITY_PROBER_CONNECT_TIMEOUT_MS * 1000000ULL;
+    while (true) {
+        while (inFlight < REACHABILITY_PROBER_MAX_IN_FLIGHT && nextWork < workCount) {
+            if (nextAddress >= work[nextWork].addressCount) {
+                nextWork++;
+                nextAddress = 0;
+                continue;
+            }
+            if (start_probe(&slots[inFlight], &work[nextWork].addresses[nextAddress++])) {
+                inFlight++;
+            }
+        }
+        if (inFlight == 0) {
+            return;
+        }
+
+        uint64_t now = metrics_now_ns();
+        uint64_t earliestNs = UINT64_MAX;
+        for (int i = 0; i < inFlight; i++) {
+            pfds[i].fd = slots[i].fd;
+            pfds[i].events = POLLOUT;
+            pfds[i].revents = 0;
+            if (slots[i].startedNs + timeoutNs < earliestNs) {
+                earliestNs = slots[i].startedNs + timeoutNs;
+            }
+        }
+        int waitMs = earliestNs > now ? (int)((earliestNs - now + 999999ULL) / 1000000ULL) : 0;
+        // On failure no revents are set and only the deadlines below apply.
+        poll(pfds, (nfds_t)inFlight, waitMs);
+
+        now = metrics_now_ns();
+        for (int i = 0; i < inFlight; i++) {
+            if (pfds[i].revents != 0) {
+                int error = 0;
+                socklen_t length = sizeof(error);
+                if (getsockopt(slots[i].fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0) {
+                    error = errno;
+                }
+                finish_probe(&slots[i], error);
+            } else if (now >= slots[i].startedNs + timeoutNs) {
+                finish_probe(&slots[i], ETIMEDOUT);
+            }
+        }
+        int kept = 0;
+        for (int i = 0; i < inFlight; i++) {
+            if (slots[i].fd >= 0) {
+                slots[kept++] = slots[i];
+            }
+        }
+        inFlight = kept;
+    }
+}
+
+// Called with proberLock held.
+static void store_result(const ProbeWork *work, uint64_t now) {
+    ProbeTarget *target = &targets[work->index];
+    if (!target->used || strcmp(target->host, work->host) != 0 || strcmp(target->port, work->port) != 0) {
+        return;
+    }
+    target->probing = false;
+    target->checkedNs = now;
+    target->state = REACHABILITY_UNREACHABLE;
+    target->rttUs = 0;
+    target->addressCount = work->addressCount;
+    memcpy(target->addresses, work->addresses, sizeof(target->addresses));
+    for (int i = 0; i < work->addressCount; i++) {
+        const ProbeAddress *address = &work->addresses[i];
+        if (address->state == REACHABILITY_REACHABLE) {
+            if (target->state != REACHABILITY_REACHABLE || address->rttUs < target->rttUs) {
+                target->rttUs = address->rttUs;
+            }
+            target->state = REACHABILITY_REACHABLE;
+        } else if (address->state == REACHABILITY_REFUSED && target->state == REACHABILITY_UNREACHABLE) {
+            target->state = REACHABILITY_REFUSED;
+        }
+    }
+}
+
+static void *prober_thread(void *arg) {
+    (void)arg;
+    // Large enough for every target, kept off the small stack of a secondary thread.
+    static ProbeWork work[REACHABILITY_PROBER_MAX_TARGETS];
+    pthread_mutex_lock(&proberLock);
+    while (active) {
+        uint64_t now = metrics_now_ns();
+        uint64_t nextDueNs = UINT64_MAX;
+        int workCount = 0;
+        for (int i = 0; i < REACHABILITY_PROBER_MAX_TARGETS; i++) {
+            ProbeTarget *target = &targets[i];
+            if (is_due(target, now)) {
+                target->probing = true;
+                ProbeWork *item = &work[workCount++];
+                memset(item, 0, sizeof(*item));
+                item->index = i;
+                memcpy(item->host, target->host, sizeof(item->host));
+                memcpy(item->port, target->port, sizeof(item->port));
+            } else if (target->used && !target->probing && target->checkedNs + ttlNs < nextDueNs) {
+                nextDueNs = target->checkedNs + ttlNs;
+            }
+        }
+        if (workCount == 0) {
+            if (nextDueNs == UINT64_MAX) {
+                pthread_cond_wait(&proberChanged, &proberLock);
+            } else {
+                wait_until(&proberChanged, &proberLock, nextDueNs);
+            }
+            continue;
+        }
+        version++;
+        pthread_mutex_unlock(&proberLock);
+
+        uint64_t startedNs = metrics_now_ns();
+        resolve_all(work, workCount);
+        probe_all(work, workCount);
+
+        pthread_mutex_lock(&proberLock);
+        now = metrics_now_ns();
+        for (int i = 0; i < workCount; i++) {
+            store_result(&work[i], now);
+        }
+        version++;
+        CLIENT_LOG_DEBUG("Reachability probed %d targets in %llu ms\n", workCount,
+                         (unsigned long long)((now - startedNs) / 1000000ULL));
+        pthread_cond_broadcast(&proberChanged);
+    }
+    running = false;
+    pthread_cond_broadcast(&proberChanged);
+    pthread_mutex_unlock(&proberLock);
+    return NULL;
+}
+
+void reachability_prober_start(uint32_t ttlMs) {
+    pthread_mutex_lock(&proberLock);
+    ttlNs = (uint64_t)ttlMs * 1000000ULL;
+    active = true;
+    if (!running) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        running = pthread_create(&thread, &attr, prober_thread, NULL) == 0;
+        pthread_attr_destroy(&attr);
+        active = running;
+    }
+    pthread_cond_broadcast(&proberChanged);
+    pthread_mutex_unlock(&proberLock);
+}
+
+void reachability_prober_stop(void) {
+    pthread_mutex_lock(&proberLock);
+    active = false;
+    pthread_cond_broadcast(&proberChanged);
+    pthread_mutex_unlock(&proberLock);
+}
+
+bool reachability_prober_watch(const char *host, const char *port) {
+    if (host == NULL || port == NULL || host[0] == '\0' ||
+        strlen(host) >= PROBER_HOST_SIZE || strlen(port) >= PROBER_PORT_SIZE) {
+        return false;
+    }
+    uint64_t now = metrics_now_ns();
+    pthread_mutex_lock(&proberLock);
+    int index = find_target(host, port);
+    if (index < 0) {
+        for (int i = 0; i < REACHABILITY_PROBER_MAX_TARGETS; i++) {
+            ProbeTarget *target = &targets[i];
+            if (!target->used) {
+                index = i;
+                break;
+            }
+            if (!target->probing && (index < 0 || target->watchedNs < targets[index].watchedNs)) {
+                index = i;
+            }
+        }
+        if (index >= 0) {
+            ProbeTarget *target = &targets[index];
+            memset(target, 0, sizeof(*target));
+            target->used = true;
+            strcpy(target->host, host);
+            strcpy(target->port, port);
+            pthread_cond_broadcast(&proberChanged);
+        }
+    }
+    if (index >= 0) {
+        targets[index].watchedNs = now;
+    }
+    pthread_mutex_unlock(&proberLock);
+    return index >= 0;
+}
+
+bool reachability_prober_lookup(const char *host, const char *port, ReachabilityResult *result) {
+    if (host == NULL || port == NULL || result == NULL) {
+        return false;
+    }
+    uint64_t now = metrics_now_ns();
+    pthread_mutex_lock(&proberLock);
+    int index = find_target(host, port);
+    if (index >= 0) {
+        const ProbeTarget *target = &targets[index];
+        result->state = target->checkedNs != 0 ? target->state : REACHABILITY_UNKNOWN;
+        result->probing = target->probing;
+        result->rttUs = target->rttUs;
+        result->ageMs = target->checkedNs != 0 ? (uint32_t)((now - target->checkedNs) / 1000000ULL) : 0;
+    }
+    pthread_mutex_unlock(&proberLock);
+    return index >= 0;
+}
+
+uint32_t reachability_prober_version(void) {
+    pthread_mutex_lock(&proberLock);
+    uint32_t current = version;
+    pthread_mutex_unlock(&proberLock);
+    return current;
+}
+
+static bool same_address(const struct sockaddr *a, const struct sockaddr *b) {
+    if (a->sa_family != b->sa_family) {
+        return false;
+    }
+    if (a->sa_family == AF_INET) {
+        const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+        const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+        return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+    }
+    if (a->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+        const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+        return a6->sin6_port == b6->sin6_port && a6->sin6_scope_id == b6->sin6_scope_id &&
+               memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+    }
+    return false;
+}
+
+bool reachability_prober_address_dead(const struct sockaddr *address, socklen_t length) {
+    if (address == NULL || length > sizeof(struct sockaddr_storage)) {
+        return false;
+    }
+    bool dead = false;
+    uint64_t now = metrics_now_ns();
+    pthread_mutex_lock(&proberLock);
+    for (int i = 0; i < REACHABILITY_PROBER_MAX_TARGETS && !dead; i++) {
+        const ProbeTarget *target = &targets[i];
+        if (!target->used || target->checkedNs == 0 || now - target->checkedNs >= ttlNs) {
+            continue;
+        }
+        for (int j = 0; j < target->addressCount; j++) {
+            const ProbeAddress *probed = &target->addresses[j];
+            if (same_address((const struct sockaddr *)&probed->address, address)) {
+                dead = probed->state != REACHABILITY_REACHABLE;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&proberLock);
+    return dead;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#ifndef ReachabilityProber_h
+#define ReachabilityProber_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define REACHABILITY_PROBER_MAX_TARGETS 64
+// Addresses probed per target, the first ones getaddrinfo returns.
+#define REACHABILITY_PROBER_MAX_ADDRESSES 4
+#define REACHABILITY_PROBER_MAX_IN_FLIGHT 8
+#define REACHABILITY_PROBER_CONNECT_TIMEOUT_MS 1500
+// getaddrinfo cannot be cancelled, so names are resolved on up to this many
+// threads and a name not resolved by the deadline is unreachable for the round.
+#define REACHABILITY_PROBER_MAX_RESOLVERS 4
+#define REACHABILITY_PROBER_RESOLVE_TIMEOUT_MS 2000
+#define REACHABILITY_PROBER_DEFAULT_TTL_MS 60000
+
+typedef enum {
+    REACHABILITY_UNKNOWN = 0,
+    REACHABILITY_REACHABLE,
+    // The host answered but nothing listens on the port.
+    REACHABILITY_REFUSED,
+    // No answer before the deadline, or the name did not resolve.
+    REACHABILITY_UNREACHABLE
+} ReachabilityState;
+
+typedef struct {
+    ReachabilityState state;
+    // Set while a probe of the target is under way, state is the previous result.
+    bool probing;
+    // Fastest TCP handshake among the addresses of a reachable target.
+    uint32_t rttUs;
+    uint32_t ageMs;
+} ReachabilityResult;
+
+// Probes every watched host and port with non-blocking TCP connects from one
+// background thread, at most REACHABILITY_PROBER_MAX_IN_FLIGHT at a time, and
+// probes each one again once its result is older than ttlMs. Nothing is sent
+// over the connections, they are closed as soon as the handshake completes.
+void reachability_prober_start(uint32_t ttlMs);
+// The current round still finishes, results are kept.
+void reachability_prober_stop(void);
+
+// Adds a target, the least recently watched one makes room when all are taken.
+bool reachability_prober_watch(const char *host, const char *port);
+// Returns false when host and port are not watched.
+bool reachability_prober_lookup(const char *host, const char *port, ReachabilityResult *result);
+// Bumped whenever results change, to refresh whatever shows them.
+uint32_t reachability_prober_version(void);
+
+// True if the latest probe within the TTL found nothing accepting connections
+// at this address, so connecting can try the other addresses first.
+bool reachability_prober_address_dead(const struct sockaddr *address, socklen_t length);
+
+#endif /* ReachabilityProber_h */
@@ -0,0 +1,89 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ReconnectPolicy.h"
+
+#include <string.h>
+
+void reconnect_policy_init(ReconnectPolicy *policy, uint32_t maxAttempts, uint64_t initialDelayNs,
+                           uint64_t maxDelayNs, uint64_t budgetNs, uint32_t seed) {
+    memset(policy, 0, sizeof(*policy));
+    policy->maxAttempts = maxAttempts;
+    policy->initialDelayNs = initialDelayNs;
+    policy->maxDelayNs = maxDelayNs > initialDelayNs ? maxDelayNs : initialDelayNs;
+    policy->budgetNs = budgetNs;
+    policy->random = seed;
+}
+
+void reconnect_policy_begin(ReconnectPolicy *policy, uint64_t nowNs) {
+    policy->state = RECONNECT_RETRYING;
+    policy->attempts = 0;
+    policy->startedNs = nowNs;
+    policy->delayNs = 0;
+    if (policy->random == 0) {
+        // Unseeded, the time of the drop differs enough between clients.
+        policy->random = (uint32_t)(nowNs ^ (nowNs >> 32)) | 1;
+    }
+}
+
+static uint32_t next_random(ReconnectPolicy *policy) {
+    uint32_t x = policy->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    policy->random = x;
+    return x;
+}
+
+int64_t reconnect_policy_next_delay(ReconnectPolicy *policy, uint64_t nowNs) {
+    if (policy->state != RECONNECT_RETRYING) {
+        return -1;
+    }
+    uint64_t elapsedNs = nowNs > policy->startedNs ? nowNs - policy->startedNs : 0;
+    if (policy->attempts >= policy->maxAttempts || elapsedNs >= policy->budgetNs) {
+        policy->state = RECONNECT_GAVE_UP;
+        return -1;
+    }
+    uint64_t delayNs = 0;
+    if (policy->attempts > 0) {
+        policy->delayNs = policy->delayNs == 0 ? policy->initialDelayNs : policy->delayNs * 2;
+        if (policy->delayNs > policy->maxDelayNs) {
+            policy->delayNs = policy->maxDelayNs;
+        }
+        // Anywhere from three quarters to the whole delay.
+        uint64_t jitterNs = policy->delayNs / 4;
+        delayNs = policy->delayNs - (jitterNs > 0 ? next_random(policy) % (jitterNs + 1) : 0);
+    }
+    if (elapsedNs + delayNs >= policy->budgetNs) {
+        // Waiting that long would end past the budget, make a last attempt at its end.
+        delayNs = policy->budgetNs - elapsedNs;
+        policy->attempts = policy->maxAttempts - 1;
+    }
+    policy->attempts++;
+    return (int64_t)delayNs;
+}
+
+void reconnect_policy_succeeded(ReconnectPolicy *policy) {
+    policy->state = RECONNECT_IDLE;
+}
+
+void reconnect_policy_give_up(ReconnectPolicy *policy) {
+    policy->state = RECONNECT_GAVE_UP;
+}
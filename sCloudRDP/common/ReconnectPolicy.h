@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#ifndef ReconnectPolicy_h
+#define ReconnectPolicy_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RECONNECT_POLICY_DEFAULT_MAX_ATTEMPTS 8
+#define RECONNECT_POLICY_DEFAULT_INITIAL_DELAY_NS 250000000ULL
+#define RECONNECT_POLICY_DEFAULT_MAX_DELAY_NS 4000000000ULL
+// Past this the server may have logged the session off, a fresh logon is better.
+#define RECONNECT_POLICY_DEFAULT_BUDGET_NS 30000000000ULL
+
+typedef enum {
+    RECONNECT_IDLE = 0,
+    RECONNECT_RETRYING,
+    RECONNECT_GAVE_UP
+} ReconnectState;
+
+// When to retry a dropped connection. The first attempt follows right away,
+// since most drops are a blip or a network handoff, then the delay doubles up
+// to maxDelayNs with some jitter so that clients behind the same failed link
+// do not all come back at once. Only used from the session thread.
+typedef struct {
+    uint32_t maxAttempts;
+    uint64_t initialDelayNs;
+    uint64_t maxDelayNs;
+    uint64_t budgetNs;
+    ReconnectState state;
+    uint32_t attempts;
+    uint64_t startedNs;
+    uint64_t delayNs;
+    uint32_t random;
+} ReconnectPolicy;
+
+// A seed of zero seeds the jitter from the time of the first drop.
+void reconnect_policy_init(ReconnectPolicy *policy, uint32_t maxAttempts, uint64_t initialDelayNs,
+                           uint64_t maxDelayNs, uint64_t budgetNs, uint32_t seed);
+
+// The connection dropped, starts counting attempts and the time budget.
+void reconnect_policy_begin(ReconnectPolicy *policy, uint64_t nowNs);
+// Returns how long to wait before the next attempt, or -1 once attempts or
+// the budget are used up and the policy gave up.
+int64_t reconnect_policy_next_delay(ReconnectPolicy *policy, uint64_t nowNs);
+// Back to idle, the next drop starts over from the first attempt.
+void reconnect_policy_succeeded(ReconnectPolicy *policy);
+// An attempt failed in a way retrying cannot fix, such as rejected credentials.
+void reconnect_policy_give_up(ReconnectPolicy *policy);
+
+#endif /* ReconnectPolicy_h */
@@ -0,0 +1,139 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "RefreshScheduler.h"
+
+#include <string.h>
+
+// Merging two areas may add this much of what was not asked for, in percent of what was.
+#define REFRESH_SCHEDULER_MERGE_SLACK_PERCENT 25
+
+void refresh_scheduler_init(RefreshScheduler *scheduler, uint64_t intervalNs) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    pthread_mutex_init(&scheduler->lock, NULL);
+    scheduler->intervalNs = intervalNs;
+}
+
+void refresh_scheduler_destroy(RefreshScheduler *scheduler) {
+    pthread_mutex_destroy(&scheduler->lock);
+}
+
+void refresh_scheduler_reset(RefreshScheduler *scheduler, int32_t width, int32_t height) {
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->width = width;
+    scheduler->height = height;
+    scheduler->count = 0;
+    pthread_mutex_unlock(&scheduler->lock);
+}
+
+static int64_t area_size(const RefreshArea *area) {
+    return (int64_t)area->width * area->height;
+}
+
+static RefreshArea bounding_area(const RefreshArea *a, const RefreshArea *b) {
+    int32_t left = a->x < b->x ? a->x : b->x;
+    int32_t top = a->y < b->y ? a->y : b->y;
+    int32_t right = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int32_t bottom = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+    return (RefreshArea){ left, top, right - left, bottom - top };
+}
+
+// Touching or overlapping areas always merge, others only if little is added.
+static bool worth_merging(const RefreshArea *a, const RefreshArea *b) {
+    bool touching = a->x <= b->x + b->width && b->x <= a->x + a->width &&
+                    a->y <= b->y + b->height && b->y <= a->y + a->height;
+    if (touching) {
+        return true;
+    }
+    RefreshArea bounds = bounding_area(a, b);
+    int64_t asked = area_size(a) + area_size(b);
+    return area_size(&bounds) * 100 <= asked * (100 + REFRESH_SCHEDULER_MERGE_SLACK_PERCENT);
+}
+
+static void remove_pending(RefreshScheduler *scheduler, uint32_t index) {
+    scheduler->pending[index] = scheduler->pending[--scheduler->count];
+}
+
+// A merged area may now be worth merging with ones it was not before.
+static void absorb_mergeable(RefreshScheduler *scheduler, RefreshArea *area) {
+    for (uint32_t i = 0; i < scheduler->count;) {
+        if (worth_merging(&scheduler->pending[i], area)) {
+            *area = bounding_area(&scheduler->pending[i], area);
+            remove_pending(scheduler, i);
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+}
+
+bool refresh_scheduler_add(RefreshScheduler *scheduler, int32_t x, int32_t y, int32_t width, int32_t height) {
+    pthread_mutex_lock(&scheduler->lock);
+    int32_t left = x > 0 ? x : 0;
+    int32_t top = y > 0 ? y : 0;
+    int32_t right = x + width < scheduler->width ? x + width : scheduler->width;
+    int32_t bottom = y + height < scheduler->height ? y + height : scheduler->height;
+    if (width <= 0 || height <= 0 || left >= right || top >= bottom) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return false;
+    }
+    RefreshArea area = { left, top, right - left, bottom - top };
+    absorb_mergeable(scheduler, &area);
+    while (scheduler->count == REFRESH_SCHEDULER_MAX_AREAS) {
+        uint32_t closest = 0;
+        int64_t leastGrowth = INT64_MAX;
+        for (uint32_t i = 0; i < scheduler->count; i++) {
+            RefreshArea bounds = bounding_area(&scheduler->pending[i], &area);
+            int64_t growth = area_size(&bounds) - area_size(&scheduler->pending[i]) - area_size(&area);
+            if (growth < leastGrowth) {
+                leastGrowth = growth;
+                closest = i;
+            }
+        }
+        area = bounding_area(&scheduler->pending[closest], &area);
+        remove_pending(scheduler, closest);
+        absorb_mergeable(scheduler, &area);
+    }
+    scheduler->pending[scheduler->count++] = area;
+    pthread_mutex_unlock(&scheduler->lock);
+    return true;
+}
+
+uint32_t refresh_scheduler_take(RefreshScheduler *scheduler, uint64_t nowNs, bool force,
+                                RefreshArea areas[REFRESH_SCHEDULER_MAX_AREAS]) {
+    pthread_mutex_lock(&scheduler->lock);
+    uint32_t count = scheduler->count;
+    if (count == 0 || (!force && scheduler->sent && nowNs - scheduler->lastSentNs < scheduler->intervalNs)) {
+        pthread_mutex_unlock(&scheduler->lock);
+        return 0;
+    }
+    memcpy(areas, scheduler->pending, count * sizeof(RefreshArea));
+    scheduler->count = 0;
+    scheduler->lastSentNs = nowNs;
+    scheduler->sent = true;
+    pthread_mutex_unlock(&scheduler->lock);
+    return count;
+}
+
+uint32_t refresh_scheduler_pending(RefreshScheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    uint32_t count = scheduler->count;
+    pthread_mutex_unlock(&scheduler->lock);
+    return count;
+}
@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef RefreshScheduler_h
+#define RefreshScheduler_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Fits in one Refresh Rect PDU, further requests are merged into these.
+#define REFRESH_SCHEDULER_MAX_AREAS 8
+#define REFRESH_SCHEDULER_DEFAULT_INTERVAL_NS 250000000ULL
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} RefreshArea;
+
+// Parts of the desktop to ask the server for again because they may be stale.
+// Overlapping and nearby requests are merged into one area, and areas are
+// sent at most once per interval so that repairs cannot flood the link.
+typedef struct {
+    pthread_mutex_t lock;
+    int32_t width;
+    int32_t height;
+    uint64_t intervalNs;
+    uint64_t lastSentNs;
+    bool sent;
+    RefreshArea pending[REFRESH_SCHEDULER_MAX_AREAS];
+    uint32_t count;
+} RefreshScheduler;
+
+void refresh_scheduler_init(RefreshScheduler *scheduler, uint64_t intervalNs);
+void refresh_scheduler_destroy(RefreshScheduler *scheduler);
+// Drops what is pending, requests for the previous desktop no longer apply.
+void refresh_scheduler_reset(RefreshScheduler *scheduler, int32_t width, int32_t height);
+
+// Returns false when nothing of the area lies on the desktop.
+bool refresh_scheduler_add(RefreshScheduler *scheduler, int32_t x, int32_t y, int32_t width, int32_t height);
+// Copies out and clears the pending areas if the interval since the last ones
+// went out has passed, or regardless with force. Returns how many were copied.
+uint32_t refresh_scheduler_take(RefreshScheduler *scheduler, uint64_t nowNs, bool force,
+                                RefreshArea areas[REFRESH_SCHEDULER_MAX_AREAS]);
+uint32_t refresh_scheduler_pending(RefreshScheduler *scheduler);
+
+#endif /* RefreshScheduler_h */
@@ -19,18 +19,21 @@
 
 #include "RemoteBridge.h"
 #include "Utility.h"
+#include "Metrics.h"
 
 bool (*framebuffer_update_callback)(int, uint8_t *, int fbW, int fbH, int x, int y, int w, int h);
 void (*framebuffer_resize_callback)(int, int fbW, int fbH);
 void (*failure_callback)(int, uint8_t *);
 
 pCursorShapeUpdateCallback cursorShapeUpdateCallback;
+pCursorShapeChangedCallback cursorShapeChangedCallback = NULL;
 pFrameBufferUpdateCallback frameBufferUpdateCallback;
 pFrameBufferResizeCallback frameBufferResizeCallback;
 pFailCallback failCallback;
 pClientLogCallback clientLogCallback;
 pYesNoCallback yesNoCallback;
 FrameBuffer globalFb;
+int recommendedFrameIntervalMs = 0;
 
 const int MAX_RESOLUTION_RETRIES = 3;
 
@@ -84,3 +87,42 @@ void resetDesiredResolution(int width, int height) {
     globalFb.desiredFbH = height;
     globalFb.numResolutionRetries = 0;
 }
+
+int getRecommendedFrameIntervalMs(void) {
+    return __atomic_load_n(&recommendedFrameIntervalMs, __ATOMIC_RELAXED);
+}
+
+void setRecommendedFrameIntervalMs(int intervalMs) {
+    __atomic_store_n(&recommendedFrameIntervalMs, intervalMs, __ATOMIC_RELAXED);
+}
+
+uint64_t bridgeMemoryPressure(int level) {
+    uint64_t before = memory_budget_total();
+    uint64_t freed = memory_budget_pressure((MemoryPressureLevel)level);
+    client_log("Memory pressure level %d, freed %llu of %llu bytes in use\n", level,
+               (unsigned long long)freed, (unsigned long long)before);
+    return freed;
+}
+
+void bridgeMemorySnapshot(MemoryBudgetSnapshot *snapshot) {
+    memory_budget_snapshot(snapshot);
+}
+
+void bridgeConnectStarted(void) {
+    connect_timeline_start(metrics_now_ns());
+}
+
+void bridgeConnectMilestone(int milestone) {
+    if (connect_timeline_mark((ConnectMilestone)milestone, metrics_now_ns()) &&
+        milestone == CONNECT_MILESTONE_FIRST_FRAME) {
+        ConnectReport report;
+        char line[512];
+        connect_timeline_report(&report);
+        connect_report_format(&report, line, sizeof(line));
+        client_log("%s\n", line);
+    }
+}
+
+void bridgeConnectReport(ConnectReport *report) {
+    connect_timeline_report(report);
+}
@@ -25,6 +25,8 @@
 #include <stdbool.h>
 #include <signal.h>
 #include <string.h>
+#include "MemoryBudget.h"
+#include "ConnectTimeline.h"
 
 typedef struct {
     uint8_t *frameBuffer;
@@ -41,8 +43,17 @@ extern const int MAX_RESOLUTION_RETRIES;
 
 extern FrameBuffer globalFb;
 
+// Minimum time between presented frames requested by the session, 0 when unset.
+extern int recommendedFrameIntervalMs;
+
 typedef void (*pCursorShapeUpdateCallback)(int instance, int w, int h, int x, int y, uint8_t *);
 extern pCursorShapeUpdateCallback cursorShapeUpdateCallback;
+// Identical shapes arrive with the same shapeId, which is CURSOR_SHAPE_NONE with no
+// pixels for a hidden pointer. The pixels are only valid during the callback.
+typedef void (*pCursorShapeChangedCallback)(int instance, uint32_t shapeId, int w, int h, int hotX, int hotY, uint8_t *pixels);
+extern pCursorShapeChangedCallback cursorShapeChangedCallback;
+// Returns false only for a left-over session that has to quit, a session that is
+// not being shown keeps its connection and returns true.
 typedef bool (*pFrameBufferUpdateCallback)(int instance, uint8_t *buffer, int fbW, int fbH, int x, int y, int w, int h);
 extern pFrameBufferUpdateCallback frameBufferUpdateCallback;
 typedef void (*pFrameBufferResizeCallback)(int instance, int fbW, int fbH);
@@ -53,6 +64,9 @@ typedef void (*pClientLogCallback)(char *);
 extern pClientLogCallback clientLogCallback;
 typedef void (*pClientClipboardCallback)(uint8_t *, long);
 extern pClientClipboardCallback clientClipboardCallback;
+typedef void (*pClipboardFormatsCallback)(bool textAvailable);
+// Returns malloc'd UTF-8 contents of the local clipboard, ownership passes to the caller.
+typedef char *(*pClipboardDataCallback)(long *size);
 typedef int (*pYesNoCallback)(int instance, int8_t *, int8_t *, int8_t *, int8_t *, int8_t *, int);
 extern pYesNoCallback yesNoCallback;
 
@@ -70,5 +84,15 @@ int getCurrentFrameBufferWidth(void);
 int getCurrentFrameBufferHeight(void);
 void resetDesiredResolution(int width, int height);
 void updateCursorShape(int instance, int w, int h, int x, int y, int *data);
+int getRecommendedFrameIntervalMs(void);
+void setRecommendedFrameIntervalMs(int intervalMs);
+// Sheds memory for a MemoryPressureLevel in the order of MemoryShedStage, returns how much was freed.
+uint64_t bridgeMemoryPressure(int level);
+void bridgeMemorySnapshot(MemoryBudgetSnapshot *snapshot);
+// Times each ConnectMilestone of the connect in progress, the whole report is
+// logged in one line once the first frame is drawn.
+void bridgeConnectStarted(void);
+void bridgeConnectMilestone(int milestone);
+void bridgeConnectReport(ConnectReport *report);
 
 #endif /* RemoteBridge_h */
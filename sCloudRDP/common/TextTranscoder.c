@@ -0,0 +1,539 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "TextTranscoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The vector paths read and write UTF-16LE units in host order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TRANSCODE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSCODE_SSE2 1
+#endif
+#endif
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+#define NORMALIZE_FLAGS (TRANSCODE_CRLF_TO_LF | TRANSCODE_LF_TO_CRLF)
+
+typedef struct {
+    uint8_t *dst;
+    size_t capacity;
+    size_t length;
+    unsigned flags;
+    bool pendingCr;
+    bool previousCr;
+    bool overflow;
+} Writer;
+
+typedef void (*EmitFunction)(Writer *writer, uint32_t cp);
+
+/* Output */
+
+static void emit_utf8(Writer *writer, uint32_t cp) {
+    uint8_t bytes[4];
+    size_t n;
+    if (cp < 0x80) {
+        bytes[0] = (uint8_t)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        bytes[0] = (uint8_t)(0xC0 | (cp >> 6));
+        bytes[1] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        bytes[0] = (uint8_t)(0xE0 | (cp >> 12));
+        bytes[1] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[2] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        bytes[0] = (uint8_t)(0xF0 | (cp >> 18));
+        bytes[1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+        bytes[2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+        bytes[3] = (uint8_t)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    if (writer->capacity - writer->length < n) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->dst + writer->length, bytes, n);
+    writer->length += n;
+}
+
+static void emit_utf16le(Writer *writer, uint32_t cp) {
+    uint16_t units[2];
+    size_t n;
+    if (cp < 0x10000) {
+        units[0] = (uint16_t)cp;
+        n = 1;
+    } else {
+        cp -= 0x10000;
+        units[0] = (uint16_t)(0xD800 | (cp >> 10));
+        units[1] = (uint16_t)(0xDC00 | (cp & 0x3FF));
+        n = 2;
+    }
+    if (writer->capacity - writer->length < n * 2) {
+        writer->overflow = true;
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        writer->dst[writer->length++] = (uint8_t)(units[i] & 0xFF);
+        writer->dst[writer->length++] = (uint8_t)(units[i] >> 8);
+    }
+}
+
+// Applies line ending normalization on the way out.
+static void emit(Writer *writer, EmitFunction function, uint32_t cp) {
+    if (writer->flags & TRANSCODE_CRLF_TO_LF) {
+        if (writer->pendingCr) {
+            writer->pendingCr = false;
+            if (cp != '\n') {
+                function(writer, '\r');
+            }
+        }
+        if (cp == '\r') {
+            writer->pendingCr = true;
+            return;
+        }
+    } else if (writer->flags & TRANSCODE_LF_TO_CRLF) {
+        if (cp == '\n' && !writer->previousCr) {
+            function(writer, '\r');
+        }
+        writer->previousCr = cp == '\r';
+    }
+    function(writer, cp);
+}
+
+static TranscodeStatus finish(Writer *writer, EmitFunction function, size_t terminatorSize, size_t *dstLength) {
+    if (writer->pendingCr) {
+        writer->pendingCr = false;
+        function(writer, '\r');
+    }
+    if (writer->overflow) {
+        return TRANSCODE_BUFFER_TOO_SMALL;
+    }
+    *dstLength = writer->length;
+    if (writer->flags & TRANSCODE_NUL_TERMINATE) {
+        if (writer->capacity - writer->length < terminatorSize) {
+            return TRANSCODE_BUFFER_TOO_SMALL;
+        }
+        memset(writer->dst + writer->length, 0, terminatorSize);
+    }
+    return TRANSCODE_OK;
+}
+
+/* Input */
+
+static bool is_continuation(uint8_t byte) {
+    return (byte & 0xC0) == 0x80;
+}
+
+// Returns the sequence length, or the negated length of the maximal
+// invalid subpart so that each one is replaced by a single U+FFFD.
+static int decode_utf8(const uint8_t *s, size_t n, uint32_t *cp) {
+    uint8_t b0 = s[0];
+    if (b0 < 0x80) {
+        *cp = b0;
+        return 1;
+    }
+    if (b0 < 0xC2) {
+        return -1;
+    }
+    if (b0 < 0xE0) {
+        if (n < 2 || !is_continuation(s[1])) {
+            return -1;
+        }
+        *cp = ((uint32_t)(b0 & 0x1F) << 6) | (s[1] & 0x3F);
+        return 2;
+    }
+    if (b0 < 0xF0) {
+        // Exclude overlong forms and UTF-16 surrogates.
+        uint8_t lo = b0 == 0xE0 ? 0xA0 : 0x80;
+        uint8_t hi = b0 == 0xED ? 0x9F : 0xBF;
+        if (n < 2 || s[1] < lo || s[1] > hi) {
+            return -1;
+        }
+        if (n < 3 || !is_continuation(s[2])) {
+            return -2;
+        }
+        *cp = ((uint32_t)(b0 & 0x0F) << 12) | ((uint32_t)(s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        return 3;
+    }
+    if (b0 < 0xF5) {
+        // Exclude overlong forms and values above U+10FFFF.
+        uint8_t lo = b0 == 0xF0 ? 0x90 : 0x80;
+        uint8_t hi = b0 == 0xF4 ? 0x8F : 0xBF;
+        if (n < 2 || s[1] < lo || s[1] > hi) {
+            return -1;
+        }
+        if (n < 3 || !is_continuation(s[2])) {
+            return -2;
+        }
+        if (n < 4 || !is_continuation(s[3])) {
+            return -3;
+        }
+        *cp = ((uint32_t)(b0 & 0x07) << 18) | ((uint32_t)(s[1] & 0x3F) << 12) |
+              ((uint32_t)(s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+        return 4;
+    }
+    return -1;
+}
+
+static uint16_t read_unit(const uint8_t *s) {
+    return (uint16_t)(s[0] | (s[1] << 8));
+}
+
+// Returns the number of bytes consumed, negated for an unpaired surrogate.
+static int decode_utf16le(const uint8_t *s, size_t n, uint32_t *cp) {
+    uint16_t unit = read_unit(s);
+    if (unit < 0xD800 || unit > 0xDFFF) {
+        *cp = unit;
+        return 2;
+    }
+    if (unit <= 0xDBFF && n >= 4) {
+        uint16_t low = read_unit(s + 2);
+        if (low >= 0xDC00 && low <= 0xDFFF) {
+            *cp = 0x10000 + (((uint32_t)(unit - 0xD800) << 10) | (uint32_t)(low - 0xDC00));
+            return 4;
+        }
+    }
+    return -2;
+}
+
+/* Vector fast paths for runs of ASCII without line breaks or NULs */
+
+#if TRANSCODE_NEON
+static bool ascii_block_to_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    uint8x16_t v = vld1q_u8(src);
+    if (vmaxvq_u8(v) >= 0x80) {
+        return false;
+    }
+    uint8x16_t special = vdupq_n_u8(0);
+    if (checkControls) {
+        special = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')));
+    }
+    if (checkNul) {
+        special = vorrq_u8(special, vceqq_u8(v, vdupq_n_u8(0)));
+    }
+    if (vmaxvq_u8(special) != 0) {
+        return false;
+    }
+    vst1q_u16((uint16_t *)dst, vmovl_u8(vget_low_u8(v)));
+    vst1q_u16((uint16_t *)(dst + 16), vmovl_high_u8(v));
+    return true;
+}
+
+static bool ascii_block_from_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(src));
+    if (vmaxvq_u16(v) >= 0x80) {
+        return false;
+    }
+    uint16x8_t special = vdupq_n_u16(0);
+    if (checkControls) {
+        special = vorrq_u16(vceqq_u16(v, vdupq_n_u16('\n')), vceqq_u16(v, vdupq_n_u16('\r')));
+    }
+    if (checkNul) {
+        special = vorrq_u16(special, vceqq_u16(v, vdupq_n_u16(0)));
+    }
+    if (vmaxvq_u16(special) != 0) {
+        return false;
+    }
+    vst1_u8(dst, vmovn_u16(v));
+    return true;
+}
+
+static bool ascii_block(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    uint8x16_t v = vld1q_u8(src);
+    if (vmaxvq_u8(v) >= 0x80) {
+        return false;
+    }
+    uint8x16_t special = vdupq_n_u8(0);
+    if (checkControls) {
+        special = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r')));
+    }
+    if (checkNul) {
+        special = vorrq_u8(special, vceqq_u8(v, vdupq_n_u8(0)));
+    }
+    if (vmaxvq_u8(special) != 0) {
+        return false;
+    }
+    vst1q_u8(dst, v);
+    return true;
+}
+#elif TRANSCODE_SSE2
+static bool ascii_block_to_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    if (_mm_movemask_epi8(v) != 0) {
+        return false;
+    }
+    __m128i special = _mm_setzero_si128();
+    if (checkControls) {
+        special = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    }
+    if (checkNul) {
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    }
+    if (_mm_movemask_epi8(special) != 0) {
+        return false;
+    }
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(v, zero));
+    _mm_storeu_si128((__m128i *)(dst + 16), _mm_unpackhi_epi8(v, zero));
+    return true;
+}
+
+static bool ascii_block_from_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    __m128i zero = _mm_setzero_si128();
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0xFF80)), zero)) != 0xFFFF) {
+        return false;
+    }
+    __m128i special = zero;
+    if (checkControls) {
+        special = _mm_or_si128(_mm_cmpeq_epi16(v, _mm_set1_epi16('\n')), _mm_cmpeq_epi16(v, _mm_set1_epi16('\r')));
+    }
+    if (checkNul) {
+        special = _mm_or_si128(special, _mm_cmpeq_epi16(v, zero));
+    }
+    if (_mm_movemask_epi8(special) != 0) {
+        return false;
+    }
+    _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(v, v));
+    return true;
+}
+
+static bool ascii_block(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    __m128i v = _mm_loadu_si128((const __m128i *)src);
+    if (_mm_movemask_epi8(v) != 0) {
+        return false;
+    }
+    __m128i special = _mm_setzero_si128();
+    if (checkControls) {
+        special = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    }
+    if (checkNul) {
+        special = _mm_or_si128(special, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    }
+    if (_mm_movemask_epi8(special) != 0) {
+        return false;
+    }
+    _mm_storeu_si128((__m128i *)dst, v);
+    return true;
+}
+#else
+static bool ascii_block_to_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    for (int i = 0; i < 16; i++) {
+        if (src[i] >= 0x80 || (checkControls && (src[i] == '\n' || src[i] == '\r')) || (checkNul && src[i] == 0)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        dst[2 * i] = src[i];
+        dst[2 * i + 1] = 0;
+    }
+    return true;
+}
+
+static bool ascii_block_from_utf16(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    for (int i = 0; i < 8; i++) {
+        uint16_t unit = read_unit(src + 2 * i);
+        if (unit >= 0x80 || (checkControls && (unit == '\n' || unit == '\r')) || (checkNul && unit == 0)) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        dst[i] = src[2 * i];
+    }
+    return true;
+}
+
+static bool ascii_block(const uint8_t *src, uint8_t *dst, bool checkControls, bool checkNul) {
+    for (int i = 0; i < 16; i++) {
+        if (src[i] >= 0x80 || (checkControls && (src[i] == '\n' || src[i] == '\r')) || (checkNul && src[i] == 0)) {
+            return false;
+        }
+    }
+    memcpy(dst, src, 16);
+    return true;
+}
+#endif
+
+/* Conversions */
+
+static void writer_init(Writer *writer, uint8_t *dst, size_t capacity, unsigned flags) {
+    memset(writer, 0, sizeof(Writer));
+    writer->dst = dst;
+    writer->capacity = capacity;
+    writer->flags = flags;
+}
+
+// Vector blocks may only be used when no line ending decision is pending.
+static bool can_use_block(const Writer *writer) {
+    return !writer->pendingCr && !writer->overflow;
+}
+
+static TranscodeStatus convert_from_utf8(const uint8_t *src, size_t srcLength, Writer *writer,
+                                         EmitFunction function, size_t blockOut, size_t terminatorSize,
+                                         size_t *dstLength) {
+    bool checkControls = (writer->flags & NORMALIZE_FLAGS) != 0;
+    bool checkNul = (writer->flags & TRANSCODE_STOP_AT_NUL) != 0;
+    bool toUtf16 = function == emit_utf16le;
+    size_t i = 0;
+    while (i < srcLength) {
+        if (srcLength - i >= 16 && can_use_block(writer) && writer->capacity - writer->length >= blockOut) {
+            uint8_t *out = writer->dst + writer->length;
+            bool converted = toUtf16 ? ascii_block_to_utf16(src + i, out, checkControls, checkNul)
+                                     : ascii_block(src + i, out, checkControls, checkNul);
+            if (converted) {
+                writer->length += blockOut;
+                writer->previousCr = false;
+                i += 16;
+                continue;
+            }
+        }
+        // Handle the block that failed the fast path one character at a time.
+        size_t blockEnd = i + 16 < srcLength ? i + 16 : srcLength;
+        while (i < blockEnd) {
+            uint32_t cp;
+            int n = decode_utf8(src + i, srcLength - i, &cp);
+            if (n < 0) {
+                if (!(writer->flags & TRANSCODE_REPLACE_INVALID)) {
+                    return TRANSCODE_INVALID_INPUT;
+                }
+                cp = REPLACEMENT_CHARACTER;
+                n = -n;
+            } else if (cp == 0 && checkNul) {
+                return finish(writer, function, terminatorSize, dstLength);
+            }
+            emit(writer, function, cp);
+            if (writer->overflow) {
+                return TRANSCODE_BUFFER_TOO_SMALL;
+            }
+            i += (size_t)n;
+        }
+    }
+    return finish(writer, function, terminatorSize, dstLength);
+}
+
+TranscodeStatus transcode_utf8_to_utf16le(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                          size_t dstCapacity, unsigned flags, size_t *dstLength) {
+    Writer writer;
+    writer_init(&writer, dst, dstCapacity, flags);
+    return convert_from_utf8(src, srcLength, &writer, emit_utf16le, 32, 2, dstLength);
+}
+
+TranscodeStatus transcode_utf8_to_utf8(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                       size_t dstCapacity, unsigned flags, size_t *dstLength) {
+    Writer writer;
+    writer_init(&writer, dst, dstCapacity, flags);
+    return convert_from_utf8(src, srcLength, &writer, emit_utf8, 16, 1, dstLength);
+}
+
+TranscodeStatus transcode_utf16le_to_utf8(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                          size_t dstCapacity, unsigned flags, size_t *dstLength) {
+    Writer writer;
+    writer_init(&writer, dst, dstCapacity, flags);
+    bool checkControls = (flags & NORMALIZE_FLAGS) != 0;
+    bool checkNul = (flags & TRANSCODE_STOP_AT_NUL) != 0;
+    bool truncated = srcLength % 2 != 0;
+    if (truncated) {
+        if (!(flags & TRANSCODE_REPLACE_INVALID)) {
+            return TRANSCODE_INVALID_INPUT;
+        }
+        // A trailing odd byte can only be a truncated unit.
+        srcLength--;
+    }
+
+    size_t i = 0;
+    while (i < srcLength) {
+        if (srcLength - i >= 16 && can_use_block(&writer) && writer.capacity - writer.length >= 8) {
+            if (ascii_block_from_utf16(src + i, writer.dst + writer.length, checkControls, checkNul)) {
+                writer.length += 8;
+                writer.previousCr = false;
+                i += 16;
+                continue;
+            }
+        }
+        size_t blockEnd = i + 16 < srcLength ? i + 16 : srcLength;
+        while (i < blockEnd) {
+            uint32_t cp;
+            int n = decode_utf16le(src + i, srcLength - i, &cp);
+            if (n < 0) {
+                if (!(flags & TRANSCODE_REPLACE_INVALID)) {
+                    return TRANSCODE_INVALID_INPUT;
+                }
+                cp = REPLACEMENT_CHARACTER;
+                n = -n;
+            } else if (cp == 0 && checkNul) {
+                return finish(&writer, emit_utf8, 1, dstLength);
+            }
+            emit(&writer, emit_utf8, cp);
+            if (writer.overflow) {
+                return TRANSCODE_BUFFER_TOO_SMALL;
+            }
+            i += (size_t)n;
+        }
+    }
+    if (truncated) {
+        emit(&writer, emit_utf8, REPLACEMENT_CHARACTER);
+    }
+    return finish(&writer, emit_utf8, 1, dstLength);
+}
+
+/* Sizing */
+
+size_t transcode_utf16le_capacity(size_t utf8Length, unsigned flags) {
+    // One unit per byte at most, two with CRLF expansion.
+    size_t perByte = (flags & TRANSCODE_LF_TO_CRLF) ? 4 : 2;
+    return utf8Length * perByte + ((flags & TRANSCODE_NUL_TERMINATE) ? 2 : 0);
+}
+
+size_t transcode_utf8_capacity(size_t utf16Length, unsigned flags) {
+    // Three bytes per unit at most, CRLF expansion fits in the same bound.
+    return (utf16Length / 2) * 3 + 3 + ((flags & TRANSCODE_NUL_TERMINATE) ? 1 : 0);
+}
+
+size_t transcode_utf8_normalized_capacity(size_t utf8Length, unsigned flags) {
+    // A single invalid byte becomes a three byte replacement character.
+    size_t perByte = (flags & TRANSCODE_REPLACE_INVALID) ? 3 : ((flags & TRANSCODE_LF_TO_CRLF) ? 2 : 1);
+    return utf8Length * perByte + ((flags & TRANSCODE_NUL_TERMINATE) ? 1 : 0);
+}
+
+bool transcode_buffer_reserve(TranscodeBuffer *buffer, size_t capacity) {
+    if (buffer->capacity >= capacity) {
+        return true;
+    }
+    uint8_t *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return false;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+void transcode_buffer_free(TranscodeBuffer *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->capacity = 0;
+}
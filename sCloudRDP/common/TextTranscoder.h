@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef TextTranscoder_h
+#define TextTranscoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRANSCODE_CRLF_TO_LF 0x01
+#define TRANSCODE_LF_TO_CRLF 0x02
+// Replace malformed sequences with U+FFFD instead of failing.
+#define TRANSCODE_REPLACE_INVALID 0x04
+#define TRANSCODE_NUL_TERMINATE 0x08
+// Input ends at the first NUL character, as in CF_UNICODETEXT.
+#define TRANSCODE_STOP_AT_NUL 0x10
+
+typedef enum {
+    TRANSCODE_OK = 0,
+    TRANSCODE_INVALID_INPUT,
+    TRANSCODE_BUFFER_TOO_SMALL
+} TranscodeStatus;
+
+// A reusable output buffer that only grows.
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+} TranscodeBuffer;
+
+// Worst case output sizes in bytes, including a terminator if requested.
+size_t transcode_utf16le_capacity(size_t utf8Length, unsigned flags);
+size_t transcode_utf8_capacity(size_t utf16Length, unsigned flags);
+size_t transcode_utf8_normalized_capacity(size_t utf8Length, unsigned flags);
+
+// Lengths are in bytes for both encodings, dstLength excludes the terminator.
+TranscodeStatus transcode_utf8_to_utf16le(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                          size_t dstCapacity, unsigned flags, size_t *dstLength);
+TranscodeStatus transcode_utf16le_to_utf8(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                          size_t dstCapacity, unsigned flags, size_t *dstLength);
+// Validates and normalizes line endings without changing the encoding.
+TranscodeStatus transcode_utf8_to_utf8(const uint8_t *src, size_t srcLength, uint8_t *dst,
+                                       size_t dstCapacity, unsigned flags, size_t *dstLength);
+
+bool transcode_buffer_reserve(TranscodeBuffer *buffer, size_t capacity);
+void transcode_buffer_free(TranscodeBuffer *buffer);
+
+#endif /* TextTranscoder_h */
@@ -29,6 +29,8 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 
+#include "Utility.h"
+
 void (*client_log_callback)(int8_t *);
 void (*utf8_client_clipboard_callback)(uint8_t *, long);
 void (*client_clipboard_callback)(char *);
@@ -41,12 +43,10 @@ char* cast_uint8_to_cchar(uint8_t* input) {
 }
 
 void client_log(const char *format, ...) {
-    if (client_log_callback != NULL) {
+    if (client_log_callback != NULL && client_log_enabled(CLIENT_LOG_LEVEL_INFO)) {
         va_list args;
-        static char message_buffer[16384];
         va_start(args, format);
-        vsnprintf(message_buffer, 16383, format, args);
-        client_log_callback((int8_t*)message_buffer);
+        client_log_v(CLIENT_LOG_LEVEL_INFO, format, args);
         va_end(args);
     }
 }
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <stdarg.h>
 
+#include "Logger.h"
+
 extern void (*client_log_callback)(int8_t *);
 extern void (*utf8_client_clipboard_callback)(uint8_t *, long);
 extern void (*client_clipboard_callback)(char *);
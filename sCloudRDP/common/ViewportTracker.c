@@ -0,0 +1,200 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ViewportTracker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int32_t left;
+    int32_t top;
+    int32_t right;
+    int32_t bottom;
+} TileRange;
+
+void viewport_tracker_init(ViewportTracker *tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+    pthread_mutex_init(&tracker->lock, NULL);
+}
+
+void viewport_tracker_destroy(ViewportTracker *tracker) {
+    free(tracker->pending);
+    tracker->pending = NULL;
+    pthread_mutex_destroy(&tracker->lock);
+}
+
+bool viewport_tracker_reset(ViewportTracker *tracker, int32_t fbWidth, int32_t fbHeight) {
+    pthread_mutex_lock(&tracker->lock);
+    int32_t tilesX = (fbWidth + VIEWPORT_TRACKER_TILE_SIZE - 1) / VIEWPORT_TRACKER_TILE_SIZE;
+    int32_t tilesY = (fbHeight + VIEWPORT_TRACKER_TILE_SIZE - 1) / VIEWPORT_TRACKER_TILE_SIZE;
+    uint8_t *pending = NULL;
+    if (fbWidth > 0 && fbHeight > 0) {
+        pending = calloc((size_t)tilesX * tilesY, 1);
+    }
+    free(tracker->pending);
+    tracker->pending = pending;
+    tracker->pendingCount = 0;
+    tracker->fbWidth = pending != NULL ? fbWidth : 0;
+    tracker->fbHeight = pending != NULL ? fbHeight : 0;
+    tracker->tilesX = pending != NULL ? tilesX : 0;
+    tracker->tilesY = pending != NULL ? tilesY : 0;
+    tracker->viewport = (ViewportRect){ 0, 0, tracker->fbWidth, tracker->fbHeight };
+    pthread_mutex_unlock(&tracker->lock);
+    return pending != NULL;
+}
+
+// Tiles touched by the rectangle, clipped to the framebuffer, false if none.
+static bool tile_range(const ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height,
+                       TileRange *range) {
+    int32_t right = x + width < tracker->fbWidth ? x + width : tracker->fbWidth;
+    int32_t bottom = y + height < tracker->fbHeight ? y + height : tracker->fbHeight;
+    x = x > 0 ? x : 0;
+    y = y > 0 ? y : 0;
+    if (width <= 0 || height <= 0 || x >= right || y >= bottom) {
+        return false;
+    }
+    range->left = x / VIEWPORT_TRACKER_TILE_SIZE;
+    range->top = y / VIEWPORT_TRACKER_TILE_SIZE;
+    range->right = (right - 1) / VIEWPORT_TRACKER_TILE_SIZE + 1;
+    range->bottom = (bottom - 1) / VIEWPORT_TRACKER_TILE_SIZE + 1;
+    return true;
+}
+
+static bool range_contains(const TileRange *range, int32_t column, int32_t row) {
+    return column >= range->left && column < range->right && row >= range->top && row < range->bottom;
+}
+
+bool viewport_tracker_add_damage(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height,
+                                 ViewportRect *visiblePart) {
+    pthread_mutex_lock(&tracker->lock);
+    TileRange damage;
+    if (tracker->pending == NULL || !tile_range(tracker, x, y, width, height, &damage)) {
+        // Without bookkeeping presenting is always safe, damage off the framebuffer never needs it.
+        bool untracked = tracker->pending == NULL;
+        pthread_mutex_unlock(&tracker->lock);
+        if (untracked && visiblePart != NULL) {
+            *visiblePart = (ViewportRect){ x, y, width, height };
+        }
+        return untracked;
+    }
+    TileRange visible;
+    const ViewportRect *viewport = &tracker->viewport;
+    bool hasVisible = tile_range(tracker, viewport->x, viewport->y, viewport->width, viewport->height, &visible);
+    bool present = false;
+    for (int32_t row = damage.top; row < damage.bottom; row++) {
+        for (int32_t column = damage.left; column < damage.right; column++) {
+            if (hasVisible && range_contains(&visible, column, row)) {
+                present = true;
+                continue;
+            }
+            uint8_t *tile = &tracker->pending[row * tracker->tilesX + column];
+            if (!*tile) {
+                *tile = 1;
+                tracker->pendingCount++;
+            }
+        }
+    }
+    if (present && visiblePart != NULL) {
+        // The damage clipped to the tiles in view, which are presented as a whole.
+        int32_t left = visible.left * VIEWPORT_TRACKER_TILE_SIZE;
+        int32_t top = visible.top * VIEWPORT_TRACKER_TILE_SIZE;
+        int32_t right = visible.right * VIEWPORT_TRACKER_TILE_SIZE;
+        int32_t bottom = visible.bottom * VIEWPORT_TRACKER_TILE_SIZE;
+        right = right < tracker->fbWidth ? right : tracker->fbWidth;
+        bottom = bottom < tracker->fbHeight ? bottom : tracker->fbHeight;
+        left = x > left ? x : left;
+        top = y > top ? y : top;
+        right = x + width < right ? x + width : right;
+        bottom = y + height < bottom ? y + height : bottom;
+        *visiblePart = (ViewportRect){ left, top, right - left, bottom - top };
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    return present;
+}
+
+bool viewport_tracker_set_viewport(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height,
+                                   ViewportRect *exposed) {
+    pthread_mutex_lock(&tracker->lock);
+    tracker->viewport = (ViewportRect){ x, y, width, height };
+    TileRange visible;
+    TileRange caughtUp = { INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN };
+    if (tracker->pendingCount > 0 && tile_range(tracker, x, y, width, height, &visible)) {
+        for (int32_t row = visible.top; row < visible.bottom; row++) {
+            for (int32_t column = visible.left; column < visible.right; column++) {
+                uint8_t *tile = &tracker->pending[row * tracker->tilesX + column];
+                if (!*tile) {
+                    continue;
+                }
+                *tile = 0;
+                tracker->pendingCount--;
+                caughtUp.left = column < caughtUp.left ? column : caughtUp.left;
+                caughtUp.top = row < caughtUp.top ? row : caughtUp.top;
+                caughtUp.right = column + 1 > caughtUp.right ? column + 1 : caughtUp.right;
+                caughtUp.bottom = row + 1 > caughtUp.bottom ? row + 1 : caughtUp.bottom;
+            }
+        }
+    }
+    bool anyExposed = caughtUp.left < caughtUp.right;
+    if (anyExposed && exposed != NULL) {
+        int32_t right = caughtUp.right * VIEWPORT_TRACKER_TILE_SIZE;
+        int32_t bottom = caughtUp.bottom * VIEWPORT_TRACKER_TILE_SIZE;
+        exposed->x = caughtUp.left * VIEWPORT_TRACKER_TILE_SIZE;
+        exposed->y = caughtUp.top * VIEWPORT_TRACKER_TILE_SIZE;
+        exposed->width = (right < tracker->fbWidth ? right : tracker->fbWidth) - exposed->x;
+        exposed->height = (bottom < tracker->fbHeight ? bottom : tracker->fbHeight) - exposed->y;
+    }
+    pthread_mutex_unlock(&tracker->lock);
+    return anyExposed;
+}
+
+void viewport_tracker_mark_presented(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height) {
+    pthread_mutex_lock(&tracker->lock);
+    TileRange presented;
+    if (tracker->pendingCount > 0 && tile_range(tracker, x, y, width, height, &presented)) {
+        int32_t right = x + width;
+        int32_t bottom = y + height;
+        for (int32_t row = presented.top; row < presented.bottom; row++) {
+            for (int32_t column = presented.left; column < presented.right; column++) {
+                // Partly covered tiles keep stale pixels outside the rectangle.
+                int32_t tileRight = (column + 1) * VIEWPORT_TRACKER_TILE_SIZE;
+                int32_t tileBottom = (row + 1) * VIEWPORT_TRACKER_TILE_SIZE;
+                tileRight = tileRight < tracker->fbWidth ? tileRight : tracker->fbWidth;
+                tileBottom = tileBottom < tracker->fbHeight ? tileBottom : tracker->fbHeight;
+                if (column * VIEWPORT_TRACKER_TILE_SIZE < x || row * VIEWPORT_TRACKER_TILE_SIZE < y ||
+                    tileRight > right || tileBottom > bottom) {
+                    continue;
+                }
+                uint8_t *tile = &tracker->pending[row * tracker->tilesX + column];
+                if (*tile) {
+                    *tile = 0;
+                    tracker->pendingCount--;
+                }
+            }
+        }
+    }
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+uint32_t viewport_tracker_pending_tiles(ViewportTracker *tracker) {
+    pthread_mutex_lock(&tracker->lock);
+    uint32_t count = tracker->pendingCount;
+    pthread_mutex_unlock(&tracker->lock);
+    return count;
+}
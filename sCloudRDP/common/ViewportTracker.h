@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#ifndef ViewportTracker_h
+#define ViewportTracker_h
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VIEWPORT_TRACKER_TILE_SIZE 64
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+} ViewportRect;
+
+// Remembers which tiles of the framebuffer changed while outside the part of
+// the desktop the viewer shows, so that updates nobody can see are neither
+// converted nor presented until they are scrolled into view. A tile touching
+// the viewport counts as visible and is brought up to date as a whole.
+typedef struct {
+    pthread_mutex_t lock;
+    int32_t fbWidth;
+    int32_t fbHeight;
+    int32_t tilesX;
+    int32_t tilesY;
+    // One byte per tile, set while the presented pixels of the tile are stale.
+    uint8_t *pending;
+    uint32_t pendingCount;
+    ViewportRect viewport;
+} ViewportTracker;
+
+void viewport_tracker_init(ViewportTracker *tracker);
+void viewport_tracker_destroy(ViewportTracker *tracker);
+// Forgets all pending tiles and shows the whole framebuffer again.
+bool viewport_tracker_reset(ViewportTracker *tracker, int32_t fbWidth, int32_t fbHeight);
+
+// Returns true when part of the damage is visible and the frame has to be
+// presented, that part in visible. Tiles outside the viewport are remembered instead.
+bool viewport_tracker_add_damage(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height,
+                                 ViewportRect *visible);
+// Moves the viewport. Returns true when pending tiles came into view, which
+// are then considered caught up, and their bounding box in exposed.
+bool viewport_tracker_set_viewport(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height,
+                                   ViewportRect *exposed);
+// Clears the tiles that lie completely inside the presented rectangle.
+void viewport_tracker_mark_presented(ViewportTracker *tracker, int32_t x, int32_t y, int32_t width, int32_t height);
+uint32_t viewport_tracker_pending_tiles(ViewportTracker *tracker);
+
+#endif /* ViewportTracker_h */
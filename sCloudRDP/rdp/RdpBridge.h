@@ -46,5 +46,21 @@ void unicodeKeyEvent(void *instance, int flags, int code);
 void vkKeyEvent(void *instance, int flags, int code);
 void disconnectRdp(void *i);
 void resizeRemoteRdpDesktop(void *instance, int x, int y);
+void setClipboardCallbacks(pClipboardFormatsCallback formats_callback, pClipboardDataCallback data_callback);
+void setCursorShapeChangedCallback(pCursorShapeChangedCallback shape_callback);
+// Part of the desktop the viewer shows, returns true if it has to catch up on
+// updates there, the region that came into view with them in exposed.
+bool setVisibleViewport(int x, int y, int width, int height, ViewportRect *exposed);
+// Asks the server to send a possibly stale region again. Requests are merged and
+// rate limited, returns false when the region is not on the desktop.
+bool requestRdpRefresh(void *instance, int x, int y, int width, int height);
+// Sends requests the rate limit held back once it allows.
+void flushRdpRefresh(void *instance);
+// Stops display updates while the session is not visible and catches up when it is
+// again, returns false when there is no connection to keep instead.
+bool setRdpOutputSuppressed(void *instance, bool suppressed);
+void clientClipboardChanged(void *instance, long changeCount);
+void clientClipboardPublished(long changeCount);
+bool requestRemoteClipboard(void *instance);
 
 #endif /* RdpBridge_h */
@@ -21,14 +21,77 @@
 #include "ios_freerdp.h"
 #include "freerdp/freerdp.h"
 #include "freerdp/gdi/gdi.h"
+#include "freerdp/graphics.h"
+#include "freerdp/codec/color.h"
 #include "freerdp/error.h"
 #include "RemoteBridge.h"
 #include "Utility.h"
+#include "Metrics.h"
+#include "CpuSampler.h"
+#include "QualityController.h"
+#include "ClipboardSync.h"
+#include "TextTranscoder.h"
+#include "FrameBufferExport.h"
+#include "ViewportTracker.h"
+#include "OutputSuppression.h"
+#include "RefreshScheduler.h"
+#include "CursorCache.h"
+#include "MemoryBudget.h"
+#include "ReconnectPolicy.h"
+#include "ConnectionWarmup.h"
+#include "SshChannelTransport.h"
 #include <freerdp/client.h>
+#include <freerdp/client/cmdline.h>
+#include <freerdp/client/disp.h>
+#include <unistd.h>
+#include <sys/sysctl.h>
 
 // libfreerdp gives us exit code 0 for authentication failures to Ubuntu 22.04
 #define FREERDP_ERROR_CONNECT_AUTH_FAILURE_UBUNTU_REMOTE_DESKTOP 0
 
+#define QUALITY_UPDATE_INTERVAL_NS 1000000000ULL
+
+// The states ConnectionStateChange reports, from libfreerdp/core/rdp.h which is not installed.
+#define RDP_CONNECTION_STATE_NEGO 1
+#define RDP_CONNECTION_STATE_MCS_CONNECT 3
+#define RDP_CONNECTION_STATE_LICENSING 10
+#define RDP_CONNECTION_STATE_FINALIZATION 13
+
+static QualityController qualityController;
+static pthread_mutex_t qualityLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t lastQualityUpdateNs = 0;
+static uint64_t beginPaintNs = 0;
+static pBeginPaint originalBeginPaint = NULL;
+static pNetworkCharacteristicsResult originalNetworkCharacteristicsResult = NULL;
+// Culls updates the viewer cannot see while zoomed in, see ViewportTracker.h.
+static ViewportTracker viewportTracker = { PTHREAD_MUTEX_INITIALIZER };
+// Decoded pointer shapes shared by all rdpPointers with the same data, see CursorCache.h.
+static CursorCache cursorCache = { PTHREAD_MUTEX_INITIALIZER };
+// Only touched from the session thread, which runs the pointer callbacks.
+static uint32_t shownCursorShape = CURSOR_SHAPE_NONE;
+// Repairs of regions that may be stale, see RefreshScheduler.h.
+static RefreshScheduler refreshScheduler = { PTHREAD_MUTEX_INITIALIZER, 0, 0, REFRESH_SCHEDULER_DEFAULT_INTERVAL_NS };
+static ReconnectPolicy reconnectPolicy = { RECONNECT_POLICY_DEFAULT_MAX_ATTEMPTS, RECONNECT_POLICY_DEFAULT_INITIAL_DELAY_NS,
+                                           RECONNECT_POLICY_DEFAULT_MAX_DELAY_NS, RECONNECT_POLICY_DEFAULT_BUDGET_NS };
+static bool sendSuppressOutput(void *context, bool allowDisplayUpdates, const OutputRect *area);
+static bool sendRefreshRect(void *context, uint8_t count, const OutputRect *areas);
+// Stops display updates while the session is not visible, see OutputSuppression.h.
+static OutputSuppression outputSuppression = { PTHREAD_MUTEX_INITIALIZER, { sendSuppressOutput, sendRefreshRect } };
+static ClipboardSync clipboardSync;
+// Only touched from the session thread that delivers remote clipboard data.
+static TranscodeBuffer serverCutTextBuffer;
+static pthread_once_t clipboardSyncOnce = PTHREAD_ONCE_INIT;
+static pClipboardFormatsCallback clipboardFormatsCallback = NULL;
+static pClipboardDataCallback clipboardDataCallback = NULL;
+// Set by the critical memory shedder, shrinks the desktop of this and later sessions.
+static bool reduceDesktopForMemory = false;
+// Set by the cache shedder, the session thread drops the decoded cursor shapes at its next paint.
+static bool shedCursorShapes = false;
+// The display control channel while it is open, it resizes the desktop mid-session.
+static pthread_mutex_t displayControlLock = PTHREAD_MUTEX_INITIALIZER;
+static DispClientContext *displayControl = NULL;
+static rdpSettings *displayControlSettings = NULL;
+
 static CGContextRef reallocate_buffer(mfInfo *mfi) {
     rdpGdi *gdi = mfi->instance->context->gdi;
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
@@ -49,9 +112,262 @@ void disconnectRdp(void *instance) {
     freerdp_abort_connect((freerdp *)instance);
 }
 
-static BOOL end_paint(rdpContext* context) {
+static RECTANGLE_16 toRectangle16(int x, int y, int width, int height) {
+    RECTANGLE_16 rectangle = { (UINT16)x, (UINT16)y, (UINT16)(x + width), (UINT16)(y + height) };
+    return rectangle;
+}
+
+static bool sendSuppressOutput(void *context, bool allowDisplayUpdates, const OutputRect *area) {
+    rdpContext *rdp = (rdpContext *)context;
+    if (rdp->update->SuppressOutput == NULL) {
+        return false;
+    }
+    if (area == NULL) {
+        return rdp->update->SuppressOutput(rdp, allowDisplayUpdates, NULL);
+    }
+    RECTANGLE_16 rectangle = toRectangle16(area->x, area->y, area->width, area->height);
+    return rdp->update->SuppressOutput(rdp, allowDisplayUpdates, &rectangle);
+}
+
+// Sent as is, merging would lose the visible part going first.
+static bool sendRefreshRect(void *context, uint8_t count, const OutputRect *areas) {
+    rdpContext *rdp = (rdpContext *)context;
+    RECTANGLE_16 rectangles[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS];
+    for (uint8_t r = 0; r < count && r < OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS; r++) {
+        rectangles[r] = toRectangle16(areas[r].x, areas[r].y, areas[r].width, areas[r].height);
+    }
+    if (rdp->update->RefreshRect != NULL && rdp->update->RefreshRect(rdp, count, rectangles)) {
+        return true;
+    }
+    for (uint8_t r = 0; r < count; r++) {
+        refresh_scheduler_add(&refreshScheduler, areas[r].x, areas[r].y, areas[r].width, areas[r].height);
+    }
+    return false;
+}
+
+// Sends what the scheduler has pending once its interval has passed, or right
+// away with force. Areas that could not be sent are queued again.
+static void sendPendingRefresh(rdpContext *context, bool force) {
+    RefreshArea areas[REFRESH_SCHEDULER_MAX_AREAS];
+    uint32_t count = refresh_scheduler_take(&refreshScheduler, metrics_now_ns(), force, areas);
+    if (count == 0) {
+        return;
+    }
+    RECTANGLE_16 rectangles[REFRESH_SCHEDULER_MAX_AREAS];
+    for (uint32_t r = 0; r < count; r++) {
+        rectangles[r] = toRectangle16(areas[r].x, areas[r].y, areas[r].width, areas[r].height);
+    }
+    if (context->update->RefreshRect != NULL && context->update->RefreshRect(context, (BYTE)count, rectangles)) {
+        return;
+    }
+    CLIENT_LOG_DEBUG("Could not send %u refresh areas, queued again\n", count);
+    for (uint32_t r = 0; r < count; r++) {
+        refresh_scheduler_add(&refreshScheduler, areas[r].x, areas[r].y, areas[r].width, areas[r].height);
+    }
+}
+
+static void apply_quality_decision(const QualityDecision *decision) {
+    setRecommendedFrameIntervalMs(decision->frameIntervalMs);
+    client_log("Session profile %s, frame interval %d ms\n",
+               quality_controller_profile_name(decision->profile), decision->frameIntervalMs);
+}
+
+static void report_frame_cost(uint64_t nowNs, uint64_t decodeUs) {
+    QualityDecision decision;
+    bool changed = false;
+    pthread_mutex_lock(&qualityLock);
+    quality_controller_report_frame_cost(&qualityController, decodeUs / 1000.0);
+    if (nowNs - lastQualityUpdateNs >= QUALITY_UPDATE_INTERVAL_NS) {
+        lastQualityUpdateNs = nowNs;
+        changed = quality_controller_update(&qualityController, nowNs, &decision);
+    }
+    pthread_mutex_unlock(&qualityLock);
+    if (changed) {
+        apply_quality_decision(&decision);
+    }
+}
+
+static BOOL begin_paint(rdpContext *context) {
+    beginPaintNs = metrics_now_ns();
+    framebuffer_export_begin_frame();
+    if (__atomic_exchange_n(&shedCursorShapes, false, __ATOMIC_RELAXED)) {
+        // The pointer callbacks run on this thread too, none of them holds a shape right now.
+        cursor_cache_clear(&cursorCache);
+        memory_budget_set(MEMORY_CURSOR_CACHE, 0);
+    }
+    BOOL result = true;
+    if (originalBeginPaint != NULL) {
+        result = originalBeginPaint(context);
+    }
+    // The invalidated region is only consumed by end_paint, start it over so
+    // it holds exactly what was drawn since the last frame.
+    HGDI_WND hwnd = context->gdi->primary->hdc->hwnd;
+    hwnd->invalid->null = TRUE;
+    hwnd->ninvalid = 0;
+    return result;
+}
+
+static BOOL network_characteristics_result(rdpContext *context, UINT16 sequenceNumber) {
+    rdpAutoDetect *autodetect = context->autodetect;
+    pthread_mutex_lock(&qualityLock);
+    quality_controller_report_network(&qualityController, autodetect->netCharBandwidth,
+                                      autodetect->netCharAverageRTT);
+    pthread_mutex_unlock(&qualityLock);
+    CLIENT_LOG_DEBUG("Network characteristics: %u kbps, %u ms average RTT\n",
+                     autodetect->netCharBandwidth, autodetect->netCharAverageRTT);
+    if (originalNetworkCharacteristicsResult != NULL) {
+        return originalNetworkCharacteristicsResult(context, sequenceNumber);
+    }
+    return true;
+}
+
+static void exportDamage(HGDI_WND hwnd) {
+    if (!framebuffer_export_enabled()) {
+        return;
+    }
+    FrameBufferExportRect damage[FRAMEBUFFER_EXPORT_MAX_DAMAGE];
+    uint32_t count = 0;
+    if (hwnd->invalid->null) {
+        // Nothing was drawn, readers still get a new sequence number.
+    } else if (hwnd->ninvalid > 0 && hwnd->ninvalid <= FRAMEBUFFER_EXPORT_MAX_DAMAGE) {
+        for (; count < (uint32_t)hwnd->ninvalid; count++) {
+            HGDI_RGN rgn = &hwnd->cinvalid[count];
+            damage[count] = (FrameBufferExportRect){ rgn->x, rgn->y, rgn->w, rgn->h };
+        }
+    } else {
+        HGDI_RGN rgn = hwnd->invalid;
+        damage[count++] = (FrameBufferExportRect){ rgn->x, rgn->y, rgn->w, rgn->h };
+    }
+    framebuffer_export_end_frame(damage, count);
+}
+
+typedef struct {
+    rdpPointer pointer;
+    uint64_t hash;
+    uint32_t shapeId;
+} iosPointer;
+
+static uint32_t decodePointer(rdpContext *context, const rdpPointer *pointer, uint64_t hash) {
+    uint32_t stride = pointer->width * 4;
+    uint8_t *pixels = malloc((size_t)stride * pointer->height);
+    if (pixels == NULL) {
+        return CURSOR_SHAPE_NONE;
+    }
+    if (!freerdp_image_copy_from_pointer_data(pixels, PIXEL_FORMAT_RGBA32, stride, 0, 0, pointer->width, pointer->height,
+                                              pointer->xorMaskData, pointer->lengthXorMask,
+                                              pointer->andMaskData, pointer->lengthAndMask,
+                                              pointer->xorBpp, &context->gdi->palette)) {
+        free(pixels);
+        return CURSOR_SHAPE_NONE;
+    }
+    cursor_premultiply_alpha(pixels, (size_t)pointer->width * pointer->height);
+    metrics_counter_add(METRIC_CURSOR_CACHE_MISSES, 1);
+    uint32_t shapeId = cursor_cache_insert(&cursorCache, hash, pointer->width, pointer->height,
+                                           pointer->xPos, pointer->yPos, pixels);
+    memory_budget_set(MEMORY_CURSOR_CACHE, cursor_cache_bytes(&cursorCache));
+    return shapeId;
+}
+
+static void showCursorShape(rdpContext *context, const CursorShape *shape) {
+    uint32_t shapeId = shape != NULL ? shape->id : CURSOR_SHAPE_NONE;
+    if (shapeId == shownCursorShape || cursorShapeChangedCallback == NULL) {
+        return;
+    }
+    shownCursorShape = shapeId;
+    if (shape == NULL) {
+        cursorShapeChangedCallback(context->argc, CURSOR_SHAPE_NONE, 0, 0, 0, 0, NULL);
+        return;
+    }
+    cursorShapeChangedCallback(context->argc, shape->id, shape->width, shape->height,
+                               shape->hotX, shape->hotY, shape->pixels);
+}
+
+static BOOL pointer_new(rdpContext *context, rdpPointer *pointer) {
+    iosPointer *iosPtr = (iosPointer *)pointer;
+    // Servers send the same few shapes over and over, under new cache indices too.
+    iosPtr->hash = cursor_cache_hash(pointer->xorMaskData, pointer->lengthXorMask,
+                                     pointer->andMaskData, pointer->lengthAndMask, pointer->xorBpp,
+                                     pointer->width, pointer->height, pointer->xPos, pointer->yPos);
+    iosPtr->shapeId = cursor_cache_find(&cursorCache, iosPtr->hash, pointer->width, pointer->height,
+                                        pointer->xPos, pointer->yPos);
+    if (iosPtr->shapeId != CURSOR_SHAPE_NONE) {
+        metrics_counter_add(METRIC_CURSOR_CACHE_HITS, 1);
+        return true;
+    }
+    iosPtr->shapeId = decodePointer(context, pointer, iosPtr->hash);
+    return true;
+}
+
+static void pointer_free(rdpContext *context, rdpPointer *pointer) {
+    // The decoded shape belongs to cursorCache, other pointers may share it.
+}
+
+static BOOL pointer_set(rdpContext *context, const rdpPointer *pointer) {
+    iosPointer *iosPtr = (iosPointer *)pointer;
+    CursorShape shape;
+    if (!cursor_cache_get(&cursorCache, iosPtr->shapeId, &shape)) {
+        // Evicted since, the pointer still holds what the server sent.
+        iosPtr->shapeId = decodePointer(context, pointer, iosPtr->hash);
+        if (!cursor_cache_get(&cursorCache, iosPtr->shapeId, &shape)) {
+            return true;
+        }
+    }
+    showCursorShape(context, &shape);
+    return true;
+}
+
+static BOOL pointer_set_null(rdpContext *context) {
+    showCursorShape(context, NULL);
+    return true;
+}
+
+static BOOL pointer_set_default(rdpContext *context) {
+    showCursorShape(context, NULL);
+    return true;
+}
+
+static BOOL pointer_set_position(rdpContext *context, UINT32 x, UINT32 y) {
+    return true;
+}
+
+static void registerPointer(rdpGraphics *graphics) {
+    rdpPointer pointer = { 0 };
+    pointer.size = sizeof(iosPointer);
+    pointer.New = pointer_new;
+    pointer.Free = pointer_free;
+    pointer.Set = pointer_set;
+    pointer.SetNull = pointer_set_null;
+    pointer.SetDefault = pointer_set_default;
+    pointer.SetPosition = pointer_set_position;
+    graphics_register_pointer(graphics, &pointer);
+}
+
+static BOOL initGdi(freerdp *instance) {
+    UINT32 width = instance->settings->DesktopWidth;
+    UINT32 height = instance->settings->DesktopHeight;
+    UINT32 stride = width * GetBytesPerPixel(PIXEL_FORMAT_RGBA32);
+    // With exporting on, gdi draws straight into the shared region so readers need no copies.
+    BYTE *pixels = framebuffer_export_allocate(width, height, stride, FRAMEBUFFER_EXPORT_FORMAT_RGBA32);
+    if (pixels != NULL) {
+        if (gdi_init_ex(instance, PIXEL_FORMAT_RGBA32, stride, pixels, framebuffer_export_release)) {
+            return true;
+        }
+        framebuffer_export_release(pixels);
+    }
+    return gdi_init(instance, PIXEL_FORMAT_RGBA32);
+}
+
+static void presentFrame(rdpContext *context) {
     int i = context->instance->context->argc;
-    //printf("end_paint, instance %d\n", i);
+    HGDI_WND hwnd = context->gdi->primary->hdc->hwnd;
+    exportDamage(hwnd);
+    // Repairs held back by the rate limit go out while updates are flowing anyway.
+    sendPendingRefresh(context, false);
+    if (output_suppression_hidden(&outputSuppression)) {
+        // Updates still in flight when output was suppressed, the refresh on resume covers them.
+        metrics_counter_add(METRIC_FRAMES_CULLED, 1);
+        return;
+    }
 
     mfInfo *mfi = MFI_FROM_INSTANCE(context->instance);
     uint8_t* pixels = CGBitmapContextGetData(mfi->bitmap_context);
@@ -59,11 +375,44 @@ static BOOL end_paint(rdpContext* context) {
     globalFb.fbH = context->instance->settings->DesktopHeight;
     globalFb.frameBuffer = pixels;
 
-    if (!frameBufferUpdateCallback(i, pixels, globalFb.fbW, globalFb.fbH, 0, 0, globalFb.fbW, globalFb.fbH)) {
+    HGDI_RGN invalid = hwnd->invalid;
+    int x = invalid->null ? 0 : invalid->x;
+    int y = invalid->null ? 0 : invalid->y;
+    int w = invalid->null ? 0 : invalid->w;
+    int h = invalid->null ? 0 : invalid->h;
+    ViewportRect visible;
+    if (!viewport_tracker_add_damage(&viewportTracker, x, y, w, h, &visible)) {
+        metrics_counter_add(METRIC_FRAMES_CULLED, 1);
+        return;
+    }
+    if (!connect_timeline_complete()) {
+        bridgeConnectMilestone(CONNECT_MILESTONE_FIRST_FRAME);
+    }
+    if (!frameBufferUpdateCallback(i, pixels, globalFb.fbW, globalFb.fbH, visible.x, visible.y, visible.width, visible.height)) {
         // This session is a left-over backgrounded session and must quit.
-        printf("Must quit background session with instance number %d\n", i);
+        client_log("Must quit background session with instance number %d\n", i);
         disconnectRdp(context->instance);
     }
+    // The viewer converts only the damage in view, tiles out of view stay stale until scrolled in.
+    viewport_tracker_mark_presented(&viewportTracker, visible.x, visible.y, visible.width, visible.height);
+}
+
+static BOOL end_paint(rdpContext* context) {
+    //printf("end_paint, instance %d\n", context->instance->context->argc);
+    uint64_t startNs = metrics_now_ns();
+    if (beginPaintNs != 0 && startNs > beginPaintNs) {
+        uint64_t decodeUs = (startNs - beginPaintNs) / 1000;
+        metrics_histogram_record(METRIC_HISTOGRAM_DECODE_US, decodeUs);
+        report_frame_cost(startNs, decodeUs);
+    }
+
+    HGDI_RGN invalid = context->gdi->primary->hdc->hwnd->invalid;
+    uint64_t damage = invalid->null ? 0 : (uint64_t)invalid->w * (uint64_t)invalid->h;
+    metrics_counter_add(METRIC_FRAMES_RECEIVED, 1);
+    metrics_counter_add(METRIC_DAMAGE_PIXELS, damage);
+    metrics_histogram_record(METRIC_HISTOGRAM_DAMAGE_AREA, damage);
+    presentFrame(context);
+    metrics_trace_complete("end_paint", startNs, metrics_now_ns());
     
     return true;
 }
@@ -82,18 +431,34 @@ static BOOL post_connect(freerdp *instance) {
         return false;
     }
 
-    if (!gdi_init(instance, PIXEL_FORMAT_RGBA32)) {
+    if (!initGdi(instance)) {
         return false;
     }
+    registerPointer(instance->context->graphics);
+    shownCursorShape = CURSOR_SHAPE_NONE;
+    if (instance->update->BeginPaint != begin_paint) {
+        originalBeginPaint = instance->update->BeginPaint;
+        instance->update->BeginPaint = begin_paint;
+    }
 
     CGContextRef old_context = mfi->bitmap_context;
     mfi->bitmap_context = reallocate_buffer(mfi);
     globalFb.fbW = instance->settings->DesktopWidth;
     globalFb.fbH = instance->settings->DesktopHeight;
+    rdpGdi *gdi = instance->context->gdi;
+    if (!memory_budget_set(MEMORY_FRAMEBUFFER, (uint64_t)gdi->stride * gdi->height)) {
+        memory_budget_pressure(MEMORY_PRESSURE_NORMAL);
+    }
+    // The viewer shows the whole desktop until it registers a viewport again.
+    viewport_tracker_reset(&viewportTracker, globalFb.fbW, globalFb.fbH);
+    refresh_scheduler_reset(&refreshScheduler, globalFb.fbW, globalFb.fbH);
+    // Every activation starts with updates allowed, a hidden session suppresses them again.
+    output_suppression_connected(&outputSuppression, instance->context, globalFb.fbW, globalFb.fbH);
     frameBufferResizeCallback(i, globalFb.fbW, globalFb.fbH);
     if (old_context != NULL) {
         CGContextRelease(old_context);
     }
+    bridgeConnectMilestone(CONNECT_MILESTONE_POST_CONNECT);
     return true;
 }
 
@@ -104,22 +469,38 @@ enum CLIENT_CONNECTION_STATE
     CLIENT_STATE_POSTCONNECT_PASSED
 };
 
-static char* getStringForInt(int status) {
-    NSString* status_str = [@(status) description];
-    char* status_char_str = (char*)[status_str cStringUsingEncoding:[NSString defaultCStringEncoding]];
-    return status_char_str;
+// Formats into the caller's buffer, autoreleased strings would pile up on
+// the session thread which has no autorelease pool of its own.
+static char* getStringForInt(int status, char *buffer, size_t size) {
+    snprintf(buffer, size, "%d", status);
+    return buffer;
 }
 
 static void ios_post_disconnect(freerdp *instance) {
     printf("ios_post_disconnect\n");
+    output_suppression_disconnected(&outputSuppression);
+    // The rdpPointers are gone with the session, their shapes are not kept around until the next one.
+    cursor_cache_clear(&cursorCache);
+    memory_budget_set(MEMORY_CURSOR_CACHE, 0);
+    shownCursorShape = CURSOR_SHAPE_NONE;
+    // Lets an in process SSH forwarder tear down the tunnel.
+    ssh_channel_transport_shutdown();
 
     int last_error = freerdp_get_last_error(instance->context);
     int connection_state = instance->ConnectionCallbackState;
     
-    char* last_error_char_str = getStringForInt(last_error);
+    char last_error_buffer[16];
+    char* last_error_char_str = getStringForInt(last_error, last_error_buffer, sizeof(last_error_buffer));
     
     int i = instance->context->argc;
     gdi_free(instance);
+    memory_budget_set(MEMORY_FRAMEBUFFER, 0);
+
+    pthread_mutex_lock(&qualityLock);
+    quality_controller_save_history(&qualityController, instance->settings->ServerHostname);
+    pthread_mutex_unlock(&qualityLock);
+    beginPaintNs = 0;
+    setRecommendedFrameIntervalMs(0);
     
     switch(last_error) {
         case FREERDP_ERROR_CONNECT_AUTH_FAILURE_UBUNTU_REMOTE_DESKTOP:
@@ -161,6 +542,59 @@ static void ios_post_disconnect(freerdp *instance) {
     }
 }
 
+static bool rejectedCredentials(int last_error) {
+    switch (last_error) {
+        case FREERDP_ERROR_CONNECT_LOGON_FAILURE:
+        case FREERDP_ERROR_AUTHENTICATION_FAILED:
+        case FREERDP_ERROR_CONNECT_WRONG_PASSWORD:
+        case FREERDP_ERROR_CONNECT_NO_OR_MISSING_CREDENTIALS:
+        case FREERDP_ERROR_CONNECT_ACCESS_DENIED:
+        case FREERDP_ERROR_CONNECT_CANCELLED:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Called by the session loop once the connection failed. Reconnects with the
+// auto-reconnect cookie the server issued at logon, which resumes the session
+// without a new logon, while the last frame stays on screen. Returns TRUE once
+// the session is back, otherwise the usual disconnection handling follows.
+static BOOL auto_reconnect(freerdp *instance) {
+    // The server ending the session sets the error info, only lost links are retried.
+    if (!instance->settings->AutoReconnectionEnabled || freerdp_shall_disconnect(instance) ||
+        freerdp_error_info(instance) != 0) {
+        return FALSE;
+    }
+    uint64_t startNs = metrics_now_ns();
+    reconnect_policy_begin(&reconnectPolicy, startNs);
+    output_suppression_disconnected(&outputSuppression);
+    clientLogCallback("Connection lost, trying to resume the session\n");
+
+    int64_t delayNs;
+    while ((delayNs = reconnect_policy_next_delay(&reconnectPolicy, metrics_now_ns())) >= 0) {
+        if (WaitForSingleObject(instance->context->abortEvent, (DWORD)(delayNs / 1000000)) == WAIT_OBJECT_0) {
+            // Disconnected by the user while waiting.
+            reconnect_policy_give_up(&reconnectPolicy);
+            return FALSE;
+        }
+        if (freerdp_reconnect(instance)) {
+            reconnect_policy_succeeded(&reconnectPolicy);
+            // The server forgot about suppressed output and pending refreshes along with the old connection.
+            output_suppression_connected(&outputSuppression, instance->context, globalFb.fbW, globalFb.fbH);
+            refresh_scheduler_reset(&refreshScheduler, globalFb.fbW, globalFb.fbH);
+            client_log("Session resumed after %u attempts in %llu ms\n", reconnectPolicy.attempts,
+                       (unsigned long long)((metrics_now_ns() - startNs) / 1000000));
+            return TRUE;
+        }
+        if (rejectedCredentials((int)freerdp_get_last_error(instance->context))) {
+            reconnect_policy_give_up(&reconnectPolicy);
+        }
+    }
+    client_log("Could not resume the session after %u attempts\n", reconnectPolicy.attempts);
+    return FALSE;
+}
+
 static BOOL resize_window(rdpContext *context) {
     printf("resize_window, instance %d\n", context->instance->context->argc);
     post_connect(context->instance);
@@ -173,6 +607,7 @@ static DWORD verify_changed_cert(freerdp* instance, const char* host, UINT16 por
                                   const char* old_subject, const char* old_issuer,
                                   const char* old_fingerprint, DWORD flags) {
     printf("verify_changed_cert, instance %d\n", instance->context->argc);
+    bridgeConnectMilestone(CONNECT_MILESTONE_RDP_TLS);
     // FIXME: Implement
     return 1;
 }
@@ -181,80 +616,281 @@ static DWORD verify_cert(freerdp* instance, const char* host, UINT16 port,
                                 const char* common_name, const char* subject,
                                 const char* issuer, const char* fingerprint, DWORD flags) {
     printf("verify_cert, instance %d\n", instance->context->argc);
+    bridgeConnectMilestone(CONNECT_MILESTONE_RDP_TLS);
     // FIXME: Implement
     return 1;
 }
 
 
 static BOOL serverCutText(rdpContext* context, uint8_t* data, UINT32 size) {
-    utf8_client_clipboard_callback(data, size);
+    clipboard_sync_complete_request(&clipboardSync);
+    // Remote text arrives with CRLF line endings, a terminator and possibly
+    // malformed sequences, hand over clean UTF-8 instead.
+    unsigned flags = TRANSCODE_CRLF_TO_LF | TRANSCODE_REPLACE_INVALID | TRANSCODE_STOP_AT_NUL | TRANSCODE_NUL_TERMINATE;
+    size_t length = 0;
+    if (!transcode_buffer_reserve(&serverCutTextBuffer, transcode_utf8_normalized_capacity(size, flags)) ||
+        transcode_utf8_to_utf8(data, size, serverCutTextBuffer.data, serverCutTextBuffer.capacity, flags, &length) != TRANSCODE_OK) {
+        client_log("Could not convert %u bytes of remote clipboard contents\n", size);
+        return false;
+    }
+    memory_budget_set(MEMORY_CLIPBOARD, serverCutTextBuffer.capacity);
+    utf8_client_clipboard_callback(serverCutTextBuffer.data, (long)length);
+    return true;
+}
+
+static void serverClipboardFormats(rdpContext *context, BOOL textAvailable) {
+    clipboard_sync_remote_formats(&clipboardSync, textAvailable);
+    if (clipboardFormatsCallback != NULL) {
+        clipboardFormatsCallback(textAvailable);
+    }
+}
+
+static BOOL clientClipboardData(rdpContext *context, UINT8 **data, UINT32 *size) {
+    long length = 0;
+    char *contents = clipboardDataCallback != NULL ? clipboardDataCallback(&length) : NULL;
+    if (contents == NULL) {
+        return false;
+    }
+    if (length < 0 || length > CLIPBOARD_MAX_BYTES) {
+        client_log("Not sending %ld bytes of clipboard contents, limit is %d\n", length, CLIPBOARD_MAX_BYTES);
+        free(contents);
+        return false;
+    }
+    // Render CF_UNICODETEXT directly rather than leaving the conversion to
+    // the clipboard synthesizer, which assumes well formed input.
+    unsigned flags = TRANSCODE_LF_TO_CRLF | TRANSCODE_REPLACE_INVALID | TRANSCODE_NUL_TERMINATE;
+    size_t capacity = transcode_utf16le_capacity(length, flags);
+    uint8_t *text = malloc(capacity);
+    size_t textLength = 0;
+    if (text == NULL ||
+        transcode_utf8_to_utf16le((uint8_t *)contents, length, text, capacity, flags, &textLength) != TRANSCODE_OK) {
+        client_log("Could not convert %ld bytes of clipboard contents\n", length);
+        free(text);
+        free(contents);
+        return false;
+    }
+    free(contents);
+    *data = text;
+    *size = (UINT32)(textLength + 2);
     return true;
 }
 
+static void initClipboardSync(void) {
+    clipboard_sync_init(&clipboardSync);
+}
+
 static void setGlobalCallbacks(pClientClipboardCallback cl_clipboard_callback, pClientLogCallback cl_log_callback, pFailCallback fail_callback, pFrameBufferResizeCallback fb_resize_callback, pFrameBufferUpdateCallback fb_update_callback, pYesNoCallback y_n_callback) {
     frameBufferUpdateCallback = fb_update_callback;
     frameBufferResizeCallback = fb_resize_callback;
     failCallback = fail_callback;
     clientLogCallback = cl_log_callback;
+    client_log_callback = (void (*)(int8_t *))cl_log_callback;
     utf8_client_clipboard_callback = cl_clipboard_callback;
     yesNoCallback = y_n_callback;
 }
 
-static void copyCredentials(char *domain, char **domainCopy, char *pass, char **passCopy, char *user, char **userCopy) {
-    int bufLength = 512;
-    *domainCopy = malloc(bufLength);
-    strncpy(*domainCopy, domain, bufLength - 1);
-    *userCopy = malloc(bufLength);
-    strncpy(*userCopy, user, bufLength - 1);
-    *passCopy = malloc(bufLength);
-    strncpy(*passCopy, pass, bufLength - 1);
+// Strings handed to the settings are copies owned by the settings, the
+// caller's buffers only live for the duration of initializeRdp.
+static const size_t sessionStringIds[] = {
+    FreeRDP_Domain, FreeRDP_Username, FreeRDP_Password, FreeRDP_ServerHostname, FreeRDP_ConnectionFile,
+    FreeRDP_GatewayHostname, FreeRDP_GatewayUsername, FreeRDP_GatewayPassword, FreeRDP_GatewayDomain
+};
+
+static void copyCredentials(rdpSettings *settings, char *domain, char *pass, char *user) {
+    freerdp_settings_set_string(settings, FreeRDP_Domain, domain);
+    freerdp_settings_set_string(settings, FreeRDP_Username, user);
+    freerdp_settings_set_string(settings, FreeRDP_Password, pass);
+}
+
+// Per session teardown of the connect path allocations, the instance itself
+// stays around because the UI may still hold on to it.
+static void releaseSessionStrings(rdpSettings *settings) {
+    for (size_t i = 0; i < sizeof(sessionStringIds) / sizeof(sessionStringIds[0]); i++) {
+        volatile char *value = (volatile char *)freerdp_settings_get_string(settings, sessionStringIds[i]);
+        while (value != NULL && *value != '\0') {
+            *value++ = '\0';
+        }
+        freerdp_settings_set_string(settings, sessionStringIds[i], NULL);
+    }
 }
 
 static void setSessionParameters(freerdp *instance, int i, char *addr, char *gateway_addr, char *gateway_domain, bool gateway_enabled, char *gateway_pass, char *gateway_port, char *gateway_user, char *port, char *domain, char *user, char *pass) {
     instance->context->argc = i;
 
-    char * domainCopy;
-    char * userCopy;
-    char * passCopy;
-    copyCredentials(domain, &domainCopy, pass, &passCopy, user, &userCopy);
-    instance->context->settings->Domain = domainCopy;
-    instance->context->settings->Username = userCopy;
-    instance->context->settings->Password = passCopy;
+    rdpSettings *settings = instance->context->settings;
+    copyCredentials(settings, domain, pass, user);
     
-    instance->context->settings->ServerHostname = addr;
-    instance->context->settings->ServerPort = atoi(port);
+    freerdp_settings_set_string(settings, FreeRDP_ServerHostname, addr);
+    settings->ServerPort = atoi(port);
     
-    instance->context->settings->GatewayEnabled = gateway_enabled;
-    instance->context->settings->GatewayHostname = gateway_addr;
-    instance->context->settings->GatewayPort = atoi(gateway_port);
-    instance->context->settings->GatewayUsername = gateway_user;
-    instance->context->settings->GatewayPassword = gateway_pass;
-    instance->context->settings->GatewayDomain = gateway_domain;
+    settings->GatewayEnabled = gateway_enabled;
+    freerdp_settings_set_string(settings, FreeRDP_GatewayHostname, gateway_addr);
+    settings->GatewayPort = atoi(gateway_port);
+    freerdp_settings_set_string(settings, FreeRDP_GatewayUsername, gateway_user);
+    freerdp_settings_set_string(settings, FreeRDP_GatewayPassword, gateway_pass);
+    freerdp_settings_set_string(settings, FreeRDP_GatewayDomain, gateway_domain);
     //FIXME: Implement dedicated RDP Gateway authentication support via:
     //instance->GatewayAuthenticate
 }
 
 static void setSessionConfigFile(freerdp *instance, int i, char *configFile, char *domain, char *user, char *pass) {
-    char * domainCopy;
-    char * userCopy;
-    char * passCopy;
-    copyCredentials(domain, &domainCopy, pass, &passCopy, user, &userCopy);
+    rdpSettings *settings = instance->context->settings;
+    copyCredentials(settings, domain, pass, user);
 
     instance->context->argc = i;
-    instance->context->settings->ConnectionFile = configFile;
-    instance->context->settings->Domain = domainCopy;
-    instance->context->settings->Username = userCopy;
-    instance->context->settings->Password = passCopy;
-    int status = freerdp_client_settings_parse_connection_file(instance->context->settings, configFile);
+    freerdp_settings_set_string(settings, FreeRDP_ConnectionFile, configFile);
+    int status = freerdp_client_settings_parse_connection_file(settings, configFile);
+    char status_buffer[16];
     clientLogCallback("freerdp_client_settings_parse_connection_file:");
-    clientLogCallback(getStringForInt(status));
+    clientLogCallback(getStringForInt(status, status_buffer, sizeof(status_buffer)));
+}
+
+// Zero where the cores are all of one kind or the kernel does not say.
+static int performanceCoreCount(void) {
+    int cores = 0;
+    size_t size = sizeof(cores);
+    if (sysctlbyname("hw.perflevel0.physicalcpu", &cores, &size, NULL, 0) != 0) {
+        return 0;
+    }
+    return cores;
+}
+
+// Pressure is reported on a background queue while the session thread may be
+// handing a shape to the app, so the shapes are freed there instead. Pointers
+// decode their shape again the next time they are set.
+static size_t shedCursorCache(void *context, size_t bytesWanted) {
+    __atomic_store_n(&shedCursorShapes, true, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// About half the pixels, and half the bytes of every update on the wire.
+static void reduceDesktopSize(int *width, int *height) {
+    *width = *width * 7 / 10 & ~1;
+    *height = *height * 7 / 10 & ~1;
+}
+
+// Asks the server for a new desktop size over the display control channel.
+// Returns false when the channel is not open or the request could not be sent.
+static bool requestDesktopSize(int width, int height) {
+    bool sent = false;
+    pthread_mutex_lock(&displayControlLock);
+    if (displayControl != NULL && displayControl->SendMonitorLayout != NULL) {
+        if (__atomic_load_n(&reduceDesktopForMemory, __ATOMIC_RELAXED)) {
+            reduceDesktopSize(&width, &height);
+        }
+        DISPLAY_CONTROL_MONITOR_LAYOUT layout = { 0 };
+        layout.Flags = DISPLAY_CONTROL_MONITOR_PRIMARY;
+        layout.Width = MIN(MAX(width, DISPLAY_CONTROL_MIN_MONITOR_WIDTH), DISPLAY_CONTROL_MAX_MONITOR_WIDTH) & ~1;
+        layout.Height = MIN(MAX(height, DISPLAY_CONTROL_MIN_MONITOR_HEIGHT), DISPLAY_CONTROL_MAX_MONITOR_HEIGHT);
+        layout.Orientation = ORIENTATION_LANDSCAPE;
+        layout.DesktopScaleFactor = displayControlSettings->DesktopScaleFactor;
+        layout.DeviceScaleFactor = displayControlSettings->DeviceScaleFactor;
+        sent = displayControl->SendMonitorLayout(displayControl, 1, &layout) == CHANNEL_RC_OK;
+        if (sent) {
+            client_log("Requested remote resolution %ux%u\n", layout.Width, layout.Height);
+        }
+    }
+    pthread_mutex_unlock(&displayControlLock);
+    return sent;
+}
+
+// The color depth is negotiated at connect time and only drops for the next
+// session. The desktop shrinks right away when the server supports display
+// control, its memory is freed once the server resizes and post_connect tags
+// the new framebuffer, so nothing is reported as freed here.
+static size_t shedDesktopQuality(void *context, size_t bytesWanted) {
+    if (!__atomic_exchange_n(&reduceDesktopForMemory, true, __ATOMIC_RELAXED)) {
+        if (requestDesktopSize((int)globalFb.fbW, (int)globalFb.fbH)) {
+            client_log("Memory is critically low, asked for a smaller desktop\n");
+        } else {
+            client_log("Memory is critically low, later sessions use a smaller desktop\n");
+        }
+    }
+    return 0;
+}
+
+static void setMemoryBudget(void) {
+    memory_budget_set_limit(memory_budget_limit_for_device([NSProcessInfo processInfo].physicalMemory));
+    memory_budget_register_shedder(MEMORY_SHED_CACHES, shedCursorCache, NULL);
+    memory_budget_register_shedder(MEMORY_SHED_QUALITY, shedDesktopQuality, NULL);
+}
+
+static QualityDecision chooseSessionQuality(freerdp *instance) {
+    DeviceCapabilities device;
+    device.cpuCores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    device.performanceCores = performanceCoreCount();
+    device.memoryBytes = [NSProcessInfo processInfo].physicalMemory;
+#ifdef WITH_GFX_H264
+    device.h264Available = true;
+#else
+    device.h264Available = false;
+#endif
+
+    pthread_mutex_lock(&qualityLock);
+    quality_controller_init(&qualityController, &device);
+    quality_controller_seed_from_history(&qualityController, instance->context->settings->ServerHostname);
+    QualityDecision decision = quality_controller_connect_decision(&qualityController);
+    lastQualityUpdateNs = 0;
+    pthread_mutex_unlock(&qualityLock);
+    return decision;
+}
+
+static const char *audioQualityArgument(AudioQualityMode mode) {
+    switch (mode) {
+        case AUDIO_QUALITY_MEDIUM:
+            return "medium";
+        case AUDIO_QUALITY_HIGH:
+            return "high";
+        case AUDIO_QUALITY_DYNAMIC:
+        default:
+            return "dynamic";
+    }
+}
+
+// Loads rdpsnd explicitly so the Quality Mode PDU follows the session profile,
+// which decides whether the server sends ADPCM or PCM.
+static void requestAudioPlayback(rdpSettings *settings, AudioQualityMode mode) {
+    if (freerdp_static_channel_collection_find(settings, "rdpsnd") != NULL) {
+        return;
+    }
+    char quality[32];
+    snprintf(quality, sizeof(quality), "quality:%s", audioQualityArgument(mode));
+    char *params[] = { "rdpsnd", "sys:ios", quality };
+    if (!freerdp_client_add_static_channel(settings, 3, params)) {
+        client_log("Could not configure the audio playback channel\n");
+    }
+}
+
+// Where ThreadingFlags carries the thread count, see freerdp_rfx_decode_threads.patch.
+#define DECODE_THREADS_SHIFT 8
+#define DECODE_THREADS_MASK 0xFF
+
+// RemoteFX and progressive decode the tiles of an update on a thread pool and
+// wait for all of them before the update is painted. The count travels with
+// the session's settings, which rfx_context_new_ex gets as ThreadingFlags.
+static void setDecodeThreads(rdpSettings *settings, int decodeThreads) {
+    settings->ThreadingFlags &= ~(THREADING_FLAGS_DISABLE_THREADS | (DECODE_THREADS_MASK << DECODE_THREADS_SHIFT));
+    if (decodeThreads <= 1) {
+        settings->ThreadingFlags |= THREADING_FLAGS_DISABLE_THREADS;
+        return;
+    }
+    if (decodeThreads > DECODE_THREADS_MASK) {
+        decodeThreads = DECODE_THREADS_MASK;
+    }
+    settings->ThreadingFlags |= (UINT32)decodeThreads << DECODE_THREADS_SHIFT;
 }
 
 static void setSessionPreferences(freerdp *instance, bool enable_sound, int height, int width, int desktopScaleFactor) {
+    QualityDecision decision = chooseSessionQuality(instance);
+    apply_quality_decision(&decision);
+
     instance->context->settings->AudioPlayback = enable_sound;
+    if (enable_sound) {
+        requestAudioPlayback(instance->context->settings, decision.audioQuality);
+    }
 
     instance->context->settings->JpegCodec = TRUE;
-    instance->context->settings->JpegQuality = 70;
+    instance->context->settings->JpegQuality = decision.jpegQuality;
     
     instance->context->settings->DisableWallpaper = TRUE;
     instance->context->settings->AllowFontSmoothing = TRUE;
@@ -265,32 +901,129 @@ static void setSessionPreferences(freerdp *instance, bool enable_sound, int heig
     instance->context->settings->NetworkAutoDetect = TRUE;
     
     instance->context->settings->AsyncChannels = TRUE;
+    instance->context->settings->AutoReconnectionEnabled = TRUE;
+    instance->context->settings->AutoReconnectMaxRetries = reconnectPolicy.maxAttempts;
     
-    instance->context->settings->GfxAVC444 = TRUE;
-    instance->context->settings->GfxH264 = TRUE;
+    instance->context->settings->GfxAVC444 = decision.gfxH264;
+    instance->context->settings->GfxH264 = decision.gfxH264;
     
-    instance->context->settings->RemoteFxCodec = TRUE;
+    instance->context->settings->RemoteFxCodec = decision.remoteFx;
+    setDecodeThreads(instance->context->settings, decision.decodeThreads);
+    client_log("Decoding tiles on %d threads\n", decision.decodeThreads);
     
+    if (__atomic_load_n(&reduceDesktopForMemory, __ATOMIC_RELAXED)) {
+        reduceDesktopSize(&width, &height);
+        decision.colorDepth = 16;
+    }
     printf("Requesting initial remote resolution to be %dx%d\n", width, height);
     instance->context->settings->DesktopWidth = width;
     instance->context->settings->DesktopHeight = height;
     instance->context->settings->DynamicResolutionUpdate = TRUE;
+    instance->context->settings->SupportDisplayControl = TRUE;
     instance->context->settings->RedirectClipboard = TRUE;
     instance->context->settings->DesktopScaleFactor = desktopScaleFactor;
     instance->context->settings->DeviceScaleFactor = 100;
     instance->context->settings->SupportGraphicsPipeline = TRUE;
-    instance->context->settings->ColorDepth = 32;
+    instance->context->settings->ColorDepth = decision.colorDepth;
+
+}
+
+static void connection_state_changed(void *context, ConnectionStateChangeEventArgs *e) {
+    switch (e->state) {
+        case RDP_CONNECTION_STATE_NEGO:
+            bridgeConnectMilestone(CONNECT_MILESTONE_RDP_STARTED);
+            break;
+        case RDP_CONNECTION_STATE_MCS_CONNECT:
+            bridgeConnectMilestone(CONNECT_MILESTONE_RDP_SECURITY);
+            break;
+        case RDP_CONNECTION_STATE_LICENSING:
+            bridgeConnectMilestone(CONNECT_MILESTONE_RDP_LICENSING);
+            break;
+        case RDP_CONNECTION_STATE_FINALIZATION:
+            bridgeConnectMilestone(CONNECT_MILESTONE_RDP_CAPABILITIES);
+            break;
+        default:
+            break;
+    }
+}
 
+static void channel_connected(void *context, ChannelConnectedEventArgs *e) {
+    if (strcmp(e->name, DISP_DVC_CHANNEL_NAME) == 0) {
+        pthread_mutex_lock(&displayControlLock);
+        displayControl = (DispClientContext *)e->pInterface;
+        displayControlSettings = ((rdpContext *)context)->settings;
+        pthread_mutex_unlock(&displayControlLock);
+    }
+}
+
+static void channel_disconnected(void *context, ChannelDisconnectedEventArgs *e) {
+    if (strcmp(e->name, DISP_DVC_CHANNEL_NAME) == 0) {
+        pthread_mutex_lock(&displayControlLock);
+        displayControl = NULL;
+        displayControlSettings = NULL;
+        pthread_mutex_unlock(&displayControlLock);
+    }
+}
+
+// Set in libfreerdp by freerdp_tcp_warm_socket.patch.
+extern int (*freerdp_tcp_connect_hook)(const char *hostname, int port, DWORD timeout);
+
+// Hands FreeRDP the socket opened while the connection was highlighted in the
+// list, for the server or the gateway, whichever it dials first. A warm-up
+// still connecting is waited for, it is further along than a new attempt.
+static int takeWarmSocket(const char *hostname, int port, DWORD timeout) {
+    char portString[16];
+    snprintf(portString, sizeof(portString), "%d", port);
+    return connection_warmup_take(hostname, portString, CONNECTION_WARMUP_CONNECT_TIMEOUT_MS, NULL, 0);
+}
+
+static void closeTransportEvent(void *event) {
+    CloseHandle((HANDLE)event);
+}
+
+// Runs the RDP connection over the SSH channel when the forwarder runs in
+// process, so no loopback socket sits between the two. Set in libfreerdp by
+// freerdp_transport_bio.patch, and asked before the TCP connect.
+static BIO* ssh_transport_connect(rdpContext* context, const char* hostname, UINT16 port) {
+    BIO *bio = ssh_channel_transport_take(SSH_CHANNEL_TRANSPORT_REOPEN_WAIT_MS);
+    if (bio == NULL) {
+        return NULL;
+    }
+    HANDLE event = CreateFileDescriptorEvent(NULL, FALSE, FALSE, ssh_channel_transport_socket(bio), WINPR_FD_READ);
+    if (event == NULL) {
+        client_log("Unable to create an event for the SSH channel transport\n");
+        BIO_free(bio);
+        return NULL;
+    }
+    ssh_channel_transport_set_event(bio, event, closeTransportEvent);
+    client_log("Connecting to %s:%u through the SSH channel\n", hostname, port);
+    return bio;
 }
 
 static void setSessionCallbacks(freerdp *instance) {
+    freerdp_tcp_connect_hook = takeWarmSocket;
+    freerdp_set_transport_bio_connect(ssh_transport_connect);
     instance->update->DesktopResize = resize_window;
     instance->update->EndPaint = end_paint;
     mfInfo *mfi = MFI_FROM_INSTANCE(instance);
     mfi->context->ServerCutText = serverCutText;
+    if (clipboardFormatsCallback != NULL && clipboardDataCallback != NULL) {
+        mfi->context->ServerClipboardFormats = serverClipboardFormats;
+        mfi->context->ClientClipboardData = clientClipboardData;
+    }
     
     instance->PostDisconnect = ios_post_disconnect;
     instance->PostConnect = post_connect;
+    mfi->context->AutoReconnect = auto_reconnect;
+    PubSub_SubscribeConnectionStateChange(instance->context->pubSub, connection_state_changed);
+    PubSub_SubscribeChannelConnected(instance->context->pubSub, channel_connected);
+    PubSub_SubscribeChannelDisconnected(instance->context->pubSub, channel_disconnected);
+
+    rdpAutoDetect *autodetect = instance->context->autodetect;
+    if (autodetect != NULL && autodetect->NetworkCharacteristicsResult != network_characteristics_result) {
+        originalNetworkCharacteristicsResult = autodetect->NetworkCharacteristicsResult;
+        autodetect->NetworkCharacteristicsResult = network_characteristics_result;
+    }
     
     // FIXME: Implement certificate verification
     //instance->VerifyX509Certificate;
@@ -319,6 +1052,10 @@ void *initializeRdp(int i, int width, int height, int desktopScaleFactor,
                     char *gateway_pass,
                     bool gateway_enabled) {
     setGlobalCallbacks(cl_clipboard_callback, cl_log_callback, fail_callback, fb_resize_callback, fb_update_callback, y_n_callback);
+    setMemoryBudget();
+    pthread_once(&clipboardSyncOnce, initClipboardSync);
+    clipboard_sync_reset(&clipboardSync);
+    framebuffer_export_enable_from_environment();
     
     freerdp* instance = ios_freerdp_new();
     if (!instance) {
@@ -340,26 +1077,34 @@ void *initializeRdp(int i, int width, int height, int desktopScaleFactor,
 }
 
 void connectRdpInstance(void *instance) {
+    cpu_sampler_tag_current_thread(THREAD_ROLE_DECODER);
+    // A new session starts out visible whatever the previous one was left as.
+    output_suppression_set_hidden(&outputSuppression, false);
     ios_run_freerdp((freerdp *)instance);
+    releaseSessionStrings(((freerdp *)instance)->context->settings);
+    cpu_sampler_untag_current_thread();
 }
 
 void cursorEvent(void *instance, int x, int y, int flags) {
     mfInfo *mfi = MFI_FROM_INSTANCE((freerdp *)instance);
     mfi->instance->input->MouseEvent(mfi->instance->input, flags, x, y);
+    metrics_counter_add(METRIC_INPUT_EVENTS, 1);
 }
 
 void unicodeKeyEvent(void *instance, int flags, int code) {
     mfInfo *mfi = MFI_FROM_INSTANCE((freerdp *)instance);
     mfi->instance->input->UnicodeKeyboardEvent(mfi->instance->input, flags, code);
+    metrics_counter_add(METRIC_INPUT_EVENTS, 1);
 }
 
 void vkKeyEvent(void *instance, int flags, int code) {
     mfInfo *mfi = MFI_FROM_INSTANCE((freerdp *)instance);
     mfi->instance->input->KeyboardEvent(mfi->instance->input, flags, code);
+    metrics_counter_add(METRIC_INPUT_EVENTS, 1);
 }
 
 void resizeRemoteRdpDesktop(void *i, int x, int y) {
-    // FIXME: Implement
+    requestDesktopSize(x, y);
 }
 
 void clientCutText(void *i, char *hostClipboardContents, int size) {
@@ -369,3 +1114,83 @@ void clientCutText(void *i, char *hostClipboardContents, int size) {
     }
 }
 
+void setClipboardCallbacks(pClipboardFormatsCallback formats_callback, pClipboardDataCallback data_callback) {
+    clipboardFormatsCallback = formats_callback;
+    clipboardDataCallback = data_callback;
+}
+
+
+void setCursorShapeChangedCallback(pCursorShapeChangedCallback shape_callback) {
+    cursorShapeChangedCallback = shape_callback;
+}
+
+bool setVisibleViewport(int x, int y, int width, int height, ViewportRect *exposed) {
+    output_suppression_set_viewport(&outputSuppression, x, y, width, height);
+    if (!viewport_tracker_set_viewport(&viewportTracker, x, y, width, height, exposed)) {
+        return false;
+    }
+    CLIENT_LOG_DEBUG("Catching up on %dx%d at %d,%d scrolled into view\n", exposed->width, exposed->height, exposed->x, exposed->y);
+    return true;
+}
+
+bool requestRdpRefresh(void *i, int x, int y, int width, int height) {
+    freerdp *instance = (freerdp *)i;
+    if (instance == NULL || instance->context == NULL) {
+        return false;
+    }
+    if (!refresh_scheduler_add(&refreshScheduler, x, y, width, height)) {
+        return false;
+    }
+    CLIENT_LOG_DEBUG("Refresh of %dx%d at %d,%d requested\n", width, height, x, y);
+    sendPendingRefresh(instance->context, false);
+    return true;
+}
+
+void flushRdpRefresh(void *i) {
+    freerdp *instance = (freerdp *)i;
+    if (instance != NULL && instance->context != NULL) {
+        sendPendingRefresh(instance->context, false);
+    }
+}
+
+bool setRdpOutputSuppressed(void *i, bool suppressed) {
+    freerdp *instance = (freerdp *)i;
+    if (instance == NULL || instance->context == NULL) {
+        return false;
+    }
+    client_log("%s display updates\n", suppressed ? "Suppressing" : "Resuming");
+    return output_suppression_set_hidden(&outputSuppression, suppressed);
+}
+
+void clientClipboardChanged(void *i, long changeCount) {
+    freerdp *instance = (freerdp *)i;
+    if (instance == NULL || instance->context == NULL) {
+        return;
+    }
+    if (clipboard_sync_local_changed(&clipboardSync, changeCount)) {
+        ios_announce_clipboard_text(instance->context);
+    }
+}
+
+void clientClipboardPublished(long changeCount) {
+    clipboard_sync_local_published(&clipboardSync, changeCount);
+}
+
+bool requestRemoteClipboard(void *i) {
+    freerdp *instance = (freerdp *)i;
+    if (instance == NULL || instance->context == NULL) {
+        return false;
+    }
+    switch (clipboard_sync_begin_request(&clipboardSync, metrics_now_ns())) {
+        case CLIPBOARD_REQUEST_SEND:
+            if (!ios_request_clipboard_text(instance->context)) {
+                clipboard_sync_complete_request(&clipboardSync);
+                return false;
+            }
+            return true;
+        case CLIPBOARD_REQUEST_PENDING:
+            return true;
+        default:
+            return false;
+    }
+}
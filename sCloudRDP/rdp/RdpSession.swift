@@ -73,6 +73,8 @@ class RdpSession: RemoteSession {
     
     // FIXME: Make a configuration value
     var preferSendingUnicode = false
+    // Part of the remote desktop on screen, nil while the whole of it is
+    var visibleViewport: CGRect? = nil
     
     var xKeySymToKeyCode: [Int32: Int] = [
         XK_Super_L: RdpSession.LWIN,
@@ -139,11 +141,16 @@ class RdpSession: RemoteSession {
             var errorTitle = ""
             var continueConnecting = true
             self.determineSshTunnelingStatusIfEnabled(sshAddress: self.sshAddress, &continueConnecting, &errorTitle)
+            if continueConnecting && self.sshAddress != "" {
+                bridgeConnectMilestone(Int32(CONNECT_MILESTONE_SSH_TUNNEL_READY.rawValue))
+            }
             
             if continueConnecting {
                 log_callback_str(message: "Connecting RDP Session to \(self.address):\(self.port) or file \(self.configFile)")
                 log_callback_str(message: "RDP Session width: \(self.width), height: \(self.height)")
                 
+                setClipboardCallbacks(clipboard_formats_callback, clipboard_data_callback)
+                setCursorShapeChangedCallback(cursor_shape_changed_callback)
                 self.cl = initializeRdp(
                     Int32(self.instance),
                     Int32(self.width),
@@ -176,6 +183,7 @@ class RdpSession: RemoteSession {
     }
     
     override func connect(currentConnection: [String:String]) {
+        bridgeConnectStarted()
         self.sshAddress = currentConnection["sshAddress"] ?? ""
         self.sshPort = currentConnection["sshPort"] ?? ""
         self.sshUser = currentConnection["sshUser"] ?? ""
@@ -184,6 +192,8 @@ class RdpSession: RemoteSession {
         self.address = currentConnection["address"] ?? ""
         self.sshPassphrase = currentConnection["sshPassphrase"] ?? ""
         self.sshPrivateKey = currentConnection["sshPrivateKey"] ?? ""
+        self.sshCiphers = currentConnection["sshCiphers"] ?? ""
+        self.sshMacs = currentConnection["sshMacs"] ?? ""
         self.keyboardLayout = currentConnection["keyboardLayout"] ??
                                 Constants.DEFAULT_LAYOUT
         self.audioEnabled = Bool(currentConnection["audioEnabled"] ?? "false")!
@@ -207,7 +217,8 @@ class RdpSession: RemoteSession {
             port = getRdpServerPort(gatewayEnabled, port, sshForwardPort)
             gatewayAddress = getRdpGatewayAddress(gatewayEnabled, gatewayAddress)
             gatewayPort = getRdpGatewayPort(gatewayEnabled, sshForwardPort, gatewayPort)
-            startSshForwardingOnBackgroundThread(forwardToAddress, forwardToPort)
+            // FreeRDP takes the SSH channel in process for the RDP server, a gateway is dialed over TCP.
+            startSshForwardingOnBackgroundThread(forwardToAddress, forwardToPort, !gatewayEnabled)
         }
         
         self.domain = currentConnection["domain"] ?? ""
@@ -395,7 +406,19 @@ class RdpSession: RemoteSession {
     }
     
     @objc override func sendScreenUpdateRequest(incrementalUpdate: Bool) {
-        // Not used for RDP
+        guard self.connected && self.cl != nil else {
+            return
+        }
+        if incrementalUpdate {
+            // The server pushes updates on its own, only repairs held back by the rate limit are due
+            flushRdpRefresh(self.cl)
+            return
+        }
+        let fbW = Int(getCurrentFrameBufferWidth())
+        let fbH = Int(getCurrentFrameBufferHeight())
+        let viewport = self.visibleViewport ?? CGRect(x: 0, y: 0, width: fbW, height: fbH)
+        _ = requestRdpRefresh(self.cl, Int32(viewport.minX), Int32(viewport.minY),
+                              Int32(viewport.width), Int32(viewport.height))
     }
     
     override func requestRemoteResolution(x: Int, y: Int) {
@@ -403,4 +426,41 @@ class RdpSession: RemoteSession {
         resizeRemoteRdpDesktop(self.cl, Int32(x), Int32(y))
         self.stateKeeper.reDraw()
     }
+    
+    override func clientClipboardChangedInSession(changeCount: Int) {
+        if (self.connected && self.cl != nil) {
+            // Only the available formats are announced, the contents are kept for when the server pastes
+            cacheClipboardText(changeCount: changeCount)
+            clientClipboardChanged(self.cl, changeCount)
+        }
+    }
+    
+    override func clipboardPublishedInSession(changeCount: Int) {
+        super.clipboardPublishedInSession(changeCount: changeCount)
+        clientClipboardPublished(changeCount)
+    }
+    
+    override func requestRemoteClipboardInSession() -> Bool {
+        if (self.connected && self.cl != nil) {
+            return requestRemoteClipboard(self.cl)
+        }
+        return false
+    }
+    
+    override func visibleViewportChanged(x: Int, y: Int, width: Int, height: Int) {
+        self.visibleViewport = CGRect(x: x, y: y, width: width, height: height)
+        // Updates that arrived while their area was off screen were never presented
+        var exposed = ViewportRect()
+        if setVisibleViewport(Int32(x), Int32(y), Int32(width), Int32(height), &exposed) {
+            self.framebufferChanged(x: Int(exposed.x), y: Int(exposed.y), width: Int(exposed.width), height: Int(exposed.height))
+            self.updateCallback()
+        }
+    }
+    
+    override func setOutputSuppressed(_ suppressed: Bool) -> Bool {
+        if (self.connected && self.cl != nil) {
+            return setRdpOutputSuppressed(self.cl, suppressed)
+        }
+        return false
+    }
 }
@@ -24,9 +24,17 @@
 #include "common/RemoteBridge.h"
 #include "Utility.h"
 #include "rfb/rfbclient.h"
+#include "common/ViewportTracker.h"
 #include "rdp/RdpBridge.h"
 #include "common/SystemMonitor.h"
 #include "common/Utilities.h"
+#include "common/Metrics.h"
+#include "common/CpuSampler.h"
+#include "common/ConnectionWarmup.h"
+#include "common/ReachabilityProber.h"
+#include "common/CursorCache.h"
+#include "common/MemoryBudget.h"
+#include "ssh/SshPortForwarder.h"
 #include "freerdp/api.h"
 #include "freerdp/input.h"
 
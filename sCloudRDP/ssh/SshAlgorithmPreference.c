@@ -0,0 +1,371 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "SshAlgorithmPreference.h"
+#include "Metrics.h"
+#include "Utility.h"
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/utsname.h>
+
+// libssh2 fills packets up to this much payload when the tunnel is busy.
+#define SSH_ALGORITHM_PACKET_SIZE 32768
+#define SSH_ALGORITHM_CACHE_VERSION 1
+
+static const char *cipherNames[SSH_CIPHER_COUNT] = {
+    "aes128-gcm@openssh.com",
+    "aes256-gcm@openssh.com",
+    "chacha20-poly1305@openssh.com",
+    "aes128-ctr",
+    "aes256-ctr",
+};
+
+static const char *macNames[SSH_MAC_COUNT] = {
+    "hmac-sha2-256",
+    "hmac-sha2-512",
+    "hmac-sha1",
+};
+
+static pthread_mutex_t preferenceLock = PTHREAD_MUTEX_INITIALIZER;
+static SshAlgorithmPreference measured;
+static bool measuredValid = false;
+static char overrideCiphers[SSH_ALGORITHM_LIST_SIZE];
+static char overrideMacs[SSH_ALGORITHM_LIST_SIZE];
+
+static bool cipher_is_aead(SshCipher cipher) {
+    return cipher == SSH_CIPHER_AES128_GCM || cipher == SSH_CIPHER_AES256_GCM ||
+           cipher == SSH_CIPHER_CHACHA20_POLY1305;
+}
+
+static const EVP_CIPHER *evp_cipher(SshCipher cipher) {
+    switch (cipher) {
+        case SSH_CIPHER_AES128_GCM:
+            return EVP_aes_128_gcm();
+        case SSH_CIPHER_AES256_GCM:
+            return EVP_aes_256_gcm();
+        case SSH_CIPHER_CHACHA20_POLY1305:
+            return EVP_chacha20_poly1305();
+        case SSH_CIPHER_AES128_CTR:
+            return EVP_aes_128_ctr();
+        case SSH_CIPHER_AES256_CTR:
+            return EVP_aes_256_ctr();
+        default:
+            return NULL;
+    }
+}
+
+static const EVP_MD *evp_md(SshMac mac) {
+    switch (mac) {
+        case SSH_MAC_HMAC_SHA2_256:
+            return EVP_sha256();
+        case SSH_MAC_HMAC_SHA2_512:
+            return EVP_sha512();
+        case SSH_MAC_HMAC_SHA1:
+            return EVP_sha1();
+        default:
+            return NULL;
+    }
+}
+
+static double megabytes_per_second(uint64_t bytes, uint64_t elapsedNs) {
+    return elapsedNs == 0 ? 0 : (double)bytes * 1000.0 / (double)elapsedNs;
+}
+
+// Encrypts packet after packet in place, each AEAD packet with its own nonce and tag.
+static bool encrypt_packet(EVP_CIPHER_CTX *ctx, bool aead, const uint8_t *iv, uint8_t *packet) {
+    int length = 0;
+    uint8_t tag[16];
+    if (aead && (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
+                 !EVP_EncryptUpdate(ctx, NULL, &length, packet, 4))) {
+        return false;
+    }
+    if (!EVP_EncryptUpdate(ctx, packet, &length, packet, SSH_ALGORITHM_PACKET_SIZE)) {
+        return false;
+    }
+    return !aead || (EVP_EncryptFinal_ex(ctx, tag, &length) &&
+                     EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, sizeof(tag), tag));
+}
+
+static double measure_cipher(SshCipher cipher, uint8_t *packet, uint64_t budgetNs) {
+    const EVP_CIPHER *evp = evp_cipher(cipher);
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    uint8_t key[32] = { 1 };
+    uint8_t iv[16] = { 2 };
+    bool aead = cipher_is_aead(cipher);
+    uint64_t bytes = 0;
+    uint64_t startNs = 0;
+    uint64_t nowNs = 0;
+    if (evp == NULL || ctx == NULL || !EVP_EncryptInit_ex(ctx, evp, NULL, key, iv) ||
+        !encrypt_packet(ctx, aead, iv, packet)) {
+        EVP_CIPHER_CTX_free(ctx);
+        return 0;
+    }
+    startNs = metrics_now_ns();
+    do {
+        if (!encrypt_packet(ctx, aead, iv, packet)) {
+            bytes = 0;
+            break;
+        }
+        bytes += SSH_ALGORITHM_PACKET_SIZE;
+        nowNs = metrics_now_ns();
+    } while (nowNs - startNs < budgetNs);
+    EVP_CIPHER_CTX_free(ctx);
+    return megabytes_per_second(bytes, nowNs - startNs);
+}
+
+static double measure_mac(SshMac mac, uint8_t *packet, uint64_t budgetNs) {
+    const EVP_MD *md = evp_md(mac);
+    uint8_t key[64] = { 3 };
+    uint8_t digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    uint64_t bytes = 0;
+    if (md == NULL || HMAC(md, key, EVP_MD_size(md), packet, SSH_ALGORITHM_PACKET_SIZE, digest, &length) == NULL) {
+        return 0;
+    }
+    uint64_t startNs = metrics_now_ns();
+    uint64_t nowNs = startNs;
+    do {
+        HMAC(md, key, EVP_MD_size(md), packet, SSH_ALGORITHM_PACKET_SIZE, digest, &length);
+        bytes += SSH_ALGORITHM_PACKET_SIZE;
+        nowNs = metrics_now_ns();
+    } while (nowNs - startNs < budgetNs);
+    return megabytes_per_second(bytes, nowNs - startNs);
+}
+
+void ssh_algorithm_benchmark_run(SshAlgorithmBenchmark *benchmark, uint64_t budgetNs) {
+    memset(benchmark, 0, sizeof(*benchmark));
+    uint8_t *packet = calloc(1, SSH_ALGORITHM_PACKET_SIZE);
+    if (packet == NULL) {
+        return;
+    }
+    for (int c = 0; c < SSH_CIPHER_COUNT; c++) {
+        benchmark->cipherMBps[c] = measure_cipher((SshCipher)c, packet, budgetNs);
+    }
+    for (int m = 0; m < SSH_MAC_COUNT; m++) {
+        benchmark->macMBps[m] = measure_mac((SshMac)m, packet, budgetNs);
+    }
+    free(packet);
+}
+
+static void append_name(char *list, size_t size, const char *name) {
+    size_t length = strlen(list);
+    size_t needed = strlen(name) + (length > 0 ? 1 : 0);
+    if (length + needed >= size) {
+        return;
+    }
+    snprintf(list + length, size - length, "%s%s", length > 0 ? "," : "", name);
+}
+
+// Insertion sort of the indices by score, fastest first and unmeasured ones last in their given order.
+static void sort_by_score(int *order, const double *score, int count) {
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (int i = 1; i < count; i++) {
+        int index = order[i];
+        int j = i - 1;
+        while (j >= 0 && score[order[j]] < score[index]) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = index;
+    }
+}
+
+void ssh_algorithm_rank(const SshAlgorithmBenchmark *benchmark, SshAlgorithmPreference *preference) {
+    memset(preference, 0, sizeof(*preference));
+    int macOrder[SSH_MAC_COUNT];
+    sort_by_score(macOrder, benchmark->macMBps, SSH_MAC_COUNT);
+    double bestMac = benchmark->macMBps[macOrder[0]];
+
+    double suiteMBps[SSH_CIPHER_COUNT];
+    for (int c = 0; c < SSH_CIPHER_COUNT; c++) {
+        double cipher = benchmark->cipherMBps[c];
+        if (cipher_is_aead((SshCipher)c) || cipher <= 0) {
+            suiteMBps[c] = cipher;
+        } else {
+            // Every byte goes through both, so their times per byte add up.
+            suiteMBps[c] = bestMac > 0 ? 1.0 / (1.0 / cipher + 1.0 / bestMac) : 0;
+        }
+    }
+    int cipherOrder[SSH_CIPHER_COUNT];
+    sort_by_score(cipherOrder, suiteMBps, SSH_CIPHER_COUNT);
+    for (int c = 0; c < SSH_CIPHER_COUNT; c++) {
+        append_name(preference->ciphers, sizeof(preference->ciphers), cipherNames[cipherOrder[c]]);
+    }
+    for (int m = 0; m < SSH_MAC_COUNT; m++) {
+        // Encrypt-then-MAC costs the same and does not authenticate plaintext.
+        char etm[64];
+        snprintf(etm, sizeof(etm), "%s-etm@openssh.com", macNames[macOrder[m]]);
+        append_name(preference->macs, sizeof(preference->macs), etm);
+        append_name(preference->macs, sizeof(preference->macs), macNames[macOrder[m]]);
+    }
+}
+
+static bool list_contains(const char *list, const char *name, size_t nameLength) {
+    const char *start = list;
+    while (*start != '\0') {
+        const char *end = strchr(start, ',');
+        size_t length = end != NULL ? (size_t)(end - start) : strlen(start);
+        if (length == nameLength && strncmp(start, name, nameLength) == 0) {
+            return true;
+        }
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+static bool supported_contains(const char *const *supported, int supportedCount, const char *name, size_t nameLength) {
+    for (int i = 0; i < supportedCount; i++) {
+        if (strlen(supported[i]) == nameLength && strncmp(supported[i], name, nameLength) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ssh_algorithm_merge(const char *preferred, const char *const *supported, int supportedCount,
+                        bool exclusive, char *merged, size_t size) {
+    int count = 0;
+    if (size == 0) {
+        return 0;
+    }
+    merged[0] = '\0';
+    const char *start = preferred != NULL ? preferred : "";
+    while (*start != '\0') {
+        const char *end = strchr(start, ',');
+        size_t length = end != NULL ? (size_t)(end - start) : strlen(start);
+        char name[128];
+        if (length > 0 && length < sizeof(name) && supported_contains(supported, supportedCount, start, length) &&
+            !list_contains(merged, start, length)) {
+            memcpy(name, start, length);
+            name[length] = '\0';
+            size_t before = strlen(merged);
+            append_name(merged, size, name);
+            count += strlen(merged) != before;
+        }
+        if (end == NULL) {
+            break;
+        }
+        start = end + 1;
+    }
+    for (int i = 0; !exclusive && i < supportedCount; i++) {
+        if (!list_contains(merged, supported[i], strlen(supported[i]))) {
+            size_t before = strlen(merged);
+            append_name(merged, size, supported[i]);
+            count += strlen(merged) != before;
+        }
+    }
+    return count;
+}
+
+void ssh_algorithm_preference_set_override(const char *ciphers, const char *macs) {
+    pthread_mutex_lock(&preferenceLock);
+    snprintf(overrideCiphers, sizeof(overrideCiphers), "%s", ciphers != NULL ? ciphers : "");
+    snprintf(overrideMacs, sizeof(overrideMacs), "%s", macs != NULL ? macs : "");
+    pthread_mutex_unlock(&preferenceLock);
+}
+
+// Another device, or another crypto library, may rank the algorithms differently.
+static void cache_key(char *key, size_t size) {
+    struct utsname name;
+    if (uname(&name) != 0) {
+        snprintf(name.machine, sizeof(name.machine), "unknown");
+    }
+    snprintf(key, size, "%d %s %lx", SSH_ALGORITHM_CACHE_VERSION, name.machine, (unsigned long)OpenSSL_version_num());
+}
+
+static void strip_newline(char *line) {
+    line[strcspn(line, "\r\n")] = '\0';
+}
+
+static bool load_cached(const char *cachePath, const char *key, SshAlgorithmPreference *preference) {
+    char line[SSH_ALGORITHM_LIST_SIZE];
+    FILE *file = cachePath != NULL ? fopen(cachePath, "r") : NULL;
+    if (file == NULL) {
+        return false;
+    }
+    bool loaded = false;
+    memset(preference, 0, sizeof(*preference));
+    if (fgets(line, sizeof(line), file) != NULL) {
+        strip_newline(line);
+        loaded = strcmp(line, key) == 0 &&
+                 fgets(preference->ciphers, sizeof(preference->ciphers), file) != NULL &&
+                 fgets(preference->macs, sizeof(preference->macs), file) != NULL;
+    }
+    fclose(file);
+    strip_newline(preference->ciphers);
+    strip_newline(preference->macs);
+    return loaded && preference->ciphers[0] != '\0' && preference->macs[0] != '\0';
+}
+
+static void save_cached(const char *cachePath, const char *key, const SshAlgorithmPreference *preference) {
+    char temporaryPath[1024];
+    if (cachePath == NULL || snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", cachePath) >= (int)sizeof(temporaryPath)) {
+        return;
+    }
+    FILE *file = fopen(temporaryPath, "w");
+    if (file == NULL) {
+        return;
+    }
+    bool written = fprintf(file, "%s\n%s\n%s\n", key, preference->ciphers, preference->macs) > 0;
+    if (fclose(file) == 0 && written) {
+        rename(temporaryPath, cachePath);
+    } else {
+        remove(temporaryPath);
+    }
+}
+
+void ssh_algorithm_preference_get(const char *cachePath, SshAlgorithmPreference *preference) {
+    pthread_mutex_lock(&preferenceLock);
+    if (!measuredValid) {
+        char key[128];
+        cache_key(key, sizeof(key));
+        if (!load_cached(cachePath, key, &measured)) {
+            SshAlgorithmBenchmark benchmark;
+            uint64_t startNs = metrics_now_ns();
+            ssh_algorithm_benchmark_run(&benchmark, SSH_ALGORITHM_BENCHMARK_NS);
+            ssh_algorithm_rank(&benchmark, &measured);
+            client_log("SSH ranked ciphers %s and MACs %s in %llu ms\n", measured.ciphers, measured.macs,
+                       (unsigned long long)((metrics_now_ns() - startNs) / 1000000));
+            save_cached(cachePath, key, &measured);
+        }
+        measuredValid = true;
+    }
+    *preference = measured;
+    if (overrideCiphers[0] != '\0') {
+        snprintf(preference->ciphers, sizeof(preference->ciphers), "%s", overrideCiphers);
+        preference->ciphersExclusive = true;
+    }
+    if (overrideMacs[0] != '\0') {
+        snprintf(preference->macs, sizeof(preference->macs), "%s", overrideMacs);
+        preference->macsExclusive = true;
+    }
+    pthread_mutex_unlock(&preferenceLock);
+}
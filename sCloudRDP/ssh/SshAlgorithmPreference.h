@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#ifndef SshAlgorithmPreference_h
+#define SshAlgorithmPreference_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SSH_ALGORITHM_LIST_SIZE 512
+#define SSH_ALGORITHM_BENCHMARK_NS 8000000ULL
+
+typedef enum {
+    SSH_CIPHER_AES128_GCM = 0,
+    SSH_CIPHER_AES256_GCM,
+    SSH_CIPHER_CHACHA20_POLY1305,
+    SSH_CIPHER_AES128_CTR,
+    SSH_CIPHER_AES256_CTR,
+    SSH_CIPHER_COUNT
+} SshCipher;
+
+typedef enum {
+    SSH_MAC_HMAC_SHA2_256 = 0,
+    SSH_MAC_HMAC_SHA2_512,
+    SSH_MAC_HMAC_SHA1,
+    SSH_MAC_COUNT
+} SshMac;
+
+// Throughput over packets of the size the tunnel sends, zero for what could not be measured.
+typedef struct {
+    double cipherMBps[SSH_CIPHER_COUNT];
+    double macMBps[SSH_MAC_COUNT];
+} SshAlgorithmBenchmark;
+
+typedef struct {
+    char ciphers[SSH_ALGORITHM_LIST_SIZE];
+    char macs[SSH_ALGORITHM_LIST_SIZE];
+    // Only the listed algorithms may be negotiated, nothing else is appended.
+    bool ciphersExclusive;
+    bool macsExclusive;
+} SshAlgorithmPreference;
+
+// Spends about budgetNs on each cipher and MAC.
+void ssh_algorithm_benchmark_run(SshAlgorithmBenchmark *benchmark, uint64_t budgetNs);
+// Orders the algorithms fastest first. The MAC only matters for the CTR ciphers,
+// which are ranked with the fastest MAC added on, the AEAD ciphers have their own.
+void ssh_algorithm_rank(const SshAlgorithmBenchmark *benchmark, SshAlgorithmPreference *preference);
+
+// The names in preferred that are also in supported, in preferred's order, followed
+// by the rest of supported in its own order unless exclusive. Returns how many.
+int ssh_algorithm_merge(const char *preferred, const char *const *supported, int supportedCount,
+                        bool exclusive, char *merged, size_t size);
+
+// Comma separated algorithm names from the connection's settings that replace
+// the measured preference entirely, for deployments that mandate particular
+// algorithms. NULL or empty lists restore the measured preference.
+void ssh_algorithm_preference_set_override(const char *ciphers, const char *macs);
+// The override if there is one, otherwise the ranking cached for this device in
+// cachePath, measuring and caching it first when there is none yet.
+void ssh_algorithm_preference_get(const char *cachePath, SshAlgorithmPreference *preference);
+
+#endif /* SshAlgorithmPreference_h */
@@ -0,0 +1,286 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "SshChannelTransport.h"
+#include "Metrics.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SSH_CHANNEL_TRANSPORT_METRICS_CHANNEL 0
+
+typedef struct {
+    uint32_t generation;
+    int sock;
+    void *event;
+    void (*releaseEvent)(void *event);
+    bool readBlocked;
+    bool writeBlocked;
+} SshChannelBio;
+
+static pthread_mutex_t transportLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t transportChanged = PTHREAD_COND_INITIALIZER;
+static pthread_once_t methodOnce = PTHREAD_ONCE_INIT;
+static BIO_METHOD *method = NULL;
+
+static LIBSSH2_CHANNEL *channel = NULL;
+static int channelSock = -1;
+// Bumped for every published channel, a BIO only ever uses the one it took.
+static uint32_t generation = 0;
+static bool published = false;
+static bool attached = false;
+// Nothing is forwarded in process until a forwarder begins.
+static bool shutdownRequested = true;
+
+void ssh_channel_transport_begin(void) {
+    pthread_mutex_lock(&transportLock);
+    channel = NULL;
+    published = false;
+    attached = false;
+    shutdownRequested = false;
+    pthread_mutex_unlock(&transportLock);
+}
+
+void ssh_channel_transport_lock(void) {
+    pthread_mutex_lock(&transportLock);
+}
+
+void ssh_channel_transport_unlock(void) {
+    pthread_mutex_unlock(&transportLock);
+}
+
+bool ssh_channel_transport_publish(LIBSSH2_CHANNEL *newChannel, int sock) {
+    pthread_mutex_lock(&transportLock);
+    bool accepted = !shutdownRequested;
+    if (accepted) {
+        channel = newChannel;
+        channelSock = sock;
+        generation++;
+        published = true;
+        attached = false;
+        pthread_cond_broadcast(&transportChanged);
+    }
+    pthread_mutex_unlock(&transportLock);
+    return accepted;
+}
+
+SshChannelTransportEnd ssh_channel_transport_wait(void) {
+    pthread_mutex_lock(&transportLock);
+    while (!shutdownRequested && (published || attached)) {
+        pthread_cond_wait(&transportChanged, &transportLock);
+    }
+    SshChannelTransportEnd end = shutdownRequested ? SSH_CHANNEL_TRANSPORT_SHUTDOWN : SSH_CHANNEL_TRANSPORT_CLOSED;
+    channel = NULL;
+    published = false;
+    pthread_mutex_unlock(&transportLock);
+    return end;
+}
+
+void ssh_channel_transport_shutdown(void) {
+    pthread_mutex_lock(&transportLock);
+    shutdownRequested = true;
+    pthread_cond_broadcast(&transportChanged);
+    pthread_mutex_unlock(&transportLock);
+}
+
+// Called with transportLock held.
+static LIBSSH2_CHANNEL *attached_channel(const SshChannelBio *data) {
+    return attached && !shutdownRequested && data->generation == generation ? channel : NULL;
+}
+
+static int channel_bio_write(BIO *bio, const char *buffer, int size) {
+    SshChannelBio *data = BIO_get_data(bio);
+    BIO_clear_retry_flags(bio);
+    pthread_mutex_lock(&transportLock);
+    LIBSSH2_CHANNEL *current = attached_channel(data);
+    ssize_t written = current != NULL ? libssh2_channel_write(current, buffer, (size_t)size) : -1;
+    pthread_mutex_unlock(&transportLock);
+    data->writeBlocked = written == LIBSSH2_ERROR_EAGAIN;
+    if (data->writeBlocked) {
+        BIO_set_retry_write(bio);
+        return -1;
+    }
+    if (written < 0) {
+        return -1;
+    }
+    metrics_ssh_channel_bytes(SSH_CHANNEL_TRANSPORT_METRICS_CHANNEL, 0, (uint64_t)written);
+    return (int)written;
+}
+
+static int channel_bio_read(BIO *bio, char *buffer, int size) {
+    SshChannelBio *data = BIO_get_data(bio);
+    BIO_clear_retry_flags(bio);
+    pthread_mutex_lock(&transportLock);
+    LIBSSH2_CHANNEL *current = attached_channel(data);
+    ssize_t read = current != NULL ? libssh2_channel_read(current, buffer, (size_t)size) : -1;
+    bool eof = read == 0 && current != NULL && libssh2_channel_eof(current);
+    pthread_mutex_unlock(&transportLock);
+    data->readBlocked = read == LIBSSH2_ERROR_EAGAIN || (read == 0 && !eof);
+    if (data->readBlocked) {
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+    if (read < 0) {
+        return -1;
+    }
+    metrics_ssh_channel_bytes(SSH_CHANNEL_TRANSPORT_METRICS_CHANNEL, (uint64_t)read, 0);
+    return (int)read;
+}
+
+static int channel_bio_puts(BIO *bio, const char *string) {
+    return channel_bio_write(bio, string, (int)strlen(string));
+}
+
+// libssh2 reads the socket until it would block, so waiting on it does not miss buffered data.
+static long wait_for_socket(int sock, short events, long timeoutMs) {
+    struct pollfd pfd = { sock, events, 0 };
+    int ready = poll(&pfd, 1, (int)timeoutMs);
+    return ready < 0 ? -1 : ready;
+}
+
+static long channel_bio_ctrl(BIO *bio, int cmd, long num, void *ptr) {
+    SshChannelBio *data = BIO_get_data(bio);
+    switch (cmd) {
+        case BIO_C_GET_FD:
+        case SSH_CHANNEL_BIO_C_GET_SOCKET:
+            if (ptr != NULL) {
+                *(int *)ptr = data->sock;
+            }
+            return data->sock;
+        case SSH_CHANNEL_BIO_C_GET_EVENT:
+            if (ptr == NULL || data->event == NULL) {
+                return 0;
+            }
+            *(void **)ptr = data->event;
+            return 1;
+        case SSH_CHANNEL_BIO_C_SET_NONBLOCK:
+        case BIO_CTRL_FLUSH:
+            return 1;
+        case SSH_CHANNEL_BIO_C_READ_BLOCKED:
+            return data->readBlocked;
+        case SSH_CHANNEL_BIO_C_WRITE_BLOCKED:
+            return data->writeBlocked;
+        case SSH_CHANNEL_BIO_C_WAIT_READ:
+            return wait_for_socket(data->sock, POLLIN, num);
+        case SSH_CHANNEL_BIO_C_WAIT_WRITE:
+            return wait_for_socket(data->sock, POLLOUT, num);
+        default:
+            return 0;
+    }
+}
+
+static int channel_bio_create(BIO *bio) {
+    SshChannelBio *data = calloc(1, sizeof(SshChannelBio));
+    if (data == NULL) {
+        return 0;
+    }
+    data->sock = -1;
+    BIO_set_data(bio, data);
+    return 1;
+}
+
+static int channel_bio_destroy(BIO *bio) {
+    SshChannelBio *data = BIO_get_data(bio);
+    if (data == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&transportLock);
+    if (attached && data->generation == generation) {
+        // The forwarder may free the channel and open another one now.
+        attached = false;
+        pthread_cond_broadcast(&transportChanged);
+    }
+    pthread_mutex_unlock(&transportLock);
+    if (data->event != NULL && data->releaseEvent != NULL) {
+        data->releaseEvent(data->event);
+    }
+    free(data);
+    BIO_set_data(bio, NULL);
+    BIO_set_init(bio, 0);
+    return 1;
+}
+
+static void create_method(void) {
+    method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "SshChannel");
+    if (method == NULL) {
+        return;
+    }
+    BIO_meth_set_write(method, channel_bio_write);
+    BIO_meth_set_read(method, channel_bio_read);
+    BIO_meth_set_puts(method, channel_bio_puts);
+    BIO_meth_set_ctrl(method, channel_bio_ctrl);
+    BIO_meth_set_create(method, channel_bio_create);
+    BIO_meth_set_destroy(method, channel_bio_destroy);
+}
+
+BIO *ssh_channel_transport_take(uint32_t waitMs) {
+    pthread_once(&methodOnce, create_method);
+    if (method == NULL) {
+        return NULL;
+    }
+    BIO *bio = BIO_new(method);
+    if (bio == NULL) {
+        return NULL;
+    }
+    SshChannelBio *data = BIO_get_data(bio);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += waitMs / 1000;
+    deadline.tv_nsec += (long)(waitMs % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&transportLock);
+    while (!published && !shutdownRequested &&
+           pthread_cond_timedwait(&transportChanged, &transportLock, &deadline) == 0) {
+    }
+    bool taken = published && !shutdownRequested;
+    if (taken) {
+        published = false;
+        attached = true;
+        data->generation = generation;
+        data->sock = channelSock;
+    }
+    pthread_mutex_unlock(&transportLock);
+    if (!taken) {
+        BIO_free(bio);
+        return NULL;
+    }
+    BIO_set_init(bio, 1);
+    return bio;
+}
+
+int ssh_channel_transport_socket(BIO *bio) {
+    SshChannelBio *data = BIO_get_data(bio);
+    return data != NULL ? data->sock : -1;
+}
+
+void ssh_channel_transport_set_event(BIO *bio, void *event, void (*releaseEvent)(void *event)) {
+    SshChannelBio *data = BIO_get_data(bio);
+    if (data != NULL) {
+        data->event = event;
+        data->releaseEvent = releaseEvent;
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#ifndef SshChannelTransport_h
+#define SshChannelTransport_h
+
+#include <libssh2.h>
+#include <openssl/bio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The BIO controls libfreerdp's transport sends to its socket BIO, from
+// libfreerdp/core/tcp.h which is not installed.
+#define SSH_CHANNEL_BIO_C_GET_SOCKET 1102
+#define SSH_CHANNEL_BIO_C_GET_EVENT 1103
+#define SSH_CHANNEL_BIO_C_SET_NONBLOCK 1104
+#define SSH_CHANNEL_BIO_C_READ_BLOCKED 1105
+#define SSH_CHANNEL_BIO_C_WRITE_BLOCKED 1106
+#define SSH_CHANNEL_BIO_C_WAIT_READ 1107
+#define SSH_CHANNEL_BIO_C_WAIT_WRITE 1108
+
+// How long a reconnecting session waits for the forwarder to open the next channel.
+#define SSH_CHANNEL_TRANSPORT_REOPEN_WAIT_MS 5000
+
+typedef enum {
+    // The session let go of the channel and may want another one.
+    SSH_CHANNEL_TRANSPORT_CLOSED = 0,
+    // The session is over, no more channels are needed.
+    SSH_CHANNEL_TRANSPORT_SHUTDOWN
+} SshChannelTransportEnd;
+
+// Hands one direct-tcpip channel of the SSH session straight to the RDP
+// transport as a BIO, instead of forwarding a local listening socket to it.
+// Every libssh2 call on the session goes through ssh_channel_transport_lock.
+
+/* Forwarder side */
+
+void ssh_channel_transport_begin(void);
+void ssh_channel_transport_lock(void);
+void ssh_channel_transport_unlock(void);
+// The session must be non-blocking. Returns false once the transport was shut down.
+bool ssh_channel_transport_publish(LIBSSH2_CHANNEL *channel, int sock);
+// Blocks until the channel can be freed, the BIO no longer touches it afterwards.
+SshChannelTransportEnd ssh_channel_transport_wait(void);
+
+/* Session side */
+
+// Takes the published channel, waiting up to waitMs for the forwarder to open
+// one after the previous BIO was freed. Returns NULL right away when no
+// forwarder is running, so the caller connects on its own.
+BIO *ssh_channel_transport_take(uint32_t waitMs);
+// The SSH socket, which is readable whenever the channel may have data.
+int ssh_channel_transport_socket(BIO *bio);
+// Handed out for BIO_C_GET_EVENT and released with the BIO.
+void ssh_channel_transport_set_event(BIO *bio, void *event, void (*releaseEvent)(void *event));
+// Also called by the forwarder when it exits.
+void ssh_channel_transport_shutdown(void);
+
+#endif /* SshChannelTransport_h */
@@ -19,6 +19,12 @@
 
 #include "SshPortForwarder.h"
 #include "Utility.h"
+#include "Metrics.h"
+#include "CpuSampler.h"
+#include "ConnectionWarmup.h"
+#include "ConnectTimeline.h"
+#include "SshAlgorithmPreference.h"
+#include "SshChannelTransport.h"
 
 #include <netdb.h>
 #include <libssh2.h>
@@ -54,6 +60,11 @@
 #define INADDR_NONE (in_addr_t)-1
 #endif
 
+// Darwin only, 0 leaves the socket options alone on Linux.
+#ifndef SO_NOSIGPIPE
+#define SO_NOSIGPIPE 0
+#endif
+
 #include <pthread.h>
 
 #define NUM_CHANNELS 10
@@ -87,10 +98,39 @@ typedef struct _args {
     struct sockaddr_in sin;
     socklen_t sinlen;
     unsigned int sport;
+    int index;
 } args;
 
 pthread_mutex_t lock;
 
+static void release_secret(char **secret) {
+    if (*secret != NULL) {
+        volatile char *p = *secret;
+        while (*p != '\0') {
+            *p++ = '\0';
+        }
+        free(*secret);
+        *secret = NULL;
+    }
+}
+
+static void release_private_key(void) {
+    release_secret(&privKeyPassphrase);
+    release_secret(&privKeyData);
+}
+
+static void release_forwarding_parameters(void) {
+    free(server_ip);
+    server_ip = NULL;
+    free(username);
+    username = NULL;
+    release_secret(&password);
+    free(local_listenip);
+    local_listenip = NULL;
+    free(remote_desthost);
+    remote_desthost = NULL;
+}
+
 int ssh_certificate_verification_callback(int instance, char* fingerprint_sha1, char* fingerprint_sha256) {
     char user_message[1024];
 
@@ -112,40 +152,43 @@ void setupSshPortForward(int instance,
                          void (*cl_log_callback)(int8_t *),
                          int  (*y_n_callback)(int instance, int8_t *, int8_t *, int8_t *, int8_t *, int8_t *, int),
                          char* host, char* port, char* user, char* password, char* privKeyP, char* privKeyD,
-                         char* local_ip, char* local_port, char* remote_ip, char* remote_port) {
-    client_log_callback = cl_log_callback;
+                         char* ciphers, char* macs, char* local_ip, char* local_port, char* remote_ip, char* remote_port, bool in_process) {
+    // The logger's drain thread reads the callback, so it is only written when it changes.
+    if (client_log_callback != cl_log_callback) {
+        client_log_callback = cl_log_callback;
+    }
     yes_no_callback = y_n_callback;
+    ssh_algorithm_preference_set_override(ciphers, macs);
     
-    int argc = 10;
-    char **argv = (char**)malloc(argc*sizeof(char*));
-    int i = 0;
-    
-    char *host_ip = calloc(256, sizeof(char));
-    if (resolve_host_to_ip(host, host_ip) != 0) {
+    // Everything below lives on this stack frame or is released before
+    // returning, startForwarding only returns once the tunnel is torn down.
+    char host_ip[256] = { 0 };
+    // A connection opened while the user was picking this one saves the DNS lookup and TCP handshake.
+    int warm_sock = connection_warmup_take(host, port, CONNECTION_WARMUP_CONNECT_TIMEOUT_MS, host_ip, sizeof(host_ip));
+    if (host_ip[0] == '\0' && resolve_host_to_ip(host, host_ip) != 0) {
         client_log("SSH Unable to resolve %s to an IP\n", host);
         ssh_forward_failure();
         return;
     }
+    connect_timeline_mark(CONNECT_MILESTONE_DNS_RESOLVED, metrics_now_ns());
     
-    for (i = 0; i < argc; i++) {
-        argv[i] = (char*)malloc(256*sizeof(char));
-    }
-    strcpy(argv[0], "dummy");
-    strcpy(argv[1], host_ip);
-    strcpy(argv[2], port);
-    strcpy(argv[3], user);
-    strcpy(argv[4], password);
-    strcpy(argv[5], local_ip);
-    strcpy(argv[6], local_port);
-    strcpy(argv[7], remote_ip);
-    strcpy(argv[8], remote_port);
+    char *argv[] = { "dummy", host_ip, port, user, password, local_ip, local_port, remote_ip, remote_port, NULL };
+    int argc = sizeof(argv) / sizeof(argv[0]);
     
-    privKeyPassphrase = (char*)malloc(1024*sizeof(char));
-    strncpy(privKeyPassphrase, privKeyP, 1023);
-    privKeyData = (char*)malloc(16384*sizeof(char));
-    strncpy(privKeyData, privKeyD, 16383);
+    privKeyPassphrase = strndup(privKeyP, 1023);
+    privKeyData = strndup(privKeyD, 16383);
+    if (privKeyPassphrase == NULL || privKeyData == NULL) {
+        client_log("SSH Unable to allocate private key buffers\n");
+        release_private_key();
+        if (warm_sock >= 0) {
+            close(warm_sock);
+        }
+        ssh_forward_failure();
+        return;
+    }
 
-    int res = startForwarding(instance, argc, argv, ssh_forward_success);
+    int res = startForwarding(instance, argc, argv, warm_sock, ssh_forward_success, in_process);
+    release_private_key();
     client_log ("Result of SSH forwarding: %d\n", res);
     if (res == -2 || res == -4) {
         fail_callback(instance, (uint8_t*)"SSH_PASSWORD_AUTHENTICATION_FAILED_TITLE");
@@ -154,6 +197,40 @@ void setupSshPortForward(int instance,
     }
 }
 
+static bool set_method_preference(LIBSSH2_SESSION *session, int method, const char *preferred, bool exclusive) {
+    const char **supported = NULL;
+    char merged[SSH_ALGORITHM_LIST_SIZE];
+    int count = libssh2_session_supported_algs(session, method, &supported);
+    if (count <= 0) {
+        return !exclusive;
+    }
+    int merges = ssh_algorithm_merge(preferred, supported, count, exclusive, merged, sizeof(merged));
+    libssh2_free(session, supported);
+    if (merges == 0) {
+        // None of the mandated algorithms is available, the defaults must not be used instead.
+        return !exclusive;
+    }
+    if (libssh2_session_method_pref(session, method, merged) != 0) {
+        client_log("libssh2: SSH Could not prefer algorithms %s\n", merged);
+        return !exclusive;
+    }
+    return true;
+}
+
+// The fastest cipher depends on whether the CPU has AES instructions, and the
+// tunnel carries all of the session's traffic.
+static bool set_method_preferences(LIBSSH2_SESSION *session) {
+    SshAlgorithmPreference preference;
+    char cache_path[1024];
+    const char *home = getenv("HOME");
+    snprintf(cache_path, sizeof(cache_path), "%s/Library/Caches/SshAlgorithmPreference", home != NULL ? home : "");
+    ssh_algorithm_preference_get(home != NULL ? cache_path : NULL, &preference);
+    return set_method_preference(session, LIBSSH2_METHOD_CRYPT_CS, preference.ciphers, preference.ciphersExclusive) &&
+           set_method_preference(session, LIBSSH2_METHOD_CRYPT_SC, preference.ciphers, preference.ciphersExclusive) &&
+           set_method_preference(session, LIBSSH2_METHOD_MAC_CS, preference.macs, preference.macsExclusive) &&
+           set_method_preference(session, LIBSSH2_METHOD_MAC_SC, preference.macs, preference.macsExclusive);
+}
+
 static void loop(args *args) {
     char buf[16384];
     LIBSSH2_CHANNEL *channel = args->channel;
@@ -163,6 +240,9 @@ static void loop(args *args) {
     struct sockaddr_in sin = args->sin;
     socklen_t sinlen = args->sinlen;
     unsigned int sport = args->sport;
+    int index = args->index;
+
+    cpu_sampler_tag_current_thread(THREAD_ROLE_SSH_FORWARDER);
 
     struct timeval tv;
     ssize_t len, wr;
@@ -173,17 +253,17 @@ static void loop(args *args) {
     tv.tv_sec = 2;
     tv.tv_usec = 10000;
     
-    client_log("libssh2: SSH Waiting for TCP connection on %s:%d...\n",
+    CLIENT_LOG_DEBUG("libssh2: SSH Waiting for TCP connection on %s:%d...\n",
                inet_ntoa(sin.sin_addr), ntohs(sin.sin_port));
     
     rc = select((int)(listensock + 1), &fds1, NULL, NULL, &tv);
     if (rc <= 0) {
-        client_log("SSH Select on listening socket indicates timeout. This is normal for some SSH channels.\n");
+        CLIENT_LOG_DEBUG("SSH Select on listening socket indicates timeout. This is normal for some SSH channels.\n");
         *return_code = 0;
         return;
     }
 
-    client_log("libssh2: SSH Detected incoming TCP connection.\n");
+    CLIENT_LOG_DEBUG("libssh2: SSH Detected incoming TCP connection.\n");
 
     forwardsock = accept(listensock, (struct sockaddr *)&sin, &sinlen);
 #ifdef WIN32
@@ -193,14 +273,22 @@ static void loop(args *args) {
         return;
     }
 #else
+    if(forwardsock == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // Every channel's thread wakes up for a connection, another one took it.
+        *return_code = 0;
+        return;
+    }
     if(forwardsock == -1) {
         perror("accept");
         client_log("libssh2: SSH Error '%s' accepting forward socket!\n", strerror(errno));
         return;
     }
+    // Accepted sockets inherit O_NONBLOCK from the listener on Darwin.
+    fcntl(forwardsock, F_SETFL, fcntl(forwardsock, F_GETFL, 0) & ~O_NONBLOCK);
 #endif
        
-    client_log("libssh2: Starting I/O loop\n");
+    CLIENT_LOG_DEBUG("libssh2: Starting I/O loop\n");
+    metrics_gauge_add(METRIC_GAUGE_SSH_CHANNELS_OPEN, 1);
 
     while(1) {
         fd_set fds;
@@ -225,6 +313,7 @@ static void loop(args *args) {
             }
             wr = 0;
             while(wr < len) {
+                metrics_ssh_channel_queue_depth(index, len - wr);
                 pthread_mutex_lock(&lock);
                 ssize_t nwritten = libssh2_channel_write(channel, buf + wr, len - wr);
                 pthread_mutex_unlock(&lock);
@@ -232,11 +321,13 @@ static void loop(args *args) {
                     continue;
                 }
                 if(nwritten < 0) {
-                    client_log("libssh2_channel_write: %ld\n", (long)nwritten);
+                    CLIENT_LOG_ERROR("libssh2_channel_write: %ld\n", (long)nwritten);
                     goto threadshutdown;
                 }
                 wr += nwritten;
             }
+            metrics_ssh_channel_queue_depth(index, 0);
+            metrics_ssh_channel_bytes(index, 0, len);
         }
         while(1) {
             pthread_mutex_lock(&lock);
@@ -245,9 +336,10 @@ static void loop(args *args) {
             if(LIBSSH2_ERROR_EAGAIN == len)
                 break;
             if(len < 0) {
-                client_log("libssh2_channel_read: %ld", (long)len);
+                CLIENT_LOG_ERROR("libssh2_channel_read: %ld\n", (long)len);
                 goto threadshutdown;
             }
+            metrics_ssh_channel_bytes(index, len, 0);
             wr = 0;
             while(wr < len) {
                 ssize_t nsent = send(forwardsock, buf + wr, len - wr, 0);
@@ -265,16 +357,58 @@ static void loop(args *args) {
     }
     
 threadshutdown:
+    metrics_gauge_add(METRIC_GAUGE_SSH_CHANNELS_OPEN, -1);
 #ifdef WIN32
     closesocket(forwardsock);
 #else
     close(listensock);
     close(forwardsock);
 #endif
-    client_log("libssh2: worker thread exiting.\n");
+    CLIENT_LOG_DEBUG("libssh2: worker thread exiting.\n");
+}
+
+// Hands direct-tcpip channels to the RDP transport one at a time until the
+// session shuts down, opening a new one whenever the session lets go of the
+// previous one so that reconnecting does not need a new SSH session.
+static int forward_in_process(LIBSSH2_SESSION *session, int sock, void (*ssh_forward_success)(void)) {
+    bool first = true;
+    ssh_channel_transport_begin();
+    client_log("libssh2: SSH Forwarding in process to remote: %s:%d\n", remote_desthost, remote_destport);
+    while (true) {
+        ssh_channel_transport_lock();
+        libssh2_session_set_blocking(session, 1);
+        LIBSSH2_CHANNEL *channel = libssh2_channel_direct_tcpip_ex(session, remote_desthost,
+            remote_destport, "127.0.0.1", 0);
+        /* Must use non-blocking IO hereafter due to the current libssh2 API */
+        libssh2_session_set_blocking(session, 0);
+        ssh_channel_transport_unlock();
+        if (channel == NULL) {
+            client_log("libssh2: SSH Could not open the direct-tcpip channel!\n"
+                       "(Note that this can be a problem at the server! "
+                       "Please review the server logs.)\n");
+            return first ? -10 : 0;
+        }
+        bool published = ssh_channel_transport_publish(channel, sock);
+        if (published && first) {
+            first = false;
+            connect_timeline_mark(CONNECT_MILESTONE_SSH_CHANNEL_OPEN, metrics_now_ns());
+            client_log("libssh2: SSH Channel published, calling ssh_forward_success\n");
+            ssh_forward_success();
+        }
+        SshChannelTransportEnd end = published ? ssh_channel_transport_wait() : SSH_CHANNEL_TRANSPORT_SHUTDOWN;
+        ssh_channel_transport_lock();
+        libssh2_session_set_blocking(session, 1);
+        libssh2_channel_free(channel);
+        libssh2_session_set_blocking(session, 0);
+        ssh_channel_transport_unlock();
+        if (end == SSH_CHANNEL_TRANSPORT_SHUTDOWN) {
+            return 0;
+        }
+        client_log("libssh2: SSH Channel released, opening another one\n");
+    }
 }
 
-int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_success)(void))
+int startForwarding(int instance, int argc, char *argv[], int connected_sock, void (*ssh_forward_success)(void), bool in_process)
 {
     int rc, auth = AUTH_NONE;
     int return_code = 0;
@@ -284,8 +418,10 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
     const char *fingerprint_sha1;
     const char *fingerprint_sha256;
     char *userauthlist;
-    LIBSSH2_SESSION *session;
-    LIBSSH2_CHANNEL *channels[NUM_CHANNELS];
+    char *fingerprint_sha1_str = NULL;
+    char *fingerprint_sha256_str = NULL;
+    LIBSSH2_SESSION *session = NULL;
+    LIBSSH2_CHANNEL *channels[NUM_CHANNELS] = { NULL };
     pthread_t threads[NUM_CHANNELS];
     args args[NUM_CHANNELS];
     const char *shost;
@@ -307,37 +443,43 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
     int sockopt, sock = -1;
     int listensock = -1;
 #endif
-    server_ip = malloc(256*sizeof(char));
-    username = malloc(256*sizeof(char));
-    password = malloc(256*sizeof(char));
-    local_listenip = malloc(256*sizeof(char));
-    remote_desthost = malloc(256*sizeof(char));
-
-    if(argc > 1)
-        strcpy(server_ip, argv[1]);
+    cpu_sampler_tag_current_thread(THREAD_ROLE_SSH_REACTOR);
+
+    // Owned by this call and released again before it returns.
+    release_forwarding_parameters();
+    server_ip = strdup(argc > 1 ? argv[1] : "");
+    username = strdup(argc > 3 ? argv[3] : "");
+    password = strdup(argc > 4 ? argv[4] : "");
+    local_listenip = strdup(argc > 5 ? argv[5] : "");
+    remote_desthost = strdup(argc > 7 ? argv[7] : "");
+    if (server_ip == NULL || username == NULL || password == NULL || local_listenip == NULL || remote_desthost == NULL) {
+        client_log("libssh2: SSH Unable to allocate forwarding parameters\n");
+        return_code = -1;
+        goto released;
+    }
+
     if(argc > 2)
         server_ssh_port = atoi(argv[2]);
-    if(argc > 3)
-        strcpy(username, argv[3]);
-    if(argc > 4)
-        strcpy(password, argv[4]);
-    if(argc > 5)
-        strcpy(local_listenip, argv[5]);
     if(argc > 6)
         local_listenport = atoi(argv[6]);
-    if(argc > 7)
-        strcpy(remote_desthost, argv[7]);
     if(argc > 8)
         remote_destport = atoi(argv[8]);
 
     rc = libssh2_init(0);
     if(rc) {
         client_log("libssh2: SSH libssh2 initialization failed (%d)\n", rc);
-        return 1;
+        return_code = 1;
+        goto released;
     }
     
     /* Connect to SSH server */
     
+    if (connected_sock >= 0) {
+        client_log("libssh2: SSH Using the connection to %s opened ahead of time\n", server_ip);
+        sock = connected_sock;
+        goto connected;
+    }
+
     int is_ipv6 = is_address_ipv6(server_ip);
     if (is_ipv6 == 1) {
         client_log("libssh2: SSH Address is ipv6, will try to connect over ipv6!\n");
@@ -347,19 +489,22 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
     } else {
         client_log("libssh2: SSH Unknown address format.!\n");
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
     
 #ifdef WIN32
     if(sock == INVALID_SOCKET) {
         client_log("SSH Failed to open socket!\n");
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
 #else
     if(sock == -1) {
         perror("socket");
         client_log("libssh2: SSH Error %s open socket!\n", strerror(errno));
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
 #endif
     
@@ -376,7 +521,8 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         addr.sin6_port = htons(server_ssh_port);
         if(connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
             client_log("libssh2: SSH Failed to connect over ipv6!\n");
-            return -1;
+            return_code = -1;
+            goto shutdown;
         }
     } else {
         client_log("libssh2: SSH Attempting ipv4 connection\n");
@@ -384,22 +530,34 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         sin.sin_addr.s_addr = inet_addr(server_ip);
         if(INADDR_NONE == sin.sin_addr.s_addr) {
             perror("inet_addr");
-            return -1;
+            return_code = -1;
+            goto shutdown;
         }
         sin.sin_port = htons(server_ssh_port);
         if(connect(sock, (struct sockaddr*)(&sin),
                    sizeof(struct sockaddr_in)) != 0) {
             client_log("libssh2: SSH Failed to connect over ipv4!\n");
-            return -1;
+            return_code = -1;
+            goto shutdown;
         }
 	}
 
+connected:
+    connect_timeline_mark(CONNECT_MILESTONE_TCP_CONNECTED, metrics_now_ns());
+
     /* Create a session instance */
     client_log("libssh2: SSH Creating a session instance\n");
     session = libssh2_session_init();
     if(!session) {
         client_log("libssh2: SSH Could not initialize SSH session!\n");
-        return -1;
+        return_code = -1;
+        goto shutdown;
+    }
+
+    if (!set_method_preferences(session)) {
+        client_log("libssh2: SSH None of the required ciphers or MACs are available!\n");
+        return_code = -1;
+        goto shutdown;
     }
 
     /* ... start it up. This will trade welcome banners, exchange keys,
@@ -409,8 +567,13 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
     rc = libssh2_session_handshake(session, sock);
     if(rc) {
         client_log("libssh2: SSH Error when starting up SSH session: %d\n", rc);
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
+    connect_timeline_mark(CONNECT_MILESTONE_SSH_HANDSHAKE, metrics_now_ns());
+    client_log("libssh2: SSH Negotiated cipher %s, MAC %s\n",
+               libssh2_session_methods(session, LIBSSH2_METHOD_CRYPT_CS),
+               libssh2_session_methods(session, LIBSSH2_METHOD_MAC_CS));
 
     /* At this point we havn't yet authenticated.  The first thing to do
      * is check the hostkey's fingerprint against our known hosts Your app
@@ -418,15 +581,16 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
      * user, that's your call
      */
     fingerprint_sha1 = libssh2_hostkey_hash(session, LIBSSH2_HOSTKEY_HASH_SHA1);
-    char *fingerprint_sha1_str = get_human_readable_fingerprint((uint8_t *)fingerprint_sha1, 20);
+    fingerprint_sha1_str = get_human_readable_fingerprint((uint8_t *)fingerprint_sha1, 20);
     client_log("libssh2: SHA1 Fingerprint: %s\n", fingerprint_sha1_str);
     fingerprint_sha256 = libssh2_hostkey_hash(session, LIBSSH2_HOSTKEY_HASH_SHA256);
-    char *fingerprint_sha256_str = get_human_readable_fingerprint((uint8_t *)fingerprint_sha256, 32);
+    fingerprint_sha256_str = get_human_readable_fingerprint((uint8_t *)fingerprint_sha256, 32);
     client_log("libssh2: SHA256 Fingerprint: %s\n", fingerprint_sha256_str);
     if (!ssh_certificate_verification_callback(instance, fingerprint_sha1_str, fingerprint_sha256_str)) {
         client_log("libssh2: SSH User did not accept SSH server certificate.\n");
         goto shutdown;
     }
+    connect_timeline_mark(CONNECT_MILESTONE_SSH_HOST_KEY_ACCEPTED, metrics_now_ns());
 
     /* check what authentication methods are available */
     userauthlist = libssh2_userauth_list(session, username, (uint)strlen(username));
@@ -467,18 +631,27 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         return_code = -4;
         goto shutdown;
     }
+    connect_timeline_mark(CONNECT_MILESTONE_SSH_AUTHENTICATED, metrics_now_ns());
+
+    if (in_process) {
+        // No local port to bind or accept on, the RDP transport reads the channel directly.
+        return_code = forward_in_process(session, sock, ssh_forward_success);
+        goto shutdown;
+    }
 
     listensock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
 #ifdef WIN32
     if(listensock == INVALID_SOCKET) {
         client_log("libssh2: SSH Failed to open listen socket!\n");
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
 #else
     if(listensock == -1) {
         perror("socket");
         client_log("libssh2: SSH Error %s opening listen socket!\n", strerror(errno));
-        return -1;
+        return_code = -1;
+        goto shutdown;
     }
 #endif
     sinlen = sizeof(sin);
@@ -510,6 +683,10 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         return_code = 0;
         goto shutdown;
     }
+#ifndef WIN32
+    // The threads that lose the race for a connection must not block in accept.
+    fcntl(listensock, F_SETFL, fcntl(listensock, F_GETFL, 0) | O_NONBLOCK);
+#endif
 
     shost = inet_ntoa(sin.sin_addr);
     sport = ntohs(sin.sin_port);
@@ -534,7 +711,9 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
         args[i].sin = sin;
         args[i].sinlen = sinlen;
         args[i].sport = sport;
+        args[i].index = i;
     }
+    connect_timeline_mark(CONNECT_MILESTONE_SSH_CHANNEL_OPEN, metrics_now_ns());
 
     /* Must use non-blocking IO hereafter due to the current libssh2 API */
     libssh2_session_set_blocking(session, 0);
@@ -556,30 +735,53 @@ int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_suc
     for (int i = 0; i < NUM_CHANNELS; i++) {
         pthread_join(threads[i], NULL);
     }
+    pthread_mutex_destroy(&lock);
     
     client_log("libssh2: Main thread shutting down\n");
 
 shutdown:
+    if (in_process) {
+        // Stops the RDP session from waiting for a channel and from touching the one it has.
+        ssh_channel_transport_shutdown();
+    }
+    free(fingerprint_sha1_str);
+    free(fingerprint_sha256_str);
 #ifdef WIN32
-    closesocket(listensock);
+    if(listensock != INVALID_SOCKET)
+        closesocket(listensock);
 #else
-    close(listensock);
+    if(listensock != -1)
+        close(listensock);
 #endif
     for (int i = 0; i < NUM_CHANNELS; i++) {
         if(return_code == 0 && channels[i] != NULL) {
             libssh2_channel_free(channels[i]);
         }
     }
-    libssh2_session_disconnect(session, "Client disconnecting normally");
-    libssh2_session_free(session);
+    if(session) {
+        libssh2_session_disconnect(session, "Client disconnecting normally");
+        libssh2_session_free(session);
+    }
 
 #ifdef WIN32
-    closesocket(sock);
+    if(sock != INVALID_SOCKET)
+        closesocket(sock);
 #else
-    close(sock);
+    if(sock != -1)
+        close(sock);
 #endif
 
     libssh2_exit();
+    cpu_sampler_untag_current_thread();
+    release_forwarding_parameters();
+    return return_code;
 
+released:
+    // Nothing was set up yet besides the parameters and a warmed up socket.
+    release_forwarding_parameters();
+    if (connected_sock >= 0) {
+        close(connected_sock);
+    }
+    cpu_sampler_untag_current_thread();
     return return_code;
 }
@@ -295,9 +295,15 @@
 #pragma map(deflateInit_, "_libssh2_os400_deflateInit_")
 #endif
 
+#import <stdbool.h>
 #import <stdint.h>
 int resolve_host_to_ip(char *  , char *);
-int startForwarding(int instance, int argc, char *argv[], void (*ssh_forward_success)(void));
+// ciphers and macs are the connection's comma separated algorithm lists, empty
+// ones leave the choice to the measured preference, see SshAlgorithmPreference.h.
+// With in_process the tunnel is handed to the RDP transport through
+// SshChannelTransport instead of listening on local_ip and local_port, see
+// freerdp_transport_bio.patch.
+int startForwarding(int instance, int argc, char *argv[], int connected_sock, void (*ssh_forward_success)(void), bool in_process);
 void setupSshPortForward(int instance,
                          void (*fail_callback)(int instance, uint8_t *),
                          void (*ssh_forward_success)(void),
@@ -305,6 +311,6 @@ void setupSshPortForward(int instance,
                          void (*cl_log_callback)(int8_t *),
                          int  (*y_n_callback)(int instance, int8_t *, int8_t *, int8_t *, int8_t *, int8_t *, int),
                          char* host, char* port, char* user, char* password, char* privKeyP, char* privKeyD,
-                         char* local_ip, char* local_port, char* remote_ip, char* remote_port);
+                         char* ciphers, char* macs, char* local_ip, char* local_port, char* remote_ip, char* remote_port, bool in_process);
 #endif
 /* vim: set expandtab ts=4 sw=4: */
@@ -0,0 +1,269 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "AdpcmDecoder.h"
+#include "TestSupport.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+static const char *dataDirectory;
+
+static uint8_t *read_file(const char *name, size_t *size) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dataDirectory, name);
+    FILE *file = fopen(path, "rb");
+    CHECK(file != NULL);
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    rewind(file);
+    uint8_t *data = malloc(*size);
+    CHECK(data != NULL && fread(data, 1, *size, file) == *size);
+    fclose(file);
+    return data;
+}
+
+// Seven standard pairs followed by two of our own, see generate.py.
+static const int16_t MS_CUSTOM_COEFFICIENTS[][2] = {
+    {256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232}, {384, -128}, {128, 128},
+};
+#define MS_CUSTOM_COEFFICIENT_COUNT (sizeof(MS_CUSTOM_COEFFICIENTS) / sizeof(MS_CUSTOM_COEFFICIENTS[0]))
+
+// The WAVEFORMATEX trailer of an MS ADPCM format with the given table.
+static size_t ms_extra(uint8_t *extra, uint16_t samplesPerBlock, const int16_t (*coefficients)[2], uint16_t count) {
+    extra[0] = samplesPerBlock & 0xFF;
+    extra[1] = samplesPerBlock >> 8;
+    extra[2] = count & 0xFF;
+    extra[3] = count >> 8;
+    for (uint16_t i = 0; i < count; i++) {
+        for (int j = 0; j < 2; j++) {
+            extra[4 + i * 4 + j * 2] = (uint16_t)coefficients[i][j] & 0xFF;
+            extra[5 + i * 4 + j * 2] = (uint16_t)coefficients[i][j] >> 8;
+        }
+    }
+    return 4 + count * 4;
+}
+
+// Decodes the vectors block by block and through the jitter buffer and
+// compares both with the reference output.
+static void check_vectors(uint16_t formatTag, uint32_t channels, uint32_t blockAlign,
+                          const char *encodedName, const char *referenceName) {
+    size_t size, referenceSize;
+    uint8_t *encoded = read_file(encodedName, &size);
+    int16_t *reference = (int16_t *)read_file(referenceName, &referenceSize);
+    AdpcmDecoder decoder;
+    CHECK(adpcm_decoder_init(&decoder, formatTag, channels, blockAlign, NULL, 0));
+
+    int16_t *decoded = malloc(referenceSize);
+    size_t frames = 0;
+    for (size_t offset = 0; offset < size; offset += blockAlign) {
+        frames += adpcm_decode_block(&decoder, encoded + offset, blockAlign, decoded + frames * channels);
+    }
+    CHECK(frames * channels * sizeof(int16_t) == referenceSize);
+    CHECK(memcmp(decoded, reference, referenceSize) == 0);
+
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, 22050, channels);
+    config.maxLatencyMs = 1500;
+    config.capacityMs = 2000;
+    AudioJitterBuffer *buffer = audio_jitter_buffer_new(&config);
+    CHECK(adpcm_decode_to_jitter_buffer(&decoder, buffer, encoded, size, 0) == frames);
+    // Reading everything back starts playback and returns the same samples.
+    memset(decoded, 0, referenceSize);
+    audio_jitter_buffer_read(buffer, decoded, frames);
+    AudioJitterStats stats;
+    audio_jitter_buffer_stats(buffer, &stats);
+    CHECK(stats.underruns == 0 && stats.bufferedFrames == 0);
+    // Past the fade in, which scales the first few frames.
+    size_t fadeSamples = 64 * channels;
+    CHECK(memcmp(decoded + fadeSamples, reference + fadeSamples, referenceSize - fadeSamples * sizeof(int16_t)) == 0);
+    audio_jitter_buffer_free(buffer);
+
+    // A truncated block decodes what it can without reading past its end.
+    int16_t *truncated = malloc(referenceSize);
+    CHECK(adpcm_decode_block(&decoder, encoded, blockAlign / 2, truncated) < decoder.samplesPerBlock);
+    free(truncated);
+
+    adpcm_decoder_free(&decoder);
+    free(decoded);
+    free(reference);
+    free(encoded);
+}
+
+// There is no bit exact MS reference, the MS vectors are encoded from
+// ms.pcm and have to come back out close to it.
+static double decode_snr_db(const AdpcmDecoder *decoder, const char *encodedName, const char *sourceName) {
+    size_t size, sourceSize;
+    uint8_t *encoded = read_file(encodedName, &size);
+    int16_t *source = (int16_t *)read_file(sourceName, &sourceSize);
+    size_t blocks = size / decoder->blockAlign;
+    size_t samples = blocks * decoder->samplesPerBlock * decoder->channels;
+    CHECK(samples * sizeof(int16_t) == sourceSize);
+
+    int16_t *decoded = malloc(sourceSize);
+    for (size_t block = 0; block < blocks; block++) {
+        CHECK(adpcm_decode_block(decoder, encoded + block * decoder->blockAlign, decoder->blockAlign,
+                                 decoded + block * decoder->samplesPerBlock * decoder->channels) ==
+              decoder->samplesPerBlock);
+    }
+    double signal = 0;
+    double noise = 0;
+    for (size_t i = 0; i < samples; i++) {
+        double error = (double)decoded[i] - source[i];
+        signal += (double)source[i] * source[i];
+        noise += error * error;
+    }
+    free(decoded);
+    free(source);
+    free(encoded);
+    return noise == 0 ? INFINITY : 10 * log10(signal / noise);
+}
+
+static void test_ms_against_source(void) {
+    AdpcmDecoder decoder;
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 2, 512, NULL, 0));
+    double snr = decode_snr_db(&decoder, "ms.bin", "ms.pcm");
+    // The custom vectors use a pair past the standard seven, which without
+    // the table falls back to the first pair and has to show.
+    double wrongTable = decode_snr_db(&decoder, "ms_custom.bin", "ms.pcm");
+    adpcm_decoder_free(&decoder);
+
+    uint8_t extra[4 + ADPCM_MAX_COEFFICIENTS * 4];
+    size_t extraSize = ms_extra(extra, (uint16_t)decoder.samplesPerBlock, MS_CUSTOM_COEFFICIENTS,
+                                MS_CUSTOM_COEFFICIENT_COUNT);
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 2, 512, extra, extraSize));
+    double customSnr = decode_snr_db(&decoder, "ms_custom.bin", "ms.pcm");
+    adpcm_decoder_free(&decoder);
+
+    printf("MS ADPCM SNR: %.1f dB, custom table %.1f dB, custom vectors with the standard table %.1f dB\n", snr,
+           customSnr, wrongTable);
+    CHECK(snr > 30);
+    CHECK(customSnr > 30);
+    CHECK(wrongTable < snr - 6);
+}
+
+// A hand decoded mono block through the eighth pair of a custom table,
+// (384, -128), starting from delta 100, sample1 1000 and sample2 800.
+static void test_custom_coefficients(void) {
+    uint8_t extra[4 + ADPCM_MAX_COEFFICIENTS * 4];
+    size_t extraSize = ms_extra(extra, 4, MS_CUSTOM_COEFFICIENTS, MS_CUSTOM_COEFFICIENT_COUNT);
+    AdpcmDecoder decoder;
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 1, 9, extra, extraSize));
+    CHECK(decoder.coefficientCount == MS_CUSTOM_COEFFICIENT_COUNT);
+    CHECK(decoder.coefficients[8][0] == 128 && decoder.coefficients[8][1] == 128);
+
+    // Nibbles 1, -1, -8 and 0. Predictions 1100, 1300, 1216 (1216.5 rounded
+    // down) and 270 (270.5), deltas 100, 89, 79 and 237.
+    uint8_t block[9] = {7, 100, 0, 0xE8, 0x03, 0x20, 0x03, 0x1F, 0x80};
+    int16_t frames[6];
+    static const int16_t expected[6] = {800, 1000, 1200, 1211, 584, 270};
+    CHECK(adpcm_decode_block(&decoder, block, sizeof(block), frames) == 6);
+    CHECK(memcmp(frames, expected, sizeof(expected)) == 0);
+
+    // A predictor past the table falls back to the first pair, (256, 0),
+    // which just repeats the previous sample before the nibble is added.
+    block[0] = MS_CUSTOM_COEFFICIENT_COUNT;
+    block[7] = 0;
+    block[8] = 0;
+    static const int16_t repeated[6] = {800, 1000, 1000, 1000, 1000, 1000};
+    CHECK(adpcm_decode_block(&decoder, block, sizeof(block), frames) == 6);
+    CHECK(memcmp(frames, repeated, sizeof(repeated)) == 0);
+    adpcm_decoder_free(&decoder);
+
+    // Tables that leave out standard pairs, are longer than we keep or are
+    // cut short fall back to the standard seven.
+    size_t shortSize = ms_extra(extra, 4, MS_CUSTOM_COEFFICIENTS, 6);
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 1, 9, extra, shortSize));
+    CHECK(decoder.coefficientCount == 7);
+    adpcm_decoder_free(&decoder);
+    ms_extra(extra, 4, MS_CUSTOM_COEFFICIENTS, MS_CUSTOM_COEFFICIENT_COUNT);
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 1, 9, extra, extraSize - 4));
+    CHECK(decoder.coefficientCount == 7);
+    adpcm_decoder_free(&decoder);
+    extra[2] = ADPCM_MAX_COEFFICIENTS + 1;
+    CHECK(adpcm_decoder_init(&decoder, ADPCM_FORMAT_MS, 1, 9, extra, extraSize));
+    CHECK(decoder.coefficientCount == 7);
+    CHECK(decoder.coefficients[6][0] == 392 && decoder.coefficients[6][1] == -232);
+    adpcm_decoder_free(&decoder);
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Decode cost per second of 44.1 kHz stereo audio, the largest stream
+// servers send, through the jitter buffer as the device plugin does.
+static void benchmark_decode(uint16_t formatTag, const char *encodedName, uint32_t blockAlign) {
+    enum { ROUNDS = 400 };
+    size_t size;
+    uint8_t *encoded = read_file(encodedName, &size);
+    AdpcmDecoder decoder;
+    uint32_t channels = formatTag == ADPCM_FORMAT_IMA ? 1 : 2;
+    CHECK(adpcm_decoder_init(&decoder, formatTag, channels, blockAlign, NULL, 0));
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, 44100, channels);
+    AudioJitterBuffer *buffer = audio_jitter_buffer_new(&config);
+    size_t framesPerWave = size / blockAlign * decoder.samplesPerBlock;
+    int16_t *drain = malloc(framesPerWave * channels * sizeof(int16_t));
+
+    uint64_t frames = 0;
+    uint64_t start = thread_cpu_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        frames += adpcm_decode_to_jitter_buffer(&decoder, buffer, encoded, size, 0);
+        audio_jitter_buffer_read(buffer, drain, framesPerWave);
+    }
+    double seconds = (double)(thread_cpu_ns() - start) / 1e9;
+    CHECK(frames == (uint64_t)ROUNDS * framesPerWave);
+    double realtime = (double)frames / 44100 / seconds;
+    printf("%s decode: %.1f MB/s of ADPCM, %.0fx real time at 44.1 kHz\n",
+           formatTag == ADPCM_FORMAT_IMA ? "IMA" : "MS", (double)size * ROUNDS / seconds / 1e6, realtime);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    // Decoding has to stay a rounding error next to playback.
+    CHECK(realtime > 100);
+#endif
+    free(drain);
+    audio_jitter_buffer_free(buffer);
+    adpcm_decoder_free(&decoder);
+    free(encoded);
+}
+
+static void test_format_support(void) {
+    CHECK(adpcm_format_supported(ADPCM_FORMAT_IMA, 2, 2048, 4));
+    CHECK(adpcm_format_supported(ADPCM_FORMAT_MS, 1, 256, 4));
+    CHECK(!adpcm_format_supported(ADPCM_FORMAT_IMA, 3, 1024, 4));
+    CHECK(!adpcm_format_supported(ADPCM_FORMAT_MS, 2, 512, 16));
+    CHECK(!adpcm_format_supported(0x0001, 2, 4, 16));
+}
+
+int main(int argc, char **argv) {
+    CHECK(argc == 2);
+    dataDirectory = argv[1];
+    test_format_support();
+    check_vectors(ADPCM_FORMAT_IMA, 1, 1024, "ima.bin", "ima.ref");
+    test_ms_against_source();
+    test_custom_coefficients();
+    benchmark_decode(ADPCM_FORMAT_IMA, "ima.bin", 1024);
+    benchmark_decode(ADPCM_FORMAT_MS, "ms.bin", 512);
+    printf("AdpcmDecoderTest passed\n");
+    return 0;
+}
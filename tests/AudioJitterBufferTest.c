@@ -0,0 +1,217 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "AudioJitterBuffer.h"
+#include "TestSupport.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define SAMPLE_RATE 44100
+#define CHANNELS 2
+#define PACKET_FRAMES 882
+#define CALLBACK_FRAMES 512
+
+typedef struct {
+    const char *name;
+    double jitterMs;
+    double burstProbability;
+    double driftPpm;
+    // Packet after which the server goes silent for two seconds, 0 for none.
+    int gapAfter;
+} Link;
+
+typedef struct {
+    AudioJitterStats stats;
+    double maxLatencyMs;
+} LinkResult;
+
+static uint32_t randomState = 3;
+
+static double random_unit(void) {
+    randomState = randomState * 1103515245u + 12345u;
+    return (double)(randomState >> 8) / (double)(1u << 24);
+}
+
+// Plays two minutes of packets with the given arrival jitter against a
+// render callback running on the device clock.
+static LinkResult simulate(const Link *link) {
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, SAMPLE_RATE, CHANNELS);
+    AudioJitterBuffer *buffer = audio_jitter_buffer_new(&config);
+    CHECK(buffer != NULL);
+
+    static int16_t packet[PACKET_FRAMES * CHANNELS];
+    static int16_t output[CALLBACK_FRAMES * CHANNELS];
+    for (int i = 0; i < PACKET_FRAMES * CHANNELS; i++) {
+        packet[i] = (int16_t)(1000 * sin(i * 0.01));
+    }
+    double serverRate = SAMPLE_RATE * (1 + link->driftPpm * 1e-6);
+    double nextPacket = 0, nextCallback = 0, lastArrival = 0;
+    LinkResult result = { { 0 }, 0 };
+    for (int sent = 0; nextCallback < 120.0; sent++) {
+        double delay = random_unit() < link->burstProbability ? random_unit() * 0.15
+                                                              : -log(random_unit() + 1e-9) * link->jitterMs / 1000.0;
+        double arrival = nextPacket + delay;
+        // Packets arrive in order over the one TCP connection.
+        if (arrival < lastArrival) {
+            arrival = lastArrival;
+        }
+        lastArrival = arrival;
+        while (nextCallback < arrival) {
+            audio_jitter_buffer_read(buffer, output, CALLBACK_FRAMES);
+            AudioJitterStats stats;
+            audio_jitter_buffer_stats(buffer, &stats);
+            double latencyMs = stats.bufferedFrames * 1000.0 / SAMPLE_RATE;
+            if (nextCallback > 5 && latencyMs > result.maxLatencyMs) {
+                result.maxLatencyMs = latencyMs;
+            }
+            nextCallback += (double)CALLBACK_FRAMES / SAMPLE_RATE;
+        }
+        audio_jitter_buffer_write(buffer, packet, PACKET_FRAMES, (uint64_t)(arrival * 1e6));
+        nextPacket += PACKET_FRAMES / serverRate;
+        if (link->gapAfter != 0 && sent == link->gapAfter) {
+            nextPacket += 2.0;
+        }
+    }
+    audio_jitter_buffer_stats(buffer, &result.stats);
+    printf("%-9s underruns %3llu dropped %6llu inserted %6llu target %3.0f ms jitter %5.1f ms max latency %3.0f ms\n",
+           link->name, (unsigned long long)result.stats.underruns, (unsigned long long)result.stats.droppedFrames,
+           (unsigned long long)result.stats.insertedFrames, result.stats.targetFrames * 1000.0 / SAMPLE_RATE,
+           result.stats.jitterMs, result.maxLatencyMs);
+    audio_jitter_buffer_free(buffer);
+    return result;
+}
+
+static void test_links(void) {
+    Link wifi = { "wifi", 2, 0, 50, 0 };
+    LinkResult result = simulate(&wifi);
+    CHECK(result.stats.underruns <= 2);
+    CHECK(result.stats.targetFrames * 1000.0 / SAMPLE_RATE < 100);
+
+    // A fast server clock has to be caught up with by skipping frames.
+    Link cellular = { "cellular", 15, 0.02, 300, 0 };
+    result = simulate(&cellular);
+    CHECK(result.stats.droppedFrames > 0);
+    CHECK(result.maxLatencyMs <= 400 + PACKET_FRAMES * 1000.0 / SAMPLE_RATE);
+
+    // A slow one by stretching, drifting far enough to leave the band around the target.
+    Link slow = { "slow", 2, 0, -1000, 0 };
+    result = simulate(&slow);
+    CHECK(result.stats.insertedFrames > 2000);
+    CHECK(result.stats.underruns <= 2);
+
+    // Silence on the server is not mistaken for jitter.
+    Link gap = { "gap", 5, 0, 0, 1000 };
+    result = simulate(&gap);
+    CHECK(result.stats.targetFrames * 1000.0 / SAMPLE_RATE < 150);
+}
+
+// Interpolating between the two extremes must not overflow while catching up.
+static void test_full_scale_steps(void) {
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, SAMPLE_RATE, CHANNELS);
+    AudioJitterBuffer *buffer = audio_jitter_buffer_new(&config);
+    CHECK(buffer != NULL);
+    static int16_t packet[PACKET_FRAMES * CHANNELS];
+    static int16_t output[CALLBACK_FRAMES * CHANNELS];
+    for (int i = 0; i < PACKET_FRAMES; i++) {
+        for (int c = 0; c < CHANNELS; c++) {
+            packet[i * CHANNELS + c] = i % 2 == 0 ? INT16_MIN : INT16_MAX;
+        }
+    }
+    // Well above the target, so playback consumes faster than it outputs.
+    for (int k = 0; k < 15; k++) {
+        CHECK(audio_jitter_buffer_write(buffer, packet, PACKET_FRAMES, (uint64_t)k * 20000) == PACKET_FRAMES);
+    }
+    bool interpolated = false;
+    for (int callback = 0; callback < 10; callback++) {
+        audio_jitter_buffer_read(buffer, output, CALLBACK_FRAMES);
+        // Past the fade in, a sample between the extremes can only come from interpolating.
+        for (int i = callback == 0 ? 256 : 0; i < CALLBACK_FRAMES * CHANNELS; i++) {
+            interpolated |= output[i] > INT16_MIN / 2 && output[i] < INT16_MAX / 2;
+        }
+    }
+    AudioJitterStats stats;
+    audio_jitter_buffer_stats(buffer, &stats);
+    CHECK(stats.droppedFrames > 0);
+    CHECK(interpolated);
+    audio_jitter_buffer_free(buffer);
+}
+
+static void test_rejects_bad_config(void) {
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, SAMPLE_RATE, AUDIO_JITTER_MAX_CHANNELS + 1);
+    CHECK(audio_jitter_buffer_new(&config) == NULL);
+    audio_jitter_config_default(&config, SAMPLE_RATE, CHANNELS);
+    config.maxLatencyMs = config.capacityMs;
+    CHECK(audio_jitter_buffer_new(&config) == NULL);
+}
+
+static AudioJitterBuffer *sharedBuffer;
+static atomic_bool producerDone;
+
+static void *produce(void *unused) {
+    (void)unused;
+    int16_t packet[441 * CHANNELS];
+    for (int k = 0; k < 2000; k++) {
+        for (int i = 0; i < 441 * CHANNELS; i++) {
+            packet[i] = (int16_t)k;
+        }
+        audio_jitter_buffer_write(sharedBuffer, packet, 441, (uint64_t)k * 10000);
+        usleep(200);
+    }
+    atomic_store(&producerDone, true);
+    return NULL;
+}
+
+// One network thread and one render thread share the buffer without locks.
+static void test_concurrent_producer_and_consumer(void) {
+    AudioJitterConfig config;
+    audio_jitter_config_default(&config, SAMPLE_RATE, CHANNELS);
+    sharedBuffer = audio_jitter_buffer_new(&config);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, produce, NULL) == 0);
+    int16_t output[256 * CHANNELS];
+    while (!atomic_load(&producerDone)) {
+        audio_jitter_buffer_read(sharedBuffer, output, 256);
+        usleep(100);
+    }
+    pthread_join(thread, NULL);
+    AudioJitterStats stats;
+    audio_jitter_buffer_stats(sharedBuffer, &stats);
+    CHECK(stats.bufferedFrames <= 1000 * SAMPLE_RATE / 1000 * 2);
+    audio_jitter_buffer_reset(sharedBuffer);
+    audio_jitter_buffer_stats(sharedBuffer, &stats);
+    CHECK(stats.bufferedFrames == 0);
+    audio_jitter_buffer_free(sharedBuffer);
+}
+
+int main(void) {
+    test_links();
+    test_full_scale_steps();
+    test_rejects_bad_config();
+    test_concurrent_producer_and_consumer();
+    printf("AudioJitterBufferTest passed\n");
+    return 0;
+}
@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ClipboardSync.h"
+#include "TestSupport.h"
+
+#include <string.h>
+
+static void test_local_changes_are_announced_once(void) {
+    ClipboardSync sync;
+    clipboard_sync_init(&sync);
+    CHECK(clipboard_sync_local_changed(&sync, 5));
+    CHECK(!clipboard_sync_local_changed(&sync, 5));
+    CHECK(clipboard_sync_local_changed(&sync, 6));
+
+    // Publishing remote text locally must not bounce it back as a local change.
+    clipboard_sync_local_published(&sync, 7);
+    CHECK(!clipboard_sync_local_changed(&sync, 7));
+
+    // A new session announces the current pasteboard again.
+    clipboard_sync_reset(&sync);
+    CHECK(clipboard_sync_local_changed(&sync, 7));
+}
+
+#define SECOND_NS (1000ULL * 1000 * 1000)
+
+// Stands in for the server end of the cliprdr channel, driven the way the bridge
+// drives ClipboardSync for pastes, format lists and the data that comes back.
+typedef struct {
+    ClipboardSync sync;
+    // Format Lists the client sent for its own copies.
+    int formatListsReceived;
+    // Format Data Requests the server got and has not answered yet.
+    int requestsReceived;
+    int unanswered;
+    // Pastes waiting for the remote contents, and how many were served.
+    int waitingPastes;
+    int servedPastes;
+} MockPeer;
+
+static void peer_init(MockPeer *peer) {
+    memset(peer, 0, sizeof(*peer));
+    clipboard_sync_init(&peer->sync);
+}
+
+// The server copied something, or cleared its clipboard.
+static void peer_send_format_list(MockPeer *peer, bool textAvailable) {
+    clipboard_sync_remote_formats(&peer->sync, textAvailable);
+}
+
+// A local paste of the remote contents, as requestRemoteClipboard handles it.
+static bool local_paste(MockPeer *peer, uint64_t nowNs) {
+    switch (clipboard_sync_begin_request(&peer->sync, nowNs)) {
+        case CLIPBOARD_REQUEST_SEND:
+            peer->requestsReceived++;
+            peer->unanswered++;
+            peer->waitingPastes++;
+            return true;
+        case CLIPBOARD_REQUEST_PENDING:
+            peer->waitingPastes++;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The Format Data Response arrives, everybody waiting gets the same contents.
+static void peer_respond(MockPeer *peer) {
+    CHECK(peer->unanswered > 0);
+    peer->unanswered--;
+    clipboard_sync_complete_request(&peer->sync);
+    peer->servedPastes += peer->waitingPastes;
+    peer->waitingPastes = 0;
+}
+
+// The server never answers, the pastes waiting give up on their own.
+static void peer_drop_request(MockPeer *peer) {
+    CHECK(peer->unanswered > 0);
+    peer->unanswered--;
+    peer->waitingPastes = 0;
+}
+
+static void local_copy(MockPeer *peer, long changeCount) {
+    if (clipboard_sync_local_changed(&peer->sync, changeCount)) {
+        peer->formatListsReceived++;
+    }
+}
+
+static void test_remote_requests(void) {
+    MockPeer peer;
+    peer_init(&peer);
+    CHECK(!local_paste(&peer, 0));
+
+    peer_send_format_list(&peer, true);
+    CHECK(local_paste(&peer, 0));
+    // Pastes while a request is in flight wait for the same answer.
+    CHECK(local_paste(&peer, 1));
+    CHECK(peer.requestsReceived == 1);
+    peer_respond(&peer);
+    CHECK(peer.servedPastes == 2);
+    CHECK(!clipboard_sync_complete_request(&peer.sync));
+
+    // Remote text stays available for further pastes until the owner changes.
+    CHECK(local_paste(&peer, 2));
+    CHECK(peer.requestsReceived == 2);
+    peer_respond(&peer);
+    CHECK(peer.servedPastes == 3);
+
+    // Copying locally takes ownership away from the remote side.
+    local_copy(&peer, 8);
+    CHECK(peer.formatListsReceived == 1);
+    CHECK(!local_paste(&peer, 3));
+
+    peer_send_format_list(&peer, false);
+    CHECK(!local_paste(&peer, 3));
+}
+
+static void test_unanswered_request_times_out(void) {
+    MockPeer peer;
+    peer_init(&peer);
+    peer_send_format_list(&peer, true);
+    CHECK(local_paste(&peer, 0));
+    peer_drop_request(&peer);
+
+    // Until the deadline later pastes still count on the lost answer.
+    CHECK(local_paste(&peer, CLIPBOARD_REQUEST_TIMEOUT_NS - 1));
+    CHECK(peer.requestsReceived == 1);
+
+    // After it a paste asks again and gets the contents.
+    CHECK(local_paste(&peer, CLIPBOARD_REQUEST_TIMEOUT_NS));
+    CHECK(peer.requestsReceived == 2);
+    CHECK(local_paste(&peer, CLIPBOARD_REQUEST_TIMEOUT_NS + SECOND_NS));
+    CHECK(peer.requestsReceived == 2);
+    peer_respond(&peer);
+    CHECK(peer.servedPastes == 3);
+}
+
+static void test_new_format_list_abandons_request(void) {
+    MockPeer peer;
+    peer_init(&peer);
+    peer_send_format_list(&peer, true);
+    CHECK(local_paste(&peer, 0));
+    CHECK(peer.requestsReceived == 1);
+
+    // The server copied again before answering, the next paste asks for the new contents right away.
+    peer_send_format_list(&peer, true);
+    CHECK(local_paste(&peer, SECOND_NS));
+    CHECK(peer.requestsReceived == 2);
+    peer_respond(&peer);
+    peer_respond(&peer);
+    CHECK(peer.servedPastes == 2);
+    CHECK(peer.unanswered == 0);
+
+    // A late answer for contents that are gone is not mistaken for a pending one.
+    CHECK(local_paste(&peer, 2 * SECOND_NS));
+    peer_send_format_list(&peer, false);
+    CHECK(!clipboard_sync_complete_request(&peer.sync));
+    CHECK(!local_paste(&peer, 3 * SECOND_NS));
+}
+
+static void test_published_contents_are_not_announced(void) {
+    MockPeer peer;
+    peer_init(&peer);
+    local_copy(&peer, 1);
+    CHECK(peer.formatListsReceived == 1);
+
+    // Offering the remote contents on the pasteboard is not a local copy.
+    peer_send_format_list(&peer, true);
+    clipboard_sync_local_published(&peer.sync, 2);
+    local_copy(&peer, 2);
+    CHECK(peer.formatListsReceived == 1);
+    CHECK(local_paste(&peer, 0));
+    peer_respond(&peer);
+    CHECK(peer.servedPastes == 1);
+
+    local_copy(&peer, 3);
+    CHECK(peer.formatListsReceived == 2);
+    CHECK(!local_paste(&peer, SECOND_NS));
+}
+
+int main(void) {
+    test_local_changes_are_announced_once();
+    test_remote_requests();
+    test_unanswered_request_times_out();
+    test_new_format_list_abandons_request();
+    test_published_contents_are_not_announced();
+    printf("ClipboardSyncTest passed\n");
+    return 0;
+}
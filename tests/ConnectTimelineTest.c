@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ConnectTimeline.h"
+#include "TestSupport.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#define MS 1000000ULL
+#define MARKER_THREADS 4
+#define MARKS 100000
+
+// Every thread passes the milestones in turn, only the earliest time may stick.
+static void *mark_milestones(void *argument) {
+    for (int i = 0; i < MARKS; i++) {
+        connect_timeline_mark((ConnectMilestone)(1 + i % (CONNECT_MILESTONE_COUNT - 1)), (uint64_t)(1000 + i) * MS);
+    }
+    return NULL;
+}
+
+static void test_milestones(void) {
+    CHECK(!connect_timeline_mark(CONNECT_MILESTONE_DNS_RESOLVED, 5));
+
+    connect_timeline_start(100 * MS);
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_DNS_RESOLVED, 112 * MS));
+    CHECK(!connect_timeline_mark(CONNECT_MILESTONE_DNS_RESOLVED, 150 * MS));
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_TCP_CONNECTED, 140 * MS));
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_RDP_STARTED, 141 * MS));
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_RDP_SECURITY, 400 * MS));
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_POST_CONNECT, 700 * MS));
+    CHECK(!connect_timeline_complete());
+    CHECK(connect_timeline_mark(CONNECT_MILESTONE_FIRST_FRAME, 900 * MS));
+    CHECK(connect_timeline_complete());
+    // Nothing counts once the first frame was drawn.
+    CHECK(!connect_timeline_mark(CONNECT_MILESTONE_RDP_TLS, 950 * MS));
+    CHECK(!connect_timeline_mark(CONNECT_MILESTONE_STARTED, 950 * MS));
+
+    ConnectReport report;
+    connect_timeline_report(&report);
+    CHECK(report.complete);
+    CHECK(report.attempt == 1);
+    CHECK(report.atNs[CONNECT_MILESTONE_RDP_TLS] == 0);
+
+    char line[512];
+    size_t length = connect_report_format(&report, line, sizeof(line));
+    CHECK(length == strlen(line));
+    CHECK(strstr(line, "in 800 ms") != NULL);
+    CHECK(strstr(line, "dns=12 tcp=28 rdp_started=1 rdp_security=259 post_connect=300 first_frame=200") != NULL);
+
+    char small[20];
+    CHECK(connect_report_format(&report, small, sizeof(small)) == length);
+    CHECK(strlen(small) == sizeof(small) - 1);
+
+    connect_timeline_start(2000 * MS);
+    connect_timeline_report(&report);
+    CHECK(report.attempt == 2);
+    CHECK(!report.complete);
+    CHECK(report.atNs[CONNECT_MILESTONE_DNS_RESOLVED] == 0);
+}
+
+static void test_concurrent_marks(void) {
+    pthread_t threads[MARKER_THREADS];
+    for (int i = 0; i < MARKER_THREADS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, mark_milestones, NULL) == 0);
+    }
+    for (int i = 0; i < MARKER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    ConnectReport report;
+    connect_timeline_report(&report);
+    for (int milestone = 1; milestone < CONNECT_MILESTONE_COUNT; milestone++) {
+        CHECK(report.atNs[milestone] == (uint64_t)(1000 + milestone - 1) * MS);
+    }
+}
+
+int main(void) {
+    test_milestones();
+    test_concurrent_marks();
+    printf("ConnectTimelineTest passed\n");
+    return 0;
+}
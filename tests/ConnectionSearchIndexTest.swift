@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+import Foundation
+
+/**
+ Checks the connection search index against a plain substring scan, and that searching
+ 10,000 connections stays well within a keystroke.
+ */
+@main
+struct ConnectionSearchIndexTest {
+    static let connectionCount = 10000
+    static let maxMillisecondsPerSearch = 5.0
+
+    static func check(_ condition: Bool, _ message: String, line: Int = #line) {
+        if !condition {
+            FileHandle.standardError.write("ConnectionSearchIndexTest.swift:\(line): check failed: \(message)\n".data(using: .utf8)!)
+            exit(1)
+        }
+    }
+
+    static func text(_ i: Int) -> String {
+        return "Server \(i) host\(i % 97).example.com user\(i % 13)"
+    }
+
+    static func scan(_ documents: [(id: String, text: String)], _ searchText: String) -> Set<String> {
+        let lowerCasedSearchText = searchText.lowercased()
+        return Set(documents.filter { $0.text.lowercased().contains(lowerCasedSearchText) }.map { $0.id })
+    }
+
+    static func testMatchesScan() {
+        let documents = (0..<1000).map { (id: String($0), text: text($0)) }
+        let index = ConnectionSearchIndex()
+        index.rebuild(documents: documents)
+        check(index.search(searchText: "") == nil, "empty search matches everything")
+        for query in ["se", "host42", "HOST42.", "user1", "example", "nothing", "r 99", "e"] {
+            check(index.search(searchText: query) == scan(documents, query), "search for \(query)")
+        }
+    }
+
+    static func testUpdatesAndRemovals() {
+        let index = ConnectionSearchIndex()
+        index.update(id: "a", text: "Office Desktop")
+        index.update(id: "b", text: "Home Desktop")
+        check(index.search(searchText: "desk") == ["a", "b"], "both desktops")
+        index.update(id: "a", text: "Office Laptop")
+        check(index.search(searchText: "desk") == ["b"], "renamed connection drops out")
+        check(index.search(searchText: "lapt") == ["a"], "renamed connection is found")
+        index.remove(id: "b")
+        check(index.search(searchText: "desk") == [], "removed connection drops out")
+        // Trigrams alone would match, the substring check must not.
+        index.update(id: "c", text: "abcXbcd")
+        check(index.search(searchText: "abcd") == [], "trigrams out of order")
+    }
+
+    static func testComposedAndDecomposedAccents() {
+        let index = ConnectionSearchIndex()
+        index.update(id: "a", text: "Caf\u{00E9} Server")
+        check(index.search(searchText: "cafe\u{0301}") == ["a"], "decomposed query finds composed text")
+    }
+
+    static func testTenThousandConnections() {
+        let documents = (0..<connectionCount).map { (id: String($0), text: text($0)) }
+        let index = ConnectionSearchIndex()
+        var start = Date()
+        index.rebuild(documents: documents)
+        print("Indexed \(connectionCount) connections in \(Int(Date().timeIntervalSince(start) * 1000)) ms")
+
+        let queries = ["host42.ex", "user12", "server 9999", "example.com", "missing"]
+        start = Date()
+        var matches = 0
+        for query in queries {
+            matches += index.search(searchText: query)?.count ?? 0
+        }
+        let perSearch = Date().timeIntervalSince(start) * 1000 / Double(queries.count)
+        print("\(String(format: "%.2f", perSearch)) ms per search, \(matches) matches")
+        check(matches > 0, "searches find connections")
+        check(perSearch < maxMillisecondsPerSearch, "\(perSearch) ms per search")
+    }
+
+    static func main() {
+        testMatchesScan()
+        testUpdatesAndRemovals()
+        testComposedAndDecomposedAccents()
+        testTenThousandConnections()
+        print("ConnectionSearchIndexTest passed")
+    }
+}
@@ -0,0 +1,229 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ConnectionWarmup.h"
+#include "Metrics.h"
+#include "TestSupport.h"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BANNER "SSH-2.0-test\r\n"
+// How long the server takes to greet a new connection.
+#define BANNER_DELAY_US 5000
+#define TTFB_ROUNDS 20
+
+static char port[16];
+static pthread_mutex_t serverLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bannerSent = PTHREAD_COND_INITIALIZER;
+static int bannersSent;
+
+// Sends a banner shortly after accepting, like an SSH server.
+static void *serve(void *arg) {
+    int listener = (int)(long)arg;
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+        usleep(BANNER_DELAY_US);
+        CHECK(write(fd, BANNER, strlen(BANNER)) == (ssize_t)strlen(BANNER));
+        close(fd);
+        pthread_mutex_lock(&serverLock);
+        bannersSent++;
+        pthread_cond_broadcast(&bannerSent);
+        pthread_mutex_unlock(&serverLock);
+    }
+    return NULL;
+}
+
+static int banners_sent(void) {
+    pthread_mutex_lock(&serverLock);
+    int sent = bannersSent;
+    pthread_mutex_unlock(&serverLock);
+    return sent;
+}
+
+static void wait_for_banners(int sent) {
+    pthread_mutex_lock(&serverLock);
+    while (bannersSent < sent) {
+        pthread_cond_wait(&bannerSent, &serverLock);
+    }
+    pthread_mutex_unlock(&serverLock);
+}
+
+static int start_server(void) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, 16) == 0);
+    socklen_t length = sizeof(address);
+    getsockname(listener, (struct sockaddr *)&address, &length);
+    snprintf(port, sizeof(port), "%d", ntohs(address.sin_port));
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, serve, (void *)(long)listener) == 0);
+    pthread_detach(thread);
+    return listener;
+}
+
+static void check_banner(int fd) {
+    char banner[32];
+    CHECK(fd >= 0);
+    CHECK(read(fd, banner, strlen(BANNER)) == (ssize_t)strlen(BANNER));
+    CHECK(memcmp(banner, BANNER, strlen(BANNER)) == 0);
+    close(fd);
+}
+
+static void test_take_warm_socket(void) {
+    char ip[64];
+    CHECK(connection_warmup_start("localhost", port, true, 2000));
+    CHECK(connection_warmup_wait_ready("localhost", port, 5000));
+    int fd = connection_warmup_take("localhost", port, 5000, ip, sizeof(ip));
+    CHECK(strcmp(ip, "127.0.0.1") == 0 || strcmp(ip, "::1") == 0);
+    check_banner(fd);
+    // Taking hands the socket over, there is nothing left for a second taker.
+    CHECK(connection_warmup_take("localhost", port, 0, ip, sizeof(ip)) < 0);
+
+    // A take while the worker is still connecting waits for it.
+    CHECK(connection_warmup_start("localhost", port, true, 2000));
+    check_banner(connection_warmup_take("localhost", port, 5000, ip, sizeof(ip)));
+    CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+}
+
+static void test_expiry_and_failures(void) {
+    char ip[64];
+    CHECK(connection_warmup_start("localhost", port, true, 200));
+    CHECK(connection_warmup_wait_ready("localhost", port, 5000));
+    // The worker lets go of its entry once the grace period is over.
+    CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+    CHECK(connection_warmup_take("localhost", port, 0, ip, sizeof(ip)) < 0);
+
+    // Only the address is warmed up for the protocol libraries.
+    CHECK(connection_warmup_start("localhost", "3389", false, 2000));
+    CHECK(connection_warmup_wait_ready("localhost", "3389", 5000));
+    CHECK(connection_warmup_take("localhost", "3389", 100, ip, sizeof(ip)) < 0);
+    CHECK(ip[0] != '\0');
+
+    CHECK(connection_warmup_start("127.0.0.1", "1", true, 2000));
+    CHECK(!connection_warmup_wait_ready("127.0.0.1", "1", 5000));
+    CHECK(connection_warmup_take("127.0.0.1", "1", 2000, ip, sizeof(ip)) < 0);
+    CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+}
+
+static void test_eviction_and_cancel(void) {
+    char otherPort[16];
+    for (int i = 0; i < CONNECTION_WARMUP_MAX_ENTRIES; i++) {
+        snprintf(otherPort, sizeof(otherPort), "%d", 40000 + i);
+        CHECK(connection_warmup_start("localhost", otherPort, false, 5000));
+        CHECK(connection_warmup_wait_ready("localhost", otherPort, 5000));
+    }
+    // A full table evicts the oldest finished entry, the slot is free for the next attempt.
+    CHECK(!connection_warmup_start("localhost", "40100", false, 5000));
+    CHECK(connection_warmup_wait_busy(CONNECTION_WARMUP_MAX_ENTRIES - 1, 5000) == CONNECTION_WARMUP_MAX_ENTRIES - 1);
+    CHECK(connection_warmup_start("localhost", "40100", false, 5000));
+    char ip[64];
+    CHECK(connection_warmup_take("localhost", "40000", 0, ip, sizeof(ip)) < 0);
+    CHECK(ip[0] == '\0');
+
+    connection_warmup_cancel_all();
+    CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+    CHECK(connection_warmup_start("localhost", port, true, 2000));
+    connection_warmup_cancel("localhost", port);
+    CHECK(connection_warmup_take("localhost", port, 0, ip, sizeof(ip)) < 0);
+    CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+}
+
+static uint64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+}
+
+// What a session does without warm-up: resolve, connect and wait for the banner.
+static int connect_cold(void) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG;
+    struct addrinfo *result = NULL;
+    CHECK(getaddrinfo("localhost", port, &hints, &result) == 0);
+    int fd = -1;
+    for (struct addrinfo *ai = result; ai != NULL && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(result);
+    return fd;
+}
+
+// Time to first byte from the moment the user connects, with the connection
+// warmed up while it was highlighted and without.
+static void benchmark_time_to_first_byte(void) {
+    uint64_t coldUs = 0;
+    uint64_t warmUs = 0;
+    for (int i = 0; i < TTFB_ROUNDS; i++) {
+        uint64_t start = monotonic_us();
+        check_banner(connect_cold());
+        coldUs += monotonic_us() - start;
+
+        int sent = banners_sent();
+        CHECK(connection_warmup_start("localhost", port, true, 2000));
+        CHECK(connection_warmup_wait_ready("localhost", port, 5000));
+        // The user takes long enough to tap connect for the server to greet us.
+        wait_for_banners(sent + 1);
+        start = monotonic_us();
+        check_banner(connection_warmup_take("localhost", port, 5000, NULL, 0));
+        warmUs += monotonic_us() - start;
+        CHECK(connection_warmup_wait_busy(0, 5000) == 0);
+    }
+    coldUs /= TTFB_ROUNDS;
+    warmUs /= TTFB_ROUNDS;
+    printf("Time to first byte over loopback with a %d us banner delay: %llu us cold, %llu us warmed up\n",
+           BANNER_DELAY_US, (unsigned long long)coldUs, (unsigned long long)warmUs);
+    CHECK(coldUs >= BANNER_DELAY_US);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    CHECK(warmUs < coldUs / 2);
+#endif
+}
+
+int main(void) {
+    int listener = start_server();
+    test_take_warm_socket();
+    test_expiry_and_failures();
+    test_eviction_and_cancel();
+    benchmark_time_to_first_byte();
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    printf("ConnectionWarmupTest passed\n");
+    return 0;
+}
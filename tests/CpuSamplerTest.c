@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "CpuSampler.h"
+#include "Metrics.h"
+#include "TestSupport.h"
+
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SPIN_NS 100000000ULL
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void *spin(void *unused) {
+    (void)unused;
+    cpu_sampler_tag_current_thread(THREAD_ROLE_DECODER);
+    // Spinning for CPU rather than wall time keeps this exact on a busy machine.
+    uint64_t startNs = thread_cpu_ns();
+    volatile uint64_t sink = 0;
+    while (thread_cpu_ns() - startNs < SPIN_NS) {
+        sink++;
+    }
+    // Blocking counts as a wakeup on platforms that report them.
+    usleep(1000);
+    return NULL;
+}
+
+static void test_attributes_cpu_to_role(void) {
+    cpu_sampler_start(50);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, spin, NULL) == 0);
+    // Wait for a sample taken while the thread was spinning.
+    CpuRoleSnapshot snapshot;
+    for (int i = 0; i < 100; i++) {
+        usleep(10000);
+        cpu_sampler_snapshot(&snapshot);
+        if (snapshot.cpuPercent[THREAD_ROLE_DECODER] > 0.0) {
+            break;
+        }
+    }
+    CHECK(snapshot.threads[THREAD_ROLE_DECODER] == 1);
+    CHECK(snapshot.cpuPercent[THREAD_ROLE_DECODER] > 0.0);
+    pthread_join(thread, NULL);
+    cpu_sampler_stop();
+
+    // The exited thread's time is kept under its role.
+    cpu_sampler_snapshot(&snapshot);
+    CHECK(snapshot.threads[THREAD_ROLE_DECODER] == 0);
+    CHECK(snapshot.cpuTimeNs[THREAD_ROLE_DECODER] >= SPIN_NS);
+    if (snapshot.wakeupsAvailable) {
+        CHECK(snapshot.wakeups[THREAD_ROLE_DECODER] >= 1);
+    }
+    CHECK(snapshot.cpuTimeNs[THREAD_ROLE_SSH_REACTOR] == 0);
+}
+
+// Stopping is done on the main thread and must not wait out the interval.
+static void test_stop_does_not_wait_for_interval(void) {
+    cpu_sampler_start(10000);
+    usleep(20000);
+    uint64_t startNs = metrics_now_ns();
+    cpu_sampler_stop();
+    CHECK(metrics_now_ns() - startNs < 500000000ULL);
+}
+
+static void test_retag_moves_to_new_role(void) {
+    cpu_sampler_tag_current_thread(THREAD_ROLE_SSH_FORWARDER);
+    cpu_sampler_tag_current_thread(THREAD_ROLE_RENDER);
+    CpuRoleSnapshot snapshot;
+    cpu_sampler_snapshot(&snapshot);
+    CHECK(snapshot.threads[THREAD_ROLE_SSH_FORWARDER] == 0);
+    CHECK(snapshot.threads[THREAD_ROLE_RENDER] == 1);
+    cpu_sampler_untag_current_thread();
+    cpu_sampler_snapshot(&snapshot);
+    CHECK(snapshot.threads[THREAD_ROLE_RENDER] == 0);
+}
+
+int main(void) {
+    test_attributes_cpu_to_role();
+    test_stop_does_not_wait_for_interval();
+    test_retag_moves_to_new_role();
+    CHECK(cpu_sampler_role_name(THREAD_ROLE_COUNT)[0] == 'u');
+    printf("CpuSamplerTest passed\n");
+    return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "CursorCache.h"
+#include "TestSupport.h"
+
+#include <string.h>
+#include <time.h>
+
+#define SHAPES 40
+#define WIDTH 32
+#define HEIGHT 32
+#define ROUNDS 50000
+
+static uint8_t xorMasks[SHAPES][WIDTH * HEIGHT * 4];
+static uint8_t andMasks[SHAPES][WIDTH * HEIGHT / 8];
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t hash_shape(int shape, uint32_t hotX) {
+    return cursor_cache_hash(xorMasks[shape], sizeof(xorMasks[shape]), andMasks[shape], sizeof(andMasks[shape]),
+                             32, WIDTH, HEIGHT, hotX, 1);
+}
+
+// Stands in for freerdp_image_copy_from_pointer_data with a 32bpp XOR mask.
+static uint8_t *decode(int shape) {
+    uint8_t *pixels = malloc(WIDTH * HEIGHT * 4);
+    CHECK(pixels != NULL);
+    const uint8_t *mask = xorMasks[shape];
+    for (uint32_t i = 0; i < WIDTH * HEIGHT; i++) {
+        pixels[i * 4] = mask[i * 4 + 2];
+        pixels[i * 4 + 1] = mask[i * 4 + 1];
+        pixels[i * 4 + 2] = mask[i * 4];
+        pixels[i * 4 + 3] = mask[i * 4 + 3];
+    }
+    cursor_premultiply_alpha(pixels, WIDTH * HEIGHT);
+    return pixels;
+}
+
+static void test_hash_and_lookup(CursorCache *cache) {
+    uint64_t hash = hash_shape(0, 1);
+    CHECK(hash == hash_shape(0, 1));
+    CHECK(hash != hash_shape(0, 2));
+    CHECK(hash != hash_shape(1, 1));
+
+    CHECK(cursor_cache_find(cache, hash, WIDTH, HEIGHT, 1, 1) == CURSOR_SHAPE_NONE);
+    uint32_t id = cursor_cache_insert(cache, hash, WIDTH, HEIGHT, 1, 1, decode(0));
+    CHECK(id != CURSOR_SHAPE_NONE);
+    CHECK(cursor_cache_find(cache, hash, WIDTH, HEIGHT, 1, 1) == id);
+    CHECK(cursor_cache_find(cache, hash, WIDTH, HEIGHT, 2, 1) == CURSOR_SHAPE_NONE);
+    // A shape decoded twice keeps its id.
+    CHECK(cursor_cache_insert(cache, hash, WIDTH, HEIGHT, 1, 1, decode(0)) == id);
+    CHECK(cache->count == 1 && cursor_cache_bytes(cache) == WIDTH * HEIGHT * 4);
+
+    CursorShape shape;
+    CHECK(cursor_cache_get(cache, id, &shape));
+    CHECK(shape.width == WIDTH && shape.height == HEIGHT && shape.hotX == 1 && shape.pixels != NULL);
+    CHECK(!cursor_cache_get(cache, CURSOR_SHAPE_NONE, &shape));
+}
+
+static void test_eviction(CursorCache *cache) {
+    uint32_t first = cursor_cache_find(cache, hash_shape(0, 1), WIDTH, HEIGHT, 1, 1);
+    uint32_t ids[SHAPES] = { first };
+    CursorShape shape;
+    for (int i = 1; i < SHAPES; i++) {
+        ids[i] = cursor_cache_insert(cache, hash_shape(i, 1), WIDTH, HEIGHT, 1, 1, decode(i));
+        CHECK(ids[i] != ids[i - 1]);
+        // Keeps the first shape the most recently used one.
+        CHECK(cursor_cache_get(cache, first, &shape));
+    }
+    CHECK(cache->count == CURSOR_CACHE_CAPACITY);
+    CHECK(cursor_cache_get(cache, first, &shape));
+    CHECK(!cursor_cache_get(cache, ids[1], &shape));
+    CHECK(cursor_cache_get(cache, ids[SHAPES - 1], &shape));
+    // Ids are never handed out again for another shape.
+    uint32_t again = cursor_cache_insert(cache, hash_shape(1, 1), WIDTH, HEIGHT, 1, 1, decode(1));
+    CHECK(again > ids[SHAPES - 1]);
+
+    cursor_cache_clear(cache);
+    CHECK(cache->count == 0 && cursor_cache_bytes(cache) == 0);
+    CHECK(!cursor_cache_get(cache, first, &shape));
+}
+
+static void test_premultiply(void) {
+    uint8_t pixels[8] = { 200, 100, 50, 128, 10, 20, 30, 255 };
+    cursor_premultiply_alpha(pixels, 2);
+    CHECK(pixels[0] == 100 && pixels[1] == 50 && pixels[2] == 25 && pixels[3] == 128);
+    CHECK(pixels[4] == 10 && pixels[5] == 20 && pixels[6] == 30 && pixels[7] == 255);
+}
+
+// Switching between known shapes hashes and looks up, a new shape also decodes.
+static void benchmark_hit_and_miss(CursorCache *cache) {
+    volatile uint32_t sink = 0;
+    uint64_t start = thread_cpu_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        int shape = i % 4;
+        uint64_t hash = hash_shape(shape, 1);
+        uint32_t id = cursor_cache_find(cache, hash, WIDTH, HEIGHT, 1, 1);
+        if (id == CURSOR_SHAPE_NONE) {
+            id = cursor_cache_insert(cache, hash, WIDTH, HEIGHT, 1, 1, decode(shape));
+        }
+        sink += id;
+    }
+    double hitNs = (double)(thread_cpu_ns() - start) / ROUNDS;
+    start = thread_cpu_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        int shape = i % 4;
+        uint64_t hash = hash_shape(shape, 1) + i + 1;
+        sink += cursor_cache_insert(cache, hash, WIDTH, HEIGHT, 1, 1, decode(shape));
+    }
+    double missNs = (double)(thread_cpu_ns() - start) / ROUNDS;
+    printf("%dx%d shapes: hit %.0f ns, miss %.0f ns\n", WIDTH, HEIGHT, hitNs, missNs);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    CHECK(hitNs < missNs);
+#endif
+    cursor_cache_clear(cache);
+}
+
+int main(void) {
+    srand(11);
+    for (int shape = 0; shape < SHAPES; shape++) {
+        for (size_t i = 0; i < sizeof(xorMasks[shape]); i++) {
+            xorMasks[shape][i] = (uint8_t)rand();
+        }
+    }
+    CursorCache cache;
+    cursor_cache_init(&cache);
+    test_hash_and_lookup(&cache);
+    test_eviction(&cache);
+    test_premultiply();
+    benchmark_hit_and_miss(&cache);
+    printf("CursorCacheTest passed\n");
+    return 0;
+}
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "FrameBufferExport.h"
+#include "TestSupport.h"
+
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FRAMES 600
+
+static char name[FRAMEBUFFER_EXPORT_NAME_SIZE];
+
+static bool open_reader(FrameBufferExportReader *reader) {
+    for (int tries = 0; tries < 2000; tries++) {
+        if (framebuffer_export_reader_open(reader, name)) {
+            return true;
+        }
+        usleep(1000);
+    }
+    return false;
+}
+
+// Runs in a separate process like real tooling. Every frame fills the whole
+// framebuffer with one increasing value, so a validated frame must be uniform
+// and never older than the previous one.
+static int read_frames(void) {
+    FrameBufferExportReader reader;
+    if (!open_reader(&reader)) {
+        return 2;
+    }
+    uint64_t last = 0;
+    uint32_t lastValue = 0;
+    int frames = 0;
+    int reopens = 0;
+    while (1) {
+        uint64_t sequence = framebuffer_export_reader_wait(&reader, last, 2000);
+        if (sequence == last) {
+            if (!reader.header->retired) {
+                break;
+            }
+            framebuffer_export_reader_close(&reader);
+            if (!open_reader(&reader)) {
+                break;
+            }
+            reopens++;
+            last = 0;
+            continue;
+        }
+        const FrameBufferExportHeader *header = reader.header;
+        const uint32_t *pixels = (const uint32_t *)reader.pixels;
+        uint32_t count = header->stride / 4 * header->height;
+        uint32_t value = pixels[0];
+        bool uniform = true;
+        for (uint32_t i = 0; i < count; i++) {
+            if (pixels[i] != value) {
+                uniform = false;
+                break;
+            }
+        }
+        bool damageMatches = header->damageCount == 1 && header->damage[0].width == (int32_t)header->width;
+        // A frame drawn while reading is simply skipped.
+        if (!framebuffer_export_reader_validate(&reader, sequence)) {
+            last = sequence;
+            continue;
+        }
+        if (!uniform || value < lastValue || !damageMatches) {
+            fprintf(stderr, "bad frame %llu value %u after %u\n", (unsigned long long)sequence, value, lastValue);
+            return 1;
+        }
+        lastValue = value;
+        last = sequence;
+        frames++;
+    }
+    framebuffer_export_reader_close(&reader);
+    printf("reader saw %d frames, %d reopens\n", frames, reopens);
+    return frames > 0 && reopens > 0 ? 0 : 3;
+}
+
+int main(void) {
+    snprintf(name, sizeof(name), "/fbxtest%d", (int)getpid());
+    CHECK(framebuffer_export_enable(name));
+    uint32_t width = 320;
+    uint32_t height = 240;
+    uint8_t *pixels = framebuffer_export_allocate(width, height, width * 4, FRAMEBUFFER_EXPORT_FORMAT_RGBA32);
+    CHECK(pixels != NULL);
+
+    fflush(stdout);
+    pid_t child = fork();
+    CHECK(child >= 0);
+    if (child == 0) {
+        int result = read_frames();
+        fflush(stdout);
+        _exit(result);
+    }
+
+    // Give the reader time to map the first region so it sees it retired.
+    usleep(50000);
+    for (uint32_t frame = 1; frame <= FRAMES; frame++) {
+        if (frame == FRAMES / 2) {
+            uint8_t *old = pixels;
+            width = 400;
+            height = 300;
+            pixels = framebuffer_export_allocate(width, height, width * 4, FRAMEBUFFER_EXPORT_FORMAT_RGBA32);
+            CHECK(pixels != NULL);
+            framebuffer_export_release(old);
+            usleep(50000);
+        }
+        framebuffer_export_begin_frame();
+        uint32_t *words = (uint32_t *)pixels;
+        for (uint32_t i = 0; i < width * height; i++) {
+            words[i] = frame;
+        }
+        FrameBufferExportRect damage = { 0, 0, (int32_t)width, (int32_t)height };
+        framebuffer_export_end_frame(&damage, 1);
+        if (frame % 7 == 0) {
+            usleep(200);
+        }
+    }
+    usleep(100000);
+    framebuffer_export_release(pixels);
+    framebuffer_export_disable();
+
+    int status;
+    CHECK(waitpid(child, &status, 0) == child);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    printf("FrameBufferExportTest passed\n");
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "Logger.h"
+#include "Utility.h"
+#include "TestSupport.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#define THREADS 8
+#define MESSAGES_PER_THREAD 20
+#define BENCHMARK_CALLS 200000
+#define EMITTED_BATCHES 200
+#define EMITTED_BATCH_SIZE 32
+
+static pthread_mutex_t receivedLock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int received;
+static char last[20000];
+
+static void receive(int8_t *message) {
+    pthread_mutex_lock(&receivedLock);
+    snprintf(last, sizeof(last), "%s", (const char *)message);
+    pthread_mutex_unlock(&receivedLock);
+    atomic_fetch_add(&received, 1);
+}
+
+static void take_last(char *message, size_t size) {
+    client_log_flush();
+    pthread_mutex_lock(&receivedLock);
+    snprintf(message, size, "%s", last);
+    last[0] = '\0';
+    pthread_mutex_unlock(&receivedLock);
+}
+
+static void *producer(void *arg) {
+    int index = (int)(long)arg;
+    for (int i = 0; i < MESSAGES_PER_THREAD; i++) {
+        client_log("thread %d message %d\n", index, i);
+    }
+    return NULL;
+}
+
+static void test_levels(void) {
+    static char message[20000];
+    client_log("info %d\n", 1);
+    take_last(message, sizeof(message));
+    CHECK(strcmp(message, "info 1\n") == 0);
+    CLIENT_LOG_DEBUG("debug %d\n", 2);
+    take_last(message, sizeof(message));
+    CHECK(message[0] == '\0');
+    client_log_set_level(CLIENT_LOG_LEVEL_DEBUG);
+    CLIENT_LOG_DEBUG("debug %d\n", 3);
+    take_last(message, sizeof(message));
+    CHECK(strcmp(message, "debug 3\n") == 0);
+    client_log_set_level(CLIENT_LOG_LEVEL_INFO);
+}
+
+static void test_long_messages(void) {
+    static char text[20000];
+    static char message[20000];
+    // Longer than a ring slot, shorter than the old 16 KB buffer: delivered whole.
+    memset(text, 'a', 5000);
+    text[5000] = '\0';
+    client_log("%s\n", text);
+    take_last(message, sizeof(message));
+    CHECK(strlen(message) == 5001 && message[4999] == 'a' && message[5000] == '\n');
+    client_log_string(CLIENT_LOG_LEVEL_INFO, text);
+    take_last(message, sizeof(message));
+    CHECK(strcmp(message, text) == 0);
+
+    // Longer than that: cut and marked.
+    memset(text, 'b', 19000);
+    text[19000] = '\0';
+    client_log("%s\n", text);
+    take_last(message, sizeof(message));
+    CHECK(strlen(message) == 16383);
+    CHECK(strstr(message, "[truncated]\n") != NULL && message[16382] == '\n');
+    client_log_string(CLIENT_LOG_LEVEL_INFO, text);
+    take_last(message, sizeof(message));
+    CHECK(strlen(message) == 16383 && strstr(message, "[truncated]\n") != NULL);
+}
+
+static void test_concurrent_producers(void) {
+    atomic_store(&received, 0);
+    pthread_t threads[THREADS];
+    for (long i = 0; i < THREADS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, producer, (void *)i) == 0);
+    }
+    for (int i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    client_log_flush();
+    // Well within the rate limit and the ring size, so nothing may be lost.
+    CHECK(atomic_load(&received) == THREADS * MESSAGES_PER_THREAD);
+}
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// What a debug call costs when the level is off, next to one that is formatted
+// and queued.
+static void benchmark_suppressed_and_emitted(void) {
+    static char formatted[256];
+    uint64_t start = thread_cpu_ns();
+    for (int i = 0; i < BENCHMARK_CALLS; i++) {
+        CLIENT_LOG_DEBUG("frame %d took %d us at %s\n", i, i * 3, "benchmark");
+    }
+    double suppressedNs = (double)(thread_cpu_ns() - start) / BENCHMARK_CALLS;
+    // In batches that fit the ring, so that every call is formatted and queued.
+    uint64_t emittedTotalNs = 0;
+    for (int batch = 0; batch < EMITTED_BATCHES; batch++) {
+        start = thread_cpu_ns();
+        for (int i = 0; i < EMITTED_BATCH_SIZE; i++) {
+            client_log_at(CLIENT_LOG_LEVEL_INFO, "frame %d took %d us at %s\n", i, i * 3, "benchmark");
+        }
+        emittedTotalNs += thread_cpu_ns() - start;
+        client_log_flush();
+    }
+    double emittedNs = (double)emittedTotalNs / (EMITTED_BATCHES * EMITTED_BATCH_SIZE);
+    start = thread_cpu_ns();
+    for (int i = 0; i < BENCHMARK_CALLS; i++) {
+        snprintf(formatted, sizeof(formatted), "frame %d took %d us at %s\n", i, i * 3, "benchmark");
+    }
+    double formatNs = (double)(thread_cpu_ns() - start) / BENCHMARK_CALLS;
+    printf("Log call: suppressed %.1f ns, emitted %.1f ns, formatting alone %.1f ns\n",
+           suppressedNs, emittedNs, formatNs);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    // A disabled call must cost a small fraction of formatting the message.
+    CHECK(suppressedNs * 10 < formatNs);
+    CHECK(suppressedNs * 10 < emittedNs);
+#endif
+}
+
+int main(void) {
+    client_log_callback = receive;
+    test_levels();
+    test_long_messages();
+    test_concurrent_producers();
+    benchmark_suppressed_and_emitted();
+    printf("LoggerTest passed\n");
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "MemoryBudget.h"
+#include "TestSupport.h"
+
+#include <pthread.h>
+
+#define MB (1024ULL * 1024)
+#define ADDER_THREADS 4
+#define ADDS 100000
+
+static uint64_t previews;
+static uint64_t cache;
+static int qualityCalls;
+
+static size_t shed_previews(void *context, size_t bytesWanted) {
+    size_t freed = previews;
+    previews = 0;
+    memory_budget_add(MEMORY_PREVIEW, -(int64_t)freed);
+    return freed;
+}
+
+// Gives up only what is asked for, to check the targets are exact.
+static size_t shed_cache(void *context, size_t bytesWanted) {
+    size_t freed = bytesWanted < cache ? bytesWanted : cache;
+    cache -= freed;
+    memory_budget_add(MEMORY_CURSOR_CACHE, -(int64_t)freed);
+    return freed;
+}
+
+// Like the bridge, frees nothing until the server resizes.
+static size_t shed_quality(void *context, size_t bytesWanted) {
+    qualityCalls++;
+    return 0;
+}
+
+static void *add_and_remove(void *argument) {
+    for (int i = 0; i < ADDS; i++) {
+        memory_budget_add(MEMORY_CLIPBOARD, 100);
+        memory_budget_add(MEMORY_CLIPBOARD, -100);
+    }
+    return NULL;
+}
+
+static void test_device_limits(void) {
+    CHECK(memory_budget_limit_for_device(3ULL << 30) == 768 * MB);
+    CHECK(memory_budget_limit_for_device(512 * MB) == MEMORY_BUDGET_MIN_LIMIT);
+    CHECK(memory_budget_limit_for_device(16ULL << 30) == MEMORY_BUDGET_MAX_LIMIT);
+}
+
+static void test_shedding_order(void) {
+    memory_budget_set_limit(400 * MB);
+    CHECK(memory_budget_register_shedder(MEMORY_SHED_PREVIEWS, shed_previews, NULL));
+    CHECK(memory_budget_register_shedder(MEMORY_SHED_CACHES, shed_cache, NULL));
+    CHECK(memory_budget_register_shedder(MEMORY_SHED_QUALITY, shed_quality, NULL));
+    // Registering twice keeps a single entry.
+    CHECK(memory_budget_register_shedder(MEMORY_SHED_QUALITY, shed_quality, NULL));
+
+    memory_budget_set(MEMORY_FRAMEBUFFER, 130 * MB);
+    previews = 40 * MB;
+    memory_budget_add(MEMORY_PREVIEW, previews);
+    cache = 200 * MB;
+    CHECK(memory_budget_add(MEMORY_CURSOR_CACHE, cache));
+    CHECK(memory_budget_pressure(MEMORY_PRESSURE_NORMAL) == 0);
+    CHECK(previews == 40 * MB);
+
+    // 420 MB is over the limit, the previews go first and are enough.
+    CHECK(!memory_budget_add(MEMORY_CLIPBOARD, 50 * MB));
+    CHECK(memory_budget_pressure(MEMORY_PRESSURE_NORMAL) == 40 * MB);
+    CHECK(memory_budget_total() <= 400 * MB);
+    CHECK(cache == 200 * MB);
+
+    // The warning target is 300 MB, the cache gives exactly what is missing.
+    CHECK(memory_budget_pressure(MEMORY_PRESSURE_WARNING) == 80 * MB);
+    CHECK(memory_budget_total() == 300 * MB);
+    CHECK(qualityCalls == 0);
+
+    // The critical target is 200 MB, still within what the cache holds.
+    memory_budget_pressure(MEMORY_PRESSURE_CRITICAL);
+    CHECK(memory_budget_total() == 200 * MB);
+    CHECK(qualityCalls == 0);
+
+    // Beyond what the caches hold the desktop quality is given up.
+    memory_budget_set(MEMORY_FRAMEBUFFER, 400 * MB);
+    memory_budget_pressure(MEMORY_PRESSURE_CRITICAL);
+    CHECK(cache == 0);
+    CHECK(qualityCalls == 1);
+
+    MemoryBudgetSnapshot snapshot;
+    memory_budget_snapshot(&snapshot);
+    CHECK(snapshot.lastLevel == MEMORY_PRESSURE_CRITICAL);
+    CHECK(snapshot.bytes[MEMORY_FRAMEBUFFER] == 400 * MB);
+    CHECK(snapshot.peakBytes >= 450 * MB);
+    CHECK(snapshot.shedBytes[MEMORY_SHED_PREVIEWS] == 40 * MB);
+    CHECK(snapshot.shedCalls[MEMORY_SHED_QUALITY] == 1);
+
+    memory_budget_unregister_shedder(MEMORY_SHED_QUALITY, shed_quality, NULL);
+    memory_budget_pressure(MEMORY_PRESSURE_CRITICAL);
+    CHECK(qualityCalls == 1);
+}
+
+static void test_concurrent_tagging(void) {
+    uint64_t before = memory_budget_total();
+    pthread_t threads[ADDER_THREADS];
+    for (int i = 0; i < ADDER_THREADS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, add_and_remove, NULL) == 0);
+    }
+    for (int i = 0; i < ADDER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK(memory_budget_total() == before);
+}
+
+static void test_reset(void) {
+    memory_budget_reset();
+    MemoryBudgetSnapshot snapshot;
+    memory_budget_snapshot(&snapshot);
+    CHECK(snapshot.totalBytes == 0);
+    CHECK(snapshot.peakBytes == 0);
+}
+
+int main(void) {
+    test_device_limits();
+    test_shedding_order();
+    test_concurrent_tagging();
+    test_reset();
+    printf("MemoryBudgetTest passed\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "Metrics.h"
+#include "TestSupport.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OPERATIONS 200000
+#define ROUNDS 5
+#define PRODUCERS 4
+
+// Recording runs on the frame path, so each operation has to stay cheap.
+// Sanitizers slow everything down by an order of magnitude, so the budget
+// is only enforced in plain builds. It is measured in thread CPU time over
+// the best of several rounds so that a busy machine does not make it flaky.
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define MAX_NS_PER_OPERATION 0
+#else
+#define MAX_NS_PER_OPERATION 100
+#endif
+
+static atomic_bool producing;
+
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void count_frame(int i) {
+    (void)i;
+    metrics_counter_add(METRIC_FRAMES_PRESENTED, 1);
+}
+
+static void record_convert_time(int i) {
+    metrics_histogram_record(METRIC_HISTOGRAM_CONVERT_US, (uint64_t)i & 0xffff);
+}
+
+// Without a trace window the producers only pay for the window check.
+static void trace_idle(int i) {
+    metrics_trace_complete("idle", (uint64_t)i, (uint64_t)i + 1);
+}
+
+static void check_overhead(const char *what, void (*operation)(int)) {
+    double best = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t startNs = thread_cpu_ns();
+        for (int i = 0; i < OPERATIONS; i++) {
+            operation(i);
+        }
+        double perOperation = (double)(thread_cpu_ns() - startNs) / OPERATIONS;
+        if (round == 0 || perOperation < best) {
+            best = perOperation;
+        }
+    }
+    printf("%s: %.1f ns per operation\n", what, best);
+    if (MAX_NS_PER_OPERATION > 0) {
+        CHECK(best < MAX_NS_PER_OPERATION);
+    }
+}
+
+static void test_overhead(void) {
+    metrics_reset();
+    check_overhead("counter", count_frame);
+    check_overhead("histogram", record_convert_time);
+    check_overhead("idle trace", trace_idle);
+
+    MetricsSnapshot snapshot;
+    metrics_snapshot(&snapshot);
+    CHECK(snapshot.counters[METRIC_FRAMES_PRESENTED] == OPERATIONS * ROUNDS);
+    CHECK(snapshot.histogramCounts[METRIC_HISTOGRAM_CONVERT_US] == OPERATIONS * ROUNDS);
+}
+
+static int count_events(const char *path, const char *name) {
+    FILE *file = fopen(path, "r");
+    CHECK(file != NULL);
+    char line[256];
+    int count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strstr(line, name) != NULL) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static void test_trace_clamps_to_window(const char *path) {
+    uint64_t beforeNs = metrics_now_ns();
+    usleep(2000);
+    metrics_trace_start(10000);
+    uint64_t nowNs = metrics_now_ns();
+    metrics_trace_complete("straddling", beforeNs, nowNs + 1000);
+    metrics_trace_complete("finished_before", beforeNs, beforeNs + 1);
+    metrics_trace_complete("inside", nowNs + 5000, nowNs + 6000);
+    CHECK(metrics_trace_dump(path) == 2);
+    CHECK(count_events(path, "\"straddling\"") == 1);
+    CHECK(count_events(path, "\"finished_before\"") == 0);
+    // Only the straddling span starts right at the beginning of the window.
+    CHECK(count_events(path, "\"ts\":0.000,") == 1);
+    CHECK(!metrics_trace_active());
+}
+
+static void *producer(void *unused) {
+    (void)unused;
+    while (atomic_load(&producing)) {
+        uint64_t nowNs = metrics_now_ns();
+        metrics_trace_complete("producer", nowNs, nowNs + 10);
+    }
+    return NULL;
+}
+
+// Restarting and dumping the trace while producers keep recording must
+// neither race on the buffer nor leave half written events behind.
+static void test_trace_restart_while_recording(const char *path) {
+    pthread_t threads[PRODUCERS];
+    atomic_store(&producing, true);
+    for (int i = 0; i < PRODUCERS; i++) {
+        CHECK(pthread_create(&threads[i], NULL, producer, NULL) == 0);
+    }
+    for (int round = 0; round < 20; round++) {
+        metrics_trace_start(10000);
+        usleep(1000);
+        int written = metrics_trace_dump(path);
+        CHECK(written >= 0);
+        CHECK(count_events(path, "\"producer\"") == written);
+    }
+    atomic_store(&producing, false);
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(void) {
+    char path[] = "/tmp/MetricsTestXXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    CHECK(metrics_trace_dump(path) == -1);
+    test_overhead();
+    test_trace_clamps_to_window(path);
+    test_trace_restart_while_recording(path);
+
+    unlink(path);
+    printf("MetricsTest passed\n");
+    return 0;
+}
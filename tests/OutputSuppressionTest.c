@@ -0,0 +1,158 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "OutputSuppression.h"
+#include "TestSupport.h"
+
+#define WIDTH 800
+#define HEIGHT 600
+
+static int suppressed;
+static int allowed;
+static int refreshes;
+static uint8_t lastCount;
+static OutputRect lastAreas[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS];
+static bool failing;
+
+static bool suppress_output(void *context, bool allowDisplayUpdates, const OutputRect *area) {
+    (void)context;
+    if (failing) {
+        return false;
+    }
+    if (allowDisplayUpdates) {
+        CHECK(area != NULL && area->width == WIDTH && area->height == HEIGHT);
+        allowed++;
+    } else {
+        CHECK(area == NULL);
+        suppressed++;
+    }
+    return true;
+}
+
+static bool refresh_rect(void *context, uint8_t count, const OutputRect *areas) {
+    (void)context;
+    refreshes++;
+    lastCount = count;
+    for (uint8_t i = 0; i < count; i++) {
+        lastAreas[i] = areas[i];
+    }
+    return true;
+}
+
+static void test_hide_and_show(void) {
+    OutputSuppressionChannel channel = { suppress_output, refresh_rect };
+    OutputSuppression suppression;
+    output_suppression_init(&suppression, &channel);
+    int context;
+
+    // Nobody to tell yet.
+    CHECK(!output_suppression_set_hidden(&suppression, true));
+    CHECK(!output_suppression_hidden(&suppression));
+    output_suppression_connected(&suppression, &context, WIDTH, HEIGHT);
+    CHECK(suppressed == 0);
+
+    CHECK(output_suppression_set_hidden(&suppression, true));
+    CHECK(suppressed == 1);
+    CHECK(output_suppression_set_hidden(&suppression, true));
+    CHECK(suppressed == 1);
+
+    // Resuming asks for the viewport first and then the rest of the desktop.
+    output_suppression_set_viewport(&suppression, 100, 50, 200, 100);
+    CHECK(output_suppression_set_hidden(&suppression, false));
+    CHECK(allowed == 1 && refreshes == 1 && lastCount == 5);
+    CHECK(lastAreas[0].x == 100 && lastAreas[0].y == 50 && lastAreas[0].width == 200);
+    long area = 0;
+    for (uint8_t i = 0; i < lastCount; i++) {
+        area += (long)lastAreas[i].width * lastAreas[i].height;
+    }
+    CHECK(area == WIDTH * HEIGHT);
+    CHECK(output_suppression_set_hidden(&suppression, false));
+    CHECK(allowed == 1);
+
+    // The server forgets on every connect, hiding is applied again.
+    CHECK(output_suppression_set_hidden(&suppression, true));
+    CHECK(suppressed == 2);
+    output_suppression_connected(&suppression, &context, WIDTH, HEIGHT);
+    CHECK(suppressed == 3);
+    output_suppression_disconnected(&suppression);
+    CHECK(!output_suppression_set_hidden(&suppression, false));
+    CHECK(output_suppression_hidden(&suppression));
+    CHECK(allowed == 1);
+    output_suppression_destroy(&suppression);
+}
+
+static void test_failures(void) {
+    OutputSuppressionChannel channel = { suppress_output, refresh_rect };
+    OutputSuppression suppression;
+    output_suppression_init(&suppression, &channel);
+    int context;
+    output_suppression_connected(&suppression, &context, WIDTH, HEIGHT);
+
+    // A PDU that could not be sent is reported and nothing changes.
+    failing = true;
+    CHECK(!output_suppression_set_hidden(&suppression, true));
+    CHECK(!output_suppression_hidden(&suppression) && !suppression.suppressed);
+    failing = false;
+    int before = suppressed;
+    output_suppression_connected(&suppression, &context, WIDTH, HEIGHT);
+    CHECK(suppressed == before);
+
+    CHECK(output_suppression_set_hidden(&suppression, true));
+    CHECK(suppressed == before + 1);
+    failing = true;
+    CHECK(!output_suppression_set_hidden(&suppression, false));
+    CHECK(output_suppression_hidden(&suppression) && suppression.suppressed);
+    failing = false;
+    CHECK(output_suppression_set_hidden(&suppression, false));
+    CHECK(!suppression.suppressed);
+    output_suppression_destroy(&suppression);
+}
+
+static void test_refresh_areas(void) {
+    OutputRect areas[OUTPUT_SUPPRESSION_MAX_REFRESH_RECTS];
+    OutputRect covering = { -10, -10, 5000, 5000 };
+    CHECK(output_suppression_refresh_areas(WIDTH, HEIGHT, &covering, areas) == 1);
+    CHECK(areas[0].width == WIDTH && areas[0].height == HEIGHT);
+    OutputRect outside = { 900, 0, 10, 10 };
+    CHECK(output_suppression_refresh_areas(WIDTH, HEIGHT, &outside, areas) == 1);
+    CHECK(output_suppression_refresh_areas(0, HEIGHT, &outside, areas) == 0);
+
+    // Whatever the viewport, the areas tile the desktop exactly.
+    srand(5);
+    for (int i = 0; i < 100000; i++) {
+        OutputRect viewport = { rand() % 900 - 50, rand() % 700 - 50, rand() % 900, rand() % 700 };
+        uint8_t count = output_suppression_refresh_areas(WIDTH, HEIGHT, &viewport, areas);
+        long area = 0;
+        for (uint8_t j = 0; j < count; j++) {
+            CHECK(areas[j].width > 0 && areas[j].height > 0 && areas[j].x >= 0 && areas[j].y >= 0);
+            CHECK(areas[j].x + areas[j].width <= WIDTH && areas[j].y + areas[j].height <= HEIGHT);
+            area += (long)areas[j].width * areas[j].height;
+        }
+        CHECK(area == WIDTH * HEIGHT);
+    }
+}
+
+int main(void) {
+    test_hide_and_show();
+    test_failures();
+    test_refresh_areas();
+    printf("OutputSuppressionTest passed\n");
+    return 0;
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "QualityController.h"
+#include "TestSupport.h"
+
+#define SECOND_NS 1000000000ULL
+
+static const DeviceCapabilities fastDevice = { 8, 4, 6ULL << 30, true };
+static const DeviceCapabilities weakDevice = { 2, 0, 2ULL << 30, false };
+
+static void test_connect_decisions(void) {
+    QualityController qc;
+    quality_controller_init(&qc, &weakDevice);
+    QualityDecision decision = quality_controller_connect_decision(&qc);
+    CHECK(decision.profile == SESSION_PROFILE_RESPONSIVE);
+    CHECK(!decision.remoteFx);
+    CHECK(decision.colorDepth == 16);
+    CHECK(decision.decodeThreads == 1);
+
+    // Without measurements a capable device starts balanced.
+    quality_controller_init(&qc, &fastDevice);
+    decision = quality_controller_connect_decision(&qc);
+    CHECK(decision.profile == SESSION_PROFILE_BALANCED);
+    CHECK(decision.gfxH264);
+    CHECK(decision.decodeThreads == 4);
+
+    quality_controller_report_network(&qc, 50000, 5);
+    quality_controller_report_frame_cost(&qc, 5);
+    decision = quality_controller_connect_decision(&qc);
+    CHECK(decision.profile == SESSION_PROFILE_QUALITY);
+    // Decoding is spread over the performance cores only.
+    CHECK(decision.decodeThreads == 4);
+
+    quality_controller_init(&qc, &fastDevice);
+    quality_controller_report_network(&qc, 800, 200);
+    decision = quality_controller_connect_decision(&qc);
+    CHECK(decision.profile == SESSION_PROFILE_RESPONSIVE);
+    CHECK(decision.decodeThreads == 2);
+}
+
+static void test_steps_down_fast_and_up_slowly(void) {
+    QualityController qc;
+    QualityDecision decision;
+    quality_controller_init(&qc, &fastDevice);
+    quality_controller_report_network(&qc, 5000, 50);
+    CHECK(quality_controller_connect_decision(&qc).profile == SESSION_PROFILE_BALANCED);
+
+    uint64_t nowNs = SECOND_NS;
+    quality_controller_report_network(&qc, 100, 400);
+    quality_controller_report_network(&qc, 100, 400);
+    CHECK(!quality_controller_update(&qc, nowNs, &decision));
+    CHECK(!quality_controller_update(&qc, nowNs + SECOND_NS, &decision));
+    CHECK(quality_controller_update(&qc, nowNs + 2 * SECOND_NS, &decision));
+    CHECK(decision.profile == SESSION_PROFILE_RESPONSIVE);
+    CHECK(decision.frameIntervalMs == 66);
+    // Codecs stay as negotiated at connect time.
+    CHECK(decision.remoteFx);
+    CHECK(decision.colorDepth == 32);
+
+    nowNs += 10 * SECOND_NS;
+    for (int i = 0; i < 20; i++) {
+        quality_controller_report_network(&qc, 5000, 50);
+    }
+    CHECK(!quality_controller_update(&qc, nowNs, &decision));
+    CHECK(!quality_controller_update(&qc, nowNs + 5 * SECOND_NS, &decision));
+    CHECK(quality_controller_update(&qc, nowNs + 10 * SECOND_NS, &decision));
+    CHECK(decision.profile == SESSION_PROFILE_BALANCED);
+    CHECK(decision.frameIntervalMs == 33);
+}
+
+static void test_history_seeds_next_connection(void) {
+    QualityController qc;
+    quality_controller_init(&qc, &fastDevice);
+    quality_controller_report_network(&qc, 800, 200);
+    quality_controller_save_history(&qc, "slow.example.com");
+
+    QualityController next;
+    quality_controller_init(&next, &fastDevice);
+    quality_controller_seed_from_history(&next, "slow.example.com");
+    CHECK(quality_controller_connect_decision(&next).profile == SESSION_PROFILE_RESPONSIVE);
+
+    quality_controller_init(&next, &fastDevice);
+    quality_controller_seed_from_history(&next, "other.example.com");
+    CHECK(quality_controller_connect_decision(&next).profile == SESSION_PROFILE_BALANCED);
+}
+
+int main(void) {
+    test_connect_decisions();
+    test_steps_down_fast_and_up_slowly();
+    test_history_seeds_next_connection();
+    CHECK(quality_controller_profile_name(SESSION_PROFILE_QUALITY)[0] == 'q');
+    printf("QualityControllerTest passed\n");
+    return 0;
+}
@@ -0,0 +1,232 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ReachabilityProber.h"
+#include "Metrics.h"
+#include "TestSupport.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LISTENERS 16
+#define SLOW_NAMES 6
+#define MS 1000000ULL
+
+// Names starting with "slow" block until released, like a resolver that
+// waits on an unreachable DNS server. Numeric IPv4 addresses resolve, the
+// rest do not exist.
+static pthread_mutex_t resolverLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolverChanged = PTHREAD_COND_INITIALIZER;
+static bool slowReleased = false;
+static int resolving = 0;
+static int mostResolving = 0;
+
+typedef struct {
+    struct addrinfo info;
+    struct sockaddr_in address;
+} ResolvedAddress;
+
+int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res) {
+    pthread_mutex_lock(&resolverLock);
+    resolving++;
+    if (resolving > mostResolving) {
+        mostResolving = resolving;
+    }
+    bool slow = strncmp(node, "slow", 4) == 0;
+    while (slow && !slowReleased) {
+        pthread_cond_wait(&resolverChanged, &resolverLock);
+    }
+    resolving--;
+    pthread_mutex_unlock(&resolverLock);
+
+    struct in_addr ip;
+    if (slow) {
+        return EAI_AGAIN;
+    }
+    if (inet_pton(AF_INET, node, &ip) != 1) {
+        return EAI_NONAME;
+    }
+    ResolvedAddress *resolved = calloc(1, sizeof(ResolvedAddress));
+    CHECK(resolved != NULL);
+    resolved->address.sin_family = AF_INET;
+    resolved->address.sin_port = htons((uint16_t)atoi(service));
+    resolved->address.sin_addr = ip;
+    resolved->info.ai_family = AF_INET;
+    resolved->info.ai_socktype = SOCK_STREAM;
+    resolved->info.ai_addrlen = sizeof(resolved->address);
+    resolved->info.ai_addr = (struct sockaddr *)&resolved->address;
+    *res = &resolved->info;
+    return 0;
+}
+
+void freeaddrinfo(struct addrinfo *res) {
+    free(res);
+}
+
+static int listen_on(char *port, size_t size, int backlog) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, backlog) == 0);
+    socklen_t length = sizeof(address);
+    CHECK(getsockname(listener, (struct sockaddr *)&address, &length) == 0);
+    snprintf(port, size, "%d", ntohs(address.sin_port));
+    return listener;
+}
+
+// A listener with a full accept queue drops handshakes, like a blackholed address.
+static int listen_blackhole(char *port, size_t size) {
+    int listener = listen_on(port, size, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)atoi(port));
+    for (int i = 0; i < 3; i++) {
+        int filler = socket(AF_INET, SOCK_STREAM, 0);
+        fcntl(filler, F_SETFL, O_NONBLOCK);
+        connect(filler, (struct sockaddr *)&address, sizeof(address));
+    }
+    usleep(100000);
+    return listener;
+}
+
+static void wait_for_version(uint32_t wanted, int timeoutMs) {
+    while (timeoutMs-- > 0 && reachability_prober_version() < wanted) {
+        usleep(1000);
+    }
+}
+
+static ReachabilityState state_of(const char *host, const char *port) {
+    ReachabilityResult result;
+    CHECK(reachability_prober_lookup(host, port, &result));
+    return result.state;
+}
+
+static void test_round(void) {
+    char ports[LISTENERS][16];
+    int listeners[LISTENERS];
+    for (int i = 0; i < LISTENERS; i++) {
+        listeners[i] = listen_on(ports[i], sizeof(ports[i]), 64);
+        CHECK(reachability_prober_watch("127.0.0.1", ports[i]));
+    }
+    char closed[16];
+    close(listen_on(closed, sizeof(closed), 1));
+    CHECK(reachability_prober_watch("127.0.0.1", closed));
+    char blackhole[16];
+    int blackholeListener = listen_blackhole(blackhole, sizeof(blackhole));
+    CHECK(reachability_prober_watch("127.0.0.1", blackhole));
+    CHECK(reachability_prober_watch("no-such-host.invalid", "3389"));
+    CHECK(!reachability_prober_watch("", "1"));
+    CHECK(state_of("127.0.0.1", closed) == REACHABILITY_UNKNOWN);
+    ReachabilityResult result;
+    CHECK(!reachability_prober_lookup("127.0.0.1", "1", &result));
+
+    uint64_t startedNs = metrics_now_ns();
+    reachability_prober_start(500);
+    wait_for_version(2, 5000);
+    uint64_t roundMs = (metrics_now_ns() - startedNs) / MS;
+    printf("A round of %d targets took %llu ms\n", LISTENERS + 3, (unsigned long long)roundMs);
+    // One connect timeout for the blackhole, however many targets there are.
+    CHECK(roundMs < 2 * REACHABILITY_PROBER_CONNECT_TIMEOUT_MS + 500);
+    for (int i = 0; i < LISTENERS; i++) {
+        CHECK(reachability_prober_lookup("127.0.0.1", ports[i], &result));
+        CHECK(result.state == REACHABILITY_REACHABLE);
+        CHECK(result.rttUs < 100000);
+    }
+    CHECK(state_of("127.0.0.1", closed) == REACHABILITY_REFUSED);
+    CHECK(state_of("127.0.0.1", blackhole) == REACHABILITY_UNREACHABLE);
+    CHECK(state_of("no-such-host.invalid", "3389") == REACHABILITY_UNREACHABLE);
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)atoi(closed));
+    CHECK(reachability_prober_address_dead((struct sockaddr *)&address, sizeof(address)));
+    address.sin_port = htons((uint16_t)atoi(ports[0]));
+    CHECK(!reachability_prober_address_dead((struct sockaddr *)&address, sizeof(address)));
+
+    // Once the TTL passes the next round sees the port go down.
+    close(listeners[0]);
+    wait_for_version(reachability_prober_version() + 2, 5000);
+    CHECK(state_of("127.0.0.1", ports[0]) == REACHABILITY_REFUSED);
+
+    reachability_prober_stop();
+    usleep((REACHABILITY_PROBER_CONNECT_TIMEOUT_MS + 200) * 1000);
+    uint32_t stoppedVersion = reachability_prober_version();
+    usleep(1000 * 1000);
+    CHECK(reachability_prober_version() == stoppedVersion);
+
+    for (int i = 1; i < LISTENERS; i++) {
+        close(listeners[i]);
+    }
+    close(blackholeListener);
+}
+
+// Names that never resolve hold up neither the round nor the other targets.
+static void test_slow_resolver(void) {
+    char port[16];
+    int listener = listen_on(port, sizeof(port), 64);
+    CHECK(reachability_prober_watch("127.0.0.1", port));
+    char slowNames[SLOW_NAMES][16];
+    for (int i = 0; i < SLOW_NAMES; i++) {
+        snprintf(slowNames[i], sizeof(slowNames[i]), "slow%d.test", i);
+        CHECK(reachability_prober_watch(slowNames[i], "3389"));
+    }
+
+    uint32_t startVersion = reachability_prober_version();
+    uint64_t startedNs = metrics_now_ns();
+    reachability_prober_start(60000);
+    wait_for_version(startVersion + 2, 10000);
+    uint64_t roundMs = (metrics_now_ns() - startedNs) / MS;
+    printf("A round with %d names that do not resolve took %llu ms\n", SLOW_NAMES, (unsigned long long)roundMs);
+    CHECK(reachability_prober_version() >= startVersion + 2);
+    CHECK(roundMs < REACHABILITY_PROBER_RESOLVE_TIMEOUT_MS + 1000);
+    CHECK(state_of("127.0.0.1", port) == REACHABILITY_REACHABLE);
+    for (int i = 0; i < SLOW_NAMES; i++) {
+        CHECK(state_of(slowNames[i], "3389") == REACHABILITY_UNREACHABLE);
+    }
+    pthread_mutex_lock(&resolverLock);
+    CHECK(mostResolving <= REACHABILITY_PROBER_MAX_RESOLVERS);
+    slowReleased = true;
+    pthread_cond_broadcast(&resolverChanged);
+    pthread_mutex_unlock(&resolverLock);
+
+    reachability_prober_stop();
+    // Lets the released resolvers finish before the process exits.
+    usleep(200000);
+    close(listener);
+}
+
+int main(void) {
+    test_round();
+    test_slow_resolver();
+    printf("ReachabilityProberTest passed\n");
+    return 0;
+}
@@ -0,0 +1,160 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "ReconnectPolicy.h"
+#include "TestSupport.h"
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MS 1000000ULL
+#define PROXY_DROPS 3
+
+typedef struct {
+    int listener;
+    int dropsLeft;
+} FlakyProxy;
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+// Hangs up on the first connections like a link that is still coming back.
+static void *run_proxy(void *argument) {
+    FlakyProxy *proxy = argument;
+    for (;;) {
+        int client = accept(proxy->listener, NULL, NULL);
+        if (client < 0) {
+            return NULL;
+        }
+        if (proxy->dropsLeft > 0) {
+            proxy->dropsLeft--;
+        } else {
+            CHECK(write(client, "ok", 2) == 2);
+        }
+        close(client);
+    }
+}
+
+static void test_attempts(void) {
+    ReconnectPolicy policy;
+    reconnect_policy_init(&policy, 8, 250 * MS, 4000 * MS, 30000 * MS, 42);
+    reconnect_policy_begin(&policy, 0);
+    uint64_t now = 0;
+    int attempts = 0;
+    int64_t delay;
+    while ((delay = reconnect_policy_next_delay(&policy, now)) >= 0) {
+        if (attempts == 0) {
+            CHECK(delay == 0);
+        }
+        CHECK(delay <= (int64_t)(4000 * MS));
+        now += delay;
+        attempts++;
+    }
+    CHECK(attempts == 8);
+    CHECK(policy.state == RECONNECT_GAVE_UP);
+}
+
+static void test_budget(void) {
+    ReconnectPolicy policy;
+    reconnect_policy_init(&policy, 100, 250 * MS, 4000 * MS, 10000 * MS, 7);
+    reconnect_policy_begin(&policy, 0);
+    uint64_t now = 0;
+    int attempts = 0;
+    int64_t delay;
+    // Every attempt itself takes 100 ms.
+    while ((delay = reconnect_policy_next_delay(&policy, now)) >= 0) {
+        now += delay + 100 * MS;
+        attempts++;
+    }
+    CHECK(now <= 10100 * MS);
+    CHECK(attempts < 100);
+}
+
+static void test_succeed_and_give_up(void) {
+    ReconnectPolicy policy;
+    reconnect_policy_init(&policy, 8, 250 * MS, 4000 * MS, 30000 * MS, 7);
+    reconnect_policy_begin(&policy, 0);
+    reconnect_policy_next_delay(&policy, 0);
+    reconnect_policy_succeeded(&policy);
+    CHECK(reconnect_policy_next_delay(&policy, 0) == -1);
+
+    reconnect_policy_begin(&policy, 0);
+    CHECK(reconnect_policy_next_delay(&policy, 0) == 0);
+    reconnect_policy_give_up(&policy);
+    CHECK(reconnect_policy_next_delay(&policy, 0) == -1);
+
+    reconnect_policy_init(&policy, 8, 250 * MS, 4000 * MS, 30000 * MS, 0);
+    reconnect_policy_begin(&policy, 123456789);
+    CHECK(policy.random != 0);
+}
+
+// Reconnects through a proxy that drops the first connections.
+static void test_flaky_proxy(void) {
+    FlakyProxy proxy = { socket(AF_INET, SOCK_STREAM, 0), PROXY_DROPS };
+    CHECK(proxy.listener >= 0);
+    struct sockaddr_in address = { 0 };
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    CHECK(bind(proxy.listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(proxy.listener, 8) == 0);
+    CHECK(getsockname(proxy.listener, (struct sockaddr *)&address, &length) == 0);
+    pthread_t thread;
+    CHECK(pthread_create(&thread, NULL, run_proxy, &proxy) == 0);
+
+    ReconnectPolicy policy;
+    reconnect_policy_init(&policy, 8, 20 * MS, 200 * MS, 5000 * MS, 1);
+    reconnect_policy_begin(&policy, monotonic_ns());
+    bool connected = false;
+    int64_t delay;
+    while ((delay = reconnect_policy_next_delay(&policy, monotonic_ns())) >= 0) {
+        usleep((useconds_t)(delay / 1000));
+        int connection = socket(AF_INET, SOCK_STREAM, 0);
+        CHECK(connect(connection, (struct sockaddr *)&address, sizeof(address)) == 0);
+        char reply[2];
+        ssize_t got = read(connection, reply, sizeof(reply));
+        close(connection);
+        if (got == 2) {
+            connected = true;
+            reconnect_policy_succeeded(&policy);
+            break;
+        }
+    }
+    CHECK(connected);
+    CHECK(policy.attempts == PROXY_DROPS + 1);
+
+    shutdown(proxy.listener, SHUT_RDWR);
+    close(proxy.listener);
+    pthread_join(thread, NULL);
+}
+
+int main(void) {
+    test_attempts();
+    test_budget();
+    test_succeed_and_give_up();
+    test_flaky_proxy();
+    printf("ReconnectPolicyTest passed\n");
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "RefreshScheduler.h"
+#include "TestSupport.h"
+
+#include <string.h>
+
+#define WIDTH 1000
+#define HEIGHT 800
+#define INTERVAL 250
+
+static bool covered(const RefreshArea *areas, uint32_t count, int32_t x, int32_t y) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (x >= areas[i].x && x < areas[i].x + areas[i].width && y >= areas[i].y && y < areas[i].y + areas[i].height) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void test_clip_merge_and_rate_limit(void) {
+    RefreshScheduler scheduler;
+    refresh_scheduler_init(&scheduler, INTERVAL);
+    refresh_scheduler_reset(&scheduler, WIDTH, HEIGHT);
+    RefreshArea areas[REFRESH_SCHEDULER_MAX_AREAS];
+
+    CHECK(!refresh_scheduler_add(&scheduler, 2000, 0, 10, 10));
+    CHECK(!refresh_scheduler_add(&scheduler, 0, 0, 0, 10));
+    CHECK(refresh_scheduler_add(&scheduler, -10, -10, 20, 20));
+    CHECK(refresh_scheduler_add(&scheduler, 5, 5, 10, 10));
+    CHECK(refresh_scheduler_pending(&scheduler) == 1);
+    CHECK(refresh_scheduler_take(&scheduler, 1000, false, areas) == 1);
+    CHECK(areas[0].x == 0 && areas[0].y == 0 && areas[0].width == 15 && areas[0].height == 15);
+
+    CHECK(refresh_scheduler_add(&scheduler, 500, 500, 10, 10));
+    CHECK(refresh_scheduler_take(&scheduler, 1000 + INTERVAL / 2, false, areas) == 0);
+    CHECK(refresh_scheduler_take(&scheduler, 1000 + INTERVAL / 2, true, areas) == 1);
+    CHECK(refresh_scheduler_add(&scheduler, 500, 500, 10, 10));
+    CHECK(refresh_scheduler_take(&scheduler, 1200, false, areas) == 0);
+    CHECK(refresh_scheduler_take(&scheduler, 1125 + INTERVAL, false, areas) == 1);
+
+    // Far apart areas stay separate, adjacent ones merge.
+    refresh_scheduler_add(&scheduler, 0, 0, 10, 10);
+    refresh_scheduler_add(&scheduler, 900, 700, 10, 10);
+    CHECK(refresh_scheduler_pending(&scheduler) == 2);
+    refresh_scheduler_add(&scheduler, 10, 0, 10, 10);
+    CHECK(refresh_scheduler_pending(&scheduler) == 2);
+    refresh_scheduler_reset(&scheduler, WIDTH, HEIGHT);
+    CHECK(refresh_scheduler_pending(&scheduler) == 0);
+
+    // Never more than one Refresh Rect PDU's worth.
+    for (int i = 0; i < 40; i++) {
+        refresh_scheduler_add(&scheduler, (i % 8) * 120, (i / 8) * 150, 5, 5);
+    }
+    CHECK(refresh_scheduler_pending(&scheduler) <= REFRESH_SCHEDULER_MAX_AREAS);
+    refresh_scheduler_destroy(&scheduler);
+}
+
+// Every requested pixel must be in the areas that go out, pending areas never
+// touch each other, and little more than what was asked for is sent.
+static void test_random_requests(void) {
+    static bool wanted[HEIGHT][WIDTH];
+    RefreshScheduler scheduler;
+    refresh_scheduler_init(&scheduler, INTERVAL);
+    refresh_scheduler_reset(&scheduler, WIDTH, HEIGHT);
+    RefreshArea areas[REFRESH_SCHEDULER_MAX_AREAS];
+    srand(7);
+    long asked = 0;
+    long sent = 0;
+    uint64_t now = 10000;
+    for (int round = 0; round < 3000; round++) {
+        int requests = 1 + rand() % 3;
+        for (int i = 0; i < requests; i++) {
+            int32_t x = rand() % 1100 - 50;
+            int32_t y = rand() % 900 - 50;
+            int32_t width = 1 + rand() % 120;
+            int32_t height = 1 + rand() % 120;
+            if (!refresh_scheduler_add(&scheduler, x, y, width, height)) {
+                continue;
+            }
+            for (int32_t row = y < 0 ? 0 : y; row < y + height && row < HEIGHT; row++) {
+                for (int32_t column = x < 0 ? 0 : x; column < x + width && column < WIDTH; column++) {
+                    if (!wanted[row][column]) {
+                        wanted[row][column] = true;
+                        asked++;
+                    }
+                }
+            }
+        }
+        CHECK(scheduler.count <= REFRESH_SCHEDULER_MAX_AREAS);
+        for (uint32_t i = 0; i < scheduler.count; i++) {
+            for (uint32_t j = i + 1; j < scheduler.count; j++) {
+                const RefreshArea *a = &scheduler.pending[i];
+                const RefreshArea *b = &scheduler.pending[j];
+                CHECK(!(a->x <= b->x + b->width && b->x <= a->x + a->width &&
+                        a->y <= b->y + b->height && b->y <= a->y + a->height));
+            }
+        }
+        now += 100;
+        uint32_t count = refresh_scheduler_take(&scheduler, now, false, areas);
+        if (count == 0) {
+            continue;
+        }
+        for (int32_t row = 0; row < HEIGHT; row++) {
+            for (int32_t column = 0; column < WIDTH; column++) {
+                if (wanted[row][column]) {
+                    CHECK(covered(areas, count, column, row));
+                    wanted[row][column] = false;
+                }
+            }
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            CHECK(areas[i].x >= 0 && areas[i].y >= 0);
+            CHECK(areas[i].x + areas[i].width <= WIDTH && areas[i].y + areas[i].height <= HEIGHT);
+            sent += (long)areas[i].width * areas[i].height;
+        }
+    }
+    printf("asked for %ld pixels, sent %ld (%.2fx)\n", asked, sent, (double)sent / asked);
+    CHECK(sent < asked * 3 / 2);
+    refresh_scheduler_destroy(&scheduler);
+}
+
+int main(void) {
+    test_clip_merge_and_rate_limit();
+    test_random_requests();
+    printf("RefreshSchedulerTest passed\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "TestSupport.h"
+
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/region.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/settings.h>
+#include <winpr/stream.h>
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 2560
+#define HEIGHT 1440
+#define ROUNDS 10
+#define MAX_THREADS 8
+// Where ThreadingFlags carries the thread count, as setDecodeThreads in
+// RdpBridge.m packs it for freerdp_rfx_decode_threads.patch.
+#define DECODE_THREADS_SHIFT 8
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static UINT32 threading_flags(int threads) {
+    return threads <= 1 ? THREADING_FLAGS_DISABLE_THREADS : (UINT32)threads << DECODE_THREADS_SHIFT;
+}
+
+// A desktop worth of gradients with text like detail, encoded once into a
+// full screen RemoteFX message with its header blocks.
+static wStream *encode_desktop(void) {
+    BYTE *desktop = malloc(WIDTH * HEIGHT * 4);
+    CHECK(desktop != NULL);
+    srand(7);
+    for (int y = 0; y < HEIGHT; y++) {
+        for (int x = 0; x < WIDTH; x++) {
+            BYTE *pixel = desktop + (y * WIDTH + x) * 4;
+            BOOL glyph = (y % 24) < 14 && (x % 9) < 6 && (rand() & 3) == 0;
+            pixel[0] = glyph ? 0x20 : (BYTE)(x * 255 / WIDTH);
+            pixel[1] = glyph ? 0x20 : (BYTE)(y * 255 / HEIGHT);
+            pixel[2] = glyph ? 0x20 : (BYTE)((x + y) & 0xFF);
+            pixel[3] = 0xFF;
+        }
+    }
+
+    RFX_CONTEXT *encoder = rfx_context_new_ex(TRUE, threading_flags(1));
+    CHECK(encoder != NULL);
+    CHECK(rfx_context_reset(encoder, WIDTH, HEIGHT));
+    rfx_context_set_pixel_format(encoder, PIXEL_FORMAT_BGRX32);
+    RFX_RECT rect = { 0, 0, WIDTH, HEIGHT };
+    RFX_MESSAGE *message = rfx_encode_message(encoder, &rect, 1, desktop, WIDTH, HEIGHT, WIDTH * 4);
+    CHECK(message != NULL);
+    wStream *stream = Stream_New(NULL, 1024);
+    CHECK(stream != NULL && rfx_write_message(encoder, stream, message));
+    rfx_message_free(encoder, message);
+    rfx_context_free(encoder);
+    free(desktop);
+    return stream;
+}
+
+// Decodes the message ROUNDS times on a pool of the given size, returns the
+// mean time per update and leaves the last frame in frame.
+static uint64_t decode(wStream *stream, int threads, BYTE *frame) {
+    RFX_CONTEXT *decoder = rfx_context_new_ex(FALSE, threading_flags(threads));
+    CHECK(decoder != NULL);
+    CHECK(rfx_context_reset(decoder, WIDTH, HEIGHT));
+    rfx_context_set_pixel_format(decoder, PIXEL_FORMAT_BGRX32);
+    REGION16 invalid;
+    region16_init(&invalid);
+    uint64_t start = monotonic_ns();
+    for (int i = 0; i < ROUNDS; i++) {
+        region16_clear(&invalid);
+        CHECK(rfx_process_message(decoder, Stream_Buffer(stream), (UINT32)Stream_GetPosition(stream), 0, 0,
+                                  frame, PIXEL_FORMAT_BGRX32, WIDTH * 4, HEIGHT, &invalid));
+    }
+    uint64_t elapsed = (monotonic_ns() - start) / ROUNDS;
+    region16_uninit(&invalid);
+    rfx_context_free(decoder);
+    return elapsed;
+}
+
+int main(void) {
+    wStream *stream = encode_desktop();
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int maxThreads = cpus < MAX_THREADS ? (int)cpus : MAX_THREADS;
+    size_t frameSize = WIDTH * HEIGHT * 4;
+    BYTE *reference = calloc(1, frameSize);
+    BYTE *frame = calloc(1, frameSize);
+    CHECK(reference != NULL && frame != NULL);
+
+    uint64_t singleNs = decode(stream, 1, reference);
+    printf("%dx%d RemoteFX update, %zu bytes: 1 thread %.1f ms\n", WIDTH, HEIGHT,
+           Stream_GetPosition(stream), singleNs / 1e6);
+    uint64_t bestNs = singleNs;
+    for (int threads = 2; threads <= maxThreads; threads++) {
+        memset(frame, 0, frameSize);
+        uint64_t ns = decode(stream, threads, frame);
+        // Tiles land in the same place whichever worker decoded them.
+        CHECK(memcmp(frame, reference, frameSize) == 0);
+        printf("%d threads %.1f ms, %.2fx\n", threads, ns / 1e6, (double)singleNs / ns);
+        if (ns < bestNs) {
+            bestNs = ns;
+        }
+    }
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    if (maxThreads > 1) {
+        CHECK(bestNs < singleNs);
+    }
+#endif
+
+    free(frame);
+    free(reference);
+    Stream_Free(stream, TRUE);
+    printf("RemoteFxDecodeTest passed\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+import Foundation
+
+func log_callback_str(message: String) -> Void {
+}
+
+/**
+ Stands in for the keychain, which the test builds without.
+ */
+class KeychainStorage: CredentialStorage {
+    var items: [String: String] = [:]
+    var writes = 0
+
+    func save(account: String, password: String, user: String, server: String?, port: String?) -> Bool {
+        items[account] = password
+        writes += 1
+        return true
+    }
+
+    func load(account: String) -> String? {
+        return items[account]
+    }
+
+    func delete(account: String) -> Bool {
+        writes += 1
+        return items.removeValue(forKey: account) != nil
+    }
+}
+
+/**
+ Round trips credentials the way the app does: saved from the edit page, dropped from the list,
+ loaded again on select, and saved again through the paths that only carry some of them.
+ */
+@main
+struct SecureStorageDelegateTest {
+    static let storage = KeychainStorage()
+
+    static func check(_ condition: Bool, _ message: String, line: Int = #line) {
+        if !condition {
+            FileHandle.standardError.write("SecureStorageDelegateTest.swift:\(line): check failed: \(message)\n".data(using: .utf8)!)
+            exit(1)
+        }
+    }
+
+    static func edited() -> [String: String] {
+        return [
+            "id": "office",
+            "address": "desktop.example.com",
+            "username": "alice",
+            "password": "rdp secret",
+            "saveCredentials": "true",
+            "sshAddress": "bastion.example.com",
+            "sshUser": "alice",
+            "sshPass": "ssh secret",
+            "saveSshCredentials": "true",
+            "sshPassphrase": "passphrase",
+            "sshPrivateKey": "private key",
+            "rdpGatewayPass": "gateway secret",
+        ]
+    }
+
+    static func checkAllLoaded(_ connection: [String: String], _ message: String, line: Int = #line) {
+        let expected = edited()
+        for field in SecureStorageDelegate.credentialFields {
+            check(connection[field] == expected[field], "\(message): \(field)", line: line)
+        }
+    }
+
+    static func testListEntryLoadsOnSelect() {
+        let listed = SecureStorageDelegate.saveCredentialsForConnection(connection: edited())
+        for field in SecureStorageDelegate.credentialFields {
+            check(listed[field] == nil, "list entry carries no \(field)")
+        }
+        checkAllLoaded(SecureStorageDelegate.loadMissingCredentialsForConnection(connection: listed), "selected")
+    }
+
+    static func testSavingWithoutCredentialsKeepsThem() {
+        let listed = SecureStorageDelegate.removeCredentialsFromConnection(connection: edited())
+        let writes = storage.writes
+        _ = SecureStorageDelegate.saveCredentialsForConnection(connection: listed)
+        check(storage.writes == writes, "a connection without credentials writes nothing")
+        checkAllLoaded(SecureStorageDelegate.loadCredentialsForConnection(connection: listed), "after saving list entry")
+
+        // A URL rewrites the address of a saved connection and connects to it.
+        var fromUrl = listed
+        fromUrl["address"] = "other.example.com"
+        let selected = SecureStorageDelegate.loadMissingCredentialsForConnection(connection: fromUrl)
+        checkAllLoaded(selected, "selected from URL")
+        _ = SecureStorageDelegate.saveCredentialsForConnection(connection: selected)
+        checkAllLoaded(SecureStorageDelegate.loadCredentialsForConnection(connection: listed), "after saving from URL")
+    }
+
+    static func testTypedCredentialsWin() {
+        var typed = SecureStorageDelegate.removeCredentialsFromConnection(connection: edited())
+        typed["password"] = "typed"
+        typed["saveCredentials"] = "false"
+        let selected = SecureStorageDelegate.loadMissingCredentialsForConnection(connection: typed)
+        check(selected["password"] == "typed", "typed password kept")
+        check(selected["sshPass"] == "ssh secret", "stored SSH password loaded")
+        _ = SecureStorageDelegate.saveCredentialsForConnection(connection: selected)
+        check(storage.load(account: "password/office") == "rdp secret", "unsaved password left out of storage")
+    }
+
+    static func testBlankFieldDeletes() {
+        var cleared = edited()
+        cleared["password"] = ""
+        cleared["saveCredentials"] = "false"
+        _ = SecureStorageDelegate.saveCredentialsForConnection(connection: cleared)
+        let loaded = SecureStorageDelegate.loadCredentialsForConnection(
+            connection: SecureStorageDelegate.removeCredentialsFromConnection(connection: cleared)
+        )
+        check(loaded["password"] == nil, "cleared password deleted")
+        check(loaded["rdpGatewayPass"] == "gateway secret", "gateway password untouched")
+        check(loaded["sshPass"] == "ssh secret", "SSH password untouched")
+    }
+
+    static func main() {
+        SecureStorageDelegate.storage = storage
+        testListEntryLoadsOnSelect()
+        testSavingWithoutCredentialsKeepsThem()
+        testTypedCredentialsWin()
+        testBlankFieldDeletes()
+        print("SecureStorageDelegateTest passed")
+    }
+}
@@ -0,0 +1,132 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "SshAlgorithmPreference.h"
+#include "TestSupport.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static const char *supported[] = {
+    "aes256-ctr", "aes128-ctr", "aes256-cbc", "aes128-gcm@openssh.com", "3des-cbc"
+};
+#define SUPPORTED_COUNT ((int)(sizeof(supported) / sizeof(supported[0])))
+
+static void test_benchmark(void) {
+    SshAlgorithmBenchmark benchmark;
+    ssh_algorithm_benchmark_run(&benchmark, 20000000ULL);
+    for (int cipher = 0; cipher < SSH_CIPHER_COUNT; cipher++) {
+        CHECK(benchmark.cipherMBps[cipher] > 0);
+    }
+    for (int mac = 0; mac < SSH_MAC_COUNT; mac++) {
+        CHECK(benchmark.macMBps[mac] > 0);
+    }
+    SshAlgorithmPreference preference;
+    ssh_algorithm_rank(&benchmark, &preference);
+    printf("Measured ciphers %s\nMeasured MACs %s\n", preference.ciphers, preference.macs);
+    CHECK(!preference.ciphersExclusive);
+    CHECK(!preference.macsExclusive);
+}
+
+static void test_rank(void) {
+    SshAlgorithmPreference preference;
+
+    // A CPU without AES instructions.
+    SshAlgorithmBenchmark software = { { 200, 150, 900, 250, 190 }, { 400, 600, 700 } };
+    ssh_algorithm_rank(&software, &preference);
+    CHECK(strncmp(preference.ciphers, "chacha20-poly1305@openssh.com,", 30) == 0);
+    CHECK(strncmp(preference.macs, "hmac-sha1-etm@openssh.com,hmac-sha1,hmac-sha2-512-etm", 50) == 0);
+
+    // The CTR cipher is faster on its own but pays for its MAC, 4000 with 2000 is 1333.
+    SshAlgorithmBenchmark hardware = { { 3000, 2500, 900, 4000, 3200 }, { 2000, 1500, 1800 } };
+    ssh_algorithm_rank(&hardware, &preference);
+    CHECK(strncmp(preference.ciphers, "aes128-gcm@openssh.com,aes256-gcm@openssh.com,aes128-ctr,", 57) == 0);
+
+    // Nothing measured still lists every algorithm.
+    SshAlgorithmBenchmark unmeasured = { { 0, 0, 500, 0, 0 }, { 0, 0, 0 } };
+    ssh_algorithm_rank(&unmeasured, &preference);
+    CHECK(strncmp(preference.ciphers, "chacha20-poly1305@openssh.com,", 30) == 0);
+    CHECK(strstr(preference.ciphers, "aes256-ctr") != NULL);
+    CHECK(strstr(preference.macs, "hmac-sha2-256") != NULL);
+}
+
+static void test_merge(void) {
+    char merged[SSH_ALGORITHM_LIST_SIZE];
+    int count = ssh_algorithm_merge("chacha20-poly1305@openssh.com,aes128-gcm@openssh.com,aes128-ctr,aes128-gcm@openssh.com",
+                                    supported, SUPPORTED_COUNT, false, merged, sizeof(merged));
+    CHECK(count == 5);
+    CHECK(strcmp(merged, "aes128-gcm@openssh.com,aes128-ctr,aes256-ctr,aes256-cbc,3des-cbc") == 0);
+
+    count = ssh_algorithm_merge("aes256-ctr,aes128-gcm@openssh.com", supported, SUPPORTED_COUNT, true, merged, sizeof(merged));
+    CHECK(count == 2);
+    CHECK(strcmp(merged, "aes256-ctr,aes128-gcm@openssh.com") == 0);
+
+    count = ssh_algorithm_merge("chacha20-poly1305@openssh.com", supported, SUPPORTED_COUNT, true, merged, sizeof(merged));
+    CHECK(count == 0);
+    CHECK(merged[0] == '\0');
+
+    ssh_algorithm_merge("", supported, SUPPORTED_COUNT, false, merged, 20);
+    CHECK(strlen(merged) < 20);
+
+    count = ssh_algorithm_merge(",,aes128-ctr,", supported, SUPPORTED_COUNT, true, merged, sizeof(merged));
+    CHECK(count == 1);
+    CHECK(strcmp(merged, "aes128-ctr") == 0);
+}
+
+static void test_cache_and_override(void) {
+    char directory[] = "/tmp/SshAlgorithmPreferenceTestXXXXXX";
+    CHECK(mkdtemp(directory) != NULL);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/cache", directory);
+
+    SshAlgorithmPreference first;
+    SshAlgorithmPreference second;
+    ssh_algorithm_preference_get(path, &first);
+    CHECK(access(path, R_OK) == 0);
+    ssh_algorithm_preference_get(path, &second);
+    CHECK(strcmp(first.ciphers, second.ciphers) == 0);
+    CHECK(!second.ciphersExclusive);
+
+    // A connection that mandates a cipher only.
+    ssh_algorithm_preference_set_override("aes256-gcm@openssh.com", NULL);
+    ssh_algorithm_preference_get(path, &second);
+    CHECK(second.ciphersExclusive);
+    CHECK(!second.macsExclusive);
+    CHECK(strcmp(second.ciphers, "aes256-gcm@openssh.com") == 0);
+    CHECK(strcmp(second.macs, first.macs) == 0);
+
+    // The next connection has no override, empty lists as the settings pass them.
+    ssh_algorithm_preference_set_override("", "");
+    ssh_algorithm_preference_get(path, &second);
+    CHECK(!second.ciphersExclusive);
+    CHECK(!second.macsExclusive);
+    CHECK(strcmp(second.ciphers, first.ciphers) == 0);
+
+    CHECK(remove(path) == 0);
+    CHECK(rmdir(directory) == 0);
+}
+
+int main(void) {
+    test_benchmark();
+    test_rank();
+    test_merge();
+    test_cache_and_override();
+    printf("SshAlgorithmPreferenceTest passed\n");
+    return 0;
+}
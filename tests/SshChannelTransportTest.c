@@ -0,0 +1,193 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+#include "SshChannelTransport.h"
+#include "TestSupport.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// A channel that reads and writes one end of a socket pair without blocking,
+// the other end stands in for the RDP server behind the tunnel.
+struct _LIBSSH2_CHANNEL {
+    int fd;
+    int eof;
+};
+
+ssize_t libssh2_channel_read(LIBSSH2_CHANNEL *channel, char *buf, size_t buflen) {
+    ssize_t got = recv(channel->fd, buf, buflen, MSG_DONTWAIT);
+    if (got < 0 && errno == EAGAIN) {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    channel->eof = got == 0;
+    return got;
+}
+
+ssize_t libssh2_channel_write(LIBSSH2_CHANNEL *channel, const char *buf, size_t buflen) {
+    ssize_t sent = send(channel->fd, buf, buflen, MSG_DONTWAIT);
+    if (sent < 0 && errno == EAGAIN) {
+        return LIBSSH2_ERROR_EAGAIN;
+    }
+    return sent;
+}
+
+int libssh2_channel_eof(LIBSSH2_CHANNEL *channel) {
+    return channel->eof;
+}
+
+typedef struct {
+    LIBSSH2_CHANNEL *channel;
+    int sock;
+} Publication;
+
+static int sockets[2];
+static int eventsReleased;
+static SshChannelTransportEnd lastEnd;
+static volatile int waited;
+
+static void release_event(void *event) {
+    eventsReleased++;
+}
+
+static void *wait_for_channel(void *argument) {
+    lastEnd = ssh_channel_transport_wait();
+    __atomic_store_n(&waited, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Publishes the next channel a little later, like a forwarder reopening one.
+static void *publish_later(void *argument) {
+    Publication *publication = argument;
+    struct timespec delay = { 0, 50000000 };
+    nanosleep(&delay, NULL);
+    ssh_channel_transport_publish(publication->channel, publication->sock);
+    return NULL;
+}
+
+static void test_without_forwarder(void) {
+    CHECK(ssh_channel_transport_take(2000) == NULL);
+}
+
+static void test_take_read_write(void) {
+    LIBSSH2_CHANNEL channel = { sockets[0], 0 };
+    ssh_channel_transport_begin();
+    CHECK(ssh_channel_transport_publish(&channel, sockets[0]));
+    BIO *bio = ssh_channel_transport_take(0);
+    CHECK(bio != NULL);
+    CHECK(ssh_channel_transport_socket(bio) == sockets[0]);
+    CHECK(BIO_get_fd(bio, NULL) == sockets[0]);
+    int event = 7;
+    ssh_channel_transport_set_event(bio, &event, release_event);
+    void *handedOut = NULL;
+    CHECK(BIO_ctrl(bio, SSH_CHANNEL_BIO_C_GET_EVENT, 0, &handedOut) == 1);
+    CHECK(handedOut == &event);
+    // Only one session gets the channel.
+    CHECK(ssh_channel_transport_take(10) == NULL);
+
+    pthread_t waiter;
+    CHECK(pthread_create(&waiter, NULL, wait_for_channel, NULL) == 0);
+    usleep(20000);
+    CHECK(!__atomic_load_n(&waited, __ATOMIC_ACQUIRE));
+
+    char buffer[64];
+    CHECK(BIO_read(bio, buffer, sizeof(buffer)) == -1);
+    CHECK(BIO_should_retry(bio));
+    CHECK(BIO_should_read(bio));
+    CHECK(BIO_ctrl(bio, SSH_CHANNEL_BIO_C_READ_BLOCKED, 0, NULL) == 1);
+    CHECK(BIO_ctrl(bio, SSH_CHANNEL_BIO_C_WAIT_READ, 10, NULL) == 0);
+    CHECK(write(sockets[1], "hello", 5) == 5);
+    CHECK(BIO_ctrl(bio, SSH_CHANNEL_BIO_C_WAIT_READ, 10, NULL) == 1);
+    CHECK(BIO_read(bio, buffer, sizeof(buffer)) == 5);
+    CHECK(memcmp(buffer, "hello", 5) == 0);
+    CHECK(BIO_write(bio, "abc", 3) == 3);
+    CHECK(read(sockets[1], buffer, 3) == 3);
+    CHECK(memcmp(buffer, "abc", 3) == 0);
+
+    // Freeing the BIO lets the forwarder free the channel.
+    BIO_free(bio);
+    pthread_join(waiter, NULL);
+    CHECK(waited);
+    CHECK(lastEnd == SSH_CHANNEL_TRANSPORT_CLOSED);
+    CHECK(eventsReleased == 1);
+}
+
+static void test_reopen_and_shutdown(void) {
+    // Nothing is published, so waiting returns right away.
+    waited = 0;
+    pthread_t waiter;
+    CHECK(pthread_create(&waiter, NULL, wait_for_channel, NULL) == 0);
+    pthread_join(waiter, NULL);
+    CHECK(lastEnd == SSH_CHANNEL_TRANSPORT_CLOSED);
+
+    // A reconnecting session waits for the next channel.
+    LIBSSH2_CHANNEL channel = { sockets[0], 0 };
+    Publication publication = { &channel, sockets[0] };
+    pthread_t publisher;
+    CHECK(pthread_create(&publisher, NULL, publish_later, &publication) == 0);
+    BIO *bio = ssh_channel_transport_take(2000);
+    CHECK(bio != NULL);
+    pthread_join(publisher, NULL);
+
+    waited = 0;
+    CHECK(pthread_create(&waiter, NULL, wait_for_channel, NULL) == 0);
+    usleep(20000);
+    CHECK(!__atomic_load_n(&waited, __ATOMIC_ACQUIRE));
+    ssh_channel_transport_shutdown();
+    pthread_join(waiter, NULL);
+    CHECK(lastEnd == SSH_CHANNEL_TRANSPORT_SHUTDOWN);
+
+    // Once shut down the BIO no longer touches the channel.
+    char buffer[64];
+    CHECK(write(sockets[1], "x", 1) == 1);
+    CHECK(BIO_read(bio, buffer, sizeof(buffer)) == -1);
+    CHECK(!BIO_should_retry(bio));
+    CHECK(BIO_write(bio, "x", 1) == -1);
+    CHECK(!ssh_channel_transport_publish(&channel, sockets[0]));
+    BIO_free(bio);
+}
+
+static void test_end_of_stream(void) {
+    LIBSSH2_CHANNEL channel = { sockets[0], 0 };
+    ssh_channel_transport_begin();
+    CHECK(ssh_channel_transport_publish(&channel, sockets[0]));
+    BIO *bio = ssh_channel_transport_take(0);
+    CHECK(bio != NULL);
+    char buffer[64];
+    while (BIO_read(bio, buffer, sizeof(buffer)) > 0) {
+    }
+    close(sockets[1]);
+    CHECK(BIO_read(bio, buffer, sizeof(buffer)) == 0);
+    BIO_free(bio);
+    ssh_channel_transport_shutdown();
+}
+
+int main(void) {
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    test_without_forwarder();
+    test_take_read_write();
+    test_reopen_and_shutdown();
+    test_end_of_stream();
+    close(sockets[0]);
+    printf("SshChannelTransportTest passed\n");
+    return 0;
+}
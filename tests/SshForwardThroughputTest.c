@@ -0,0 +1,544 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+// Pushes data both ways through the forwarder, libssh2 and a local sshd for
+// each cipher and MAC suite, and for whatever the measured preference
+// negotiates, and compares throughput, round trip time and CPU per MB. The
+// preferred suite also runs in process, reading and writing the channel
+// through SshChannelTransport's BIO the way FreeRDP does, against the loopback
+// listener. Takes the paths of sshd and ssh-keygen as arguments.
+
+#include "SshPortForwarder.h"
+#include "SshChannelTransport.h"
+#include "TestSupport.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UPLOAD_BYTES (32 * 1024 * 1024)
+#define DOWNLOAD_BYTES (64 * 1024 * 1024)
+#define CHUNK 16384
+#define PINGS 1000
+#define PING_BYTES 64
+
+typedef struct {
+    const char *name;
+    const char *ciphers;
+    const char *macs;
+} Suite;
+
+// The first one leaves the choice to SshAlgorithmPreference.
+static const Suite suites[] = {
+    { "preference", "", "" },
+    { "aes128-gcm", "aes128-gcm@openssh.com", "" },
+    { "aes256-gcm", "aes256-gcm@openssh.com", "" },
+    { "chacha20-poly1305", "chacha20-poly1305@openssh.com", "" },
+    { "aes128-ctr hmac-sha2-256", "aes128-ctr", "hmac-sha2-256" },
+    { "aes256-ctr hmac-sha2-512", "aes256-ctr", "hmac-sha2-512" },
+    { "aes128-ctr hmac-sha1", "aes128-ctr", "hmac-sha1" },
+};
+#define SUITE_COUNT (int)(sizeof(suites) / sizeof(suites[0]))
+
+typedef enum {
+    FORWARD_PENDING = 0,
+    FORWARD_UP,
+    FORWARD_FAILED
+} ForwardState;
+
+static pthread_mutex_t stateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stateChanged = PTHREAD_COND_INITIALIZER;
+static ForwardState forwardState;
+static char negotiated[128];
+
+static char directory[] = "/tmp/SshForwardThroughputTestXXXXXX";
+static char privateKey[16384];
+static char user[256];
+static char sshPort[16];
+static char sinkPort[16];
+static int sinkListener = -1;
+static bool sinkDone;
+static bool sinkIntact;
+
+static uint8_t pattern(size_t offset) {
+    return (uint8_t)(offset * 131 + (offset >> 13));
+}
+
+static void set_state(ForwardState state) {
+    pthread_mutex_lock(&stateLock);
+    forwardState = state;
+    pthread_cond_broadcast(&stateChanged);
+    pthread_mutex_unlock(&stateLock);
+}
+
+static void fail_callback(int instance, uint8_t *message) {
+    (void)instance;
+    fprintf(stderr, "Forwarder failed: %s\n", (char *)message);
+    set_state(FORWARD_FAILED);
+}
+
+static void success_callback(void) {
+    set_state(FORWARD_UP);
+}
+
+static void failure_callback(void) {
+    set_state(FORWARD_FAILED);
+}
+
+// Keeps the suite the forwarder reports after the handshake.
+static void log_callback(int8_t *message) {
+    const char *line = strstr((const char *)message, "Negotiated cipher ");
+    if (line != NULL) {
+        pthread_mutex_lock(&stateLock);
+        snprintf(negotiated, sizeof(negotiated), "%s", line + strlen("Negotiated cipher "));
+        negotiated[strcspn(negotiated, "\n")] = '\0';
+        pthread_mutex_unlock(&stateLock);
+    }
+}
+
+static int yes_no(int instance, int8_t *title, int8_t *text, int8_t *a, int8_t *b, int8_t *c, int d) {
+    (void)instance;
+    (void)title;
+    (void)text;
+    (void)a;
+    (void)b;
+    (void)c;
+    (void)d;
+    return 1;
+}
+
+static double now_s(int clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double process_cpu_s(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static int listen_on_loopback(char *port, size_t size) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, 8) == 0);
+    socklen_t length = sizeof(address);
+    getsockname(listener, (struct sockaddr *)&address, &length);
+    snprintf(port, size, "%d", ntohs(address.sin_port));
+    return listener;
+}
+
+// A port nothing listens on right now, for servers that bind it themselves.
+static void free_port(char *port, size_t size) {
+    close(listen_on_loopback(port, size));
+}
+
+static int connect_to(const char *port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(atoi(port));
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Plays the RDP server behind sshd: takes the client's upload, then sends the download.
+static void *serve(void *arg) {
+    int fd = (int)(long)arg;
+    uint8_t buffer[CHUNK];
+    bool intact = true;
+    size_t received = 0;
+    while (received < UPLOAD_BYTES) {
+        ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            intact = false;
+            break;
+        }
+        for (ssize_t i = 0; i < length; i++) {
+            intact = intact && buffer[i] == pattern(received + i);
+        }
+        received += length;
+    }
+    if (received == 0) {
+        // One of the channels the forwarder opened but nothing connected to.
+        close(fd);
+        return NULL;
+    }
+    for (size_t sent = 0; intact && sent < DOWNLOAD_BYTES;) {
+        size_t length = DOWNLOAD_BYTES - sent < CHUNK ? DOWNLOAD_BYTES - sent : CHUNK;
+        for (size_t i = 0; i < length; i++) {
+            buffer[i] = pattern(sent + i);
+        }
+        ssize_t written = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (written <= 0) {
+            intact = false;
+            break;
+        }
+        sent += written;
+    }
+    pthread_mutex_lock(&stateLock);
+    sinkIntact = intact;
+    sinkDone = true;
+    pthread_cond_broadcast(&stateChanged);
+    pthread_mutex_unlock(&stateLock);
+    // Then echoes the client's pings until it goes away.
+    ssize_t length;
+    while (intact && (length = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        CHECK(send(fd, buffer, length, MSG_NOSIGNAL) == length);
+    }
+    close(fd);
+    return NULL;
+}
+
+// sshd connects once for every channel the forwarder opens, up front, so each
+// connection is served on its own.
+static void *sink(void *arg) {
+    (void)arg;
+    while (1) {
+        int fd = accept(sinkListener, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+        pthread_t thread;
+        CHECK(pthread_create(&thread, NULL, serve, (void *)(long)fd) == 0);
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static char localPort[16];
+static const Suite *currentSuite;
+static bool currentInProcess;
+
+// The client end of the tunnel, a loopback socket or the channel's BIO.
+typedef struct {
+    int fd;
+    BIO *bio;
+} Connection;
+
+static void send_all(Connection *connection, const uint8_t *buffer, size_t length) {
+    for (size_t sent = 0; sent < length;) {
+        int written;
+        if (connection->bio == NULL) {
+            written = (int)send(connection->fd, buffer + sent, length - sent, MSG_NOSIGNAL);
+        } else {
+            written = BIO_write(connection->bio, buffer + sent, (int)(length - sent));
+            if (written <= 0 && BIO_should_retry(connection->bio)) {
+                BIO_ctrl(connection->bio, SSH_CHANNEL_BIO_C_WAIT_WRITE, 100, NULL);
+                continue;
+            }
+        }
+        CHECK(written > 0);
+        sent += written;
+    }
+}
+
+static size_t receive_some(Connection *connection, uint8_t *buffer, size_t size) {
+    while (1) {
+        int length;
+        if (connection->bio == NULL) {
+            length = (int)recv(connection->fd, buffer, size, 0);
+        } else {
+            length = BIO_read(connection->bio, buffer, (int)size);
+            if (length <= 0 && BIO_should_retry(connection->bio)) {
+                BIO_ctrl(connection->bio, SSH_CHANNEL_BIO_C_WAIT_READ, 100, NULL);
+                continue;
+            }
+        }
+        CHECK(length > 0);
+        return (size_t)length;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double difference = *(const double *)a - *(const double *)b;
+    return difference < 0 ? -1 : difference > 0;
+}
+
+static void *forward(void *arg) {
+    (void)arg;
+    setupSshPortForward(0, fail_callback, success_callback, failure_callback, log_callback, yes_no,
+                        "127.0.0.1", sshPort, user, "", "", privateKey,
+                        (char *)currentSuite->ciphers, (char *)currentSuite->macs,
+                        "127.0.0.1", localPort, "127.0.0.1", sinkPort, currentInProcess);
+    // Ends quietly when the host key is rejected or the tunnel closes, neither happens before FORWARD_UP here.
+    pthread_mutex_lock(&stateLock);
+    if (forwardState == FORWARD_PENDING) {
+        forwardState = FORWARD_FAILED;
+        pthread_cond_broadcast(&stateChanged);
+    }
+    pthread_mutex_unlock(&stateLock);
+    return NULL;
+}
+
+typedef struct {
+    bool measured;
+    double uploadMBps;
+    double downloadMBps;
+    double cpuMsPerMB;
+    double medianRttUs;
+    char negotiated[128];
+} Result;
+
+static void run_suite(const Suite *suite, bool inProcess, Result *result) {
+    memset(result, 0, sizeof(*result));
+    currentSuite = suite;
+    currentInProcess = inProcess;
+    free_port(localPort, sizeof(localPort));
+    pthread_mutex_lock(&stateLock);
+    forwardState = FORWARD_PENDING;
+    negotiated[0] = '\0';
+    sinkDone = false;
+    sinkIntact = false;
+    pthread_mutex_unlock(&stateLock);
+
+    pthread_t forwarder;
+    CHECK(pthread_create(&forwarder, NULL, forward, NULL) == 0);
+    pthread_mutex_lock(&stateLock);
+    while (forwardState == FORWARD_PENDING) {
+        pthread_cond_wait(&stateChanged, &stateLock);
+    }
+    ForwardState state = forwardState;
+    pthread_mutex_unlock(&stateLock);
+    if (state != FORWARD_UP) {
+        // libssh2 or sshd does not offer this suite.
+        pthread_join(forwarder, NULL);
+        return;
+    }
+
+    Connection connection = { -1, NULL };
+    if (inProcess) {
+        connection.bio = ssh_channel_transport_take(SSH_CHANNEL_TRANSPORT_REOPEN_WAIT_MS);
+        CHECK(connection.bio != NULL);
+    } else {
+        connection.fd = connect_to(localPort);
+        CHECK(connection.fd >= 0);
+    }
+    uint8_t buffer[CHUNK];
+    double cpuStart = process_cpu_s();
+    double start = now_s(CLOCK_MONOTONIC);
+    for (size_t sent = 0; sent < UPLOAD_BYTES; sent += CHUNK) {
+        for (size_t i = 0; i < CHUNK; i++) {
+            buffer[i] = pattern(sent + i);
+        }
+        send_all(&connection, buffer, CHUNK);
+    }
+    // The sink only answers once it has the whole upload.
+    double firstByte = 0;
+    bool intact = true;
+    size_t received = 0;
+    while (received < DOWNLOAD_BYTES) {
+        size_t length = receive_some(&connection, buffer, sizeof(buffer));
+        if (received == 0) {
+            firstByte = now_s(CLOCK_MONOTONIC);
+        }
+        for (size_t i = 0; i < length; i++) {
+            intact = intact && buffer[i] == pattern(received + i);
+        }
+        received += length;
+    }
+    double end = now_s(CLOCK_MONOTONIC);
+    double cpu = process_cpu_s() - cpuStart;
+
+    // Small messages one at a time, like input events and their screen updates.
+    static double rtts[PINGS];
+    for (int ping = 0; ping < PINGS; ping++) {
+        memset(buffer, ping, PING_BYTES);
+        double sentAt = now_s(CLOCK_MONOTONIC);
+        send_all(&connection, buffer, PING_BYTES);
+        for (size_t echoed = 0; echoed < PING_BYTES;) {
+            echoed += receive_some(&connection, buffer + echoed, PING_BYTES - echoed);
+        }
+        rtts[ping] = (now_s(CLOCK_MONOTONIC) - sentAt) * 1e6;
+        CHECK(buffer[0] == (uint8_t)ping && buffer[PING_BYTES - 1] == (uint8_t)ping);
+    }
+    qsort(rtts, PINGS, sizeof(rtts[0]), compare_doubles);
+
+    if (inProcess) {
+        // What the RDP session does when it disconnects.
+        ssh_channel_transport_shutdown();
+        BIO_free(connection.bio);
+    } else {
+        close(connection.fd);
+    }
+    pthread_join(forwarder, NULL);
+
+    pthread_mutex_lock(&stateLock);
+    while (!sinkDone) {
+        pthread_cond_wait(&stateChanged, &stateLock);
+    }
+    CHECK(sinkIntact);
+    snprintf(result->negotiated, sizeof(result->negotiated), "%s", negotiated);
+    pthread_mutex_unlock(&stateLock);
+    CHECK(intact);
+    result->measured = true;
+    result->uploadMBps = UPLOAD_BYTES / 1e6 / (firstByte - start);
+    result->downloadMBps = DOWNLOAD_BYTES / 1e6 / (end - firstByte);
+    // Includes this process's own sending and checking, which is the same for every suite.
+    result->cpuMsPerMB = cpu * 1000 / ((UPLOAD_BYTES + DOWNLOAD_BYTES) / 1e6);
+    result->medianRttUs = rtts[PINGS / 2];
+}
+
+static void print_result(const char *name, const char *mode, const Result *result) {
+    printf("%-26s %-11s %-40s %10.1f %10.1f %10.0f %10.2f\n", name, mode, result->negotiated,
+           result->uploadMBps, result->downloadMBps, result->medianRttUs, result->cpuMsPerMB);
+}
+
+static void run(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void run(const char *format, ...) {
+    char command[1024];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(command, sizeof(command), format, args);
+    va_end(args);
+    CHECK(system(command) == 0);
+}
+
+static void read_file(const char *path, char *buffer, size_t size) {
+    FILE *file = fopen(path, "r");
+    CHECK(file != NULL);
+    size_t length = fread(buffer, 1, size - 1, file);
+    buffer[length] = '\0';
+    fclose(file);
+}
+
+static pid_t start_sshd(const char *sshd, const char *keygen) {
+    // ECDSA keys in PEM work with every libssh2 crypto backend.
+    run("%s -q -t ecdsa -m PEM -N '' -f %s/host_key", keygen, directory);
+    run("%s -q -t ecdsa -m PEM -N '' -f %s/client_key", keygen, directory);
+    run("cp %s/client_key.pub %s/authorized_keys", directory, directory);
+    char path[256];
+    snprintf(path, sizeof(path), "%s/client_key", directory);
+    read_file(path, privateKey, sizeof(privateKey));
+
+    free_port(sshPort, sizeof(sshPort));
+    char config[256];
+    snprintf(config, sizeof(config), "%s/sshd_config", directory);
+    FILE *file = fopen(config, "w");
+    CHECK(file != NULL);
+    fprintf(file,
+            "Port %s\nListenAddress 127.0.0.1\nHostKey %s/host_key\n"
+            "AuthorizedKeysFile %s/authorized_keys\nPidFile %s/sshd.pid\n"
+            "StrictModes no\nUsePAM no\nPasswordAuthentication no\n"
+            "PermitRootLogin prohibit-password\nAllowTcpForwarding yes\nLogLevel ERROR\n",
+            sshPort, directory, directory, directory);
+    fclose(file);
+
+    pid_t pid = fork();
+    CHECK(pid >= 0);
+    if (pid == 0) {
+        execl(sshd, sshd, "-D", "-e", "-f", config, (char *)NULL);
+        _exit(127);
+    }
+    for (int i = 0; i < 500; i++) {
+        int fd = connect_to(sshPort);
+        if (fd >= 0) {
+            close(fd);
+            return pid;
+        }
+        CHECK(waitpid(pid, NULL, WNOHANG) == 0);
+        usleep(10000);
+    }
+    CHECK(!"sshd did not start listening");
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    CHECK(argc == 3);
+    signal(SIGPIPE, SIG_IGN);
+    CHECK(mkdtemp(directory) != NULL);
+    struct passwd *account = getpwuid(geteuid());
+    CHECK(account != NULL);
+    snprintf(user, sizeof(user), "%s", account->pw_name);
+    // The measured preference is cached under $HOME/Library/Caches.
+    char cache[256];
+    snprintf(cache, sizeof(cache), "%s/Library/Caches", directory);
+    run("mkdir -p %s", cache);
+    setenv("HOME", directory, 1);
+
+    pid_t sshd = start_sshd(argv[1], argv[2]);
+    sinkListener = listen_on_loopback(sinkPort, sizeof(sinkPort));
+    pthread_t sinkThread;
+    CHECK(pthread_create(&sinkThread, NULL, sink, NULL) == 0);
+
+    Result results[SUITE_COUNT];
+    int measured = 0;
+    double bestCpuMsPerMB = 0;
+    printf("%-26s %-11s %-40s %10s %10s %10s %10s\n", "suite", "mode", "negotiated",
+           "up MB/s", "down MB/s", "RTT us", "CPU ms/MB");
+    for (int i = 0; i < SUITE_COUNT; i++) {
+        run_suite(&suites[i], false, &results[i]);
+        if (!results[i].measured) {
+            printf("%-26s not offered by libssh2 or sshd\n", suites[i].name);
+            continue;
+        }
+        measured++;
+        if (i > 0 && (bestCpuMsPerMB == 0 || results[i].cpuMsPerMB < bestCpuMsPerMB)) {
+            bestCpuMsPerMB = results[i].cpuMsPerMB;
+        }
+        print_result(suites[i].name, "loopback", &results[i]);
+    }
+    CHECK(results[0].measured);
+    CHECK(measured >= 3);
+    Result inProcess;
+    run_suite(&suites[0], true, &inProcess);
+    CHECK(inProcess.measured);
+    print_result(suites[0].name, "in-process", &inProcess);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    // The preference ranks the suites with OpenSSL on this machine, which libssh2
+    // uses too, so what it negotiates should be close to the cheapest one.
+    CHECK(results[0].cpuMsPerMB < bestCpuMsPerMB * 1.5);
+    // The loopback forwarder only looks at the channel when its socket has
+    // data or every 10 ms, the BIO waits on the SSH socket itself.
+    CHECK(inProcess.medianRttUs < results[0].medianRttUs);
+    CHECK(inProcess.downloadMBps > results[0].downloadMBps * 0.8);
+#endif
+
+    shutdown(sinkListener, SHUT_RDWR);
+    close(sinkListener);
+    pthread_join(sinkThread, NULL);
+    kill(sshd, SIGTERM);
+    waitpid(sshd, NULL, 0);
+    run("rm -rf %s", directory);
+    printf("SshForwardThroughputTest passed\n");
+    return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+// Runs thousands of forwarder setups and teardowns against a local listener
+// and the libssh2 stand-in in stubs/, checking that nothing is left behind.
+// Leaks are caught by the ASan variant, growth that is still reachable by the
+// RSS check in the plain build.
+
+#include "SshPortForwarder.h"
+#include "SshChannelTransport.h"
+#include "TestSupport.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int authFailures;
+static int successes;
+static int failures;
+static bool acceptHostKey;
+
+static void fail_callback(int instance, uint8_t *message) {
+    (void)instance;
+    CHECK(strcmp((char *)message, "SSH_PASSWORD_AUTHENTICATION_FAILED_TITLE") == 0);
+    authFailures++;
+}
+
+static void success_callback(void) {
+    successes++;
+    // Plays the part of the RDP session ending right after the tunnel came up.
+    ssh_channel_transport_shutdown();
+}
+
+static void failure_callback(void) {
+    failures++;
+}
+
+static void log_callback(int8_t *message) {
+    (void)message;
+}
+
+static int yes_no(int instance, int8_t *title, int8_t *text, int8_t *a, int8_t *b, int8_t *c, int d) {
+    (void)instance;
+    (void)title;
+    (void)text;
+    (void)a;
+    (void)b;
+    (void)c;
+    (void)d;
+    return acceptHostKey;
+}
+
+// Stands in for the SSH server's TCP side, the stub does the protocol.
+static void *serve(void *arg) {
+    int listener = (int)(long)arg;
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            break;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static long max_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char *argv[]) {
+    int cycles = argc > 1 ? atoi(argv[1]) : 4000;
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, 64) == 0);
+    socklen_t length = sizeof(address);
+    getsockname(listener, (struct sockaddr *)&address, &length);
+    char port[16];
+    snprintf(port, sizeof(port), "%d", ntohs(address.sin_port));
+    pthread_t server;
+    CHECK(pthread_create(&server, NULL, serve, (void *)(long)listener) == 0);
+
+    char key[4000];
+    memset(key, 'k', sizeof(key) - 1);
+    key[sizeof(key) - 1] = '\0';
+
+    long baseline = 0;
+    int expectedAuthFailures = 0;
+    int expectedSuccesses = 0;
+    int expectedFailures = 0;
+    for (int i = 0; i < cycles; i++) {
+        char *password = "password";
+        acceptHostKey = true;
+        libssh2Stub.passwordResult = -1;
+        libssh2Stub.publicKeyResult = -1;
+        switch (i % 4) {
+        case 0:
+            expectedAuthFailures++;
+            break;
+        case 1:
+            // Rejected host keys end quietly.
+            acceptHostKey = false;
+            break;
+        case 2:
+            password = "";
+            expectedFailures++;
+            break;
+        case 3:
+            libssh2Stub.passwordResult = 0;
+            expectedSuccesses++;
+            break;
+        }
+        setupSshPortForward(0, fail_callback, success_callback, failure_callback, log_callback, yes_no,
+                            "127.0.0.1", port, "user", password, "passphrase", key, "", "",
+                            "127.0.0.1", "0", "10.0.0.1", "3389", true);
+        if (i == cycles / 10) {
+            baseline = max_rss_kb();
+        }
+    }
+    CHECK(authFailures == expectedAuthFailures);
+    CHECK(successes == expectedSuccesses);
+    CHECK(failures == expectedFailures);
+    CHECK(libssh2Stub.sessionsOpen == 0);
+    CHECK(libssh2Stub.channelsOpen == 0);
+    CHECK(libssh2Stub.algorithmListsOpen == 0);
+
+    long end = max_rss_kb();
+    printf("%d cycles, max RSS %ld KB after warm up, %ld KB at the end\n", cycles, baseline, end);
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    // The sanitizers keep freed memory in quarantine, so only the plain build is flat.
+    CHECK(end - baseline < 512);
+#endif
+
+    shutdown(listener, SHUT_RDWR);
+    close(listener);
+    pthread_join(server, NULL);
+    printf("SshPortForwarderSoakTest passed\n");
+    return 0;
+}
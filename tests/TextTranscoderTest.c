@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "TextTranscoder.h"
+#include "TestSupport.h"
+
+#include <string.h>
+
+static int utf8_to_utf8(const char *src, size_t length, unsigned flags, char *dst) {
+    uint8_t buffer[256];
+    size_t written;
+    TranscodeStatus status = transcode_utf8_to_utf8((const uint8_t *)src, length, buffer, sizeof(buffer), flags, &written);
+    if (status != TRANSCODE_OK) {
+        return -(int)status;
+    }
+    memcpy(dst, buffer, written);
+    dst[written] = '\0';
+    return (int)written;
+}
+
+static void test_line_endings_and_validation(void) {
+    char out[256];
+    CHECK(utf8_to_utf8("a\r\nb\rc\r", 7, TRANSCODE_CRLF_TO_LF, out) == 6 && strcmp(out, "a\nb\rc\r") == 0);
+    CHECK(utf8_to_utf8("a\nb\r\n", 5, TRANSCODE_LF_TO_CRLF, out) == 6 && strcmp(out, "a\r\nb\r\n") == 0);
+    // Overlong forms, truncated sequences and surrogates are rejected or replaced.
+    CHECK(utf8_to_utf8("\xE0\x80\x80", 3, 0, out) == -TRANSCODE_INVALID_INPUT);
+    CHECK(utf8_to_utf8("\xE0\x80\x80", 3, TRANSCODE_REPLACE_INVALID, out) == 9);
+    CHECK(utf8_to_utf8("\xF0\x9F\x98", 3, TRANSCODE_REPLACE_INVALID, out) == 3);
+    CHECK(utf8_to_utf8("\xED\xA0\x80", 3, TRANSCODE_REPLACE_INVALID, out) == 9);
+    CHECK(utf8_to_utf8("ab\0cd", 5, TRANSCODE_STOP_AT_NUL, out) == 2);
+}
+
+static void test_round_trip(void) {
+    const char *text = "0123456789abcdef0123456789\r\nabcdef\xC3\xA9\xF0\x9F\x98\x80 tail0123456789abcdef";
+    uint8_t utf16[512];
+    uint8_t back[512];
+    size_t utf16Length, backLength;
+    CHECK(transcode_utf8_to_utf16le((const uint8_t *)text, strlen(text), utf16, sizeof(utf16),
+                                    TRANSCODE_CRLF_TO_LF | TRANSCODE_NUL_TERMINATE, &utf16Length) == TRANSCODE_OK);
+    CHECK(utf16[utf16Length] == 0 && utf16[utf16Length + 1] == 0);
+    CHECK(transcode_utf16le_to_utf8(utf16, utf16Length + 2, back, sizeof(back),
+                                    TRANSCODE_LF_TO_CRLF | TRANSCODE_STOP_AT_NUL, &backLength) == TRANSCODE_OK);
+    CHECK(backLength == strlen(text) && memcmp(back, text, backLength) == 0);
+
+    uint8_t unpaired[] = { 0x00, 0xD8, 'a', 0, 'b' };
+    CHECK(transcode_utf16le_to_utf8(unpaired, sizeof(unpaired), back, sizeof(back), TRANSCODE_REPLACE_INVALID, &backLength) == TRANSCODE_OK);
+    CHECK(backLength == 7);
+    CHECK(transcode_utf16le_to_utf8(unpaired, sizeof(unpaired), back, sizeof(back), 0, &backLength) == TRANSCODE_INVALID_INPUT);
+    CHECK(transcode_utf8_to_utf16le((const uint8_t *)text, strlen(text), utf16, 10, 0, &utf16Length) == TRANSCODE_BUFFER_TOO_SMALL);
+}
+
+// A NUL inside a run of ASCII long enough for the block fast paths must
+// still end the input.
+static void test_stop_at_nul_inside_ascii_block(void) {
+    uint8_t src[52];
+    memset(src, 'a', sizeof(src));
+    src[31] = '\0';
+    uint8_t dst[256];
+    size_t length;
+    CHECK(transcode_utf8_to_utf8(src, sizeof(src), dst, sizeof(dst), TRANSCODE_STOP_AT_NUL, &length) == TRANSCODE_OK);
+    CHECK(length == 31);
+    CHECK(transcode_utf8_to_utf16le(src, sizeof(src), dst, sizeof(dst), TRANSCODE_STOP_AT_NUL, &length) == TRANSCODE_OK);
+    CHECK(length == 62);
+
+    uint8_t utf16[104];
+    for (size_t i = 0; i < sizeof(utf16); i += 2) {
+        utf16[i] = i == 62 ? 0 : 'a';
+        utf16[i + 1] = 0;
+    }
+    CHECK(transcode_utf16le_to_utf8(utf16, sizeof(utf16), dst, sizeof(dst), TRANSCODE_STOP_AT_NUL, &length) == TRANSCODE_OK);
+    CHECK(length == 31);
+}
+
+// Random input with line breaks and invalid bytes must always fit in the
+// advertised worst case capacity.
+static void test_capacity_bounds(void) {
+    size_t size = 1 << 20;
+    uint8_t *src = malloc(size);
+    CHECK(src != NULL);
+    srand(1);
+    for (size_t i = 0; i < size; i++) {
+        int r = rand() % 100;
+        src[i] = r < 90 ? 'a' + r % 26 : (r < 93 ? '\n' : (r < 95 ? '\r' : rand() & 0xFF));
+    }
+    unsigned flags = TRANSCODE_LF_TO_CRLF | TRANSCODE_REPLACE_INVALID | TRANSCODE_NUL_TERMINATE;
+    size_t utf16Capacity = transcode_utf16le_capacity(size, flags);
+    uint8_t *utf16 = malloc(utf16Capacity);
+    size_t utf16Length, length;
+    CHECK(transcode_utf8_to_utf16le(src, size, utf16, utf16Capacity, flags, &utf16Length) == TRANSCODE_OK);
+
+    size_t utf8Capacity = transcode_utf8_capacity(utf16Length, flags);
+    uint8_t *utf8 = malloc(utf8Capacity);
+    CHECK(transcode_utf16le_to_utf8(utf16, utf16Length, utf8, utf8Capacity, flags | TRANSCODE_CRLF_TO_LF, &length) == TRANSCODE_OK);
+
+    size_t normalizedCapacity = transcode_utf8_normalized_capacity(size, flags);
+    uint8_t *normalized = malloc(normalizedCapacity);
+    CHECK(transcode_utf8_to_utf8(src, size, normalized, normalizedCapacity, flags, &length) == TRANSCODE_OK);
+
+    free(normalized);
+    free(utf8);
+    free(utf16);
+    free(src);
+}
+
+static void test_buffer_reserve(void) {
+    TranscodeBuffer buffer = { NULL, 0 };
+    CHECK(transcode_buffer_reserve(&buffer, 100));
+    uint8_t *data = buffer.data;
+    CHECK(transcode_buffer_reserve(&buffer, 50));
+    CHECK(buffer.data == data && buffer.capacity >= 100);
+    transcode_buffer_free(&buffer);
+    CHECK(buffer.data == NULL);
+}
+
+int main(void) {
+    test_line_endings_and_validation();
+    test_round_trip();
+    test_stop_at_nul_inside_ascii_block();
+    test_capacity_bounds();
+    test_buffer_reserve();
+    printf("TextTranscoderTest passed\n");
+    return 0;
+}
@@ -0,0 +1,209 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "ViewportTracker.h"
+#include "TestSupport.h"
+
+#include <string.h>
+
+#define TILE VIEWPORT_TRACKER_TILE_SIZE
+#define MAX_TILES 1024
+
+static ViewportTracker tracker;
+static int32_t fbWidth;
+static int32_t fbHeight;
+static int32_t tilesX;
+static int32_t tilesY;
+// Tiles whose presented pixels are behind the framebuffer, as the test sees it.
+static bool stale[MAX_TILES];
+
+static bool touches(int32_t column, int32_t row, int32_t x, int32_t y, int32_t width, int32_t height) {
+    int32_t left = column * TILE;
+    int32_t top = row * TILE;
+    int32_t right = left + TILE < fbWidth ? left + TILE : fbWidth;
+    int32_t bottom = top + TILE < fbHeight ? top + TILE : fbHeight;
+    if (x < 0) {
+        width += x;
+        x = 0;
+    }
+    if (y < 0) {
+        height += y;
+        y = 0;
+    }
+    return width > 0 && height > 0 && x < right && left < x + width && y < bottom && top < y + height;
+}
+
+static bool contains(const ViewportRect *outer, int32_t x, int32_t y, int32_t width, int32_t height) {
+    return x >= outer->x && y >= outer->y &&
+           x + width <= outer->x + outer->width && y + height <= outer->y + outer->height;
+}
+
+// Nothing in view may be stale, and the tracker must remember every stale tile.
+static void check_tiles(void) {
+    ViewportRect viewport = tracker.viewport;
+    uint32_t pending = 0;
+    for (int32_t row = 0; row < tilesY; row++) {
+        for (int32_t column = 0; column < tilesX; column++) {
+            int32_t tile = row * tilesX + column;
+            if (touches(column, row, viewport.x, viewport.y, viewport.width, viewport.height)) {
+                CHECK(!stale[tile]);
+            }
+            if (stale[tile]) {
+                CHECK(tracker.pending[tile]);
+            }
+            pending += tracker.pending[tile];
+        }
+    }
+    CHECK(pending == viewport_tracker_pending_tiles(&tracker));
+}
+
+static void move_viewport(void) {
+    double zoom = 1 + rand() % 40 / 10.0;
+    int32_t width = (int32_t)(fbWidth / zoom);
+    int32_t height = (int32_t)(fbHeight / zoom);
+    int32_t x = rand() % (fbWidth - width + 1) - 20;
+    int32_t y = rand() % (fbHeight - height + 1) - 20;
+    ViewportRect exposed;
+    if (!viewport_tracker_set_viewport(&tracker, x, y, width, height, &exposed)) {
+        return;
+    }
+    // The exposed box has to cover every stale tile that is now in view.
+    for (int32_t row = 0; row < tilesY; row++) {
+        for (int32_t column = 0; column < tilesX; column++) {
+            if (touches(column, row, exposed.x, exposed.y, exposed.width, exposed.height) &&
+                touches(column, row, x, y, width, height)) {
+                stale[row * tilesX + column] = false;
+            }
+        }
+    }
+}
+
+static void damage(long *culled) {
+    int32_t x = rand() % fbWidth - 10;
+    int32_t y = rand() % fbHeight - 10;
+    int32_t width = 1 + rand() % 200;
+    int32_t height = 1 + rand() % 100;
+    ViewportRect visible;
+    bool present = viewport_tracker_add_damage(&tracker, x, y, width, height, &visible);
+    ViewportRect viewport = tracker.viewport;
+    if (present) {
+        // Only damaged pixels are presented.
+        CHECK(visible.width > 0 && visible.height > 0);
+        CHECK(visible.x >= x && visible.y >= y);
+        CHECK(visible.x + visible.width <= x + width && visible.y + visible.height <= y + height);
+    }
+    for (int32_t row = 0; row < tilesY; row++) {
+        for (int32_t column = 0; column < tilesX; column++) {
+            if (!touches(column, row, x, y, width, height)) {
+                continue;
+            }
+            if (touches(column, row, viewport.x, viewport.y, viewport.width, viewport.height)) {
+                CHECK(present);
+                // All of the damage in a tile in view is presented.
+                int32_t left = column * TILE > x ? column * TILE : x;
+                int32_t top = row * TILE > y ? row * TILE : y;
+                int32_t right = (column + 1) * TILE < x + width ? (column + 1) * TILE : x + width;
+                int32_t bottom = (row + 1) * TILE < y + height ? (row + 1) * TILE : y + height;
+                right = right < fbWidth ? right : fbWidth;
+                bottom = bottom < fbHeight ? bottom : fbHeight;
+                CHECK(contains(&visible, left, top, right - left, bottom - top));
+                stale[row * tilesX + column] = false;
+            } else {
+                stale[row * tilesX + column] = true;
+            }
+        }
+    }
+    if (!present) {
+        (*culled)++;
+    }
+}
+
+static void test_random_zoom_and_damage(void) {
+    srand(3);
+    viewport_tracker_init(&tracker);
+    long updates = 0;
+    long culled = 0;
+    for (int round = 0; round < 200; round++) {
+        fbWidth = 200 + rand() % 1800;
+        fbHeight = 200 + rand() % 1200;
+        tilesX = (fbWidth + TILE - 1) / TILE;
+        tilesY = (fbHeight + TILE - 1) / TILE;
+        CHECK(viewport_tracker_reset(&tracker, fbWidth, fbHeight));
+        memset(stale, 0, sizeof(stale));
+        for (int operation = 0; operation < 2000; operation++) {
+            if (rand() % 8 == 0) {
+                move_viewport();
+            } else {
+                damage(&culled);
+                updates++;
+                if (rand() % 50 == 0) {
+                    viewport_tracker_mark_presented(&tracker, 0, 0, fbWidth, fbHeight);
+                    memset(stale, 0, sizeof(stale));
+                    CHECK(viewport_tracker_pending_tiles(&tracker) == 0);
+                }
+            }
+            check_tiles();
+        }
+    }
+    // Zoomed in most of the time, so a good share of the updates is never presented.
+    CHECK(culled > updates / 10);
+    viewport_tracker_destroy(&tracker);
+}
+
+static void test_catch_up(void) {
+    viewport_tracker_init(&tracker);
+    CHECK(viewport_tracker_reset(&tracker, 1024, 768));
+    ViewportRect exposed;
+    CHECK(!viewport_tracker_set_viewport(&tracker, 0, 0, 256, 256, &exposed));
+    ViewportRect visible;
+    CHECK(viewport_tracker_add_damage(&tracker, 100, 100, 10, 10, &visible));
+    CHECK(visible.x == 100 && visible.y == 100 && visible.width == 10 && visible.height == 10);
+    CHECK(!viewport_tracker_add_damage(&tracker, 600, 400, 10, 10, &visible));
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 1);
+    // Damage reaching out of view is presented up to the last tile in view.
+    CHECK(viewport_tracker_add_damage(&tracker, 200, 10, 400, 10, &visible));
+    CHECK(visible.x == 200 && visible.y == 10 && visible.width == 56 && visible.height == 10);
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 7);
+
+    CHECK(viewport_tracker_set_viewport(&tracker, 512, 384, 256, 256, &exposed));
+    CHECK(exposed.x == 576 && exposed.y == 384 && exposed.width == TILE && exposed.height == TILE);
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 6);
+    // Only the newly exposed tiles have to be caught up on.
+    CHECK(viewport_tracker_set_viewport(&tracker, 256, 0, 256, 256, &exposed));
+    CHECK(exposed.x == 256 && exposed.y == 0 && exposed.width == 4 * TILE && exposed.height == TILE);
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 2);
+    CHECK(viewport_tracker_set_viewport(&tracker, 512, 0, 128, 64, &exposed));
+    CHECK(exposed.x == 512 && exposed.width == 2 * TILE);
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 0);
+
+    // Resetting shows the whole framebuffer again.
+    CHECK(!viewport_tracker_add_damage(&tracker, 0, 0, 10, 10, &visible));
+    CHECK(viewport_tracker_reset(&tracker, 1024, 768));
+    CHECK(viewport_tracker_pending_tiles(&tracker) == 0);
+    CHECK(viewport_tracker_add_damage(&tracker, 0, 0, 10, 10, &visible));
+    viewport_tracker_destroy(&tracker);
+}
+
+int main(void) {
+    test_random_zoom_and_damage();
+    test_catch_up();
+    printf("ViewportTrackerTest passed\n");
+    return 0;
+}
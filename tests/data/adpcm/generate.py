@@ -0,0 +1,109 @@
+# Regenerates the ADPCM vectors used by AdpcmDecoderTest. Needs a Python
+# with the audioop module (3.12 or older).
+#
+# ima.bin: three mono IMA ADPCM blocks of 1024 bytes encoded by audioop,
+#          ima.ref: what audioop decodes them to.
+# ms.pcm:  a stereo 16-bit source signal, ms.bin: that signal as stereo MS
+#          ADPCM blocks of 512 bytes, ms_custom.bin: the same signal with the
+#          coefficient table of MS_CUSTOM_COEFFICIENTS in AdpcmDecoderTest.
+#
+# There is no bit exact MS reference here, neither ffmpeg nor sox were at hand
+# when these were made. The MS vectors are instead checked against the source
+# signal they were encoded from: the encoder below is written from the format
+# description, picks predictor and step size per block and only ever emits
+# what a conforming decoder reproduces, so a decoder that gets the header
+# layout, nibble order, coefficients or step adaptation wrong falls far short
+# of the signal to noise ratio the test asks for.
+import audioop
+import math
+import random
+import struct
+
+random.seed(7)
+
+IMA_SAMPLES_PER_BLOCK = 2041
+pcm = b''.join(struct.pack('<h', int(12000 * math.sin(i * 0.03) + random.randint(-2000, 2000)))
+               for i in range(IMA_SAMPLES_PER_BLOCK * 3))
+blocks = b''
+reference = []
+state = None
+position = 0
+for block in range(3):
+    samples = pcm[position * 2:(position + IMA_SAMPLES_PER_BLOCK) * 2]
+    position += IMA_SAMPLES_PER_BLOCK
+    first = struct.unpack('<h', samples[:2])[0]
+    index = state[1] if state else 0
+    encoded, state = audioop.lin2adpcm(samples[2:], 2, (first, index))
+    # audioop puts the first sample in the high nibble, WAVE files in the low one.
+    swapped = bytes(((x & 0x0F) << 4) | (x >> 4) for x in encoded)
+    blocks += struct.pack('<hBB', first, index, 0) + swapped
+    decoded, _ = audioop.adpcm2lin(encoded, 2, (first, index))
+    reference += [first] + list(struct.unpack('<%dh' % (len(decoded) // 2), decoded))
+open('ima.bin', 'wb').write(blocks)
+open('ima.ref', 'wb').write(struct.pack('<%dh' % len(reference), *reference))
+
+ADAPTATION = [230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230]
+STANDARD = [(256, 0), (512, -256), (0, 0), (192, 64), (240, 0), (460, -208), (392, -232)]
+CUSTOM = STANDARD + [(384, -128), (128, 128)]
+CHANNELS = 2
+BLOCK_ALIGN = 512
+MS_SAMPLES_PER_BLOCK = 2 + (BLOCK_ALIGN - 7 * CHANNELS) * 2 // CHANNELS
+BLOCKS = 6
+
+
+def predict(coefficients, sample1, sample2):
+    # The coefficients are fixed point with eight fraction bits, rounded down.
+    return math.floor((sample1 * coefficients[0] + sample2 * coefficients[1]) / 256)
+
+
+def encode_channel(samples, coefficients, delta):
+    """Returns the nibbles for samples[2:] and their squared error."""
+    sample2, sample1 = samples[0], samples[1]
+    nibbles = []
+    error = 0
+    for target in samples[2:]:
+        predicted = predict(coefficients, sample1, sample2)
+        code = max(-8, min(7, round((target - predicted) / delta)))
+        value = max(-32768, min(32767, predicted + code * delta))
+        error += (target - value) ** 2
+        nibble = code & 15
+        nibbles.append(nibble)
+        sample2, sample1 = sample1, value
+        delta = max(16, ADAPTATION[nibble] * delta // 256)
+    return nibbles, error
+
+
+def encode(frames, table):
+    blocks = b''
+    for start in range(0, len(frames), MS_SAMPLES_PER_BLOCK):
+        block = frames[start:start + MS_SAMPLES_PER_BLOCK]
+        header = [[], [], [], []]
+        nibbles = []
+        for c in range(CHANNELS):
+            samples = [frame[c] for frame in block]
+            delta = max(16, sum(abs(b - a) for a, b in zip(samples, samples[1:])) // (len(samples) - 1))
+            best = None
+            for predictor, coefficients in enumerate(table):
+                channel, error = encode_channel(samples, coefficients, delta)
+                if best is None or error < best[0]:
+                    best = (error, predictor, channel)
+            header[0].append(best[1])
+            header[1].append(delta)
+            header[2].append(samples[1])
+            header[3].append(samples[0])
+            nibbles.append(best[2])
+        body = bytearray()
+        interleaved = [nibbles[n % CHANNELS][n // CHANNELS] for n in range(len(nibbles[0]) * CHANNELS)]
+        for n in range(0, len(interleaved), 2):
+            body.append((interleaved[n] << 4) | interleaved[n + 1])
+        blocks += (bytes(header[0]) + struct.pack('<%dh' % (3 * CHANNELS), *header[1], *header[2], *header[3]) +
+                   bytes(body))
+    return blocks
+
+
+frames = [(int(9000 * math.sin(i * 0.021) + 5000 * math.sin(i * 0.27) + random.randint(-600, 600)),
+           int(14000 * math.sin(i * 0.013 + 1) + random.randint(-300, 300)))
+          for i in range(MS_SAMPLES_PER_BLOCK * BLOCKS)]
+open('ms.pcm', 'wb').write(b''.join(struct.pack('<2h', *frame) for frame in frames))
+open('ms.bin', 'wb').write(encode(frames, STANDARD))
+open('ms_custom.bin', 'wb').write(encode(frames, CUSTOM))
@@ -0,0 +1,180 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+#include "libssh2.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+Libssh2Stub libssh2Stub = { -1, -1, 0, 0, 0 };
+
+struct _LIBSSH2_SESSION {
+    char hash[32];
+    char ciphers[256];
+};
+
+struct _LIBSSH2_CHANNEL {
+    int unused;
+};
+
+static const char *supportedCiphers[] = { "aes128-ctr", "aes256-ctr", "chacha20-poly1305@openssh.com" };
+static const char *supportedMacs[] = { "hmac-sha2-256", "hmac-sha1" };
+
+int libssh2_init(int flags) {
+    (void)flags;
+    return 0;
+}
+
+void libssh2_exit(void) {
+}
+
+void libssh2_free(LIBSSH2_SESSION *session, void *ptr) {
+    (void)session;
+    libssh2Stub.algorithmListsOpen--;
+    free(ptr);
+}
+
+LIBSSH2_SESSION *libssh2_session_init(void) {
+    LIBSSH2_SESSION *session = calloc(1, sizeof(LIBSSH2_SESSION));
+    if (session != NULL) {
+        libssh2Stub.sessionsOpen++;
+    }
+    return session;
+}
+
+int libssh2_session_free(LIBSSH2_SESSION *session) {
+    libssh2Stub.sessionsOpen--;
+    free(session);
+    return 0;
+}
+
+int libssh2_session_handshake(LIBSSH2_SESSION *session, int sock) {
+    (void)session;
+    return sock >= 0 ? 0 : -1;
+}
+
+int libssh2_session_disconnect(LIBSSH2_SESSION *session, const char *description) {
+    (void)session;
+    (void)description;
+    return 0;
+}
+
+void libssh2_session_set_blocking(LIBSSH2_SESSION *session, int blocking) {
+    (void)session;
+    (void)blocking;
+}
+
+int libssh2_session_supported_algs(LIBSSH2_SESSION *session, int method_type, const char ***algs) {
+    (void)session;
+    bool ciphers = method_type == LIBSSH2_METHOD_CRYPT_CS || method_type == LIBSSH2_METHOD_CRYPT_SC;
+    const char **list = ciphers ? supportedCiphers : supportedMacs;
+    int count = ciphers ? 3 : 2;
+    *algs = malloc(count * sizeof(char *));
+    if (*algs == NULL) {
+        return -1;
+    }
+    memcpy(*algs, list, count * sizeof(char *));
+    libssh2Stub.algorithmListsOpen++;
+    return count;
+}
+
+int libssh2_session_method_pref(LIBSSH2_SESSION *session, int method_type, const char *prefs) {
+    if (method_type == LIBSSH2_METHOD_CRYPT_CS) {
+        strncpy(session->ciphers, prefs, sizeof(session->ciphers) - 1);
+    }
+    return 0;
+}
+
+const char *libssh2_session_methods(LIBSSH2_SESSION *session, int method_type) {
+    return method_type == LIBSSH2_METHOD_CRYPT_CS ? session->ciphers : "hmac-sha2-256";
+}
+
+const char *libssh2_hostkey_hash(LIBSSH2_SESSION *session, int hash_type) {
+    (void)hash_type;
+    return session->hash;
+}
+
+char *libssh2_userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len) {
+    (void)session;
+    (void)username;
+    (void)username_len;
+    return "password,publickey";
+}
+
+int libssh2_userauth_password(LIBSSH2_SESSION *session, const char *username, const char *password) {
+    (void)session;
+    (void)username;
+    (void)password;
+    return libssh2Stub.passwordResult;
+}
+
+int libssh2_userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len,
+                                          const char *publickeyfiledata, size_t publickeyfiledata_len,
+                                          const char *privatekeyfiledata, size_t privatekeyfiledata_len,
+                                          const char *passphrase) {
+    (void)session;
+    (void)username;
+    (void)username_len;
+    (void)publickeyfiledata;
+    (void)publickeyfiledata_len;
+    (void)privatekeyfiledata;
+    (void)privatekeyfiledata_len;
+    (void)passphrase;
+    return libssh2Stub.publicKeyResult;
+}
+
+LIBSSH2_CHANNEL *libssh2_channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port,
+                                                 const char *shost, int sport) {
+    (void)session;
+    (void)host;
+    (void)port;
+    (void)shost;
+    (void)sport;
+    LIBSSH2_CHANNEL *channel = calloc(1, sizeof(LIBSSH2_CHANNEL));
+    if (channel != NULL) {
+        libssh2Stub.channelsOpen++;
+    }
+    return channel;
+}
+
+int libssh2_channel_free(LIBSSH2_CHANNEL *channel) {
+    libssh2Stub.channelsOpen--;
+    free(channel);
+    return 0;
+}
+
+ssize_t libssh2_channel_read(LIBSSH2_CHANNEL *channel, char *buf, size_t buflen) {
+    (void)channel;
+    (void)buf;
+    (void)buflen;
+    return LIBSSH2_ERROR_EAGAIN;
+}
+
+ssize_t libssh2_channel_write(LIBSSH2_CHANNEL *channel, const char *buf, size_t buflen) {
+    (void)channel;
+    (void)buf;
+    return (ssize_t)buflen;
+}
+
+int libssh2_channel_eof(LIBSSH2_CHANNEL *channel) {
+    (void)channel;
+    return 0;
+}
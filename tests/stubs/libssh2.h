@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2021- Morpheusly Inc. All rights reserved.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307,
+ * USA.
+ */
+
+
+// The parts of libssh2 the forwarder uses, for running it on Linux against
+// Libssh2Stub.c instead of a real SSH server.
+
+#ifndef libssh2_h
+#define libssh2_h
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Darwin only, 0 leaves the socket options alone on Linux.
+#ifndef SO_NOSIGPIPE
+#define SO_NOSIGPIPE 0
+#endif
+
+typedef struct _LIBSSH2_SESSION LIBSSH2_SESSION;
+typedef struct _LIBSSH2_CHANNEL LIBSSH2_CHANNEL;
+
+#define LIBSSH2_ERROR_EAGAIN -37
+#define LIBSSH2_HOSTKEY_HASH_SHA1 2
+#define LIBSSH2_HOSTKEY_HASH_SHA256 3
+#define LIBSSH2_METHOD_CRYPT_CS 2
+#define LIBSSH2_METHOD_CRYPT_SC 3
+#define LIBSSH2_METHOD_MAC_CS 4
+#define LIBSSH2_METHOD_MAC_SC 5
+
+int libssh2_init(int flags);
+void libssh2_exit(void);
+void libssh2_free(LIBSSH2_SESSION *session, void *ptr);
+
+LIBSSH2_SESSION *libssh2_session_init(void);
+int libssh2_session_free(LIBSSH2_SESSION *session);
+int libssh2_session_handshake(LIBSSH2_SESSION *session, int sock);
+int libssh2_session_disconnect(LIBSSH2_SESSION *session, const char *description);
+void libssh2_session_set_blocking(LIBSSH2_SESSION *session, int blocking);
+int libssh2_session_supported_algs(LIBSSH2_SESSION *session, int method_type, const char ***algs);
+int libssh2_session_method_pref(LIBSSH2_SESSION *session, int method_type, const char *prefs);
+const char *libssh2_session_methods(LIBSSH2_SESSION *session, int method_type);
+const char *libssh2_hostkey_hash(LIBSSH2_SESSION *session, int hash_type);
+
+char *libssh2_userauth_list(LIBSSH2_SESSION *session, const char *username, unsigned int username_len);
+int libssh2_userauth_password(LIBSSH2_SESSION *session, const char *username, const char *password);
+int libssh2_userauth_publickey_frommemory(LIBSSH2_SESSION *session, const char *username, size_t username_len,
+                                          const char *publickeyfiledata, size_t publickeyfiledata_len,
+                                          const char *privatekeyfiledata, size_t privatekeyfiledata_len,
+                                          const char *passphrase);
+
+LIBSSH2_CHANNEL *libssh2_channel_direct_tcpip_ex(LIBSSH2_SESSION *session, const char *host, int port,
+                                                 const char *shost, int sport);
+int libssh2_channel_free(LIBSSH2_CHANNEL *channel);
+ssize_t libssh2_channel_read(LIBSSH2_CHANNEL *channel, char *buf, size_t buflen);
+ssize_t libssh2_channel_write(LIBSSH2_CHANNEL *channel, const char *buf, size_t buflen);
+int libssh2_channel_eof(LIBSSH2_CHANNEL *channel);
+
+/* Stub controls */
+
+typedef struct {
+    // Results of password and public key authentication, 0 for success.
+    int passwordResult;
+    int publicKeyResult;
+    // Counts what is still allocated, so tests can check nothing is left behind.
+    int sessionsOpen;
+    int channelsOpen;
+    int algorithmListsOpen;
+} Libssh2Stub;
+
+extern Libssh2Stub libssh2Stub;
+
+#endif /* libssh2_h */